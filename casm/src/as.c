@@ -32,6 +32,7 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #endif
+#include <pthread.h>
 
 #include "as.h"
 #include "proto.h"
@@ -39,45 +40,6 @@
 #include "label.h"
 #include "input.h"
 
-/* global variables */
-
-int			outputROMSize = 8192;			/* Size for the ROM file */
-/*
-	occurance count holders
-*/
-
-
-/*
-	various line counters
-*/
-u_int16		Cfn = 0;						/* Current file number 1...n			*/
-
-
-
-/*
-	internal/external options
-*/
-int				Cpflag = 0;						/* print cumulative cycles flag			*/
-
-/*
-	file handling pointers/counters
-*/
-u_int16		asmFileCount =0;             	/* Number of files to assemble			*/
-char		*filelist[MAX_FILES];			/* list of files to assemble		*/
-char		*ipathlist[MAX_SEARCHPATHS];	/* search paths for include/lib pseudo */
-
-/*
-	misc pointers and other data
-*/
-char		**Argv =0;              		/* pointer to file names        		*/
-u_int16		OptCount;						/* Counter for lines that can be optimized */
-int			lineCount = 0;
-
-char		*includeDirectories[256];
-int			includeCount;
-char		*outputDirectory;
-char		*outputFilename;
-
 
 
 /*
@@ -85,8 +47,6 @@ char		*outputFilename;
  */
 static void Initialize(EnvContext *ctx)
 {
-	atexit(FwdRefDone);
-
 	ctx->m_CPUType = CPU_6309;		/* CPU Type									*/
 	ctx->m_OutputType = MOTBIN;		/* output type.								*/
 	ctx->m_Pass = 1;				/* Which pass the assembler is on			*/
@@ -114,6 +74,16 @@ static void Initialize(EnvContext *ctx)
 	ctx->m_Misc.OptFlag = false;				/* Display number of lines that could be optimized */
 	ctx->m_Misc.OptShow = false;				/* Display lines that could be optimized */
 
+	ctx->m_Relax.m_Enabled = false;				/* Relax code until its size is stable	*/
+	ctx->m_Relax.m_Active = false;				/* Not in a relaxation pass				*/
+	ctx->m_Relax.m_Moved = false;				/* No symbols moved						*/
+	ctx->m_Relax.m_Passes = 0;					/* No relaxation passes made			*/
+	ctx->m_Relax.m_Bytes = 0;					/* Bytes emitted this pass				*/
+
+	memset(&ctx->m_Stats, 0, sizeof(ctx->m_Stats));	/* No statistics gathered			*/
+	ctx->m_Stats.m_Format = STATS_NONE;			/* Don't report statistics				*/
+
+	memset(&ctx->m_Precomp, 0, sizeof(ctx->m_Precomp));	/* No precompiled definitions		*/
 
 	ctx->m_Compat.m_AsmMode = ASM_MODE_CASM;
 	ctx->m_Compat.m_AsmOpMask = ASM_ALL;
@@ -141,22 +111,27 @@ static void Initialize(EnvContext *ctx)
 	ctx->m_ListingFlags.OptNoOpData = false;	/* Do not print op data in listing			*/
 	ctx->m_ListingFlags.OptCommentMacros = false;	/* Comment out macros in listing		*/
 
-
+	ctx->m_Files.m_Count = 0;					/* No files to assemble yet				*/
+	ctx->m_Files.m_Current = 0;
+	ctx->m_Files.m_IncludeCount = 0;
+	ctx->m_Files.m_OutputDirectory = NULL;
+	ctx->m_Files.m_OutputName = NULL;
+	ctx->m_Files.m_ROMSize = 8192;				/* Size for the ROM file				*/
+	ctx->m_Exports.m_MMUPage = -1;				/* Not a loadable module				*/
+
+	InitInput(ctx);
+	InitMacros(ctx);
+	InitStructs(ctx);
 	InitSymbolTable(ctx);
 
 	ctx->m_Misc.N_page  = false;
-	Cpflag  = 0;
-	Cfn = 0;
-	lineCount = 0;
-
-	includeCount = 0;
-	outputDirectory = NULL;
-	outputFilename = NULL;
-
-	FwdRefInit();	/* forward ref init */
-	InitCPU();
-	InitOpcodeTable();
-	ResetMacroLocalLabels();
+	ctx->m_Misc.Cpflag  = 0;
+	ctx->m_LineCount = 0;
+
+	FwdRefInit(ctx);	/* forward ref init */
+	InitCPU(ctx);
+	InitOpcodeTable(ctx);
+	ResetMacroLocalLabels(ctx);
 	ResetLocalLabels(ctx);
 }
 
@@ -177,14 +152,16 @@ static void Reinitialize(EnvContext *ctx)
 	ctx->m_ErrorCount = 0;
 	ctx->m_WarningCount = 0;
 	ctx->m_Misc.N_page  = false;
-	Cpflag  = 0;
-	Cfn = 0;
-	lineCount = 0;
+	ctx->m_Relax.m_Bytes = 0;
+	ctx->m_Misc.Cpflag  = 0;
+	ctx->m_Files.m_Current = 0;
+	ctx->m_LineCount = 0;
 
-	InitCPU();
+	InitCPU(ctx);
 	FwdRefReinit(ctx);
-	ResetMacroLocalLabels();
+	ResetMacroLocalLabels(ctx);
 	ResetLocalLabels(ctx);
+	ResetPrecomp(ctx);
 }
 
 
@@ -197,7 +174,7 @@ static bool GetLine(EnvContext *ctx, char *buffer, int max)
 	ctx->m_Operand = NULL;
 	ctx->m_Ptr = NULL;
 
-	if(true == IsMacroOpen() && NULL != GetMacroLine(ctx, buffer)) {
+	if(true == IsMacroOpen(ctx) && NULL != GetMacroLine(ctx, buffer)) {
 		return true;
 	}
 
@@ -210,19 +187,19 @@ static void AssembleFile(EnvContext *ctx, const char *np)
 	LineBuffer	lineBuffer;
 
 	
-	SetNamespace(NULL, "");
-	OptCount = 0;		/* Reset Optimization count */
+	SetNamespace(ctx, "");
+	ctx->m_Misc.OptCount = 0;		/* Reset Optimization count */
 
-	if(ctx->m_SilentMode == false) {
-		fprintf(stderr, "Assembler pass: %d  ", ctx->m_Pass);
+	if(ctx->m_SilentMode == false && false == ctx->m_Relax.m_Active) {
+		fprintf(ctx->m_Err, "Assembler pass: %d  ", ctx->m_Pass);
 		if(ctx->m_Pass > 1) {
-			fprintf(stderr, "Assembling %s", np);
+			fprintf(ctx->m_Err, "Assembling %s", np);
 		}
-		fprintf(stderr, "\n");
+		fprintf(ctx->m_Err, "\n");
 	}
 
 
-	while(0 != GetOpenFileCount()) {
+	while(0 != GetOpenFileCount(ctx)) {
 
 		while(false != GetLine(ctx, lineBuffer.m_Line, MAX_BUFFERSIZE)) {
 			const char *limit;
@@ -231,11 +208,11 @@ static void AssembleFile(EnvContext *ctx, const char *np)
 			limit = lineBuffer.m_Line + MAX_BUFFERSIZE - 1;
 			opcodeENDM = false;
 
-			if(false == IsMacroOpen()) {
+			if(false == IsMacroOpen(ctx)) {
 				ctx->m_LineNumber++;
 			}
 			
-			lineCount++;
+			ctx->m_LineCount++;
 
 			
 			ctx->m_ListingFlags.P_force = false;	/* No force unless bytes emitted */
@@ -248,19 +225,19 @@ static void AssembleFile(EnvContext *ctx, const char *np)
 
 			
 			if(EOS == *lineBuffer.m_Line) {
-				GetNextMacroLocalLabel();
-				GetNextLocalLabel();
+				GetNextMacroLocalLabel(ctx);
+				GetNextLocalLabel(ctx);
 			}
 
-			if(ctx->m_Pass == 2) {
+			if(ctx->m_Pass == 2 && false == ctx->m_Relax.m_Active) {
 				if(true == ctx->m_ListingFlags.m_OptEnabled && false == ctx->m_Misc.N_page) {
-					if(false == IsMacroOpen() || true == OnFirstMacroLine() || true == ctx->m_ListingFlags.m_ExpandMacros) {
+					if(false == IsMacroOpen(ctx) || true == OnFirstMacroLine(ctx) || true == ctx->m_ListingFlags.m_ExpandMacros) {
 						bool comment;
 
 						comment = false;
 
 						if(true == ctx->m_ListingFlags.OptCommentMacros) {
-							if(true == opcodeENDM || true == IsProcessingMacro() || (true == OnFirstMacroLine() && true == ctx->m_ListingFlags.m_ExpandMacros)) {
+							if(true == opcodeENDM || true == IsProcessingMacro(ctx) || (true == OnFirstMacroLine(ctx) && true == ctx->m_ListingFlags.m_ExpandMacros)) {
 								comment = true;
 							}
 						}
@@ -273,29 +250,29 @@ static void AssembleFile(EnvContext *ctx, const char *np)
 						warning(ctx, WARN_OPTIMIZE, "!!Optimization alert!! ");
 						PrintLine(ctx, lineBuffer.m_Line, false);
 					}
-					OptCount++;
+					ctx->m_Misc.OptCount++;
 				}
 			}
 
-			if(Cpflag == 3) {
+			if(ctx->m_Misc.Cpflag == 3) {
 				PrintCycles(ctx, ctx->m_CycleTotal);		/* print cumulative cycles */
 			}
 
 
 			ctx->m_ListingFlags.P_total = 0;			/* reset byte count, */
-			Cpflag = 0;				/* cycle print flag, */
+			ctx->m_Misc.Cpflag = 0;				/* cycle print flag, */
 			ctx->m_CycleCount = 0;			/* and per instruction cycle count */
 
 
 			if(false != ctx->m_Finished) {
-				while(0 != GetOpenFileCount()) {
+				while(0 != GetOpenFileCount(ctx)) {
 					CloseInputFile(ctx);
 				}
 				break;
 			}
 		}
 
-		if(0 != GetOpenFileCount()) {
+		if(0 != GetOpenFileCount(ctx)) {
 			CloseInputFile(ctx);
 		}
 	}
@@ -303,68 +280,164 @@ static void AssembleFile(EnvContext *ctx, const char *np)
 }
 
 
+/*
+ *	RelaxPass --- make one pass 2 over the files without output
+ */
+static void RelaxPass(EnvContext *ctx)
+{
+	char	**np;
 
+	Reinitialize(ctx);
+	BeginPassStats(ctx);
 
+	np = ctx->m_Files.m_List;
+	while( ++ctx->m_Files.m_Current <= ctx->m_Files.m_Count) {
+		if(OpenInputFile(ctx, *np, false) == true) {
+			ctx->m_Finished = false;
+			AssembleFile(ctx, *np);
+		}
 
-int main(int argc, char **argv)
+		np++;
+	}
+
+	EndPassStats(ctx, STATS_RELAX);
+}
+
+
+/*
+ *	RelaxFiles --- repeat pass 2 without output until no symbol moves
+ *
+ *	Each relaxation pass sizes instructions with the symbol values left by
+ *	the pass before it, so once a pass moves no symbols the final pass will
+ *	lay the code out the same way.  If the size never settles, the values
+ *	from pass 1 are put back and the code is assembled without relaxing.
+ *
+ *	The bytes saved are reported against a pass sized the way pass 2 would
+ *	size it without -relax: short branches are not taken and symbols keep
+ *	their pass 1 values.
+ */
+static void RelaxFiles(EnvContext *ctx)
+{
+	u_int32	plainBytes = 0;
+
+	ctx->m_Relax.m_Saved = SaveSymbolValues(ctx);
+
+	ctx->m_Pass = 2;
+	ctx->m_Relax.m_Active = true;
+	ctx->m_Relax.m_Passes = 0;
+
+	if(ctx->m_SilentMode == false) {
+		ctx->m_Relax.m_Enabled = false;
+		RelaxPass(ctx);
+		plainBytes = ctx->m_Relax.m_Bytes;
+		ctx->m_Relax.m_Enabled = true;
+	}
+
+	do {
+		ctx->m_Relax.m_Moved = false;
+		ctx->m_Relax.m_Passes++;
+
+		RelaxPass(ctx);
+	} while(true == ctx->m_Relax.m_Moved && ctx->m_Relax.m_Passes < MAX_RELAX_PASSES);
+
+	ctx->m_Relax.m_Active = false;
+
+	if(true == ctx->m_Relax.m_Moved) {
+		RestoreSymbolValues(ctx, ctx->m_Relax.m_Saved);
+		ctx->m_Relax.m_Enabled = false;
+
+		if(ctx->m_SilentMode == false) {
+			fprintf(ctx->m_Err, "Code size did not settle after %d relaxation passes, assembling without relaxing\n", ctx->m_Relax.m_Passes);
+		}
+	} else if(ctx->m_SilentMode == false) {
+		long saved = (long)plainBytes - (long)ctx->m_Relax.m_Bytes;
+
+		fprintf(ctx->m_Err, "Relaxed in %d pass%s, %ld byte%s saved\n", ctx->m_Relax.m_Passes, 1 == ctx->m_Relax.m_Passes ? "" : "es",
+			saved, 1 == saved ? "" : "s");
+	}
+
+	free(ctx->m_Relax.m_Saved);
+	ctx->m_Relax.m_Saved = NULL;
+}
+
+
+
+
+
+/*
+ *	AssembleFiles --- assemble the files named on a command line
+ */
+static int AssembleFiles(EnvContext *ctx, int argc, char **argv)
 {
-	EnvContext	ctx;
 	char		**np;
 #ifdef _WIN32
 	DWORD	startTime;
 	DWORD	endTime;
 #endif
 
-	Argv = argv;
-
-
+	ctx->m_Files.m_Argv = argv;
 
-	Initialize(&ctx);
+	Initialize(ctx);
 
-	Params(&ctx, argc, argv);
+	Params(ctx, argc, argv);
+	InitPrecomp(ctx);
 
-	np = filelist;
-	Cfn = 0;
+	np = ctx->m_Files.m_List;
+	ctx->m_Files.m_Current = 0;
 
 #ifdef _WIN32
 	startTime = GetTickCount();
 #endif
 
-	while( ++Cfn <= asmFileCount && false == ctx.m_Finished) {
+	BeginPassStats(ctx);
+
+	while( ++ctx->m_Files.m_Current <= ctx->m_Files.m_Count && false == ctx->m_Finished) {
 		bool result;
 
-		result = OpenInputFile(&ctx, *np, false);
+		result = OpenInputFile(ctx, *np, false);
 		if(true == result) {
-			AssembleFile(&ctx, *np);
+			AssembleFile(ctx, *np);
 		}
 		np++;
 	}
 
-	if(0 != GetOpenFileCount()) {
-		internal((&ctx, "Error in filecount: %i\n", GetOpenFileCount()));
+	if(0 != GetOpenFileCount(ctx)) {
+		internal((ctx, "Error in filecount: %i\n", GetOpenFileCount(ctx)));
+	}
+
+	EndPassStats(ctx, STATS_PASS1);
+
+	/* Relaxing needs a clean pass 1 to start from */
+	if(true == ctx->m_Relax.m_Enabled) {
+		if(0 == ctx->m_ErrorCount) {
+			RelaxFiles(ctx);
+		} else {
+			ctx->m_Relax.m_Enabled = false;
+		}
 	}
 
 	/* If no errors or a listing has been requested
-		increase pass count go keep going */
-	if(0 == ctx.m_ErrorCount || true == ctx.m_ListingFlags.m_OptEnabled) {
-		ctx.m_Pass++;
+		go on to pass 2 */
+	if(0 == ctx->m_ErrorCount || true == ctx->m_ListingFlags.m_OptEnabled) {
+		ctx->m_Pass = 2;
 
 		/* If errors have occured turn off the output file */
-		if(0 != ctx.m_ErrorCount) {
-			ctx.m_Misc.Oflag = false;
+		if(0 != ctx->m_ErrorCount) {
+			ctx->m_Misc.Oflag = false;
 		}
 
-		np = filelist;
+		np = ctx->m_Files.m_List;
 
-		Reinitialize(&ctx);
+		Reinitialize(ctx);
+		BeginPassStats(ctx);
 
-		if(ctx.m_Misc.Oflag == true) {
+		if(ctx->m_Misc.Oflag == true) {
 			bool result;
 
-			if(outputFilename) {
-				result = OpenOutput(&ctx, outputFilename, false);
-			} else if(NULL != filelist[0]) {
-				result = OpenOutput(&ctx, filelist[0], true);
+			if(ctx->m_Files.m_OutputName) {
+				result = OpenOutput(ctx, ctx->m_Files.m_OutputName, false);
+			} else if(NULL != ctx->m_Files.m_List[0]) {
+				result = OpenOutput(ctx, ctx->m_Files.m_List[0], true);
 			} else {
 				result = true;
 			}
@@ -374,28 +447,30 @@ int main(int argc, char **argv)
 			}
 		}
 
-		while( ++Cfn <= asmFileCount) {
-			if(OpenInputFile(&ctx, *np, false) == true) {
-				ctx.m_Finished = false;
-				AssembleFile(&ctx, *np);
+		while( ++ctx->m_Files.m_Current <= ctx->m_Files.m_Count) {
+			if(OpenInputFile(ctx, *np, false) == true) {
+				ctx->m_Finished = false;
+				AssembleFile(ctx, *np);
 			}
 
 			np++;
 		}
 
-		CloseOutput(&ctx);                 /* output closing record */
+		CloseOutput(ctx);                 /* output closing record */
 
-		if(true == ctx.m_Misc.Cflag) {
-			PrintCycles(&ctx, ctx.m_CycleTotal);  /* if still counting cycles, then  print cycles counted */
+		EndPassStats(ctx, STATS_PASS2);
+
+		if(true == ctx->m_Misc.Cflag) {
+			PrintCycles(ctx, ctx->m_CycleTotal);  /* if still counting cycles, then  print cycles counted */
 		}
 
-		if(ctx.m_SilentMode == false) {
-			if (ctx.m_Misc.Sflag == 1) {
-				DumpSymTable(&ctx);
+		if(ctx->m_SilentMode == false) {
+			if (ctx->m_Misc.Sflag == 1) {
+				DumpSymTable(ctx);
 			}
 
-			if (true == ctx.m_ListingFlags.m_ListSymbols) {
-				 DumpCrossRef();
+			if (true == ctx->m_ListingFlags.m_ListSymbols) {
+				 DumpCrossRef(ctx);
 			}
 		}
 	}
@@ -404,27 +479,450 @@ int main(int argc, char **argv)
 	endTime = GetTickCount();
 #endif
 
-	if(ctx.m_SilentMode == false) {
-		fprintf(stderr, "\n\n");
+	if(ctx->m_SilentMode == false) {
+		fprintf(ctx->m_Err, "\n\n");
 
-		if(ctx.m_Misc.OptFlag == true || ctx.m_Misc.OptShow == true) {
-			fprintf(stderr, "Number of lines that can be optimized: %u\n", OptCount);
+		if(ctx->m_Misc.OptFlag == true || ctx->m_Misc.OptShow == true) {
+			fprintf(ctx->m_Err, "Number of lines that can be optimized: %u\n", ctx->m_Misc.OptCount);
 		}
 
 #ifdef _WIN32
-		fprintf(stderr, "%d lines assembled in %2.2f seconds\n", lineCount, (double)(endTime - startTime) / 1000);
+		fprintf(ctx->m_Err, "%d lines assembled in %2.2f seconds\n", ctx->m_LineCount, (double)(endTime - startTime) / 1000);
 #endif
-		if(0 != ctx.m_ErrorCount) {
-			fprintf(stderr, "Number of errors %d\n", ctx.m_ErrorCount);
+		if(0 != ctx->m_ErrorCount) {
+			fprintf(ctx->m_Err, "Number of errors %d\n", ctx->m_ErrorCount);
 		}
 
-		if(0 != ctx.m_WarningCount) {
-			fprintf(stderr, "Number of warnings %d\n", ctx.m_WarningCount);
+		if(0 != ctx->m_WarningCount) {
+			fprintf(ctx->m_Err, "Number of warnings %d\n", ctx->m_WarningCount);
 		}
 	}
 
-	FwdRefDone();
+	if(STATS_NONE != ctx->m_Stats.m_Format) {
+		PrintStats(ctx);
+	}
+
+	return(0 != ctx->m_ErrorCount ? ERR_GENERAL : ERR_SUCCESS);
+}
+
+
+/*
+ *	Shutdown --- release everything a module allocated
+ *
+ *	A module ended by a fatal error can still have its output file open.
+ */
+static void Shutdown(EnvContext *ctx)
+{
+	if(NULL != ctx->m_Output.m_File) {
+		fclose(ctx->m_Output.m_File);
+		ctx->m_Output.m_File = NULL;
+	}
+
+	free(ctx->m_Relax.m_Saved);
+	ctx->m_Relax.m_Saved = NULL;
 
-	return(0 != ctx.m_ErrorCount ? ERR_GENERAL : ERR_SUCCESS);
+	ReleasePrecomp(ctx);
+	ReleaseOpcodeTable(ctx);
+	FwdRefDone(ctx);
+	ReleaseExports(ctx);
+	ReleaseStructs(ctx);
+	ReleaseMacros(ctx);
+	ReleaseSymbolTable(ctx);
+	ReleaseInput(ctx);
+
+	fflush(ctx->m_Out);
+	fflush(ctx->m_Err);
 }
 
+
+/*
+ *	AssembleModule --- assemble the files named on a command line
+ *
+ *	Every module has a context of its own, which holds all of the state
+ *	of its assembly.  Listings go to 'out' and messages to 'err'.  A fatal
+ *	error ends the module and returns its exit code.
+ */
+static int AssembleModule(int argc, char **argv, FILE *out, FILE *err)
+{
+	EnvContext	*ctx;
+	jmp_buf		abort;
+	int			result;
+
+	/* The output record buffer makes the context too big for a thread's stack */
+	ctx = (EnvContext *)CAllocMem(1, sizeof(EnvContext));
+	ctx->m_Out = out;
+	ctx->m_Err = err;
+	ctx->m_Abort = &abort;
+
+	if(0 == setjmp(abort)) {
+		result = AssembleFiles(ctx, argc, argv);
+	} else {
+		result = ctx->m_ExitCode;
+	}
+
+	Shutdown(ctx);
+	free(ctx);
+
+	return result;
+}
+
+
+/*
+ *	Batch assembly
+ *
+ *	An argument of the form @<file> names a module list.  Each line of
+ *	the list holds the files and options for one module, which are added
+ *	after the options given on the command line.  The modules are
+ *	assembled in this process, each with a context of its own, so the
+ *	symbol table, macros, forward references and output state start out
+ *	fresh for each one.  With -j<n> up to n modules are assembled at once
+ *	on worker threads, and the output of each module is held back and
+ *	shown in list order.
+ *
+ *	Source files are read through a cache that every module shares, so
+ *	an include file used by many modules is only read and split into
+ *	lines once.
+ */
+typedef struct {
+	char	*m_Name;		/* line of the list the module came from */
+	int		m_Argc;
+	char	**m_Argv;
+	FILE	*m_Out;			/* held listing output */
+	FILE	*m_Err;			/* held messages */
+	bool	m_Done;
+	bool	m_Failed;
+} BatchModule;
+
+typedef struct {
+	char			*m_Program;		/* name the assembler was run as */
+	BatchModule		*m_Modules;
+	int				m_Count;
+	int				m_Max;
+	int				m_Next;			/* next module to assemble */
+	bool			m_Hold;			/* hold output to show in list order */
+	pthread_mutex_t	m_Lock;			/* guards m_Next and the m_Done flags */
+	pthread_cond_t	m_Finished;		/* signalled as each module finishes */
+} Batch;
+
+
+/*
+ *	SplitBatchLine --- split a line of a module list into arguments
+ *
+ *	Arguments are separated by white space and may be enclosed in
+ *	double quotes.  The line is modified in place.
+ */
+static int SplitBatchLine(char *line, char **args, int maxArgs)
+{
+	char	*ptr, *out;
+	int		count;
+
+	count = 0;
+	ptr = line;
+
+	while(true) {
+		while(isspace((unsigned char)*ptr)) {
+			ptr++;
+		}
+
+		if(EOS == *ptr || count == maxArgs) {
+			break;
+		}
+
+		args[count++] = out = ptr;
+
+		while(EOS != *ptr && !isspace((unsigned char)*ptr)) {
+			if('"' == *ptr) {
+				ptr++;
+				while(EOS != *ptr && '"' != *ptr) {
+					*(out++) = *(ptr++);
+				}
+				if('"' == *ptr) {
+					ptr++;
+				}
+			} else {
+				*(out++) = *(ptr++);
+			}
+		}
+
+		if(EOS != *ptr) {
+			ptr++;
+		}
+
+		*out = EOS;
+	}
+
+	return count;
+}
+
+
+/*
+ *	ReadBatchList --- add the modules in a list file to the batch
+ *
+ *	Blank lines and lines starting with '#' or '*' are skipped.
+ */
+static bool ReadBatchList(Batch *batch, const char *filename, char **common, int commonCount)
+{
+	FILE	*fp;
+	char	line[MAX_BUFFERSIZE];
+	char	*args[MAX_FILES + 64];
+
+	fp = fopen(filename, "r");
+	if(NULL == fp) {
+		fprintf(stderr, "%s: can't open module list %s\n", batch->m_Program, filename);
+		return false;
+	}
+
+	while(NULL != fgets(line, sizeof(line), fp)) {
+		BatchModule	*mod;
+		char		*name;
+		int			i, count;
+
+		line[strcspn(line, "\r\n")] = EOS;
+
+		name = line;
+		while(isspace((unsigned char)*name)) {
+			name++;
+		}
+
+		if(EOS == *name || '#' == *name || '*' == *name) {
+			continue;
+		}
+
+		if(batch->m_Count == batch->m_Max) {
+			batch->m_Max = (0 == batch->m_Max ? 64 : batch->m_Max * 2);
+			batch->m_Modules = (BatchModule *)ReallocMem(batch->m_Modules, batch->m_Max * sizeof(BatchModule));
+		}
+
+		mod = &batch->m_Modules[batch->m_Count++];
+		memset(mod, 0, sizeof(BatchModule));
+
+		mod->m_Name = strdup(name);
+		count = SplitBatchLine(name, args, sizeof(args) / sizeof(args[0]));
+
+		/* The assembler's name, the common arguments, then the module's own */
+		mod->m_Argv = (char **)malloc((1 + commonCount + count + 1) * sizeof(char *));
+		if(NULL == mod->m_Name || NULL == mod->m_Argv) {
+			fatal(NULL, "Out of memory");
+		}
+
+		mod->m_Argv[mod->m_Argc++] = batch->m_Program;
+		for(i = 0; i < commonCount; i++) {
+			mod->m_Argv[mod->m_Argc++] = common[i];
+		}
+		for(i = 0; i < count; i++) {
+			mod->m_Argv[mod->m_Argc++] = strdup(args[i]);
+		}
+		mod->m_Argv[mod->m_Argc] = NULL;
+	}
+
+	fclose(fp);
+
+	return true;
+}
+
+
+/*
+ *	ShowHeldOutput --- copy a module's held output to a stream
+ */
+static void ShowHeldOutput(FILE *held, FILE *to)
+{
+	char	buffer[4096];
+	size_t	count;
+
+	if(NULL == held) {
+		return;
+	}
+
+	rewind(held);
+	while(0 != (count = fread(buffer, 1, sizeof(buffer), held))) {
+		fwrite(buffer, 1, count, to);
+	}
+	fclose(held);
+	fflush(to);
+}
+
+
+/*
+ *	BatchWorker --- assemble modules of the batch until none are left
+ *
+ *	If the output of a module can't be held it is written out as it is
+ *	produced.
+ */
+static void *BatchWorker(void *arg)
+{
+	Batch	*batch = (Batch *)arg;
+
+	pthread_mutex_lock(&batch->m_Lock);
+
+	while(batch->m_Next < batch->m_Count) {
+		BatchModule	*mod = &batch->m_Modules[batch->m_Next++];
+		FILE		*out = stdout;
+		FILE		*err = stderr;
+		int			result;
+
+		pthread_mutex_unlock(&batch->m_Lock);
+
+		if(true == batch->m_Hold) {
+			mod->m_Out = tmpfile();
+			mod->m_Err = tmpfile();
+			if(NULL != mod->m_Out && NULL != mod->m_Err) {
+				out = mod->m_Out;
+				err = mod->m_Err;
+			}
+		}
+
+		result = AssembleModule(mod->m_Argc, mod->m_Argv, out, err);
+
+		pthread_mutex_lock(&batch->m_Lock);
+		mod->m_Failed = (0 != result);
+		mod->m_Done = true;
+		pthread_cond_broadcast(&batch->m_Finished);
+	}
+
+	pthread_mutex_unlock(&batch->m_Lock);
+
+	return NULL;
+}
+
+
+/*
+ *	AssembleBatch --- assemble the modules in the lists on the command line
+ */
+static int AssembleBatch(int argc, char **argv)
+{
+	Batch		batch;
+	pthread_t	*threads;
+	char		**common;
+	int			commonCount;
+	int			jobs;
+	int			started;
+	int			failed;
+	int			count;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.m_Program = argv[0];
+	pthread_mutex_init(&batch.m_Lock, NULL);
+	pthread_cond_init(&batch.m_Finished, NULL);
+
+	jobs = 1;
+	failed = 0;
+	commonCount = 0;
+
+	common = (char **)malloc(argc * sizeof(char *));
+	if(NULL == common) {
+		fatal(NULL, "Out of memory");
+	}
+
+	/* Sort out the job count and the options every module gets */
+	for(count = 1; count < argc; count++) {
+		if('-' == argv[count][0] && 'j' == argv[count][1]) {
+			if(EOS != argv[count][2]) {
+				jobs = atoi(&argv[count][2]);
+			}
+#ifdef _SC_NPROCESSORS_ONLN
+			else {
+				jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+			}
+#endif
+		} else if('@' != argv[count][0]) {
+			common[commonCount++] = argv[count];
+		}
+	}
+
+	for(count = 1; count < argc; count++) {
+		if('@' == argv[count][0] && false == ReadBatchList(&batch, &argv[count][1], common, commonCount)) {
+			return ERR_GENERAL;
+		}
+	}
+
+	if(jobs > batch.m_Count) {
+		jobs = batch.m_Count;
+	}
+
+	if(jobs < 1) {
+		jobs = 1;
+	}
+
+	/* With more than one job the modules are assembled on worker threads
+		while this thread shows their output in list order */
+	started = 0;
+	threads = NULL;
+	batch.m_Hold = (jobs > 1);
+
+	if(true == batch.m_Hold) {
+		threads = (pthread_t *)AllocMem(jobs * sizeof(pthread_t));
+		while(started < jobs && 0 == pthread_create(&threads[started], NULL, BatchWorker, &batch)) {
+			started++;
+		}
+	}
+
+	if(0 == started) {
+		batch.m_Hold = false;
+		BatchWorker(&batch);
+	}
+
+	pthread_mutex_lock(&batch.m_Lock);
+
+	for(count = 0; count < batch.m_Count; count++) {
+		BatchModule *mod = &batch.m_Modules[count];
+
+		while(false == mod->m_Done) {
+			pthread_cond_wait(&batch.m_Finished, &batch.m_Lock);
+		}
+
+		pthread_mutex_unlock(&batch.m_Lock);
+
+		ShowHeldOutput(mod->m_Out, stdout);
+		ShowHeldOutput(mod->m_Err, stderr);
+		if(true == mod->m_Failed) {
+			failed++;
+		}
+
+		pthread_mutex_lock(&batch.m_Lock);
+	}
+
+	pthread_mutex_unlock(&batch.m_Lock);
+
+	for(count = 0; count < started; count++) {
+		pthread_join(threads[count], NULL);
+	}
+	free(threads);
+
+	if(0 != failed) {
+		fprintf(stderr, "%s: %d of %d modules failed\n", batch.m_Program, failed, batch.m_Count);
+	}
+
+	/* The module's own arguments follow the assembler's name and the common ones */
+	for(count = 0; count < batch.m_Count; count++) {
+		BatchModule *mod = &batch.m_Modules[count];
+		int arg;
+
+		for(arg = 1 + commonCount; arg < mod->m_Argc; arg++) {
+			free(mod->m_Argv[arg]);
+		}
+		free(mod->m_Argv);
+		free(mod->m_Name);
+	}
+	free(batch.m_Modules);
+	free(common);
+
+	pthread_cond_destroy(&batch.m_Finished);
+	pthread_mutex_destroy(&batch.m_Lock);
+
+	return (0 != failed ? ERR_GENERAL : ERR_SUCCESS);
+}
+
+
+int main(int argc, char **argv)
+{
+	int	count;
+
+	/* A module list on the command line means a batch of assemblies */
+	for(count = 1; count < argc; count++) {
+		if('@' == argv[count][0]) {
+			return AssembleBatch(argc, argv);
+		}
+	}
+
+	return AssembleModule(argc, argv, stdout, stderr);
+}
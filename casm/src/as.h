@@ -45,6 +45,8 @@
 #include "error.h"
 #include "output.h"
 #include "context.h"
+#include "stats.h"
+#include "precomp.h"
 
 
 typedef struct _Export {
@@ -53,47 +55,4 @@ typedef struct _Export {
 } Export;
 
 
-/* global variables */
-
-
-/*
-	various line counters
-*/
-extern u_int16		Cfn;			/* Current file number 1...n			*/
-
-
-/*
-	internal/external options
-*/
-
-extern int			Cpflag;			/* print cumulative cycles flag			*/
-extern int			outputROMSize;	/* Size of the output ROM				*/
-/*
-	file handling pointers/counters
-*/
-extern u_int16		asmFileCount;	/* Number of files to assemble			*/
-extern char			*filelist[];	/* list of files to assemble			*/
-extern char			*ipathlist[];	/* search paths for include/lib pseudo	*/
-
-
-/*
-	misc pointers and other data
-*/
-extern char			**Argv;			/* pointer to file names				*/
-
-
-/*
-	Structures
-*/
-extern bool			instruct;
-extern Struct		*laststructfound;
-
-/* More misc */
-extern char			*includeDirectories[256];
-extern int			includeCount;
-extern char			*outputDirectory;
-extern char			*outputFilename;
-
-
-
 #endif
@@ -34,122 +34,127 @@
 #include "proto.h"
 #include "context.h"
 
-static void banner(void);
+static void banner(EnvContext *ctx);
 
 
-static void banner(void)
+static void banner(EnvContext *ctx)
 {
-	fprintf(stderr, "CASM Motorola MC6809/Hitatchi HT6309 Cross Assembler V3.0 (ALPHA 2)\n");
-	fprintf(stderr, "Copyright (c) 1997, 2004 Digital Asphyxia\n");
-	fprintf(stderr, "Written by Chet Simpson\n\n");
+	fprintf(ctx->m_Err, "CASM Motorola MC6809/Hitatchi HT6309 Cross Assembler V3.0 (ALPHA 2)\n");
+	fprintf(ctx->m_Err, "Copyright (c) 1997, 2004 Digital Asphyxia\n");
+	fprintf(ctx->m_Err, "Written by Chet Simpson\n\n");
 }
 
-static void Usage(void)
+static void Usage(EnvContext *ctx)
 {
-	fprintf(stderr, "Usage:  %s [files] [-options]\n", Argv[0]);
-	fprintf(stderr, "Example:  %s file1.asm file2.asm -xref -bin\n\n", Argv[0]);
+	fprintf(ctx->m_Err, "Usage:  %s [files] [-options]\n", ctx->m_Files.m_Argv[0]);
+	fprintf(ctx->m_Err, "        %s @modules.lst [-j<n>] [-options]\n", ctx->m_Files.m_Argv[0]);
+	fprintf(ctx->m_Err, "Example:  %s file1.asm file2.asm -xref -bin\n\n", ctx->m_Files.m_Argv[0]);
 }
 
 
-static void poption(const char *opt, const char *desc)
+static void poption(EnvContext *ctx, const char *opt, const char *desc)
 {
 	size_t tabs;
 
-	fputc('-', stderr);
-	fputs(opt, stderr);
+	fputc('-', ctx->m_Err);
+	fputs(opt, ctx->m_Err);
 	tabs = (30 - strlen(opt)) / 8;
 	while(tabs > 0) {
-		fputc(TAB, stderr);
+		fputc(TAB, ctx->m_Err);
 		tabs--;
 	}
-	fprintf(stderr, "%s\n",  desc);
+	fprintf(ctx->m_Err, "%s\n",  desc);
 }
 
 
-static void pheader(const char *hdr)
+static void pheader(EnvContext *ctx, const char *hdr)
 {
-	fprintf(stderr, "\n%s\n", hdr);
-	fputs("-------------------------------------------------------------------------------\n", stdout);
+	fprintf(ctx->m_Err, "\n%s\n", hdr);
+	fputs("-------------------------------------------------------------------------------\n", ctx->m_Err);
 }
 
-static void help(void)
+NORETURN static void help(EnvContext *ctx)
 {
-	Usage();
+	Usage(ctx);
 
 	/* General options */
-	pheader("General CASM options");
-	poption("help", "Displays this list");
-	poption("?", "Displays this list");
-	poption("6809", "Allow only 6809 Opcodes");
-	poption("D", "Define symbol");
+	pheader(ctx, "General CASM options");
+	poption(ctx, "help", "Displays this list");
+	poption(ctx, "?", "Displays this list");
+	poption(ctx, "6809", "Allow only 6809 Opcodes");
+	poption(ctx, "D", "Define symbol");
 #ifdef FIXME_LATER_OR_IMPLEMENT
-	poption("I", "Add include directory");
+	poption(ctx, "I", "Add include directory");
 #endif
-	poption("C", "Use case sensative labels");
-	poption("silent", "Run in silent mode");
-	poption("-no-warn", "Disable warnings");
+	poption(ctx, "C", "Use case sensative labels");
+	poption(ctx, "silent", "Run in silent mode");
+	poption(ctx, "-no-warn", "Disable warnings");
+	poption(ctx, "j<n>", "Assemble up to n modules of a @list at once");
+	poption(ctx, "relax", "Shorten branches and addresses until the code size is stable");
+	poption(ctx, "P<dir>", "Keep precompiled definitions of includes in dir");
+	poption(ctx, "stats[=json]", "Report pass times, symbol table and memory use");
 
 	/* Output options */
-	pheader("Output file options");
-	poption("O", "Set output directory");
-	poption("o", "Set output name");
-	poption("bin", "Generate CoCo RS-DOS binary file");
-	poption("s19", "Generate S-record file");
-	poption("rom", "Generate a padded ROM file");
-	poption("raw", "Generate raw binary file");
-	poption("mod", "Generate shared object module");
-	poption("os9", "Generate Microware OS-9 module");
-	poption("rof", "Generate Microware Relocatable Object File");
-	poption("obj", "Generate CASM object file");
-	poption("noout", "Assemble only, do not generate output file");
+	pheader(ctx, "Output file options");
+	poption(ctx, "O", "Set output directory");
+	poption(ctx, "o", "Set output name");
+	poption(ctx, "bin", "Generate CoCo RS-DOS binary file");
+	poption(ctx, "s19", "Generate S-record file");
+	poption(ctx, "rom", "Generate a padded ROM file");
+	poption(ctx, "raw", "Generate raw binary file");
+	poption(ctx, "mod", "Generate shared object module");
+	poption(ctx, "os9", "Generate Microware OS-9 module");
+	poption(ctx, "rof", "Generate Microware Relocatable Object File");
+	poption(ctx, "obj", "Generate CASM object file");
+	poption(ctx, "noout", "Assemble only, do not generate output file");
 
 	/* Compatibility options */
-	pheader("Compatibilty options");
-	poption("-mode-rma", "Assemble in RMA compatibility mode");
-	poption("-mode-macro80c", "Assemble in Macro-80c compatibility mode");
-	poption("-mode-edtasm", "Assemble in EDTASM+ compatibility mode");
-	poption("-mode-edtasm6309", "Assemble in EDTASM6309 compatibility mode");
-	poption("-mode-ccasm", "Assemble in CCASM compatibility mode");
-	poption("-warn-portable", "Warn of source code portability issues");
-	poption("-force-zero-offset", "Enable explicit 0 index offset");
-	poption("-force-pc-relative", "Use relative offsets for both PC and PCR");
-	poption("-disable-macros", "Disable use of macros");
-	poption("-disable-locals", "Disable use of local labels");
-	poption("-strict-locals", "Enable use of strict local label rules");
-	poption("-ignore-case", "Ignore case on symbols");
-	poption("-enable-precedence", "Enable operator precedence in expressions");
+	pheader(ctx, "Compatibilty options");
+	poption(ctx, "-mode-rma", "Assemble in RMA compatibility mode");
+	poption(ctx, "-mode-macro80c", "Assemble in Macro-80c compatibility mode");
+	poption(ctx, "-mode-edtasm", "Assemble in EDTASM+ compatibility mode");
+	poption(ctx, "-mode-edtasm6309", "Assemble in EDTASM6309 compatibility mode");
+	poption(ctx, "-mode-ccasm", "Assemble in CCASM compatibility mode");
+	poption(ctx, "-warn-portable", "Warn of source code portability issues");
+	poption(ctx, "-force-zero-offset", "Enable explicit 0 index offset");
+	poption(ctx, "-force-pc-relative", "Use relative offsets for both PC and PCR");
+	poption(ctx, "-disable-macros", "Disable use of macros");
+	poption(ctx, "-disable-locals", "Disable use of local labels");
+	poption(ctx, "-strict-locals", "Enable use of strict local label rules");
+	poption(ctx, "-ignore-case", "Ignore case on symbols");
+	poption(ctx, "-enable-precedence", "Enable operator precedence in expressions");
 	
 
 	/* Listing options */
-	pheader("Assembler listing options");
-	poption("list", "Generate formatted source file listing to stdout");
-	poption("nolist", "Source output disabled");
-	poption("cycle", "Cycle count enabled");
-	poption("slist", "Generate formatted list of labels");
-	poption("xref", "Cross refence table disabled");
-	poption("expand", "Macro definitions will be expanded in listing");
-	poption("opt", "Display number of lines that could be optmized");
-	poption("alert", "Display source lines that could be displayed");
-	poption("noln", "Do not print line numbers in listing");
-	poption("noopdata", "Do not print opcode data in listing");
-	poption("cm", "Comment out macros in listing");
+	pheader(ctx, "Assembler listing options");
+	poption(ctx, "list", "Generate formatted source file listing to ctx->m_Err");
+	poption(ctx, "nolist", "Source output disabled");
+	poption(ctx, "cycle", "Cycle count enabled");
+	poption(ctx, "slist", "Generate formatted list of labels");
+	poption(ctx, "xref", "Cross refence table disabled");
+	poption(ctx, "expand", "Macro definitions will be expanded in listing");
+	poption(ctx, "opt", "Display number of lines that could be optmized");
+	poption(ctx, "alert", "Display source lines that could be displayed");
+	poption(ctx, "noln", "Do not print line numbers in listing");
+	poption(ctx, "noopdata", "Do not print opcode data in listing");
+	poption(ctx, "cm", "Comment out macros in listing");
 
 #if 0
-	pheader("CCASM compatible command line options");
-	poption("l", "Generate formatted source file listing to stdout");
-	poption("s", "Generate formatted list of labels");
-	poption("sa", "ignored");
-	poption("sr", "ignored");
-	poption("nr", "Generate output file with no records");
-	poption("d", "ignored");
-	poption("bin", "Generate CoCo RS-DOS binary file");
-	poption("rom[=size]", "Generate a padded ROM file with optional size");
+	pheader(ctx, "CCASM compatible command line options");
+	poption(ctx, "l", "Generate formatted source file listing to ctx->m_Err");
+	poption(ctx, "s", "Generate formatted list of labels");
+	poption(ctx, "sa", "ignored");
+	poption(ctx, "sr", "ignored");
+	poption(ctx, "nr", "Generate output file with no records");
+	poption(ctx, "d", "ignored");
+	poption(ctx, "bin", "Generate CoCo RS-DOS binary file");
+	poption(ctx, "rom[=size]", "Generate a padded ROM file with optional size");
 #endif
 
-	fprintf(stderr, "\nSome options can be enabled or disabled from within source files\n");
-	fprintf(stderr, "Please refer to the on-line manual for a list of those options.\n");
+	fprintf(ctx->m_Err, "\nSome options can be enabled or disabled from within source files\n");
+	fprintf(ctx->m_Err, "Please refer to the on-line manual for a list of those options.\n");
 
-	exit(0);
+	AbortAssembly(ctx, 0);
 }
 
 
@@ -162,7 +167,8 @@ void Params(EnvContext *ctx, int argc, char **argv)
 	char *opt;
 	int count;
 	bool flag;
-	asmFileCount = 0;
+	ctx->m_Files.m_Argv = argv;
+	ctx->m_Files.m_Count = 0;
 
 	ctx->m_Compat.m_AsmMode = ASM_MODE_CASM;
 
@@ -226,8 +232,16 @@ void Params(EnvContext *ctx, int argc, char **argv)
 					ctx->m_DisableWarnings = true;
 				}
 
+				else if(0 == stricmp(opt, "stats")) {
+					ctx->m_Stats.m_Format = STATS_TEXT;
+				}
+
+				else if(0 == stricmp(opt, "stats=json")) {
+					ctx->m_Stats.m_Format = STATS_JSON;
+				}
+
 				else {
-					fatal(NULL, "Invalid option '%s'", argv[count]);
+					fatal(ctx, "Invalid option '%s'", argv[count]);
 				}
 			}
 	
@@ -252,12 +266,12 @@ void Params(EnvContext *ctx, int argc, char **argv)
 					opt += 3;
 					if('=' == *opt) {
 						opt++;
-						outputROMSize = atoi(opt) * 1024;
-						if(outputROMSize < 2048) {
-							fatal(NULL, "Invalid ROM size. Valid sizes are 2, 4, 8, 16, etc.");
+						ctx->m_Files.m_ROMSize = atoi(opt) * 1024;
+						if(ctx->m_Files.m_ROMSize < 2048) {
+							fatal(ctx, "Invalid ROM size. Valid sizes are 2, 4, 8, 16, etc.");
 						}
 					} else {
-						fatal(NULL, "Invalid option '%s'\n", argv[count]);
+						fatal(ctx, "Invalid option '%s'\n", argv[count]);
 					}
 				}
 				ctx->m_OutputType = ROMBIN;
@@ -329,19 +343,34 @@ void Params(EnvContext *ctx, int argc, char **argv)
 				ctx->m_SilentMode = true;
 			}
 
+			else if(0 == stricmp(opt, "relax")) {
+				ctx->m_Relax.m_Enabled = true;
+			}
+
+			else if(0 == stricmp(opt, "stats")) {
+				ctx->m_Stats.m_Format = STATS_TEXT;
+			}
+
+			else if(0 == stricmp(opt, "stats=json")) {
+				ctx->m_Stats.m_Format = STATS_JSON;
+			}
+
 
 			else {
 				switch(*opt) {
 				case '?':
-					help();
+					help(ctx);
 					break;
 
 				case 'I':	/* Add include directory */
+					if(MAX_SEARCHPATHS == ctx->m_Files.m_IncludeCount) {
+						fatal(ctx, "Too many include directories");
+					}
 					if(opt[1] == '=') {
-						includeDirectories[includeCount++] = &opt[2];
+						ctx->m_Files.m_IncludeDirs[ctx->m_Files.m_IncludeCount++] = &opt[2];
 					}
 					else {
-						includeDirectories[includeCount++] = &opt[2];
+						ctx->m_Files.m_IncludeDirs[ctx->m_Files.m_IncludeCount++] = &opt[2];
 					}
 					break;
 					break;
@@ -363,31 +392,42 @@ void Params(EnvContext *ctx, int argc, char **argv)
 					}
 
 					*ptr = 0;
-					BeginSegment(NULL, SEGMENT_DATA);
-					AddSymbol(NULL, symname, symval, SYM_VALUE, NULL, 0);
-					EndSegment(NULL);
+					BeginSegment(ctx, SEGMENT_DATA);
+					AddSymbol(ctx, symname, symval, SYM_VALUE, NULL, 0);
+					EndSegment(ctx);
 					break;
 
 				case 'C':	/* Case sensative labels */
 					break;
 
+				case 'j':	/* Job count for module lists */
+					break;
+
+				case 'P':	/* Directory of precompiled definitions */
+					if(EOS == opt[1]) {
+						flag = true;
+					} else {
+						ctx->m_Precomp.m_Dir = &opt[1];
+					}
+					break;
+
 				case 'O':	/* Set output directory */
 					if(opt[1] == '=') {
-						outputDirectory = &opt[2];
+						ctx->m_Files.m_OutputDirectory = &opt[2];
 					}
 
 					else {
-						outputDirectory = &opt[1];
+						ctx->m_Files.m_OutputDirectory = &opt[1];
 					}
 					break;
 
 				case 'o':
 					if(opt[1] == '=') {
-						outputFilename = &opt[2];
+						ctx->m_Files.m_OutputName = &opt[2];
 					}
 
 					else {
-						outputFilename = &opt[1];
+						ctx->m_Files.m_OutputName = &opt[1];
 					}
 					break;
 
@@ -398,21 +438,24 @@ void Params(EnvContext *ctx, int argc, char **argv)
 
 				/* check for misc and help options */
 				if(flag) {
-					banner();
-					fprintf(stderr, "[%s] ", argv[count]);
-					fprintf(stderr, "Invalid option.  Use -help or -? for a list of options\n\n");
-					exit(CRITICAL_USER);
+					banner(ctx);
+					fprintf(ctx->m_Err, "[%s] ", argv[count]);
+					fprintf(ctx->m_Err, "Invalid option.  Use -help or -? for a list of options\n\n");
+					AbortAssembly(ctx, CRITICAL_USER);
 				}
 			}
 
 		}else {
-			filelist[asmFileCount++] = argv[count];
+			if(MAX_FILES == ctx->m_Files.m_Count) {
+				fatal(ctx, "Too many files to assemble");
+			}
+			ctx->m_Files.m_List[ctx->m_Files.m_Count++] = argv[count];
 		}
 	}
 
-	if(asmFileCount == 0) {
-		Usage();
-		exit(ERR_GENERAL);
+	if(ctx->m_Files.m_Count == 0) {
+		Usage(ctx);
+		AbortAssembly(ctx, ERR_GENERAL);
 	}
 
 	if(MODBIN == ctx->m_OutputType) {
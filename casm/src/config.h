@@ -57,6 +57,9 @@ typedef enum {
 #ifdef _MSC_VER
 #pragma warning(disable: 4127)	/* Turn off warning for conditional expressions that are always true */
 #pragma warning(disable: 4100)	/* Turn off warning for arguments that are not used */
+#define THREAD_LOCAL	__declspec(thread)
+#else
+#define THREAD_LOCAL	__thread
 #endif
 
 
@@ -120,8 +123,13 @@ int strnicmp(const char *, const char *, size_t sz);
 #define EMIT_LIMIT	   4096		/* Size of emit buffer used before flushing to file */
 #define PMIT_LIMIT		 12		/* Bytes collected for listing */
 #define MAX_VAR_LENGTH	 16		/* Max macro variable name length */
+#define MAX_MACRO_DEPTH	1024	/* Max depth of macros opened inside macros */
+#define MAX_RELAX_PASSES	 32		/* Max relaxation passes before giving up */
 #define MAX_FCB_REPEATS	512		/* Maximum number of characters in an FCB repeating array */
 #define MAX_TITLESIZE	 64		/* Max characters allowed in title */
+#define MAX_DP_STACK	256		/* Max Direct Page values saved at once */
+#define MAX_SEGMENTS	 64		/* Max depth of the segment stack */
+#define MAX_RECORD_SIZE	32768	/* Largest record held by an output file */
 /*      Character Constants     */
 #define TAB		'\t'
 #define SPACE	' '
@@ -144,6 +152,14 @@ typedef enum {
 	CPU_6309
 } CPUTYPE;
 
+/* Placed here so that context.h can hold the segment stack */
+typedef enum {
+	SEGMENT_INVALID = -1,
+	SEGMENT_CODE,
+	SEGMENT_DATA,
+	SEGMENT_BSS,
+} SEGMENT;
+
 /* Output file types */
 typedef enum {
 	UNKNOWN = -1,
@@ -31,6 +31,8 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
+#include <setjmp.h>
+
 #include "config.h"
 #include "pseudo.h"
 
@@ -47,6 +49,19 @@ typedef enum {
 } ASM_MODE;
 
 
+typedef enum {
+	STATS_NONE,
+	STATS_TEXT,
+	STATS_JSON
+} STATS_FORMAT;
+
+
+#define STATS_PASS1		0			/* Pass 1									*/
+#define STATS_RELAX		1			/* All relaxation passes					*/
+#define STATS_PASS2		2			/* Pass 2									*/
+#define STATS_PASSES	3
+
+
 
 #define ASM_EDTASM		0x0001
 #define ASM_EDTASMX		0x0002
@@ -66,6 +81,7 @@ typedef struct {
 	OUTPUT_TYPE	m_OutputType;				/* File generation type						*/
 	int			m_Pass;					/* Which pass the assembler is on			*/
 	u_int32		m_LineNumber;			/* Line number of the current file			*/
+	int			m_LineCount;			/* Lines assembled in the current pass		*/
 	u_int32		m_CycleCount;			/* # of cycles per instruction				*/
 	u_int32		m_CycleTotal;			/* # of cycles seen so far					*/
 	bool		m_ForceWord;			/* Result should be a word when set			*/
@@ -126,9 +142,160 @@ typedef struct {
 		bool	N_page;					/* new page flag							*/
 		bool	OptFlag;				/* Display number of optimizable lines		*/
 		bool	OptShow;				/* Display lines that could be optimized	*/
+		u_int16	OptCount;				/* Lines that could be optimized			*/
+		int		Cpflag;					/* print cumulative cycles flag				*/
 	} m_Misc;
 
+	struct {
+		bool	m_Enabled;				/* Relax code until its size is stable		*/
+		bool	m_Active;				/* Current pass is a relaxation pass		*/
+		bool	m_Moved;				/* A symbol changed value during the pass	*/
+		int		m_Passes;				/* Number of relaxation passes made			*/
+		u_int32	m_Bytes;				/* Bytes emitted during the current pass	*/
+		int32	*m_Saved;				/* Symbol values from pass 1				*/
+	} m_Relax;
+
+	struct {
+		STATS_FORMAT	m_Format;		/* Report format, if any					*/
+		double	m_StartWall;			/* Elapsed time when the pass began			*/
+		double	m_StartCPU;				/* CPU time when the pass began				*/
+		int		m_StartLines;			/* Line count when the pass began			*/
+		struct {
+			double	m_Wall;				/* Elapsed time spent in the pass			*/
+			double	m_CPU;				/* CPU time spent in the pass				*/
+			u_int32	m_Lines;			/* Lines assembled in the pass				*/
+			int		m_Count;			/* Number of times the pass was made		*/
+		} m_Pass[STATS_PASSES];
+		double	m_ReadTime;				/* Time spent reading source files			*/
+		u_int32	m_FilesRead;			/* Source files read						*/
+		u_int32	m_BytesRead;			/* Bytes of source read						*/
+		u_int32	m_Lookups;				/* Symbol table lookups						*/
+		u_int32	m_Inserts;				/* Symbols added to the table				*/
+		u_int32	m_Probes;				/* Symbols compared during lookups			*/
+		u_int32	m_LongestProbe;			/* Most symbols compared in one lookup		*/
+		u_int32	m_MacroExpansions;		/* Macros expanded							*/
+	} m_Stats;
+
+
+
+	struct {
+		struct _symbol	**m_Table;		/* Hash table of symbols					*/
+		u_int32		m_TableSize;		/* Number of slots, a power of 2			*/
+		u_int32		m_Count;			/* Number of symbols in the table			*/
+		struct _symbol	**m_Sorted;		/* Symbols in order, built for listings		*/
+		struct _symarena *m_Arena;		/* Memory for symbols, names and lines		*/
+		int			m_LocalOccur;		/* occurance of local labels				*/
+		int			m_LocalCount;		/* local labels seen in this occurance		*/
+		char		m_NameSpace[MAX_LABELSIZE + 1];	/* Current namespace				*/
+	} m_Symbols;
+
+
+
+	struct {
+		char		**m_Argv;			/* Command line of the module				*/
+		char		*m_List[MAX_FILES];	/* Files to assemble						*/
+		u_int16		m_Count;			/* Number of files to assemble				*/
+		u_int16		m_Current;			/* Current file number 1...n				*/
+		char		*m_IncludeDirs[MAX_SEARCHPATHS];	/* Search paths for include		*/
+		int			m_IncludeCount;		/* Number of search paths					*/
+		char		*m_OutputDirectory;	/* Directory output files are written to	*/
+		char		*m_OutputName;		/* Name of the output file					*/
+		int			m_ROMSize;			/* Size of the output ROM					*/
+	} m_Files;
+
+	struct {
+		struct _inputfile	*m_Stack;	/* Files opened for input, 1...m_Count		*/
+		int			m_Count;			/* Number of files currently opened			*/
+	} m_Input;
+
+	struct {
+		u_int16		m_PC;				/* Program Counter							*/
+		u_int16		m_OldPC;			/* Program Counter at beginning of line		*/
+		u_int16		m_DP;				/* Direct Page contents assumption			*/
+		u_char		m_DPStack[MAX_DP_STACK];	/* Direct Page values saved			*/
+		int			m_DPStackPtr;		/* Number of Direct Page values saved		*/
+	} m_CPU;
+
+	struct {
+		struct _forwardref	*m_Refs;	/* Lines holding forward refs				*/
+		int			m_Size;				/* Entries allocated in m_Refs				*/
+		int			m_Count;			/* Next entry to match						*/
+		int			m_Max;				/* Entries recorded in pass 1				*/
+		u_int16		m_File;				/* File number of the next forward ref		*/
+		u_int32		m_Line;				/* Line of the next forward ref				*/
+	} m_FwdRefs;
+
+	struct {
+		struct _MacroArena	*m_Arena;	/* Memory for macros, names and lines		*/
+		struct _Macro	*m_Head;		/* Macros defined so far					*/
+		struct _Macro	*m_Tail;		/* Last macro defined						*/
+		struct _Macro	*m_Defining;	/* Macro being defined						*/
+		bool		m_Processing;		/* Processing a macro definition?			*/
+		struct _Macro	*m_Open;		/* Macro being expanded						*/
+		struct _MacroLine	*m_Line;	/* Next line of the macro being expanded	*/
+		bool		m_IsOpen;			/* Is a macro being expanded?				*/
+		u_int16		m_Occur;			/* Macro local label occurance				*/
+		struct _OpenedMacro	*m_Stack;	/* Expansions the open macro is nested in	*/
+		int			m_Depth;			/* Number of nested expansions				*/
+		int			m_StackSize;		/* Entries allocated in m_Stack				*/
+	} m_Macros;
+
+	struct {
+		struct _struct	*m_Head;		/* Structures defined so far				*/
+		struct _struct	*m_Tail;		/* Structure being defined					*/
+		struct _struct	*m_LastFound;	/* Structure found by the last lookup		*/
+		struct _struct	*m_Union;		/* Union being defined						*/
+		struct _struct	*m_Unions;		/* Unions defined so far					*/
+		bool		m_InStruct;			/* Declaring structure data?				*/
+		bool		m_Defining;			/* Adding elements to m_Tail?				*/
+	} m_Structs;
+
+	struct {
+		struct _Export	*m_List;		/* Symbols exported by a loadable module	*/
+		struct _Export	*m_Tail;		/* Last export in the list					*/
+		int			m_Count;			/* Number of exports						*/
+		int			m_MMUPage;			/* MMU page of the module, or -1			*/
+		u_int16		m_Address;			/* Address of the module					*/
+	} m_Exports;
+
+	struct {
+		const char	*m_Dir;				/* Directory of precompiled definitions		*/
+		bool		m_Enabled;			/* Definitions are loaded and saved			*/
+		struct _PrecompUse	*m_Use;		/* Innermost include being recorded			*/
+		struct _PrecompSkip	*m_Skips;	/* Includes pass 1 loaded, for pass 2		*/
+		int			m_SkipCount;		/* Entries used in m_Skips					*/
+		int			m_SkipSize;			/* Entries allocated in m_Skips				*/
+		int			m_NextSkip;			/* Next entry to match						*/
+		u_int32		m_Ordinal;			/* Includes both passes made so far			*/
+		int			m_PassOnly;			/* Open includes only one pass makes		*/
+	} m_Precomp;
+
+	struct {
+		const struct _OutputIFace	*m_Gen;	/* File generation interface			*/
+		FILE		*m_File;			/* Output file								*/
+		SEGMENT		m_Segments[MAX_SEGMENTS];	/* Segment stack					*/
+		int			m_SegmentCount;		/* Current segment stack pointer			*/
+		u_int16		m_PC;				/* PC at beginning of the held record		*/
+		u_int16		m_Total;			/* Number of bytes held						*/
+		u_int32		m_CRC;				/* CRC of an OS-9 module					*/
+		u_char		m_Bytes[MAX_RECORD_SIZE];	/* Emitted bytes held for a record	*/
+	} m_Output;
+
+	struct {
+		const struct _mneumonic	**m_Slots;	/* Entry for each slot, or NULL			*/
+		u_int32		*m_Displace;		/* Displacement for each bucket				*/
+		u_int32		m_SlotCount;		/* Number of slots, a power of 2			*/
+		int			m_SlotShift;		/* Shift that leaves a slot number			*/
+		u_int32		m_BucketCount;		/* Number of buckets, a power of 2			*/
+		u_int16		m_Mask;				/* Compatibility mask of the table			*/
+		CPUTYPE		m_CPU;				/* CPU type of the table					*/
+	} m_Opcodes;
+
 
+	FILE		*m_Out;					/* Listings and symbol tables				*/
+	FILE		*m_Err;					/* Messages, errors and warnings			*/
+	jmp_buf		*m_Abort;				/* Where a fatal error ends the module		*/
+	int			m_ExitCode;				/* Exit code of a module that was ended		*/
 
 	const char	*m_Line;				/* Pointer to the full buffered line		*/
 	const char	*m_Label;				/* Pointer to the label for the line		*/
@@ -32,90 +32,82 @@
 #include "error.h"
 #include "util.h"
 
-#define MAX_DP_STACK	256
 
-static u_int16	regtenPC;                  	/* Program Counter              		*/
-static u_int16	regtenOldPC;              	/* Program Counter at beginning 		*/
-static u_int16	regtenDP;				/* storage to DP contents assumption 	*/
-static u_char	dpStack[MAX_DP_STACK];
-static int		dpStackPtr = 0;
-
-
-void SetDPReg(const u_char val)
+void SetDPReg(EnvContext *ctx, const u_char val)
 {
-	regtenDP = (val & 0xff);
+	ctx->m_CPU.m_DP = (val & 0xff);
 }
 
 
-void InitCPU(void)
+void InitCPU(EnvContext *ctx)
 {
-	SetPCReg(0);
-	SetOldPCReg(0);
-	regtenDP = 0x0000;
-	dpStackPtr = 0;
+	SetPCReg(ctx, 0);
+	SetOldPCReg(ctx, 0);
+	ctx->m_CPU.m_DP = 0x0000;
+	ctx->m_CPU.m_DPStackPtr = 0;
 }
 
 
-u_char GetDPReg(void)
+u_char GetDPReg(EnvContext *ctx)
 {
-	return lobyte(regtenDP);
+	return lobyte(ctx->m_CPU.m_DP);
 }
 
-void SetPCReg(const u_int16 val)
+void SetPCReg(EnvContext *ctx, const u_int16 val)
 {
-	regtenPC = val;
+	ctx->m_CPU.m_PC = val;
 }
 
-void SetOldPCReg(const u_int16 val)
+void SetOldPCReg(EnvContext *ctx, const u_int16 val)
 {
-	regtenOldPC = val;
+	ctx->m_CPU.m_OldPC = val;
 }
 
-u_int16 GetPCReg(void)
+u_int16 GetPCReg(EnvContext *ctx)
 {
-	return regtenPC;
+	return ctx->m_CPU.m_PC;
 }
 
 
-u_int16 GetOldPCReg(void)
+u_int16 GetOldPCReg(EnvContext *ctx)
 {
-	return regtenOldPC;
+	return ctx->m_CPU.m_OldPC;
 }
 
-u_int16 BumpPCReg(const u_int16 val)
+u_int16 BumpPCReg(EnvContext *ctx, const u_int16 val)
 {
-	regtenPC = regtenPC + val;
-	return regtenPC;
+	ctx->m_CPU.m_PC = ctx->m_CPU.m_PC + val;
+	return ctx->m_CPU.m_PC;
 }
 
 void PushDPReg(EnvContext *ctx)
 {
-	if(dpStackPtr >= MAX_DP_STACK) {
+	if(ctx->m_CPU.m_DPStackPtr >= MAX_DP_STACK) {
 		error(ctx, ERR_GENERAL, "too many Direct Page values saved");
 	} else {
-		dpStack[dpStackPtr] = (u_char)GetDPReg();
+		ctx->m_CPU.m_DPStack[ctx->m_CPU.m_DPStackPtr] = (u_char)GetDPReg(ctx);
 	}
 
-	dpStackPtr++;
+	ctx->m_CPU.m_DPStackPtr++;
 }
 
 void PopDPReg(EnvContext *ctx)
 {
-	if(0 == dpStackPtr) {
+	if(0 == ctx->m_CPU.m_DPStackPtr) {
 		warning(ctx, WARN_DPSTACK, "no DP value has been saved : value of DP remains unchanged");
 	} else {
 
 		/* Restore DP only if it's within the stack */
-		if(dpStackPtr < MAX_DP_STACK) {
-			SetDPReg(dpStack[dpStackPtr]);
+		if(ctx->m_CPU.m_DPStackPtr < MAX_DP_STACK) {
+			SetDPReg(ctx, ctx->m_CPU.m_DPStack[ctx->m_CPU.m_DPStackPtr]);
 		}
 
-		dpStackPtr--;
+		ctx->m_CPU.m_DPStackPtr--;
 	}
 }
 
 
-bool IsAddressInDirectPage(const u_int16 addr)
+bool IsAddressInDirectPage(EnvContext *ctx, const u_int16 addr)
 {
-	return(hibyte(addr) == GetDPReg());
+	return(hibyte(addr) == GetDPReg(ctx));
 }
@@ -125,17 +125,17 @@ typedef enum {
 
 
 
-void InitCPU(void);
-u_int16 BumpPCReg(const u_int16 val);
-u_char GetDPReg();
-u_int16 GetPCReg(void);
-u_int16 GetOldPCReg(void);
-void SetPCReg(const u_int16 val);
-void SetOldPCReg(const u_int16 val);
-void SetDPReg(const u_char val);
+void InitCPU(EnvContext *ctx);
+u_int16 BumpPCReg(EnvContext *ctx, const u_int16 val);
+u_char GetDPReg(EnvContext *ctx);
+u_int16 GetPCReg(EnvContext *ctx);
+u_int16 GetOldPCReg(EnvContext *ctx);
+void SetPCReg(EnvContext *ctx, const u_int16 val);
+void SetOldPCReg(EnvContext *ctx, const u_int16 val);
+void SetDPReg(EnvContext *ctx, const u_char val);
 void PushDPReg(EnvContext *ctx);
 void PopDPReg(EnvContext *ctx);
-bool IsAddressInDirectPage(const u_int16 addr);
+bool IsAddressInDirectPage(EnvContext *ctx, const u_int16 addr);
 
 
 #endif	/* CPU_H */
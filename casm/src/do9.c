@@ -86,7 +86,7 @@ static void ProcGroup2(EnvContext *ctx, const Mneumonic *op)
 
 	Evaluate(ctx, &result, EVAL_NORMAL, NULL);
 
-	if(true == ctx->m_ForceByte || (false == ctx->m_ForceWord && true == IsAddressInDirectPage(loword(result)))) {
+	if(true == ctx->m_ForceByte || (false == ctx->m_ForceWord && true == IsAddressInDirectPage(ctx, loword(result)))) {
 		EmitOpCode(ctx, op, 0);
 		EmitOpDataByte(ctx, lobyte(result));
 		ctx->m_CycleCount += 2;
@@ -32,18 +32,48 @@
 #include "as.h"
 #include "input.h"
 
+/*----------------------------------------------------------------------------
+	AbortAssembly --- stop assembling the module
+
+	A module assembled as part of a batch shares the process with the
+	others, so it unwinds to its driver instead of exiting.
+----------------------------------------------------------------------------*/
+NORETURN void AbortAssembly(EnvContext *ctx, int code)
+{
+	if(NULL != ctx && NULL != ctx->m_Abort) {
+		ctx->m_ExitCode = code;
+		longjmp(*ctx->m_Abort, 1);
+	}
+	exit(code);
+}
+
+
+/*----------------------------------------------------------------------------
+	ErrorStream --- stream messages about a module are written to
+----------------------------------------------------------------------------*/
+static FILE *ErrorStream(EnvContext *ctx)
+{
+	if(NULL == ctx || NULL == ctx->m_Err) {
+		return stderr;
+	}
+	return ctx->m_Err;
+}
+
+
 /*----------------------------------------------------------------------------
 	fatal --- fatal error handler
 ----------------------------------------------------------------------------*/
 
 NORETURN static void dofatal(EnvContext *ctx, int error, const char *fmt, va_list list)
 {
-	if(GetOpenFileCount() > 0 && NULL != ctx) {
-		fprintf(stderr, "%s(%lu) : ", GetCurrentFilePathname(), ctx->m_LineNumber);
+	FILE *err = ErrorStream(ctx);
+
+	if(NULL != ctx && GetOpenFileCount(ctx) > 0) {
+		fprintf(err, "%s(%lu) : ", GetCurrentFilePathname(ctx), ctx->m_LineNumber);
 	}
-	vfprintf(stderr, fmt, list);
-	fprintf(stderr, "\n");
-	exit(CRITICAL_FATAL);
+	vfprintf(err, fmt, list);
+	fprintf(err, "\n");
+	AbortAssembly(ctx, CRITICAL_FATAL);
 }
 
 NORETURN void fatal(EnvContext *ctx, const char *str, ...)
@@ -59,25 +89,31 @@ NORETURN void fatal(EnvContext *ctx, const char *str, ...)
 /*----------------------------------------------------------------------------
 	error --- error in a line. print line number and error
 ----------------------------------------------------------------------------*/
-const char *internal_fname;
-int internal_lineno;
+THREAD_LOCAL const char *internal_fname;
+THREAD_LOCAL int internal_lineno;
 NORETURN void internal_ex(EnvContext *ctx, const char *fmt, ...)
 {
 	va_list list;
+	FILE *err = ErrorStream(ctx);
 
 	va_start(list, fmt);
 
 	if(NULL != ctx) {
-		fprintf(stderr, "%s\n", ctx->m_Line);
+		if(NULL != ctx->m_Line) {
+			fprintf(err, "%s\n", ctx->m_Line);
+		}
+		if(GetOpenFileCount(ctx) > 0) {
+			fprintf(err, "%s(%lu) : ", GetCurrentFilePathname(ctx), ctx->m_LineNumber);
+		}
 	}
-	fprintf(stderr, "%s(%lu) : Internal assembler error: ", GetCurrentFilePathname(), ctx->m_LineNumber);
-	vfprintf(stderr, fmt, list);
-	fputc('\n', stderr);
+	fprintf(err, "Internal assembler error: ");
+	vfprintf(err, fmt, list);
+	fputc('\n', err);
 	if(NULL != internal_fname) {
-		fprintf(stderr, "casm file %s line %d\n", internal_fname, internal_lineno);
+		fprintf(err, "casm file %s line %d\n", internal_fname, internal_lineno);
 	}
-	fprintf(stderr, "\n");
-	exit(CRITICAL_INTER);
+	fprintf(err, "\n");
+	AbortAssembly(ctx, CRITICAL_INTER);
 }
 
 
@@ -88,50 +124,59 @@ NORETURN void internal_ex(EnvContext *ctx, const char *fmt, ...)
 void error(EnvContext *ctx, ERROR_NUMBER errnum, const char *str, ...)
 {
 	va_list list;
+	FILE *err = ErrorStream(ctx);
 
 
+	/* Relaxation passes are repeated by the final pass, which reports errors */
+	if(NULL != ctx && true == ctx->m_Relax.m_Active) {
+		return;
+	}
+
 	va_start(list, str);
 
 	if(NULL != ctx) {
-		fprintf(stderr, "%s(%lu) : error A%4d : ", GetCurrentFilePathname(), ctx->m_LineNumber, errnum + 2100);
+		fprintf(err, "%s(%lu) : error A%4d : ", GetCurrentFilePathname(ctx), ctx->m_LineNumber, errnum + 2100);
 	}
 
 	
 	switch(errnum) {
 	case ERR_SYNTAX:
-		fprintf(stderr, "syntax error : ");
+		fprintf(err, "syntax error : ");
 		break;
 
 	case ERR_INVALID_MODE_FOR_OPERATION:
-		fprintf(stderr, "invalid mode for operation : ");
+		fprintf(err, "invalid mode for operation : ");
 		break;
 
 	case ERR_PHASING:
-		fprintf(stderr, "phasing error : ");
+		fprintf(err, "phasing error : ");
 		break;
 
 	case ERR_INVALID_REG_FOR_OPERATION:
-		fprintf(stderr, "invalid register ");
+		fprintf(err, "invalid register ");
 		break;
 
 	case ERR_INVALID_MODE_FOR_REGISTER:
-		fprintf(stderr, "invalid mode for register : ");
+		fprintf(err, "invalid mode for register : ");
 		break;
 
 	case ERR_MISMATCHED_COND:
-		fprintf(stderr, "mismatched conditional directive : ");
+		fprintf(err, "mismatched conditional directive : ");
 		break;
 
 	default:
 		break;
 	}
 
-	vfprintf(stderr, str, list);
-	fputc('\n', stderr);
+	vfprintf(err, str, list);
+	fputc('\n', err);
 
-	if(NULL != ctx) {
-		fprintf(stderr, "%s\n", ctx->m_Line);
-	}	ctx->m_ErrorCount++;
+	if(NULL == ctx) {
+		return;
+	}
+
+	fprintf(err, "%s\n", ctx->m_Line);
+	ctx->m_ErrorCount++;
 
 	if(ctx->m_ErrorCount > MAX_ERRORS) {
 		va_list list;
@@ -166,12 +211,16 @@ void warning(EnvContext *ctx, WARNING_NUMBER warn, const char *str, ...)
 		return;    /* if not listing, don't */
 	}
 
+	if(true == ctx->m_Relax.m_Active) {
+		return;
+	}
+
 	va_start(list, str);
 
 	/* repeat the warnings   */
-	fprintf(stderr, "%s(%lu): warning : ", GetCurrentFilePathname(), ctx->m_LineNumber);
-	vfprintf(stderr, str, list);
-	fprintf(stderr, "\n");
+	fprintf(ctx->m_Err, "%s(%lu): warning : ", GetCurrentFilePathname(ctx), ctx->m_LineNumber);
+	vfprintf(ctx->m_Err, str, list);
+	fprintf(ctx->m_Err, "\n");
 	ctx->m_WarningCount++;
 }
 
@@ -181,12 +230,12 @@ void warning(EnvContext *ctx, WARNING_NUMBER warn, const char *str, ...)
 ----------------------------------------------------------------------------*/
 void note(EnvContext *ctx, const char *str, ...)
 {
-	if(true == ctx->m_ListingFlags.m_OptEnabled && 2 == ctx->m_Pass) {
+	if(true == ctx->m_ListingFlags.m_OptEnabled && 2 == ctx->m_Pass && false == ctx->m_Relax.m_Active) {
 		va_list list;
 		va_start(list, str);
 
-		fprintf(stderr, "%s(%lu): note : ", GetCurrentFilePathname(), ctx->m_LineNumber);
-		vfprintf(stderr, str, list);
-		fprintf(stderr, "\n");
+		fprintf(ctx->m_Err, "%s(%lu): note : ", GetCurrentFilePathname(ctx), ctx->m_LineNumber);
+		vfprintf(ctx->m_Err, str, list);
+		fprintf(ctx->m_Err, "\n");
 	}
 }
@@ -98,8 +98,8 @@ typedef enum {
 } WARNING_NUMBER;
 
 NORETURN void internal_ex(EnvContext *ctx, const char *str, ...);
-extern const char *internal_fname;
-extern int internal_lineno;
+extern THREAD_LOCAL const char *internal_fname;
+extern THREAD_LOCAL int internal_lineno;
 #define internal(x)	\
 	{ internal_fname = __FILE__;\
 	  internal_lineno = __LINE__;\
@@ -107,6 +107,7 @@ extern int internal_lineno;
 #define ASSERTX(x)		if(!(x)) { internal((ctx, "%s", #x)); }
 
 
+NORETURN void AbortAssembly(EnvContext *ctx, int code);
 NORETURN void fatal(EnvContext *ctx, const char *str, ...);
 void error(EnvContext *ctx, const ERROR_NUMBER errorno, const char *str, ...);
 void warning(EnvContext *ctx, const WARNING_NUMBER warn, const char *str, ...);
@@ -366,8 +366,6 @@ static bool GetEvalTerm(EnvContext *ctx,
 	bool	hasError;
 
 	Symbol *sym;
-	Line *pnt;
-	Line *bpnt;
 
 	hasError = false;
 	*retResult = 0;
@@ -416,7 +414,7 @@ static bool GetEvalTerm(EnvContext *ctx,
 
 			else {
 				ctx->m_Ptr++;
-				stct = StructLookup(structName);
+				stct = StructLookup(ctx, structName);
 				if(NULL == stct) {
 					error(ctx, ERR_UNDEFINED, "'%s' is not defined or was not declared as a structure", structName);
 					hasError = true;
@@ -486,7 +484,7 @@ static bool GetEvalTerm(EnvContext *ctx,
 	/* current location counter */
 	else if('*' == *ctx->m_Ptr) {	
 		ctx->m_Ptr++;
-		val = GetOldPCReg();
+		val = GetOldPCReg(ctx);
 	}
 	
 	
@@ -599,24 +597,8 @@ static bool GetEvalTerm(EnvContext *ctx,
 			}
 
 
-			if (ctx->m_Pass == 2) {
-				pnt = sym->L_list;
-				bpnt = NULL;
-
-				while (pnt != NULL) {
-					bpnt = pnt;
-					pnt = pnt->next;
-				}
-
-				pnt = (Line*)AllocMem(sizeof(Line));
-				if (bpnt == NULL) {
-					sym->L_list = pnt;
-				} else {
-					bpnt->next = pnt;
-				}
-
-				pnt->L_num = ctx->m_LineNumber;
-				pnt->next = NULL;
+			if (ctx->m_Pass == 2 && false == ctx->m_Relax.m_Active) {
+				AddSymbolLine(ctx, sym, ctx->m_LineNumber);
 			}
 
 			val = offset;
@@ -631,7 +613,7 @@ static bool GetEvalTerm(EnvContext *ctx,
 			}
 		}
 		
-		else if(2 == ctx->m_Pass && true == FwdRefIsRecord(ctx->m_LineNumber, Cfn)) {
+		else if(2 == ctx->m_Pass && true == FwdRefIsRecord(ctx, ctx->m_LineNumber, ctx->m_Files.m_Current)) {
 			if(false == ctx->m_ForceByte) {
 				ctx->m_ForceWord = true;
 			}
@@ -31,23 +31,32 @@
 #include "as.h"
 #include "proto.h"
 
-static Export	*exportList = NULL;
-static Export	*exportTail = NULL;
-static int		exportCount = 0;
-static int		exportMMUPage = -1;
-static u_int16	exportAddress;
-
-
-void SetExportAddress(const int mmuPage, const u_int16 address)
+void SetExportAddress(EnvContext *ctx, const int mmuPage, const u_int16 address)
 {
-	exportMMUPage = mmuPage;
-	exportAddress = address;
+	ctx->m_Exports.m_MMUPage = mmuPage;
+	ctx->m_Exports.m_Address = address;
 }
 
 void InitExports(EnvContext *ctx)
 {
 	ASSERT(MODBIN == ctx->m_OutputType);
-	AddExport(NULL, "initmod");
+	AddExport(ctx, "initmod");
+}
+
+void ReleaseExports(EnvContext *ctx)
+{
+	Export *exp;
+
+	while(NULL != (exp = ctx->m_Exports.m_List)) {
+		ctx->m_Exports.m_List = exp->next;
+		free(exp->name);
+		free(exp);
+	}
+
+	ctx->m_Exports.m_Tail = NULL;
+	ctx->m_Exports.m_Count = 0;
+	ctx->m_Exports.m_MMUPage = -1;
+	ctx->m_Exports.m_Address = 0;
 }
 
 void AddExport(EnvContext *ctx, const char *name)
@@ -57,10 +66,10 @@ void AddExport(EnvContext *ctx, const char *name)
 	ASSERTX(1 == ctx->m_Pass);
 
 	/* See if the export already exists */
-	exp = exportList;
+	exp = ctx->m_Exports.m_List;
 	while(NULL != exp) {
 		if(0 == strcmp(exp->name, name)) {
-			warning(ctx, WARN_DBLEXPORT, "%s already exported");
+			warning(ctx, WARN_DBLEXPORT, "%s already exported", name);
 			return;
 		}
 		exp = exp->next;
@@ -76,15 +85,15 @@ void AddExport(EnvContext *ctx, const char *name)
 
 
 	/* Add it to the list */
-	if(NULL == exportTail) {
-		exportList = exp;
-		exportTail = exp;
+	if(NULL == ctx->m_Exports.m_Tail) {
+		ctx->m_Exports.m_List = exp;
+		ctx->m_Exports.m_Tail = exp;
 	} else {
-		exportTail->next = exp;
-		exportTail = exp;
+		ctx->m_Exports.m_Tail->next = exp;
+		ctx->m_Exports.m_Tail = exp;
 	}
 
-	exportCount++;
+	ctx->m_Exports.m_Count++;
 }
 
 
@@ -100,22 +109,22 @@ void EmitExports(EnvContext *ctx, FILE *output)
 
 	ASSERTX(MODBIN == ctx->m_OutputType);
 
-	if(-1 == exportMMUPage) {
+	if(-1 == ctx->m_Exports.m_MMUPage) {
 		fputc(0x00, output);
 		fputc(0x00, output);
 	} else {
 		fputc(0xff, output);
-		fputc(exportMMUPage, output);
+		fputc(ctx->m_Exports.m_MMUPage, output);
 	}
-	EmitExportWord(output, exportAddress);
-	EmitExportWord(output, loword(exportCount));
+	EmitExportWord(output, ctx->m_Exports.m_Address);
+	EmitExportWord(output, loword(ctx->m_Exports.m_Count));
 
 	/* Write the exports */
-	exp = exportList;
+	exp = ctx->m_Exports.m_List;
 	while(NULL != exp) {
 		Symbol *sym;
 
-		sym = FindSymbol(NULL, exp->name, true, true);
+		sym = FindSymbol(ctx, exp->name, true, true);
 		if(NULL == sym) {
 			error(ctx, ERR_UNDEFINED, "symbol '%s' was declared for export but is not defined", exp->name);
 		} else {
@@ -30,26 +30,21 @@
 *****************************************************************************/
 #include "as.h"
 #include "proto.h"
+#include "util.h"
 
 
-#define MAX_FORWARD_REFS	32768
+#define FORWARD_REFS_START	1024			/* Forward refs allocated at first		*/
 
-typedef struct {
+typedef struct _forwardref {
 	u_int16		cfn;
 	u_int32		line;
 } ForwardRef;
 
-static ForwardRef refs[MAX_FORWARD_REFS];
-static int		refsCount = 0;
-static int		refsMax = 0;
-static u_int16	Ffn = 0;						/* forward ref file #					*/
-static u_int32	F_ref = 0;						/* next line with forward ref			*/
 
 
-
-bool FwdRefIsRecord(const u_int32 lineNumber, const int fileno)
+bool FwdRefIsRecord(EnvContext *ctx, const u_int32 lineNumber, const int fileno)
 {
-	if(lineNumber == F_ref && fileno == Ffn) {
+	if(lineNumber == ctx->m_FwdRefs.m_Line && fileno == ctx->m_FwdRefs.m_File) {
 		return true;
 	}
 	return false;
@@ -57,10 +52,14 @@ bool FwdRefIsRecord(const u_int32 lineNumber, const int fileno)
 }
 
 
-void FwdRefInit(void)
+void FwdRefInit(EnvContext *ctx)
 {
-	refsCount = 0;
-	refsMax = 0;
+	ctx->m_FwdRefs.m_Refs = NULL;
+	ctx->m_FwdRefs.m_Size = 0;
+	ctx->m_FwdRefs.m_Count = 0;
+	ctx->m_FwdRefs.m_Max = 0;
+	ctx->m_FwdRefs.m_File = 0;
+	ctx->m_FwdRefs.m_Line = 0;
 }
 
 /*
@@ -68,8 +67,8 @@ void FwdRefInit(void)
  */
 void FwdRefReinit(EnvContext *ctx)
 {
-	refsCount = 0;
-	if(0 != refsMax) {
+	ctx->m_FwdRefs.m_Count = 0;
+	if(0 != ctx->m_FwdRefs.m_Max) {
 		FwdRefNext(ctx);
 	}
 }
@@ -79,12 +78,24 @@ void FwdRefReinit(EnvContext *ctx)
  */
 void FwdRefMark(EnvContext *ctx)
 {
-	ASSERT(refsCount < MAX_FORWARD_REFS);
-	refs[refsCount].cfn = Cfn;
-	refs[refsCount].line = ctx->m_LineNumber;
+	ForwardRef *ref;
+
+	if(ctx->m_FwdRefs.m_Count == ctx->m_FwdRefs.m_Size) {
+		ctx->m_FwdRefs.m_Size = (0 == ctx->m_FwdRefs.m_Size ? FORWARD_REFS_START : ctx->m_FwdRefs.m_Size * 2);
+		ctx->m_FwdRefs.m_Refs = (ForwardRef *)ReallocMem(ctx->m_FwdRefs.m_Refs, ctx->m_FwdRefs.m_Size * sizeof(ForwardRef));
+	}
+
+	ref = &ctx->m_FwdRefs.m_Refs[ctx->m_FwdRefs.m_Count];
+	ref->cfn = ctx->m_Files.m_Current;
+	ref->line = ctx->m_LineNumber;
+
+	ctx->m_FwdRefs.m_Count++;
+	ctx->m_FwdRefs.m_Max++;
 
-	refsCount++;
-	refsMax++;
+	/* Pass 2 has to see the value of a forward reference */
+	if(NULL != ctx->m_Precomp.m_Use) {
+		PrecompVeto(ctx);
+	}
 }
 
 /*
@@ -92,19 +103,26 @@ void FwdRefMark(EnvContext *ctx)
  */
 void FwdRefNext(EnvContext *ctx)
 {
-	ASSERTX(refsCount <= refsMax);
-	Ffn = refs[refsCount].cfn;
-	F_ref = refs[refsCount].line;
-	refsCount++;
+	ASSERTX(ctx->m_FwdRefs.m_Count <= ctx->m_FwdRefs.m_Max);
+	if(ctx->m_FwdRefs.m_Count < ctx->m_FwdRefs.m_Max) {
+		ctx->m_FwdRefs.m_File = ctx->m_FwdRefs.m_Refs[ctx->m_FwdRefs.m_Count].cfn;
+		ctx->m_FwdRefs.m_Line = ctx->m_FwdRefs.m_Refs[ctx->m_FwdRefs.m_Count].line;
+	} else {
+		/* Past the last one, nothing more to match */
+		ctx->m_FwdRefs.m_File = 0;
+		ctx->m_FwdRefs.m_Line = 0;
+	}
+	ctx->m_FwdRefs.m_Count++;
 }
 
 /*
- *  FwdRefDone --- closes & deletes forward reference file
+ *  FwdRefDone --- releases the forward reference list
  */
-void FwdRefDone(void)
+void FwdRefDone(EnvContext *ctx)
 {
-	refsCount = 0;
-	refsMax = 0;
+	free(ctx->m_FwdRefs.m_Refs);
+	ctx->m_FwdRefs.m_Refs = NULL;
+	ctx->m_FwdRefs.m_Size = 0;
+	ctx->m_FwdRefs.m_Count = 0;
+	ctx->m_FwdRefs.m_Max = 0;
 }
-
-
@@ -28,6 +28,8 @@
 	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 
 *****************************************************************************/
+#include <pthread.h>
+
 #include "as.h"
 #include "proto.h"
 #include "os9.h"
@@ -41,10 +43,32 @@ typedef struct {
 	char	ext[MAXEXT];
 } PATH;
 
-typedef struct {
-	PATH	path;
-	FILE	*file;
-	int		line_num;
+/*
+ *	Source files are read once and kept in memory for the rest of the run,
+ *	so the second pass and repeated includes do not go back to the disk.
+ *	Text files are split into a line index when they are loaded.  The cache
+ *	is shared by every module assembled in the process; an entry is never
+ *	changed once it is in the list, so only adding to the list is locked.
+ */
+typedef struct SourceFile {
+	struct SourceFile	*m_Next;
+	char				*m_Name;		/* path the file was opened with */
+	bool				m_Binary;
+	char				*m_Data;
+	size_t				m_Size;
+	size_t				*m_LineStart;	/* offset of each line */
+	size_t				*m_LineLength;	/* length of each line, without its terminator */
+	int					m_LineCount;
+	bool				m_Unterminated;	/* last line runs into end of file */
+} SourceFile;
+
+typedef struct _inputfile {
+	PATH		path;
+	SourceFile	*source;
+	int			next_line;				/* next line to read from the source */
+	size_t		line_offset;			/* characters of that line already read */
+	size_t		byte_offset;			/* position for byte reads */
+	int			line_num;
 } RECUR_FILES;
 
 
@@ -55,18 +79,252 @@ typedef struct {
 	 char ext[MAXEXT];
 } DIRDEF;
 
-static FILE			*inputFile = NULL;				/* Current input file structure			*/
-static RECUR_FILES	openedFiles[FILE_DEPTH];		/* recursive file list 				*/
-static PATH			curfilepath;					/* split path information of current file */
-static int			filecount = 0;					/* number of files currently opened		*/
+static SourceFile		*sourceFiles = NULL;		/* files loaded so far 					*/
+static pthread_mutex_t	sourceLock = PTHREAD_MUTEX_INITIALIZER;	/* guards sourceFiles		*/
 
 
-int GetCurrentInputFileSize()
+/*
+ *	IndexSource --- split a text file into lines
+ *
+ *	A line ends at "\n", "\n\r" or "\r", which is how lines were read
+ *	from the file a character at a time.
+ */
+static bool IndexSource(SourceFile *src)
 {
-	return (NULL == inputFile ? 0 : filelength(fileno(inputFile)));
+	size_t	pos, start;
+	int		max;
+
+	max = 0;
+	start = 0;
+
+	for(pos = 0; pos <= src->m_Size; pos++) {
+		bool eol;
+
+		eol = (pos == src->m_Size || '\n' == src->m_Data[pos] || '\r' == src->m_Data[pos]);
+		if(false == eol) {
+			continue;
+		}
+
+		/* A final "\n" ends the file rather than starting an empty line */
+		if(pos == start && (pos == src->m_Size || ('\n' == src->m_Data[pos] && pos + 1 == src->m_Size))) {
+			break;
+		}
+
+		if(src->m_LineCount == max) {
+			size_t *ns, *nl;
+
+			max = (0 == max ? 1024 : max * 2);
+			ns = (size_t *)realloc(src->m_LineStart, max * sizeof(size_t));
+			nl = (size_t *)realloc(src->m_LineLength, max * sizeof(size_t));
+			if(NULL != ns) {
+				src->m_LineStart = ns;
+			}
+			if(NULL != nl) {
+				src->m_LineLength = nl;
+			}
+			if(NULL == ns || NULL == nl) {
+				return false;
+			}
+		}
+
+		src->m_LineStart[src->m_LineCount] = start;
+		src->m_LineLength[src->m_LineCount] = pos - start;
+		src->m_LineCount++;
+
+		if(pos == src->m_Size || ('\n' == src->m_Data[pos] && pos + 1 == src->m_Size)) {
+			src->m_Unterminated = true;
+			break;
+		}
+
+		if('\n' == src->m_Data[pos] && pos + 1 < src->m_Size && '\r' == src->m_Data[pos + 1]) {
+			pos++;
+		}
+
+		start = pos + 1;
+	}
+
+	return true;
 }
 
 
+/*
+ *	FindSource --- find a file in the source cache
+ */
+static SourceFile *FindSource(const char *filename, const bool binary)
+{
+	SourceFile	*src;
+
+	pthread_mutex_lock(&sourceLock);
+	for(src = sourceFiles; NULL != src; src = src->m_Next) {
+		if(src->m_Binary == binary && 0 == strcmp(src->m_Name, filename)) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sourceLock);
+
+	return src;
+}
+
+
+static void FreeSource(SourceFile *src)
+{
+	free(src->m_LineLength);
+	free(src->m_LineStart);
+	free(src->m_Data);
+	free(src->m_Name);
+	free(src);
+}
+
+
+/*
+ *	LoadSource --- find a file in the source cache, reading it in if needed
+ *
+ *	The file is read without holding the lock, so another module may load
+ *	the same file meanwhile.  The first copy added to the cache is kept.
+ *	*loaded is set when this call read the file from the disk.
+ */
+static SourceFile *LoadSource(const char *filename, const bool binary, bool *loaded)
+{
+	SourceFile	*src;
+	SourceFile	*other;
+	FILE		*fp;
+	size_t		max, count;
+
+	*loaded = false;
+
+	src = FindSource(filename, binary);
+	if(NULL != src) {
+		return src;
+	}
+
+	fp = fopen(filename, true == binary ? "rb" : "r");
+	if(NULL == fp) {
+		return NULL;
+	}
+
+	src = (SourceFile *)calloc(1, sizeof(SourceFile));
+	if(NULL == src) {
+		fclose(fp);
+		return NULL;
+	}
+
+	src->m_Binary = binary;
+	src->m_Name = (char *)malloc(strlen(filename) + 1);
+	if(NULL != src->m_Name) {
+		strcpy(src->m_Name, filename);
+	}
+
+	/* Text mode reads may come up short of the file length, so read until EOF */
+	max = 0;
+	do {
+		char *data;
+
+		if(src->m_Size == max) {
+			max = (0 == max ? 65536 : max * 2);
+			data = (char *)realloc(src->m_Data, max);
+			if(NULL == data) {
+				break;
+			}
+			src->m_Data = data;
+		}
+
+		count = fread(src->m_Data + src->m_Size, 1, max - src->m_Size, fp);
+		src->m_Size += count;
+	} while(0 != count);
+
+	fclose(fp);
+
+	if(NULL == src->m_Name || NULL == src->m_Data || (false == binary && false == IndexSource(src))) {
+		FreeSource(src);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&sourceLock);
+	for(other = sourceFiles; NULL != other; other = other->m_Next) {
+		if(other->m_Binary == binary && 0 == strcmp(other->m_Name, filename)) {
+			break;
+		}
+	}
+
+	if(NULL == other) {
+		src->m_Next = sourceFiles;
+		sourceFiles = src;
+		*loaded = true;
+	}
+	pthread_mutex_unlock(&sourceLock);
+
+	if(NULL != other) {
+		FreeSource(src);
+		src = other;
+	}
+
+	return src;
+}
+
+
+void InitInput(EnvContext *ctx)
+{
+	ctx->m_Input.m_Stack = (RECUR_FILES *)CAllocMem(FILE_DEPTH + 1, sizeof(RECUR_FILES));
+	ctx->m_Input.m_Count = 0;
+}
+
+
+void ReleaseInput(EnvContext *ctx)
+{
+	free(ctx->m_Input.m_Stack);
+	ctx->m_Input.m_Stack = NULL;
+	ctx->m_Input.m_Count = 0;
+}
+
+
+int GetCurrentInputFileSize(EnvContext *ctx)
+{
+	return (0 == ctx->m_Input.m_Count ? 0 : (int)ctx->m_Input.m_Stack[ctx->m_Input.m_Count].source->m_Size);
+}
+
+
+
+/*
+ *	ReadSource --- get a file through the source cache
+ *
+ *	A file not seen before is read in and counted for -stats.
+ */
+static SourceFile *ReadSource(EnvContext *ctx, const char *filename, const bool binary)
+{
+	SourceFile	*src;
+	bool		loaded;
+	double		start;
+
+	start = GetWallTime();
+	src = LoadSource(filename, binary, &loaded);
+	if(true == loaded) {
+		ctx->m_Stats.m_ReadTime += GetWallTime() - start;
+		ctx->m_Stats.m_FilesRead++;
+		ctx->m_Stats.m_BytesRead += (u_int32)src->m_Size;
+	}
+
+	return src;
+}
+
+
+/*
+ *	GetSourceText --- get the text of a source file without opening it
+ */
+bool GetSourceText(EnvContext *ctx, const char *filename, const char **data, size_t *size)
+{
+	SourceFile	*src;
+
+	src = ReadSource(ctx, filename, false);
+	if(NULL == src) {
+		return false;
+	}
+
+	*data = src->m_Data;
+	*size = src->m_Size;
+
+	return true;
+}
+
 
 /*
  *	ProcessLine --- determine mnemonic class and act on it
@@ -74,7 +332,9 @@ int GetCurrentInputFileSize()
 
 bool OpenInputFile(EnvContext *ctx, const char *filename, const bool binary)
 {
-	PATH	*cfp = &curfilepath;
+	RECUR_FILES	*openedFiles = ctx->m_Input.m_Stack;
+	int		filecount = ctx->m_Input.m_Count;
+	PATH	*cfp = &openedFiles[filecount].path;
 	PATH	temp;
 	char	tcb[MAXPATH];
 	char	filename_new[MAXPATH];
@@ -107,23 +367,22 @@ bool OpenInputFile(EnvContext *ctx, const char *filename, const bool binary)
 		}
 	}
 
-	openedFiles[filecount + 1].file = fopen(filename, true == binary ? "rb" : "r");
-	if(NULL == openedFiles[filecount+1].file) {
-		fprintf(stderr, "%s can't open %s\n", Argv[0], filename);
+	openedFiles[filecount + 1].source = ReadSource(ctx, filename, binary);
+	if(NULL == openedFiles[filecount+1].source) {
+		fprintf(ctx->m_Err, "%s can't open %s\n", ctx->m_Files.m_Argv[0], filename);
 	} else {
 		openedFiles[filecount].line_num = ctx->m_LineNumber;
 
-		filecount++;
-
-		cfp = &curfilepath;
-		fnsplit(filename, cfp->drive, cfp->dir, cfp->filename, cfp->ext);
+		filecount = ++ctx->m_Input.m_Count;
 
 		cfp = &openedFiles[filecount].path;
 		fnsplit(filename, cfp->drive, cfp->dir, cfp->filename, cfp->ext);
 
 		strcpy(openedFiles[filecount].path.fullpath, filename);
 
-		inputFile = openedFiles[filecount].file;	/* add file handle to list */
+		openedFiles[filecount].next_line = 0;
+		openedFiles[filecount].line_offset = 0;
+		openedFiles[filecount].byte_offset = 0;
 		ctx->m_LineNumber = 0;
 
 		return true;
@@ -135,98 +394,90 @@ bool OpenInputFile(EnvContext *ctx, const char *filename, const bool binary)
 
 int CloseInputFile(EnvContext *ctx)
 {
-	PATH *tp, *cfp = &curfilepath;
+	RECUR_FILES *openedFiles = ctx->m_Input.m_Stack;
 
-	if(true == IsProcessingMacro()) {
+	if(true == IsProcessingMacro(ctx)) {
 		error(ctx, ERR_GENERAL, "unterminated macro at end of file");
 	}
 
 
-	if(openedFiles == 0) {
-		fprintf(stderr, "casm: no files opened\n");
+	if(ctx->m_Input.m_Count == 0) {
+		fprintf(ctx->m_Err, "casm: no files opened\n");
 		return false;
 	}
-	fclose(openedFiles[filecount].file);
-	memset(&openedFiles[filecount], 0, sizeof(RECUR_FILES));
 
-	filecount--;
-	inputFile = openedFiles[filecount].file;
-	tp = &openedFiles[filecount].path;
-	memcpy(cfp, tp, sizeof(PATH));
-	ctx->m_LineNumber = openedFiles[filecount].line_num;
+	/* Save the definitions of an include that was being recorded */
+	if(NULL != ctx->m_Precomp.m_Use) {
+		PrecompEnd(ctx, ctx->m_Input.m_Count);
+	}
+
+	/* The source stays in the cache for the next pass */
+	memset(&openedFiles[ctx->m_Input.m_Count], 0, sizeof(RECUR_FILES));
+
+	ctx->m_Input.m_Count--;
+	ctx->m_LineNumber = openedFiles[ctx->m_Input.m_Count].line_num;
 	return(true);
 }
 
-u_char ReadInputByte()
+u_char ReadInputByte(EnvContext *ctx)
 {
-	return (u_char)fgetc(inputFile);
+	RECUR_FILES *rf = &ctx->m_Input.m_Stack[ctx->m_Input.m_Count];
+
+	if(rf->byte_offset >= rf->source->m_Size) {
+		return (u_char)EOF;
+	}
+
+	return (u_char)rf->source->m_Data[rf->byte_offset++];
 }
 
-int GetOpenFileCount()
+int GetOpenFileCount(EnvContext *ctx)
 {
-	return filecount;
+	return ctx->m_Input.m_Count;
 }
 
-const char *GetCurrentFilePathname()
+const char *GetCurrentFilePathname(EnvContext *ctx)
 {
-	return openedFiles[filecount].path.fullpath;
+	return ctx->m_Input.m_Stack[ctx->m_Input.m_Count].path.fullpath;
 }
 
 
 bool ReadInputLine(EnvContext *ctx, char *lineBuffer, const int maxLength)
 {
-	char *dst;
-	int count;
-	int ch;
+	RECUR_FILES	*rf;
+	SourceFile	*src;
+	size_t		length;
 
 	ASSERTX(maxLength > 0);
 
-	count = 0;
-	dst = lineBuffer;
-	ch = 0;
-
-	while(count < (maxLength - 1)) {
-
-		ch = fgetc(inputFile);
-
-		if(EOF == ch) {
-			break;
-		}
-
-		if('\n' == ch) {
-			ch = fgetc(inputFile);
-			if('\r' != ch) {
-				ungetc(ch, inputFile);
-			}
-			break;
-		}
-
-		if('\r' == ch) {
-			break;
-		}
+	rf = &ctx->m_Input.m_Stack[ctx->m_Input.m_Count];
+	src = rf->source;
 
-		*(dst++) = (char)ch;
-		count++;
+	if(rf->next_line >= src->m_LineCount) {
+		*lineBuffer = 0;
+		return false;
 	}
 
-	*dst = 0;
+	length = src->m_LineLength[rf->next_line] - rf->line_offset;
 
-	if(0 == count && EOF == ch) {
+	/* The rest of an unterminated last line was already read */
+	if(0 == length && 0 != rf->line_offset && rf->next_line == src->m_LineCount - 1 && true == src->m_Unterminated) {
+		rf->next_line++;
+		*lineBuffer = 0;
 		return false;
 	}
 
-	if(count == maxLength) {
-		while(EOF != ch) {
-			ch = fgetc(inputFile);
-			if(ch == '\n' || ch == '\r') {
-				break;
-			}
-		}
-		warning(ctx, WARN_LINESIZE, "input line is too long and has been truncated to %d characters", maxLength);
-		return false;
+	memcpy(lineBuffer, src->m_Data + src->m_LineStart[rf->next_line] + rf->line_offset, length < (size_t)(maxLength - 1) ? length : (size_t)(maxLength - 1));
+
+	/* Overlong lines are returned in pieces */
+	if(length >= (size_t)(maxLength - 1)) {
+		length = maxLength - 1;
+		rf->line_offset += length;
+	} else {
+		rf->next_line++;
+		rf->line_offset = 0;
 	}
 
+	lineBuffer[length] = 0;
 
 	return true;
 }
-
@@ -41,12 +41,15 @@ typedef struct {
 } LineBuffer;
 
 
-int GetOpenFileCount();
+void InitInput(EnvContext *ctx);
+void ReleaseInput(EnvContext *ctx);
+int GetOpenFileCount(EnvContext *ctx);
 bool OpenInputFile(EnvContext *ctx, const char *filename, const bool binary);
 int CloseInputFile(EnvContext *ctx);
-const char *GetCurrentFilePathname();
-int GetCurrentInputFileSize(void);
-u_char ReadInputByte();
+const char *GetCurrentFilePathname(EnvContext *ctx);
+bool GetSourceText(EnvContext *ctx, const char *filename, const char **data, size_t *size);
+int GetCurrentInputFileSize(EnvContext *ctx);
+u_char ReadInputByte(EnvContext *ctx);
 bool ReadInputLine(EnvContext *ctx, char *lineBuffer, const int maxLength);
 
 
@@ -28,136 +28,194 @@
 	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 
 *****************************************************************************/
+#include <stddef.h>
+
 #include "as.h"
 #include "proto.h"
 #include "macro.h"
 #include "label.h"
 
 
+#define MACRO_ARENA_SIZE	65536		/* bytes in each arena block				*/
+#define MACRO_ALIGN(n)		(((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+
 typedef struct _MacroVar MacroVar;
 typedef struct _MacroLine MacroLine;
 typedef struct _Macro Macro;
+typedef struct _MacroArena MacroArena;
 
-typedef struct {
+typedef struct _OpenedMacro {
 	Macro		*mac;
 	MacroLine	*m_Line;
 } OpenedMacro;
 
 
+/*
+	Macro lines are tokenized when they are added to the macro.  Argument
+	references are looked up then, so expanding a line only has to copy
+	text and argument values.  Each token is a type byte followed by its
+	data; lengths and numbers are stored as two bytes, low byte first.
+*/
+enum {
+	MTOK_TEXT,			/* length, text */
+	MTOK_ARG,			/* variable number */
+	MTOK_BADINDEX,		/* index, length, rest of the line from the '\' */
+	MTOK_BADNAME,		/* name length, length, '{' name and rest of line */
+	MTOK_BADCHAR,		/* 0, length, '{' and rest of the line */
+	MTOK_UNTERMINATED	/* 0, length, '{' and rest of the line */
+};
+
+
 struct _MacroVar {
-	char		m_Var[MAX_LABELSIZE];		/* variable */
-	char		m_Value[MAX_BUFFERSIZE];	/* variable contents while processing macro */
-	MacroVar	*m_Next;					/* next variable in list */
+	char		*m_Var;					/* variable */
+	char		*m_Value;				/* variable contents while processing macro */
+	size_t		m_Length;				/* length of the contents */
+	size_t		m_Size;					/* bytes allocated for the contents */
 };
 
 
 struct _MacroLine {
-	char		m_Line[MAX_BUFFERSIZE];	/* Contents of the macro line */
 	MacroLine	*m_Next;				/* Next macro line */
+	u_int16		m_Size;					/* Bytes of tokens in m_Data */
+	u_char		m_Data[1];				/* Tokens of the macro line */
 };
 
 
 struct _Macro {
-	char		m_Name[MAX_LABELSIZE];	/* Name of the macro */
-	int			m_ID;					/* Unique ID */
+	char		*m_Name;				/* Name of the macro */
 	int			m_VarCount;				/* Number of variables in the macro */
 	MacroVar	*m_Vars;				/* Variables */
 	MacroLine	*m_Lines;				/* Macro lines */
+	MacroLine	*m_LastLine;			/* Last line added while defining */
 	Macro		*m_Next;				/* Next macro in the list */
 };
 
 
+/* Block of memory macros, their names and lines are carved from */
+struct _MacroArena {
+	MacroArena	*next;		/* previous block */
+	size_t		used;		/* bytes handed out */
+	size_t		size;		/* bytes in data */
+	u_char		*data;
+};
+
 
 static void AddVarToMacro(EnvContext *ctx, const char *var);
 
 
-/*
-	Macro processing pointers, flags and counters
-*/
-static Macro		*macrosHead = NULL;
-static Macro		*macrosTail = NULL;
-static Macro		*currentmac = NULL;
-static MacroLine	*curmacLine = NULL;
-static bool			procmacro = false;	/* processing a macro? */
-static bool			macroopen = false;	/* macro open */
-static u_int16		macrooccur = 0;		/* macro local label occurance */
-static int			macroline;
-static Macro		*currentopenmac = NULL;
-static OpenedMacro	openedmacros[50];
-static int			macrosopened = 0;
-
-
-bool IsMacroOpen()
+void InitMacros(EnvContext *ctx)
 {
-	return (0 != macroopen);
+	memset(&ctx->m_Macros, 0, sizeof(ctx->m_Macros));
 }
 
 
-bool IsProcessingMacro()
+/*----------------------------------------------------------------------------
+	ReleaseMacros --- free the macros and the memory they were carved from
+----------------------------------------------------------------------------*/
+void ReleaseMacros(EnvContext *ctx)
 {
-	return procmacro;
+	Macro *mac;
+	MacroArena *arena;
+	int var;
+
+	/* Variables are grown outside the arena */
+	for(mac = ctx->m_Macros.m_Head; NULL != mac; mac = mac->m_Next) {
+		for(var = 0; var < mac->m_VarCount; var++) {
+			free(mac->m_Vars[var].m_Value);
+		}
+		free(mac->m_Vars);
+	}
+
+	while(NULL != (arena = ctx->m_Macros.m_Arena)) {
+		ctx->m_Macros.m_Arena = arena->next;
+		free(arena);
+	}
+
+	free(ctx->m_Macros.m_Stack);
+	InitMacros(ctx);
 }
 
 
-void ResetMacroLocalLabels()
+bool IsMacroOpen(EnvContext *ctx)
 {
-	macrooccur = 0;	/* occurance of local labels in macros */
+	return (0 != ctx->m_Macros.m_IsOpen);
 }
 
 
-int GetNextMacroLocalLabel()
+bool IsProcessingMacro(EnvContext *ctx)
 {
-	return ++macrooccur;
+	return ctx->m_Macros.m_Processing;
 }
 
 
-int GetMacroLocalLabel()
+void ResetMacroLocalLabels(EnvContext *ctx)
 {
-	return macrooccur;
+	ctx->m_Macros.m_Occur = 0;	/* occurance of local labels in macros */
 }
 
 
-bool OnFirstMacroLine()
+int GetNextMacroLocalLabel(EnvContext *ctx)
 {
-	return (NULL != currentopenmac && curmacLine == currentopenmac->m_Lines);
+	return ++ctx->m_Macros.m_Occur;
 }
 
 
-static Macro *allocMacro(void)
+int GetMacroLocalLabel(EnvContext *ctx)
 {
-	Macro *temp;
+	return ctx->m_Macros.m_Occur;
+}
 
-	temp = (Macro*)CAllocMem(1, sizeof(Macro));
 
-	return temp;
+bool OnFirstMacroLine(EnvContext *ctx)
+{
+	return (NULL != ctx->m_Macros.m_Open && ctx->m_Macros.m_Line == ctx->m_Macros.m_Open->m_Lines);
 }
 
 
-static MacroLine *allocMacroLine(void)
+/*----------------------------------------------------------------------------
+	MacroAlloc --- hand out memory that lives as long as the macros
+----------------------------------------------------------------------------*/
+static void *MacroAlloc(EnvContext *ctx, size_t nbytes)
 {
-	MacroLine *temp;
-	temp = (MacroLine*)CAllocMem(1, sizeof(MacroLine));
-	macroline++;
-	temp->m_Next = NULL;
+	MacroArena *arena;
+	void *ptr;
 
-	return temp;
+	nbytes = MACRO_ALIGN(nbytes);
+	arena = ctx->m_Macros.m_Arena;
+
+	if(NULL == arena || arena->used + nbytes > arena->size) {
+		size_t size = nbytes > MACRO_ARENA_SIZE ? nbytes : MACRO_ARENA_SIZE;
+
+		arena = (MacroArena*)AllocMem(MACRO_ALIGN(sizeof(MacroArena)) + size);
+		arena->next = ctx->m_Macros.m_Arena;
+		arena->used = 0;
+		arena->size = size;
+		arena->data = (u_char*)arena + MACRO_ALIGN(sizeof(MacroArena));
+		ctx->m_Macros.m_Arena = arena;
+	}
+
+	ptr = arena->data + arena->used;
+	arena->used += nbytes;
+
+	return ptr;
 }
 
 
-static MacroVar *allocMacroVar(void)
+static char *MacroStrdup(EnvContext *ctx, const char *str)
 {
-	MacroVar *temp;
+	char *ptr;
 
-	temp = (MacroVar *)CAllocMem(1, sizeof(MacroVar));
-	temp->m_Next = NULL;
+	ptr = (char*)MacroAlloc(ctx, strlen(str) + 1);
+	strcpy(ptr, str);
 
-	return temp;
+	return ptr;
 }
 
 
-static Macro *FindMacro(const char *name)
+static Macro *FindMacro(EnvContext *ctx, const char *name)
 {
-	Macro *mac = macrosHead;
+	Macro *mac = ctx->m_Macros.m_Head;
 
 	while(mac != NULL) {
 		if(stricmp(name, mac->m_Name) == 0) return mac;
@@ -169,40 +227,30 @@ static Macro *FindMacro(const char *name)
 
 void CreateMacro(EnvContext *ctx, const char *macroname, const char *macroargs)
 {
+	Macro *mac;
 	char delim;
 	int vaflag;
 
-	procmacro = true;
-	macroline = 0;	/* reset macro line count */
+	ctx->m_Macros.m_Processing = true;
 	if(ctx->m_Pass == 2) return;
 
 	/* FIXME - check lables, structs, and unions */
-	if(FindMacro(macroname) != NULL) {
+	if(FindMacro(ctx, macroname) != NULL) {
 		error(ctx, ERR_REDEFINED, "'%s' has already been defined as a macro", macroname);
 		return;
 	}
 
-	/* if macros have not been defined yet, allocate mem for one */
-	if(macrosHead == NULL) {
-		macrosHead = allocMacro();
-		macrosTail = macrosHead;
-		currentmac = macrosHead;
-		curmacLine = NULL;	/* reset current macro line */
-	}
-	
-	else { /* we already have macros, so lets allocate a new one */
-		macrosTail->m_Next = allocMacro();
-		macrosTail = macrosTail->m_Next;
-		currentmac = macrosTail;
+	mac = (Macro*)MacroAlloc(ctx, sizeof(Macro));
+	memset(mac, 0, sizeof(Macro));
+	mac->m_Name = MacroStrdup(ctx, macroname);	/* copy over label as the name */
+
+	if(ctx->m_Macros.m_Head == NULL) {
+		ctx->m_Macros.m_Head = mac;
+	} else {
+		ctx->m_Macros.m_Tail->m_Next = mac;
 	}
-	/*
-		we have either created the initial macro or found the last
-		slot and added to it.  Lets copy the contents
-	*/
-	currentmac->m_Next = NULL;				/* set the next macro and null */
-	currentmac->m_Vars = NULL;				/* reset current variable pointer */
-	currentmac->m_VarCount = 0;				/* no variables defined yet */
-	strcpy(currentmac->m_Name, macroname);	/* copy over label as the name */
+	ctx->m_Macros.m_Tail = mac;
+	ctx->m_Macros.m_Defining = mac;
 
 	vaflag = 0;
 
@@ -244,18 +292,190 @@ void CreateMacro(EnvContext *ctx, const char *macroname, const char *macroargs)
 
 void EndMacro(EnvContext *ctx)
 {
-	procmacro = false;	/* Add things needed to end this macro */
-	currentmac = NULL;
-	if(ctx->m_Pass == 2) {
-		return;
+	ctx->m_Macros.m_Processing = false;	/* Add things needed to end this macro */
+	ctx->m_Macros.m_Defining = NULL;
+}
+
+
+/*----------------------------------------------------------------------------
+	PutWord --- store a length or number in a token
+----------------------------------------------------------------------------*/
+static u_char *PutWord(u_char *dst, size_t value)
+{
+	*(dst++) = (u_char)(value & 0xff);
+	*(dst++) = (u_char)((value >> 8) & 0xff);
+
+	return dst;
+}
+
+
+static size_t GetWord(const u_char *src)
+{
+	return (size_t)src[0] | ((size_t)src[1] << 8);
+}
+
+
+/*----------------------------------------------------------------------------
+	PutText --- append characters to the text token at the end of a line
+----------------------------------------------------------------------------*/
+static u_char *PutText(u_char *dst, u_char **textToken, const char *text, size_t length)
+{
+	if(0 == length) {
+		return dst;
+	}
+
+	if(NULL == *textToken) {
+		*textToken = dst;
+		*(dst++) = MTOK_TEXT;
+		dst = PutWord(dst, 0);
+	}
+
+	memcpy(dst, text, length);
+	PutWord(*textToken + 1, GetWord(*textToken + 1) + length);
+
+	return dst + length;
+}
+
+
+/*----------------------------------------------------------------------------
+	PutError --- end a line with a token that reports a bad variable
+----------------------------------------------------------------------------*/
+static u_char *PutError(u_char *dst, int type, size_t number, const char *prefix, size_t prefixLength, const char *text)
+{
+	size_t length;
+
+	length = strlen(text);
+
+	*(dst++) = (u_char)type;
+	dst = PutWord(dst, number);
+	dst = PutWord(dst, prefixLength + length);
+	memcpy(dst, prefix, prefixLength);
+	memcpy(dst + prefixLength, text, length);
+
+	return dst + prefixLength + length;
+}
+
+
+/*----------------------------------------------------------------------------
+	TokenizeMacroLine --- turn a line of a macro into tokens
+
+	Returns the number of bytes stored in tokens, which must have room for
+	three times the length of the line plus a few bytes.  Scanning stops at the
+	first bad variable reference, which will be reported when the line is
+	expanded.
+----------------------------------------------------------------------------*/
+static size_t TokenizeMacroLine(EnvContext *ctx, Macro *mac, const char *src, u_char *tokens)
+{
+	u_char	*dst;
+	u_char	*textToken;
+
+	dst = tokens;
+	textToken = NULL;
+
+	/* Lines of a macro without variables are copied as they are */
+	if(0 == mac->m_VarCount) {
+		return PutText(dst, &textToken, src, strlen(src)) - tokens;
+	}
+
+	while(*src != 0x00) {
+
+		/* Handle Macro-80c variable access */
+		if('\\' == *src) {
+
+			src++;
+
+			/* If we hit a period assume that it's some kind of internal or local label */
+			if('.' == *src) {
+				const char *label;
+
+				src++;
+
+				/* KLUDGE - convert to a non-standard local label */
+				dst = PutText(dst, &textToken, "@", 1);
+				label = src;
+				while(IsStructLabelChar(ctx, *src)) {
+					src++;
+				}
+				dst = PutText(dst, &textToken, label, src - label);
+			}
+
+			/* Check for parameter access; only the first digit is skipped */
+			else if(isdigit(*src)) {
+				long index;
+
+				index = atol(src++);
+
+				if(index < 0 || index >= mac->m_VarCount) {
+					return PutError(dst, MTOK_BADINDEX, index > 0xffff ? 0xffff : (size_t)index, "", 0, src - 2) - tokens;
+				}
+
+				*(dst++) = MTOK_ARG;
+				dst = PutWord(dst, (size_t)index);
+				textToken = NULL;
+			}
+		}
+
+		else if(*src == '{') {
+			const char	*name;
+			char		temp[MAX_BUFFERSIZE];
+			int			var;
+
+			src++;
+			name = src;
+
+			/* search for end of variable */
+			while(*src != '}') {
+				if(true == IsWS(*src) || true == IsCommentChar(ctx, *src)) {
+					return PutError(dst, MTOK_BADCHAR, 0, "{", 1, src) - tokens;
+				}
+				if(EOS == *src) {
+					return PutError(dst, MTOK_UNTERMINATED, 0, "{", 1, name) - tokens;
+				}
+				src++;
+			}
+
+			memcpy(temp, name, src - name);
+			temp[src - name] = EOS;
+
+			/* go find the variable */
+			for(var = 0; var < mac->m_VarCount; var++) {
+				if(strcmp(mac->m_Vars[var].m_Var, temp) == 0) {
+					break;
+				}
+			}
+
+			if(var == mac->m_VarCount) {
+				return PutError(dst, MTOK_BADNAME, src - name, "{", 1, name) - tokens;
+			}
+
+			*(dst++) = MTOK_ARG;
+			dst = PutWord(dst, (size_t)var);
+			textToken = NULL;
+
+			src++;
+		}
+
+		else {
+			const char *text;
+
+			text = src;
+			while(EOS != *src && '\\' != *src && '{' != *src) {
+				src++;
+			}
+			dst = PutText(dst, &textToken, text, src - text);
+		}
 	}
 
-	curmacLine = NULL;	/* reset current macro line */
+	return dst - tokens;
 }
 
 
 void AddLineToMacro(EnvContext *ctx, const char *macroline)
 {
+	u_char		tokens[MAX_BUFFERSIZE * 3 + 16];
+	Macro		*mac;
+	MacroLine	*line;
+	size_t		size;
 
 	/* FIXME
 	if(true == HasLocalLabelChar(ctx, ctx->m_Label)) {
@@ -266,79 +486,72 @@ void AddLineToMacro(EnvContext *ctx, const char *macroline)
 	*/
 
 	/* if a macro is empty, allocate first line */
-	if(ctx->m_Pass == 2) {
+	mac = ctx->m_Macros.m_Defining;
+	if(ctx->m_Pass == 2 || NULL == mac) {
 		return;
 	}
 
-	if(curmacLine == NULL) {
-		currentmac->m_Lines = allocMacroLine();	/* allocate macros first line */
-		curmacLine = currentmac->m_Lines;	/* set the current line to this one */
-	}
+	size = TokenizeMacroLine(ctx, mac, macroline, tokens);
 
-	/* its got something in it, allocate next line */
-	else { 
-		curmacLine->m_Next = allocMacroLine();
-		curmacLine = curmacLine->m_Next;
-	}
+	line = (MacroLine*)MacroAlloc(ctx, offsetof(MacroLine, m_Data) + size);
+	line->m_Next = NULL;
+	line->m_Size = (u_int16)size;
+	memcpy(line->m_Data, tokens, size);
 
-	curmacLine->m_Next = NULL;
-	strcpy(curmacLine->m_Line, macroline);
+	if(NULL == mac->m_LastLine) {
+		mac->m_Lines = line;
+	} else {
+		mac->m_LastLine->m_Next = line;
+	}
+	mac->m_LastLine = line;
 }
 
 
 static void AddVarToMacro(EnvContext *ctx, const char *var)
 {
-	MacroVar *curmacvar;
+	Macro *mac;
+	MacroVar *vars;
 
 	if(ctx->m_Pass == 2) {
 		return;
 	}
 
-	if(currentmac->m_Vars == NULL) {			/* if no macro variables are defined, do first one */
-		curmacvar = allocMacroVar();		/* allocate variable memory */
-		currentmac->m_Vars = curmacvar;		/* set first variable pointer in macro def */
-	}
-	
-	else {
-		curmacvar = currentmac->m_Vars;		/* variables exist, point to first one */
-
-		/* find last macro */
-		while(curmacvar->m_Next != NULL) {	/* are we at the last one? */
-			curmacvar = curmacvar->m_Next;	/* go to next one */
-		}
-
-		curmacvar->m_Next = allocMacroVar();	/* allocate next variable */
-		curmacvar = curmacvar->m_Next;			/* point to it */
-	}
+	mac = ctx->m_Macros.m_Defining;
+	vars = (MacroVar*)ReallocMem(mac->m_Vars, (mac->m_VarCount + 1) * sizeof(MacroVar));
+	mac->m_Vars = vars;
+	vars += mac->m_VarCount++;		/* increase number of variables used in macro */
 
-	currentmac->m_VarCount++;			/* increase number of variables used in macro */
-	strcpy(curmacvar->m_Var, var);	/* copy variable name */
+	vars->m_Var = MacroStrdup(ctx, var);		/* copy variable name */
+	vars->m_Value = NULL;
+	vars->m_Length = 0;
+	vars->m_Size = 0;
 }
 
 
-static void SetVarValue(EnvContext *ctx, const int var, const char *value)
+static void SetVarValue(EnvContext *ctx, const int var, const char *value, size_t length)
 {
-	int i;
 	MacroVar *curmacvar;
 
-	if(var >= currentopenmac->m_VarCount) {
-		warning(ctx, WARN_MACROPARAMS, "too many parameters passed to macro [%03i:%03i]", var, currentopenmac->m_VarCount);
+	if(var >= ctx->m_Macros.m_Open->m_VarCount) {
+		warning(ctx, WARN_MACROPARAMS, "too many parameters passed to macro [%03i:%03i]", var, ctx->m_Macros.m_Open->m_VarCount);
 		return;
 	}
 
-	/* find last macro */
-	curmacvar = currentopenmac->m_Vars;
+	curmacvar = &ctx->m_Macros.m_Open->m_Vars[var];
 
-	for(i = 0; i < var; i++) {
-		/* skip to specified variable */
-		curmacvar = curmacvar->m_Next;
+	if(length > curmacvar->m_Size) {
+		curmacvar->m_Value = (char*)ReallocMem(curmacvar->m_Value, length);
+		curmacvar->m_Size = length;
 	}
 
-	strcpy(curmacvar->m_Value, value);
+	if(0 != length) {
+		memcpy(curmacvar->m_Value, value, length);
+	}
+	curmacvar->m_Length = length;
 }
 
 
-static const char *GetVarEnd(EnvContext *ctx, const char *varptr, char *varBuffer)
+static const char *GetVarEnd(EnvContext *ctx, const char *varptr, const char **varEnd)
 {
 	bool	quote = false;
 
@@ -350,6 +563,7 @@ static const char *GetVarEnd(EnvContext *ctx, const char *varptr, char *varBuffe
 	while(true) {
 		/* handle quotes */
 		if(EOS == *varptr) {
+			*varEnd = varptr;
 			break;
 		}
 		
@@ -368,16 +582,15 @@ static const char *GetVarEnd(EnvContext *ctx, const char *varptr, char *varBuffe
 		
 		/* if not in quotes and a comma is there */
 		else if(false == quote && (',' == *varptr || true == IsWS(*varptr))) {
+			*varEnd = varptr;
 			varptr++;
 			break;
 		}
 
-		/* copy the character */
-		*(varBuffer++) = *(varptr++);
+		/* take the character */
+		varptr++;
 	}
 
-	*varBuffer = EOS;
-
 	if(quote != 0) {
 		error(ctx, ERR_SYNTAX, "unterminated quotes in macro variable definition");
 	}
@@ -390,218 +603,356 @@ static const char *GetVarEnd(EnvContext *ctx, const char *varptr, char *varBuffe
 /* routines for opening and reading from a macro */
 bool OpenMacro(EnvContext *ctx, const char *name, const char *macroargs)
 {
-	char varBuffer[MAX_VAR_LENGTH + 1];
 	const char *vptr;
+	const char *vend;
 	const char *next;
 	int count;
 	Macro *temp;
 
-	macroline = 0;
-	temp = FindMacro(name);
+	temp = FindMacro(ctx, name);
 	if(NULL == temp) {
 		return false;
 	}
 
-	if(currentopenmac) {
+	if(ctx->m_Macros.m_Open) {
 
-		if(macrosopened > 49) {
+		if(ctx->m_Macros.m_Depth >= MAX_MACRO_DEPTH) {
 			error(ctx, ERR_GENERAL, "too many macros opened");
 			return false;
 		}
-		openedmacros[macrosopened].mac = currentopenmac;
-		openedmacros[macrosopened].m_Line = curmacLine;
-		macrosopened++;
+
+		if(ctx->m_Macros.m_Depth == ctx->m_Macros.m_StackSize) {
+			ctx->m_Macros.m_StackSize = (0 == ctx->m_Macros.m_StackSize ? 16 : ctx->m_Macros.m_StackSize * 2);
+			ctx->m_Macros.m_Stack = (OpenedMacro*)ReallocMem(ctx->m_Macros.m_Stack, ctx->m_Macros.m_StackSize * sizeof(OpenedMacro));
+		}
+
+		ctx->m_Macros.m_Stack[ctx->m_Macros.m_Depth].mac = ctx->m_Macros.m_Open;
+		ctx->m_Macros.m_Stack[ctx->m_Macros.m_Depth].m_Line = ctx->m_Macros.m_Line;
+		ctx->m_Macros.m_Depth++;
 	}
 
-	currentopenmac = temp;
-	macroopen = true;
-	curmacLine = currentopenmac->m_Lines;
+	ctx->m_Macros.m_Open = temp;
+	ctx->m_Macros.m_IsOpen = true;
+	ctx->m_Stats.m_MacroExpansions++;
+	ctx->m_Macros.m_Line = temp->m_Lines;
 
 	vptr = macroargs;
 	count = 0;
-	if(currentopenmac->m_VarCount != 0) {
-		while((next = GetVarEnd(ctx, vptr, varBuffer)) != NULL) {
-			SetVarValue(ctx, count, varBuffer);
+	if(temp->m_VarCount != 0) {
+		while((next = GetVarEnd(ctx, vptr, &vend)) != NULL) {
+			SetVarValue(ctx, count, vptr, vend - vptr);
 			count++;
 			vptr = next;
 		}
 	}
 
-	return(NULL != currentopenmac ? true : false);
+	return(NULL != ctx->m_Macros.m_Open ? true : false);
 }
 
 
-void CloseMacro(void)
+void CloseMacro(EnvContext *ctx)
 {
-	if(macrosopened) {
+	if(ctx->m_Macros.m_Depth) {
 		do {
-			macrosopened--;
-			currentopenmac = openedmacros[macrosopened].mac;
-			curmacLine = openedmacros[macrosopened].m_Line;
-		} while(macrosopened > 0 && NULL == curmacLine);
+			ctx->m_Macros.m_Depth--;
+			ctx->m_Macros.m_Open = ctx->m_Macros.m_Stack[ctx->m_Macros.m_Depth].mac;
+			ctx->m_Macros.m_Line = ctx->m_Macros.m_Stack[ctx->m_Macros.m_Depth].m_Line;
+		} while(ctx->m_Macros.m_Depth > 0 && NULL == ctx->m_Macros.m_Line);
 	} else {
-		currentopenmac = NULL;
-		curmacLine = NULL;
-		macroopen = false;
+		ctx->m_Macros.m_Open = NULL;
+		ctx->m_Macros.m_Line = NULL;
+		ctx->m_Macros.m_IsOpen = false;
 	}
 
-	GetNextMacroLocalLabel();
+	GetNextMacroLocalLabel(ctx);
 }
 
 
-char *FindChar(char *vptr, char ch)
+/*----------------------------------------------------------------------------
+	PutOutput --- append characters to an expanded line, as far as they fit
+----------------------------------------------------------------------------*/
+static char *PutOutput(char *dst, const char *limit, const void *text, size_t length)
 {
-	while(*vptr != 0) {
-		if(*vptr++ == ch) {
-			return (vptr);
-		}
+	if(0 == length) {
+		return dst;
 	}
-	return vptr;
+
+	if(length > (size_t)(limit - dst)) {
+		length = limit - dst;
+	}
+
+	memcpy(dst, text, length);
+
+	return dst + length;
 }
 
 
-/* find a macro variable */
-char *GetMacroVarByName(char *varName)
+char *GetMacroLine(EnvContext *ctx, char *outBufferPtr)
 {
-	MacroVar *var;
+	const u_char	*src;
+	const u_char	*end;
+	const char		*limit;
+	char			*dst;
+	MacroLine		*line;
+	Macro			*mac;
 
-	var = currentopenmac->m_Vars;
+	outBufferPtr[0] = EOS;
 
-	while(var != NULL) {
-		if(strcmp(var->m_Var, varName) == 0) {
-			return (var->m_Value);
+	if(ctx->m_Macros.m_Line == NULL) {
+		CloseMacro(ctx);
+		if(ctx->m_Macros.m_Line) {
+			return(GetMacroLine(ctx, outBufferPtr));
 		}
-		var = var->m_Next;
+		return(NULL);
 	}
-	return (NULL);
+
+	line = ctx->m_Macros.m_Line;
+	ctx->m_Macros.m_Line = line->m_Next;
+	mac = ctx->m_Macros.m_Open;
+
+	src = line->m_Data;
+	end = src + line->m_Size;
+	dst = outBufferPtr;
+	limit = outBufferPtr + MAX_BUFFERSIZE - 1;
+
+	while(src < end) {
+		size_t number;
+		size_t length;
+
+		number = GetWord(src + 1);
+
+		switch(*src) {
+		case MTOK_TEXT:
+			dst = PutOutput(dst, limit, src + 3, number);
+			src += 3 + number;
+			break;
+
+		case MTOK_ARG:
+			dst = PutOutput(dst, limit, mac->m_Vars[number].m_Value, mac->m_Vars[number].m_Length);
+			src += 3;
+			break;
+
+		default:
+			/* A bad variable reference ends the line */
+			length = GetWord(src + 3);
+
+			if(MTOK_BADINDEX == *src) {
+				error(ctx, ERR_UNDEFINED, "No variable at index %d", (int)number);
+				dst = outBufferPtr;
+			} else if(MTOK_BADNAME == *src) {
+				char name[MAX_BUFFERSIZE];
+
+				memcpy(name, src + 6, number);
+				name[number] = EOS;
+				error(ctx, ERR_UNDEFINED, "unknown variable '%s' in macro '%s'", name, mac->m_Name);
+			} else if(MTOK_BADCHAR == *src) {
+				error(ctx, ERR_SYNTAX, "illegal variable assignment in macro '%s'", mac->m_Name);
+			} else {
+				error(ctx, ERR_SYNTAX, "unterminated variable assignment in macro '%s'", mac->m_Name);
+			}
+
+			dst = PutOutput(dst, limit, src + 5, length);
+			src = end;
+			break;
+		}
+	}
+
+	*dst = EOS;
+
+	return outBufferPtr;
 }
 
 
-char *GetMacroVarByIndex(int index)
+/*----------------------------------------------------------------------------
+	PackMacros --- copy the macros defined after a macro into a buffer
+
+	Each macro is stored as its name, the number of variables and their
+	names, the number of lines and then each line as its size and tokens.
+	Names end with a 0 and numbers are stored low byte first.  Returns
+	the number of bytes needed, and fills in buffer unless it is NULL.
+----------------------------------------------------------------------------*/
+size_t PackMacros(EnvContext *ctx, const Macro *after, u_char *buffer)
 {
-	MacroVar *var;
+	const Macro		*mac;
+	const MacroLine	*line;
+	size_t			size;
+	size_t			count;
+	int				var;
+
+	size = 0;
+
+	for(mac = (NULL == after ? ctx->m_Macros.m_Head : after->m_Next); NULL != mac; mac = mac->m_Next) {
+		if(NULL != buffer) {
+			strcpy((char*)buffer + size, mac->m_Name);
+			PutWord(buffer + size + strlen(mac->m_Name) + 1, mac->m_VarCount);
+		}
+		size += strlen(mac->m_Name) + 3;
+
+		for(var = 0; var < mac->m_VarCount; var++) {
+			if(NULL != buffer) {
+				strcpy((char*)buffer + size, mac->m_Vars[var].m_Var);
+			}
+			size += strlen(mac->m_Vars[var].m_Var) + 1;
+		}
+
+		count = 0;
+		for(line = mac->m_Lines; NULL != line; line = line->m_Next) {
+			count++;
+		}
 
-	var = currentopenmac->m_Vars;
+		if(NULL != buffer) {
+			PutWord(PutWord(buffer + size, count & 0xffff), count >> 16);
+		}
+		size += 4;
 
-	while(var != NULL && index > 0) {
-		index--;	
-		var = var->m_Next;
+		for(line = mac->m_Lines; NULL != line; line = line->m_Next) {
+			if(NULL != buffer) {
+				PutWord(buffer + size, line->m_Size);
+				memcpy(buffer + size + 2, line->m_Data, line->m_Size);
+			}
+			size += 2 + line->m_Size;
+		}
 	}
 
-	return (NULL == var ? NULL : var->m_Value);
+	return size;
 }
 
 
-char *GetMacroLine(EnvContext *ctx, char *outBufferPtr)
+/*----------------------------------------------------------------------------
+	UnpackString --- find the end of a name stored by PackMacros
+----------------------------------------------------------------------------*/
+static const u_char *UnpackString(const u_char *data, const u_char *end)
 {
-	outBufferPtr[0] = EOS;
+	const u_char *eos;
 
-	if(curmacLine == NULL) {
-		CloseMacro();
-		if(curmacLine) {
-			return(GetMacroLine(ctx, outBufferPtr));
+	eos = (const u_char*)memchr(data, EOS, end - data);
+
+	return (NULL == eos ? NULL : eos + 1);
+}
+
+
+/*----------------------------------------------------------------------------
+	UnpackMacros --- define macros stored by PackMacros
+
+	The macros are checked first: the data must be whole, every token must
+	be in its line and none of the macros may be defined yet.  When define
+	is false nothing else is done, so that a caller can check everything it
+	is about to bring in before any of it is added.
+----------------------------------------------------------------------------*/
+bool UnpackMacros(EnvContext *ctx, const u_char *data, size_t size, const bool define)
+{
+	const u_char	*end;
+	const u_char	*next;
+	const u_char	*token;
+	Macro			*mac;
+	MacroLine		*line;
+	size_t			count;
+	size_t			length;
+	int				vars;
+	int				var;
+
+	end = data + size;
+	mac = NULL;
+
+	while(data < end) {
+		/* The name and variables */
+		next = UnpackString(data, end);
+		if(NULL == next || end - next < 2 || NULL != FindMacro(ctx, (const char*)data)) {
+			return false;
 		}
-		return(NULL);
-	}
 
-	if(currentopenmac->m_VarCount == 0) {
-		strcpy(outBufferPtr, curmacLine->m_Line);
-	}
+		if(true == define) {
+			mac = (Macro*)MacroAlloc(ctx, sizeof(Macro));
+			memset(mac, 0, sizeof(Macro));
+			mac->m_Name = MacroStrdup(ctx, (const char*)data);
+		}
 
-	else {
-		char	*src;
-		char	*dst;
+		vars = (int)GetWord(next);
+		data = next + 2;
 
-		src = curmacLine->m_Line;	/* get start of macro line */
-		dst = outBufferPtr;
-		while(*src != 0x00) {
+		if(true == define && 0 != vars) {
+			mac->m_Vars = (MacroVar*)CAllocMem(vars, sizeof(MacroVar));
+			mac->m_VarCount = vars;
+		}
 
-			/* Handle Macro-80c variable access */
-			if('\\' == *src) {
+		for(var = 0; var < vars; var++) {
+			next = UnpackString(data, end);
+			if(NULL == next || next - data > MAX_VAR_LENGTH + 1) {
+				return false;
+			}
 
-				src++;
+			if(true == define) {
+				mac->m_Vars[var].m_Var = MacroStrdup(ctx, (const char*)data);
+			}
 
-				/* If we hit a period assume that it's some kind of internal or local label */
-				if('.' == *src) {
-					src++;
+			data = next;
+		}
 
-					/* KLUDGE - convert to a non-standard local label */
-					*(dst++) = '@';
-					while(IsStructLabelChar(ctx, *src)) {
-						*(dst++) = *(src++);
-					}
-					*dst = 0;
-				}
-				
-				/* Check for parameter access */
-				else if(isdigit(*src)) {
-					int index;
-					char *value;
-
-					index = atoi(src++);
-
-					value = GetMacroVarByIndex(index);
-					if(NULL == value) {
-						error(ctx, ERR_UNDEFINED, "No variable at index %d", index);
-						sprintf(outBufferPtr, "%s", src - 2);
-						curmacLine = curmacLine->m_Next;
-						return outBufferPtr;
-					}
-					strcpy(dst, value);
-					dst += strlen(value);
+		/* The lines */
+		if(end - data < 4) {
+			return false;
+		}
 
-				}
+		count = GetWord(data) | (GetWord(data + 2) << 16);
+		data += 4;
 
-				else {
-				}
+		while(count-- > 0) {
+			if(end - data < 2 || (size_t)(end - data - 2) < GetWord(data)) {
+				return false;
 			}
 
-			else if(*src == '{') {
-				char	*var;
-				char	temp[100];
+			length = GetWord(data);
+			data += 2;
 
-				src++;
-				var = temp;
-				/* search for end of variable */
-				while(*src != '}') {
-					if(true == IsWS(*src) || true == IsCommentChar(ctx, *src)) {
-						error(ctx, ERR_SYNTAX, "illegal variable assignment in macro '%s'", currentopenmac->m_Name);
-						*var = 0;
-						curmacLine = curmacLine->m_Next;
-						sprintf(dst, "{%s%s", var, src);
-						return outBufferPtr;
-					}
-					if(EOS == *src) {
-						error(ctx, ERR_SYNTAX, "unterminated variable assignment in macro '%s'", currentopenmac->m_Name);
-						curmacLine = curmacLine->m_Next;
-						sprintf(dst, "{%s%s", var, src);
-						return outBufferPtr;
+			for(token = data; token < data + length; ) {
+				if(data + length - token < 3) {
+					return false;
+				}
+
+				if(MTOK_TEXT == *token) {
+					token += 3 + GetWord(token + 1);
+				} else if(MTOK_ARG == *token) {
+					if((int)GetWord(token + 1) >= vars) {
+						return false;
 					}
-					*var++ = *src++;
+					token += 3;
+				} else if(*token <= MTOK_UNTERMINATED && data + length - token >= 5) {
+					token += 5 + GetWord(token + 3);
+				} else {
+					return false;
 				}
-				*var = 0;	/* set end of variable */
-				var = GetMacroVarByName(temp);	/* go find the variable */
-				if(var == NULL) {
-					error(ctx, ERR_UNDEFINED, "unknown variable '%s' in macro '%s'", temp, currentopenmac->m_Name);
-					curmacLine = curmacLine->m_Next;
-					sprintf(dst, "{%s%s", temp, src);
-					return outBufferPtr;
+			}
+
+			if(token != data + length) {
+				return false;
+			}
+
+			if(true == define) {
+				line = (MacroLine*)MacroAlloc(ctx, offsetof(MacroLine, m_Data) + length);
+				line->m_Next = NULL;
+				line->m_Size = (u_int16)length;
+				memcpy(line->m_Data, data, length);
+
+				if(NULL == mac->m_LastLine) {
+					mac->m_Lines = line;
 				} else {
-					strcpy(dst, var);
-					dst += strlen(var);
+					mac->m_LastLine->m_Next = line;
 				}
-				src++;
+				mac->m_LastLine = line;
 			}
-			
-			else {
-				*(dst++) = *(src++);
+
+			data += length;
+		}
+
+		if(true == define) {
+			if(ctx->m_Macros.m_Head == NULL) {
+				ctx->m_Macros.m_Head = mac;
+			} else {
+				ctx->m_Macros.m_Tail->m_Next = mac;
 			}
+			ctx->m_Macros.m_Tail = mac;
 		}
-		*dst = 0;
 	}
 
-	curmacLine = curmacLine->m_Next;
-
-	return outBufferPtr;
+	return true;
 }
-
@@ -39,18 +39,22 @@
 	Macro processing pointers, flags and counters
 */
 
+void InitMacros(EnvContext *ctx);
+void ReleaseMacros(EnvContext *ctx);
 bool OpenMacro(EnvContext *info, const char *name, const char *macroargs);
-void CloseMacro(void);
+void CloseMacro(EnvContext *ctx);
 void CreateMacro(EnvContext *info, const char *macroname, const char *macroargs);
 void EndMacro(EnvContext *line);
 void AddLineToMacro(EnvContext *line, const char *macroline);
 char *GetMacroLine(EnvContext *info, char *outBuffer);
-bool IsMacroOpen();
-bool IsProcessingMacro();
-void ResetMacroLocalLabels();
-int GetNextMacroLocalLabel();
-int GetMacroLocalLabel();
-bool OnFirstMacroLine();
+bool IsMacroOpen(EnvContext *ctx);
+bool IsProcessingMacro(EnvContext *ctx);
+void ResetMacroLocalLabels(EnvContext *ctx);
+int GetNextMacroLocalLabel(EnvContext *ctx);
+int GetMacroLocalLabel(EnvContext *ctx);
+bool OnFirstMacroLine(EnvContext *ctx);
+size_t PackMacros(EnvContext *ctx, const struct _Macro *after, u_char *buffer);
+bool UnpackMacros(EnvContext *ctx, const u_char *data, size_t size, const bool define);
 
 
 #endif	/* MACRO_H */
@@ -32,29 +32,20 @@
 #include "proto.h"
 #include "output.h"
 
-#define MAX_SEGMENTS	64
-
-/*
-	Added for OS-9 Module files
-*/
-static FILE			*outputFile = NULL;
-/*
-	output (emit) byte buffers and counters
-*/
-const OutputIFace	*filegen = NULL;			/* File generation interface pointer	*/
-static SEGMENT		segments[MAX_SEGMENTS];		/* Segment stack						*/
-static int			segmentCount = 0;			/* Current segment stack pointer		*/
-
-
 void BeginSegment(EnvContext *ctx, SEGMENT seg)
 {
-	segments[segmentCount++] = seg;
+	if(MAX_SEGMENTS == ctx->m_Output.m_SegmentCount) {
+		error(ctx, ERR_GENERAL, "too many segments opened");
+		return;
+	}
+
+	ctx->m_Output.m_Segments[ctx->m_Output.m_SegmentCount++] = seg;
 }
 
 
 void EndSegment(EnvContext *ctx)
 {
-	if(0 == segmentCount) {
+	if(0 == ctx->m_Output.m_SegmentCount) {
 		error(ctx, ERR_GENERAL, "not currently in a segment");
 		return;
 	}
@@ -63,21 +54,21 @@ void EndSegment(EnvContext *ctx)
 
 SEGMENT GetCurrentSegment(EnvContext *ctx)
 {
-	if(0 == segmentCount) {
+	if(0 == ctx->m_Output.m_SegmentCount) {
 		internal((ctx, "no segment defined for GetCurrentSegment()"));
 	}
-	return segments[segmentCount - 1];
+	return ctx->m_Output.m_Segments[ctx->m_Output.m_SegmentCount - 1];
 }
 
 
 void SetSegment(EnvContext *ctx, SEGMENT segment)
 {
-	if(0 == segmentCount) {
-		segmentCount++;
+	if(0 == ctx->m_Output.m_SegmentCount) {
+		ctx->m_Output.m_SegmentCount++;
 	}
 
-	ASSERTX(1 == segmentCount);
-	segments[0] = segment;
+	ASSERTX(1 == ctx->m_Output.m_SegmentCount);
+	ctx->m_Output.m_Segments[0] = segment;
 }
 
 
@@ -86,15 +77,16 @@ void SetSegment(EnvContext *ctx, SEGMENT segment)
 ----------------------------------------------------------------------------*/
 static void Emit(EnvContext *ctx, u_char byte)
 {
-	BumpPCReg(1);
+	BumpPCReg(ctx, 1);
+	ctx->m_Relax.m_Bytes++;
 
 	if(1 != ctx->m_Pass) {
 		if(ctx->m_ListingFlags.m_OptEnabled && (ctx->m_ListingFlags.P_total < PMIT_LIMIT)) {
 			ctx->m_ListingFlags.P_bytes[ctx->m_ListingFlags.P_total++] = byte;
 		}
 
-		if(true == ctx->m_Misc.Oflag && NULL != filegen) {
-			filegen->filegen_addbyte(ctx, byte, GetPCReg());
+		if(true == ctx->m_Misc.Oflag && NULL != ctx->m_Output.m_Gen) {
+			ctx->m_Output.m_Gen->filegen_addbyte(ctx, byte, GetPCReg(ctx));
 		}
 	}
 }
@@ -187,7 +179,7 @@ void EmitOpRelAddrByte(EnvContext *ctx, const u_char data)
 void EmitUninitData(EnvContext *ctx, const u_int16 size)
 {
 	FlushOutput(ctx);
-	BumpPCReg(size);
+	BumpPCReg(ctx, size);
 	FlushOutput(ctx);
 }
 
@@ -196,8 +188,12 @@ void EmitUninitData(EnvContext *ctx, const u_int16 size)
 
 void FlushOutput(EnvContext *ctx)
 {
-	if(NULL != filegen) {
-		filegen->filegen_flush(ctx, GetPCReg());
+	if(NULL != ctx->m_Output.m_Gen) {
+		ctx->m_Output.m_Gen->filegen_flush(ctx, GetPCReg(ctx));
+	}
+
+	if(NULL != ctx->m_Precomp.m_Use) {
+		PrecompFlush(ctx);
 	}
 }
 
@@ -211,6 +207,7 @@ bool OpenOutput(EnvContext *ctx, const char *name, const bool forceExt)
 	char	odirect[MAXDIR];
 	char	ofile[MAXFILE];
 	char	oext[MAXEXT];
+	const OutputIFace	*filegen;
 
 	ctx->m_ListingFlags.P_total = 0;
 	fext = NULL;
@@ -251,6 +248,7 @@ bool OpenOutput(EnvContext *ctx, const char *name, const bool forceExt)
 		break;
 
 	default:
+		filegen = NULL;
 		internal((ctx, "unknown output type"));
 	}
 
@@ -264,27 +262,28 @@ bool OpenOutput(EnvContext *ctx, const char *name, const bool forceExt)
 
 
 	/* Get output directory */
-	if(outputDirectory) {
-		fnmerge(outputName, "", outputDirectory, ofile, oext);
+	if(ctx->m_Files.m_OutputDirectory) {
+		fnmerge(outputName, "", ctx->m_Files.m_OutputDirectory, ofile, oext);
 	} else {
 		fnmerge(outputName, odrive, odirect, ofile, oext);
 	}
 
 	if(ctx->m_SilentMode == false) {
-		fprintf(stderr, "Output file:%s\n", outputName);
+		fprintf(ctx->m_Err, "Output file:%s\n", outputName);
 	}
 
 	if(S19FILE != ctx->m_OutputType) {
-		outputFile = fopen(outputName, "wb");
+		ctx->m_Output.m_File = fopen(outputName, "wb");
 	}  else {
-		outputFile = fopen(outputName, "wt");
+		ctx->m_Output.m_File = fopen(outputName, "wt");
 	}
 
-	if(outputFile == NULL) {
+	if(ctx->m_Output.m_File == NULL) {
 		fatal(ctx, "unable to open '%s' for output", outputName);
 	}
 
-	filegen->filegen_init(ctx, outputFile);
+	ctx->m_Output.m_Gen = filegen;
+	filegen->filegen_init(ctx, ctx->m_Output.m_File);
 
 	return true;
 }
@@ -294,13 +293,14 @@ void CloseOutput(EnvContext *ctx)
 {
 	FlushOutput(ctx);
 
-	if(NULL != filegen) {
-		filegen->filegen_finish(ctx, GetPCReg());
+	if(NULL != ctx->m_Output.m_Gen) {
+		ctx->m_Output.m_Gen->filegen_finish(ctx, GetPCReg(ctx));
+		ctx->m_Output.m_Gen = NULL;
 	}
 
-	if(NULL != outputFile) {
-		fclose(outputFile);
-		outputFile = NULL;
+	if(NULL != ctx->m_Output.m_File) {
+		fclose(ctx->m_Output.m_File);
+		ctx->m_Output.m_File = NULL;
 	}
 }
 
@@ -37,14 +37,6 @@
 
 
 
-typedef enum {
-	SEGMENT_INVALID = -1,
-	SEGMENT_CODE,
-	SEGMENT_DATA,
-	SEGMENT_BSS,
-} SEGMENT;
-
-
 typedef void (*FILEGEN_INIT_FUNC)(EnvContext *ctx, FILE *outFile);
 typedef void (*FILEGEN_ADDBYTE_FUNC)(EnvContext *ctx, const u_char val,const  u_int16 pcreg);
 typedef void (*FILEGEN_FINISH_FUNC)(EnvContext *ctx, const u_int16 regpc);
@@ -65,7 +57,7 @@ typedef void (*FILEGEN_FLUSH_FUNC)(EnvContext *ctx, const u_int16 regpc);
 	};
 
 
-typedef struct {
+typedef struct _OutputIFace {
 	const char				*extension;
 	bool					fill_uninitdata;
 	FILEGEN_INIT_FUNC		filegen_init;
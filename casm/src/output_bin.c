@@ -37,37 +37,33 @@
 #define MAX_BIN_RECORD_SIZE		255
 #endif
 
-static u_int16	E_pc;							/* PC at beginning of collection	*/
-static u_int16	E_Total;						/* total # bytes for one line			*/
-static u_char	E_Bytes[MAX_BIN_RECORD_SIZE];	/* Emitted held bytes					*/
-static FILE		*outputFile = NULL;
 FILEGEN(bin, bin, bin, false);
 
 
 static void filegen_bin_flush(EnvContext *ctx, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	if(0 != E_Total) {
-		fprintf(outputFile, "%c%c%c%c%c", 0x00, hibyte(E_Total), lobyte(E_Total), hibyte(E_pc), lobyte(E_pc));
-		fwrite(E_Bytes, 1, E_Total, outputFile);
+	if(0 != ctx->m_Output.m_Total) {
+		fprintf(ctx->m_Output.m_File, "%c%c%c%c%c", 0x00, hibyte(ctx->m_Output.m_Total), lobyte(ctx->m_Output.m_Total), hibyte(ctx->m_Output.m_PC), lobyte(ctx->m_Output.m_PC));
+		fwrite(ctx->m_Output.m_Bytes, 1, ctx->m_Output.m_Total, ctx->m_Output.m_File);
 	}
-	E_pc = regpc;
-	E_Total = 0;
+	ctx->m_Output.m_PC = regpc;
+	ctx->m_Output.m_Total = 0;
 }
 
 
 static void filegen_bin_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	E_Bytes[E_Total++] = val;
+	ctx->m_Output.m_Bytes[ctx->m_Output.m_Total++] = val;
 
-	if(MAX_BIN_RECORD_SIZE == E_Total) {
+	if(MAX_BIN_RECORD_SIZE == ctx->m_Output.m_Total) {
 		filegen_bin_flush(ctx, regpc);
 	}
 
@@ -76,18 +72,16 @@ static void filegen_bin_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 static void filegen_bin_finish(EnvContext *ctx, u_int16 regpc)
 {
 	filegen_bin_flush(ctx, regpc);
-	fprintf(outputFile, "%c%c%c%c%c", 0xff, 0x00, 0x00, hibyte(ctx->m_EntryPoint), lobyte(ctx->m_EntryPoint));
-	outputFile = NULL;
+	fprintf(ctx->m_Output.m_File, "%c%c%c%c%c", 0xff, 0x00, 0x00, hibyte(ctx->m_EntryPoint), lobyte(ctx->m_EntryPoint));
 }
 
 static void filegen_bin_init(EnvContext *ctx, FILE *outFile)
 {
-	ASSERTX(NULL == outputFile);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	outputFile = outFile;
-	E_Total = 0;
-	E_pc = 0;
+	ASSERTX(outFile == ctx->m_Output.m_File);
+	ctx->m_Output.m_Total = 0;
+	ctx->m_Output.m_PC = 0;
 
 }
 
@@ -53,72 +53,72 @@ void PrintLine(EnvContext *ctx, const char *lineBuffer, bool forceComment)
 	}
 
 	if(false == ctx->m_ListingFlags.OptNoLineNumbers) {
-		fprintf(stdout, "%5d%c ", (int)ctx->m_LineNumber, optchar);
+		fprintf(ctx->m_Out, "%5d%c ", (int)ctx->m_LineNumber, optchar);
 	}
 
 	if(false == ctx->m_ListingFlags.OptNoOpData) {
-		if(ctx->m_ListingFlags.P_total || true == ctx->m_ListingFlags.P_force || true == IsMacroOpen()) {
-			fprintf(stdout, "%04x ", GetOldPCReg());
+		if(ctx->m_ListingFlags.P_total || true == ctx->m_ListingFlags.P_force || true == IsMacroOpen(ctx)) {
+			fprintf(ctx->m_Out, "%04x ", GetOldPCReg(ctx));
 		}
 
 		else {
-			fprintf(stdout, "     ");
+			fprintf(ctx->m_Out, "     ");
 		}
 
 		i = 0;
 
 		if(i < ctx->m_ListingFlags.P_total) {
 			if(ctx->m_ListingFlags.P_total > 1 && (PAGE2 == ctx->m_ListingFlags.P_bytes[0] || PAGE3 == ctx->m_ListingFlags.P_bytes[0])) {
-				fprintf(stdout, "%02X", ctx->m_ListingFlags.P_bytes[i++]);
+				fprintf(ctx->m_Out, "%02X", ctx->m_ListingFlags.P_bytes[i++]);
 			}
-			fprintf(stdout, "%02X", ctx->m_ListingFlags.P_bytes[i++]);
+			fprintf(ctx->m_Out, "%02X", ctx->m_ListingFlags.P_bytes[i++]);
 
 			/*
-			fputc(SPACE, stdout);
+			fputc(SPACE, ctx->m_Out);
 			if(1 == i) {
-				fputc(SPACE, stdout);
-				fputc(SPACE, stdout);
+				fputc(SPACE, ctx->m_Out);
+				fputc(SPACE, ctx->m_Out);
 			}
 			*/
 		}
 
 		for(;i < ctx->m_ListingFlags.P_total && i < 6 ;i++) {
-			fprintf(stdout, "%02x", lobyte(ctx->m_ListingFlags.P_bytes[i]));
+			fprintf(ctx->m_Out, "%02x", lobyte(ctx->m_ListingFlags.P_bytes[i]));
 		}
 
 		for(; i < 6; i++) {
-			fprintf(stdout, "  ");
+			fprintf(ctx->m_Out, "  ");
 		}
 
-		fprintf(stdout, "  ");
+		fprintf(ctx->m_Out, "  ");
 
 		if(ctx->m_Misc.Cflag && ctx->m_CycleCount) {
-			fprintf(stdout, "[%2d] ", (int)ctx->m_CycleCount);
+			fprintf(ctx->m_Out, "[%2d] ", (int)ctx->m_CycleCount);
 		}
 
 		else {
-			fprintf(stdout, "       ");
+			fprintf(ctx->m_Out, "       ");
 		}
 	}
 
 	if(true == forceComment) {
-		putchar('*');
+		fputc('*', ctx->m_Out);
 	}
 
 	ptr = lineBuffer;
 	while( *ptr != EOS ) {
-		putchar(*ptr++);   /* just echo the line back out */
+		fputc(*ptr++, ctx->m_Out);   /* just echo the line back out */
 	}
 
 	if(false == ctx->m_ListingFlags.OptNoOpData) {
 		for(; i < ctx->m_ListingFlags.P_total; i++) {
 			if(0 == (i % 6)) {
-				fprintf(stdout, "\n            ");
+				fprintf(ctx->m_Out, "\n            ");
 			}
-			fprintf(stdout, "%02x", ctx->m_ListingFlags.P_bytes[i]);
+			fprintf(ctx->m_Out, "%02x", ctx->m_ListingFlags.P_bytes[i]);
 		}
 	}
-	fprintf(stdout, "\n");
+	fprintf(ctx->m_Out, "\n");
 }
 
 /*----------------------------------------------------------------------------
@@ -126,8 +126,8 @@ void PrintLine(EnvContext *ctx, const char *lineBuffer, bool forceComment)
 ----------------------------------------------------------------------------*/
 void PrintCycles(EnvContext *ctx, const int cycles)
 {
-	if(ctx->m_Pass == 2 && 0 != cycles) {
-		fprintf(stdout, "  ctx->m_CycleCount Counted:  %d\n\n", cycles);
+	if(ctx->m_Pass == 2 && false == ctx->m_Relax.m_Active && 0 != cycles) {
+		fprintf(ctx->m_Out, "  ctx->m_CycleCount Counted:  %d\n\n", cycles);
 	}
 }
 
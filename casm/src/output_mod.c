@@ -33,31 +33,28 @@
 
 #define MAX_MOD_RECORD_SIZE		512
 
-static FILE		*outputFile = NULL;
-static u_int16	E_Total;						/* total # bytes for one line			*/
-static u_char	E_Bytes[MAX_MOD_RECORD_SIZE];	/* Emitted held bytes					*/
 FILEGEN(mod, mod, mod, true);
 
 static void filegen_mod_flush(EnvContext *ctx, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	fwrite(E_Bytes, 1, E_Total, outputFile);
-	E_Total = 0;
+	fwrite(ctx->m_Output.m_Bytes, 1, ctx->m_Output.m_Total, ctx->m_Output.m_File);
+	ctx->m_Output.m_Total = 0;
 }
 
 
 static void filegen_mod_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	E_Bytes[E_Total++] = val;
+	ctx->m_Output.m_Bytes[ctx->m_Output.m_Total++] = val;
 
-	if(MAX_MOD_RECORD_SIZE == E_Total) {
+	if(MAX_MOD_RECORD_SIZE == ctx->m_Output.m_Total) {
 		filegen_mod_flush(ctx, regpc);
 	}
 
@@ -66,22 +63,20 @@ static void filegen_mod_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 static void filegen_mod_finish(EnvContext *ctx, u_int16 regpc)
 {
 	filegen_mod_flush(ctx, regpc);
-	outputFile = NULL;
 }
 
 static void filegen_mod_init(EnvContext *ctx, FILE *outFile)
 {
-	ASSERTX(NULL == outputFile);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	outputFile = outFile;
-	E_Total = 0;
+	ASSERTX(outFile == ctx->m_Output.m_File);
+	ctx->m_Output.m_Total = 0;
 
 	/* Write out the header */
-	fprintf(outputFile, "%c%c%c%c", 0x80, 0xc0, 0x55, 0x85);
+	fprintf(ctx->m_Output.m_File, "%c%c%c%c", 0x80, 0xc0, 0x55, 0x85);
 
 	/* Write out the exports */
-	EmitExports(ctx, outputFile);
+	EmitExports(ctx, ctx->m_Output.m_File);
 
 }
 
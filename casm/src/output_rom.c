@@ -33,9 +33,6 @@
 
 #define MAX_ROM_RECORD_SIZE	512
 
-static FILE			*outputFile = NULL;
-static u_int16		E_Total;						/* total # bytes for one line			*/
-static u_char		E_Bytes[MAX_ROM_RECORD_SIZE];	/* Emitted held bytes					*/
 
 
 
@@ -46,21 +43,20 @@ FILEGEN(rom, raw, raw, true);
 
 static void filegen_rom_init(EnvContext *ctx, FILE *outFile)
 {
-	ASSERTX(NULL == outputFile);
-	outputFile = outFile;
-	E_Total = 0;
+	ASSERTX(outFile == ctx->m_Output.m_File);
+	ctx->m_Output.m_Total = 0;
 }
 
 
 static void filegen_rom_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	E_Bytes[E_Total++] = val;
+	ctx->m_Output.m_Bytes[ctx->m_Output.m_Total++] = val;
 
-	if(MAX_ROM_RECORD_SIZE == E_Total) {
+	if(MAX_ROM_RECORD_SIZE == ctx->m_Output.m_Total) {
 		filegen_rom_flush(ctx, regpc);
 	}
 }
@@ -69,14 +65,14 @@ static void filegen_rom_addbyte(EnvContext *ctx, u_char val, u_int16 regpc)
 static void filegen_rom_flush(EnvContext *ctx, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	if(E_Total > 0) {
+	if(ctx->m_Output.m_Total > 0) {
 		if(true == ctx->m_Misc.Oflag) {
-			fwrite(E_Bytes, 1, E_Total, outputFile);
+			fwrite(ctx->m_Output.m_Bytes, 1, ctx->m_Output.m_Total, ctx->m_Output.m_File);
 		}
-		E_Total = 0;
+		ctx->m_Output.m_Total = 0;
 	}
 }
 
@@ -84,7 +80,7 @@ static void filegen_rom_flush(EnvContext *ctx, u_int16 regpc)
 static void filegen_rom_finish(EnvContext *ctx, u_int16 regpc)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
 	/* Fluish the output */
@@ -93,19 +89,18 @@ static void filegen_rom_finish(EnvContext *ctx, u_int16 regpc)
 	if(ROMBIN == ctx->m_OutputType) {
 		int length;
 
-		length = ftell(outputFile);
-		if(length > outputROMSize) {
-			warning(ctx, WARN_ROMSIZE, "ROM file is %d bytes larger than requested ROM size", length - outputROMSize);
+		length = ftell(ctx->m_Output.m_File);
+		if(length > ctx->m_Files.m_ROMSize) {
+			warning(ctx, WARN_ROMSIZE, "ROM file is %d bytes larger than requested ROM size", length - ctx->m_Files.m_ROMSize);
 		}
 		
 		else {
-			while(length < outputROMSize) {
-				fputc(0, outputFile);
+			while(length < ctx->m_Files.m_ROMSize) {
+				fputc(0, ctx->m_Output.m_File);
 				length++;
 			}
 		}
 	}
 
-	outputFile = NULL;
 }
 
@@ -33,10 +33,6 @@
 
 #define MAX_S19_RECORD_SIZE		32
 
-static FILE		*outputFile = NULL;
-static u_int16	E_Total;						/* total # bytes for one line			*/
-static u_int16	E_pc;							/* PC at beginning of collection	*/
-static u_char	E_Bytes[MAX_S19_RECORD_SIZE];	/* Emitted held bytes					*/
 FILEGEN(S19, S19, s19, true);
 
 
@@ -54,50 +50,50 @@ static void HexOut(EnvContext *ctx, FILE *out, const u_char byte)
 
 static void filegen_S19_init(EnvContext *ctx, FILE *outFile)
 {
-	outputFile = outFile;
-	E_Total = 0;
-	E_pc = 0;
+	ASSERTX(outFile == ctx->m_Output.m_File);
+	ctx->m_Output.m_Total = 0;
+	ctx->m_Output.m_PC = 0;
 }
 
 
 static void filegen_S19_flush(EnvContext *ctx, u_int16 pcreg)
 {
-	if(E_Total > 0) {
+	if(ctx->m_Output.m_Total > 0) {
 		int stat;
 		int i;
 		int chksum;
 
-		chksum =  E_Total + 3;    /* total bytes in this record */
-		chksum += lobyte(E_pc);
-		chksum += hibyte(E_pc);
+		chksum =  ctx->m_Output.m_Total + 3;    /* total bytes in this record */
+		chksum += lobyte(ctx->m_Output.m_PC);
+		chksum += hibyte(ctx->m_Output.m_PC);
 
-		stat = fprintf(outputFile, "S1");   /* record header preamble */
+		stat = fprintf(ctx->m_Output.m_File, "S1");   /* record header preamble */
 		if(stat != 2) {
 			fatal(ctx, "Error writing file");
 			return;
 		}
 
-		HexOut(ctx, outputFile, lobyte(E_Total + 3));	/* byte count +3 */
-		HexOut(ctx, outputFile, hibyte(E_pc));	/* high byte of PC */
-		HexOut(ctx, outputFile, lobyte(E_pc));	/* low byte of PC */
+		HexOut(ctx, ctx->m_Output.m_File, lobyte(ctx->m_Output.m_Total + 3));	/* byte count +3 */
+		HexOut(ctx, ctx->m_Output.m_File, hibyte(ctx->m_Output.m_PC));	/* high byte of PC */
+		HexOut(ctx, ctx->m_Output.m_File, lobyte(ctx->m_Output.m_PC));	/* low byte of PC */
 
-		for(i=0;i<E_Total;i++) {
-			chksum += E_Bytes[i];
-			HexOut(ctx, outputFile, E_Bytes[i]);    /* data byte */
+		for(i=0;i<ctx->m_Output.m_Total;i++) {
+			chksum += ctx->m_Output.m_Bytes[i];
+			HexOut(ctx, ctx->m_Output.m_File, ctx->m_Output.m_Bytes[i]);    /* data byte */
 		}
 
 		/* Output the checksum */
 		chksum =~ chksum;			/* one's complement */
-		HexOut(ctx, outputFile, lobyte(chksum));	/* checksum */
+		HexOut(ctx, ctx->m_Output.m_File, lobyte(chksum));	/* checksum */
 
-		stat = fprintf(outputFile, "\n");
+		stat = fprintf(ctx->m_Output.m_File, "\n");
 		if( stat < 0 ) {
 			fatal(ctx, "error writing file");
 		}
 	}
 
-	E_Total = 0;
-	E_pc = pcreg;
+	ctx->m_Output.m_Total = 0;
+	ctx->m_Output.m_PC = pcreg;
 }
 
 
@@ -108,12 +104,12 @@ static void filegen_S19_flush(EnvContext *ctx, u_int16 pcreg)
 static void filegen_S19_addbyte(EnvContext *ctx, u_char val, u_int16 pcreg)
 {
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	E_Bytes[E_Total++] = val;
+	ctx->m_Output.m_Bytes[ctx->m_Output.m_Total++] = val;
 
-	if(MAX_S19_RECORD_SIZE == E_Total) {
+	if(MAX_S19_RECORD_SIZE == ctx->m_Output.m_Total) {
 		filegen_S19_flush(ctx, pcreg);
 	}
 
@@ -129,10 +125,10 @@ static void filegen_S19_finish(EnvContext *ctx, u_int16 regpc)
 	int     chksum;
 
 	ASSERTX(2 == ctx->m_Pass);
-	ASSERTX(NULL != outputFile);
+	ASSERTX(NULL != ctx->m_Output.m_File);
 	ASSERTX(true == ctx->m_Misc.Oflag);
 
-	stat = fprintf(outputFile, "S9");		/* record header preamble */
+	stat = fprintf(ctx->m_Output.m_File, "S9");		/* record header preamble */
 	if( stat != 2 ) {
 		fatal(ctx, "error writing object file");
 	}
@@ -141,12 +137,12 @@ static void filegen_S19_finish(EnvContext *ctx, u_int16 regpc)
 	chksum += hibyte(ctx->m_EntryPoint);
 	chksum += lobyte(ctx->m_EntryPoint);
 	chksum =~ chksum;				/* one's complement */
-	HexOut(ctx, outputFile, 3);					/* byte count +1 */
-	HexOut(ctx, outputFile, hibyte(ctx->m_EntryPoint));	/* high byte of entry addres */
-	HexOut(ctx, outputFile, lobyte(ctx->m_EntryPoint));	/* low byte of entry address */
-	HexOut(ctx, outputFile, lobyte(chksum)); /* checksum */
+	HexOut(ctx, ctx->m_Output.m_File, 3);					/* byte count +1 */
+	HexOut(ctx, ctx->m_Output.m_File, hibyte(ctx->m_EntryPoint));	/* high byte of entry addres */
+	HexOut(ctx, ctx->m_Output.m_File, lobyte(ctx->m_EntryPoint));	/* low byte of entry address */
+	HexOut(ctx, ctx->m_Output.m_File, lobyte(chksum)); /* checksum */
 
-	stat = fprintf(outputFile, "\n");
+	stat = fprintf(ctx->m_Output.m_File, "\n");
 	if(stat < 0) {
 		fatal(ctx, "Error writing object file");
 		return;
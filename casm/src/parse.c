@@ -53,7 +53,7 @@ bool ProcessLine(EnvContext *ctx)
 		mne = NULL;
 	}
 
-	SetOldPCReg(GetPCReg());
+	SetOldPCReg(ctx, GetPCReg(ctx));
 
 	/*
 		Lines within MACRO/ENDM must be processed first in order to allow for
@@ -61,7 +61,7 @@ bool ProcessLine(EnvContext *ctx)
 		constructs are not supported and conditionals must exist entirely
 		inside or outside of the macro declaration or havoc will result
 	*/
-	if(true == IsProcessingMacro()) {
+	if(true == IsProcessingMacro(ctx)) {
 		if(NULL != mne && ENDM == mne->opcode) {
 			/* Proc the pseudo op as normal */
 			ProcPseudo(ctx, mne);
@@ -100,8 +100,13 @@ bool ProcessLine(EnvContext *ctx)
 		and we are not inside of a macro.
 	*/
 
+	/* Check that an include being recorded holds only definitions */
+	if(NULL != ctx->m_Precomp.m_Use) {
+		PrecompLine(ctx, mne);
+	}
+
 	 /* If we are inside of a structure add the element */
-	if(instruct == true) {
+	if(ctx->m_Structs.m_InStruct == true) {
 		StructAddElement(ctx, ctx->m_Label, ctx->m_Opcode);
 		return false;
 	}
@@ -134,7 +139,7 @@ bool ProcessLine(EnvContext *ctx)
 			bool result;
 
 			if(*ctx->m_Label) {
-				AddSymbol(ctx, ctx->m_Label, GetPCReg(), SYM_ADDRESS, NULL, 0);
+				AddSymbol(ctx, ctx->m_Label, GetPCReg(ctx), SYM_ADDRESS, NULL, 0);
 			}
 
 			result = OpenMacro(ctx, ctx->m_Opcode, ctx->m_Operand);
@@ -155,7 +160,7 @@ bool ProcessLine(EnvContext *ctx)
 
 		/* Add the symbol if it's there */
 		if(*ctx->m_Label) {
-			AddSymbol(ctx, ctx->m_Label, GetPCReg(), SYM_ADDRESS, NULL, 0);
+			AddSymbol(ctx, ctx->m_Label, GetPCReg(ctx), SYM_ADDRESS, NULL, 0);
 		}
 		/*
 		if(CPU_6809 == ctx->m_CPUType) {
@@ -168,7 +173,7 @@ bool ProcessLine(EnvContext *ctx)
 		if(NOPAGE == mne->page && 0x39 == mne->opcode) {
 			Symbol *sym = FindSymbol(ctx, "?RTS", true, false);
 			if(NULL == sym) {
-				AddSymbol(ctx, "?RTS", GetPCReg(), SYM_ADDRESS, NULL, 0);
+				AddSymbol(ctx, "?RTS", GetPCReg(ctx), SYM_ADDRESS, NULL, 0);
 			}
 		}
 
@@ -205,7 +210,7 @@ bool ParseLine(LineBuffer *line, EnvContext *ctx)
 	/* Reset the contents of the buffers */
 	src = line->m_Line;
 
-	procMacro = IsProcessingMacro();
+	procMacro = IsProcessingMacro(ctx);
 
 
 	/*************************************************************************
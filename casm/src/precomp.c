@@ -0,0 +1,1437 @@
+/*****************************************************************************
+	precomp.c	- Precompiled definitions
+
+	With -P<dir>, a file brought in by include that holds only definitions
+	(equates, rmb, org, conditionals, namespaces, macros and structures) is
+	saved at the end of pass 1 as the symbols, structures and macros it
+	defined, the state it left behind, the outside symbols it looked for
+	and a hash of every file it read.  A later assembly that includes the
+	same file in the same state and with the same options maps the saved
+	copy in instead of assembling the file again, provided the files and
+	outside symbols are unchanged.  Pass 2 then skips the file as well,
+	unless a symbol it looked for has changed value since pass 1.  Nothing
+	is loaded while a listing or cross reference is made, as they would
+	miss the lines of the file.
+*****************************************************************************/
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#include "as.h"
+#include "proto.h"
+#include "input.h"
+
+
+#define PRECOMP_MAGIC		"CPC1"
+#define PRECOMP_BYTE_ORDER	0x01020304
+#define HASH_BASIS			14695981039346656037ULL
+#define HASH_PRIME			1099511628211ULL
+#define NO_ORDINAL			((u_int32)-1)
+#define KEEP_LASTFOUND		-1
+
+
+/* the state a definitions file may change */
+typedef struct {
+	unsigned int	m_PC;
+	unsigned int	m_DP;
+	int				m_Segment;
+	unsigned int	m_OriginSet;
+	unsigned int	m_OrgBase;
+	int				m_MMUPage;
+	unsigned int	m_Address;
+} PrecompState;
+
+
+/*
+	A precompiled definitions file is this header, the input, dependency,
+	symbol, structure and element tables, the names they refer to and the
+	macros as packed by PackMacros.  Every field is 32 bits, in the byte
+	order of the machine that wrote it.
+*/
+typedef struct {
+	char			m_Magic[4];
+	unsigned int	m_ByteOrder;
+	unsigned int	m_Key[2];			/* low and high words of the key */
+	PrecompState	m_Start;
+	PrecompState	m_End;
+	unsigned int	m_NameSpace;		/* namespace at the end of the file */
+	unsigned int	m_Lines;			/* lines assembled */
+	unsigned int	m_Blanks;			/* blank lines, each a new local label scope */
+	unsigned int	m_Flushed;			/* the output was flushed */
+	unsigned int	m_Reread;			/* pass 2 reads it differently, see SaveInclude */
+	int				m_LastFound;		/* last structure looked up, or KEEP_LASTFOUND */
+	unsigned int	m_InputCount;
+	unsigned int	m_DepCount;
+	unsigned int	m_SymbolCount;
+	unsigned int	m_StructCount;		/* structures, which come before... */
+	unsigned int	m_UnionCount;		/* ...the unions, newest first */
+	unsigned int	m_ElementCount;
+	unsigned int	m_StringSize;
+	unsigned int	m_MacroSize;
+} SavedHeader;
+
+typedef struct {
+	unsigned int	m_Name;
+	unsigned int	m_Hash[2];
+} SavedInput;
+
+typedef struct {
+	unsigned int	m_Name;
+	unsigned int	m_Defined;
+	int				m_Type;
+	int				m_Value;
+} SavedDep;
+
+typedef struct {
+	unsigned int	m_Name;
+	int				m_Type;
+	int				m_Value;
+	int				m_Segment;
+	unsigned int	m_Struct;			/* structure number + 1, or 0 */
+	int				m_Count;			/* structure count */
+	int				m_Line;
+} SavedSymbol;
+
+typedef struct {
+	unsigned int	m_Name;
+	int				m_Size;
+	unsigned int	m_Elements;			/* number of elements */
+} SavedStruct;
+
+typedef struct {
+	unsigned int	m_Name;
+	int				m_Offset;
+	int				m_Size;
+	int				m_Count;
+	unsigned int	m_Child;			/* structure number + 1, or 0 */
+} SavedElement;
+
+
+/* a file read while recording an include */
+typedef struct {
+	size_t				m_Name;			/* offset of the name in m_Names */
+	unsigned long long	m_Hash;			/* hash of the text */
+} UseInput;
+
+/* an outside symbol looked for while recording an include */
+typedef struct {
+	size_t		m_Name;					/* offset of the name in m_Names */
+	const char	*m_Sort;				/* the name, while sorting */
+	bool		m_Defined;				/* the symbol was found */
+	SYMBOL_TYPE	m_Type;					/* its type, if found */
+	int			m_Value;				/* its value, if found */
+} UseLookup;
+
+/* an include recorded on pass 1, or followed on pass 2 */
+typedef struct _PrecompUse {
+	struct _PrecompUse	*m_Prev;		/* include it was included from */
+	int			m_Depth;				/* input files open while it is read */
+	bool		m_PassOnly;				/* included under ifp1 or ifp2 */
+	bool		m_Fallback;				/* pass 2 assembles what pass 1 loaded */
+	bool		m_Vetoed;				/* it can't be saved */
+	bool		m_Flushed;				/* it flushed the output */
+	unsigned long long	m_Key;			/* key of the saved copy */
+	char		*m_Path;				/* path it was opened by */
+	PrecompState	m_Start;			/* state when it was included */
+	u_int32		m_Serial;				/* first symbol it defined */
+	int			m_CondCount;			/* conditionals in effect */
+	int			m_ErrorCount;			/* errors before it */
+	int			m_WarningCount;			/* warnings before it */
+	int			m_LineCount;			/* lines assembled before it */
+	u_int16		m_Occur;				/* macro local label occurance */
+	struct _Macro	*m_Macros;			/* last macro defined before it */
+	Struct		*m_Structs;				/* last structure defined before it */
+	Struct		*m_Unions;				/* last union defined before it */
+	Struct		*m_LastFound;			/* structure last looked up before it */
+	UseInput	*m_Inputs;				/* files read */
+	int			m_InputCount;
+	int			m_InputSize;
+	UseLookup	*m_Lookups;				/* outside symbols looked for */
+	int			m_LookupCount;
+	int			m_LookupSize;
+	char		*m_Names;				/* names of the inputs and lookups */
+	size_t		m_NamesUsed;
+	size_t		m_NamesSize;
+} UseRecord;
+
+/* an include pass 1 loaded, which pass 2 may skip */
+typedef struct _PrecompSkip {
+	u_int32		m_Ordinal;				/* order of the include on both passes */
+	unsigned long long	m_Key;			/* key when pass 1 loaded it */
+	bool		m_Fallback;				/* a pass assembled it instead */
+	PrecompState	m_End;				/* state it leaves behind */
+	unsigned int	m_Lines;
+	unsigned int	m_Blanks;
+	bool		m_Flushed;
+	bool		m_KeepLastFound;		/* it leaves m_LastFound as it was */
+	Struct		*m_LastFound;
+	SavedDep	*m_Deps;				/* outside symbols it looked for */
+	unsigned int	m_DepCount;
+	char		*m_Strings;				/* names of the deps and the namespace */
+	unsigned int	m_NameSpace;
+} SkipRecord;
+
+
+
+/*----------------------------------------------------------------------------
+	HashBytes --- add bytes to a 64 bit FNV-1a hash
+----------------------------------------------------------------------------*/
+static unsigned long long HashBytes(unsigned long long hash, const void *data, size_t size)
+{
+	const u_char *ptr = (const u_char*)data;
+
+	while(size-- > 0) {
+		hash ^= *(ptr++);
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+
+/*----------------------------------------------------------------------------
+	GrowArray --- make room for one more entry in an array
+----------------------------------------------------------------------------*/
+static void *GrowArray(void *array, const int count, int *size, const size_t entrySize)
+{
+	if(count == *size) {
+		*size = (0 == *size ? 64 : *size * 2);
+		array = ReallocMem(array, *size * entrySize);
+	}
+
+	return array;
+}
+
+
+/*----------------------------------------------------------------------------
+	AddName --- add a name to a block of names, returning its offset
+----------------------------------------------------------------------------*/
+static size_t AddName(char **names, size_t *used, size_t *size, const char *name)
+{
+	size_t offset = *used;
+	size_t length = strlen(name) + 1;
+
+	while(*used + length > *size) {
+		*size = (0 == *size ? 4096 : *size * 2);
+		*names = (char*)ReallocMem(*names, *size);
+	}
+
+	memcpy(*names + offset, name, length);
+	*used += length;
+
+	return offset;
+}
+
+
+/*----------------------------------------------------------------------------
+	GetState --- read the state a definitions file may change
+----------------------------------------------------------------------------*/
+static void GetState(EnvContext *ctx, PrecompState *state)
+{
+	memset(state, 0, sizeof(PrecompState));
+
+	state->m_PC = GetPCReg(ctx);
+	state->m_DP = GetDPReg(ctx);
+	state->m_Segment = GetCurrentSegment(ctx);
+	state->m_OriginSet = ctx->m_OriginSet;
+	state->m_OrgBase = ctx->m_OrgBase;
+	state->m_MMUPage = ctx->m_Exports.m_MMUPage;
+	state->m_Address = ctx->m_Exports.m_Address;
+}
+
+
+/*----------------------------------------------------------------------------
+	SetEnd --- leave the assembler as a definitions file did
+----------------------------------------------------------------------------*/
+static void SetEnd(EnvContext *ctx, const PrecompState *end, const char *ns, const unsigned int lines, const unsigned int blanks, const bool flushed)
+{
+	SetPCReg(ctx, (u_int16)end->m_PC);
+	SetDPReg(ctx, (u_char)end->m_DP);
+	ctx->m_OriginSet = (0 != end->m_OriginSet);
+	ctx->m_OrgBase = (u_int16)end->m_OrgBase;
+	SetExportAddress(ctx, end->m_MMUPage, (u_int16)end->m_Address);
+	SetNamespace(ctx, ns);
+	ctx->m_LineCount += lines;
+
+	/* Every blank line starts a new scope for local labels */
+	if(0 != blanks) {
+		ctx->m_Macros.m_Occur = (u_int16)(ctx->m_Macros.m_Occur + blanks);
+		GetNextLocalLabel(ctx);
+	}
+
+	if(true == flushed) {
+		FlushOutput(ctx);
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompKey --- hash what an include depends on besides its lookups
+
+	That is the file, the options, the state it starts in, the namespace
+	and the include directories.
+----------------------------------------------------------------------------*/
+static unsigned long long PrecompKey(EnvContext *ctx, const char *path)
+{
+	PrecompState		state;
+	int					options[15];
+	unsigned long long	key;
+	int					i;
+
+	GetState(ctx, &state);
+
+	options[0] = ctx->m_CPUType;
+	options[1] = ctx->m_OutputType;
+	options[2] = ctx->m_Compat.m_AsmMode;
+	options[3] = ctx->m_Compat.m_AsmOpMask;
+	options[4] = ctx->m_Compat.m_Warn;
+	options[5] = ctx->m_Compat.m_DisablePCIndex;
+	options[6] = ctx->m_Compat.m_ForcePCR;
+	options[7] = ctx->m_Compat.m_ForceZeroOffset;
+	options[8] = ctx->m_Compat.m_StrictLocals;
+	options[9] = ctx->m_Compat.m_DisableMacros;
+	options[10] = ctx->m_Compat.m_DisableLocals;
+	options[11] = ctx->m_Compat.m_IgnoreCase;
+	options[12] = ctx->m_Compat.m_UsePrecedence;
+	options[13] = ctx->m_Compat.m_SemicolonComment;
+	options[14] = ctx->m_DisableWarnings;
+
+	key = HashBytes(HASH_BASIS, PRECOMP_MAGIC, 4);
+	key = HashBytes(key, path, strlen(path) + 1);
+	key = HashBytes(key, options, sizeof(options));
+	key = HashBytes(key, &state, sizeof(state));
+	key = HashBytes(key, ctx->m_Symbols.m_NameSpace, strlen(ctx->m_Symbols.m_NameSpace) + 1);
+
+	for(i = 0; i < ctx->m_Files.m_IncludeCount; i++) {
+		key = HashBytes(key, ctx->m_Files.m_IncludeDirs[i], strlen(ctx->m_Files.m_IncludeDirs[i]) + 1);
+	}
+
+	return key;
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompFileName --- make the name of the saved copy of an include
+
+	Returns false if the name would not fit in MAX_BUFFERSIZE bytes.
+----------------------------------------------------------------------------*/
+static bool PrecompFileName(EnvContext *ctx, const char *path, const unsigned long long key, char *name)
+{
+	const char *base;
+	const char *ptr;
+
+	base = path;
+	for(ptr = path; EOS != *ptr; ptr++) {
+		if('/' == *ptr || '\\' == *ptr || ':' == *ptr) {
+			base = ptr + 1;
+		}
+	}
+
+	if(strlen(ctx->m_Precomp.m_Dir) + strlen(base) + 24 >= MAX_BUFFERSIZE) {
+		return false;
+	}
+
+	sprintf(name, "%s/%s.%08x%08x.cpc", ctx->m_Precomp.m_Dir, base, (unsigned int)(key >> 32), (unsigned int)key);
+
+	return true;
+}
+
+
+/*----------------------------------------------------------------------------
+	MapFile --- map a saved file into memory, or return NULL
+----------------------------------------------------------------------------*/
+static void *MapFile(const char *name, size_t *size)
+{
+	void	*data = NULL;
+#ifdef _WIN32
+	FILE	*fp;
+	long	length;
+
+	fp = fopen(name, "rb");
+	if(NULL == fp) {
+		return NULL;
+	}
+
+	if(0 == fseek(fp, 0, SEEK_END) && (length = ftell(fp)) >= (long)sizeof(SavedHeader)) {
+		*size = length;
+		data = AllocMem(*size);
+
+		if(0 != fseek(fp, 0, SEEK_SET) || *size != fread(data, 1, *size, fp)) {
+			free(data);
+			data = NULL;
+		}
+	}
+
+	fclose(fp);
+#else
+	struct stat	st;
+	int			fd;
+
+	fd = open(name, O_RDONLY);
+	if(fd < 0) {
+		return NULL;
+	}
+
+	if(0 == fstat(fd, &st) && st.st_size >= (off_t)sizeof(SavedHeader)) {
+		*size = st.st_size;
+		data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if(MAP_FAILED == data) {
+			data = NULL;
+		}
+	}
+
+	close(fd);
+#endif
+
+	return data;
+}
+
+
+/*----------------------------------------------------------------------------
+	UnmapFile --- release a file mapped by MapFile
+----------------------------------------------------------------------------*/
+static void UnmapFile(void *data, const size_t size)
+{
+#ifdef _WIN32
+	free(data);
+#else
+	munmap(data, size);
+#endif
+}
+
+
+/*----------------------------------------------------------------------------
+	FreeUse --- release the record of an include
+----------------------------------------------------------------------------*/
+static void FreeUse(UseRecord *use)
+{
+	free(use->m_Path);
+	free(use->m_Inputs);
+	free(use->m_Lookups);
+	free(use->m_Names);
+	free(use);
+}
+
+
+/*----------------------------------------------------------------------------
+	PopUses --- release the records of the includes still open
+----------------------------------------------------------------------------*/
+static void PopUses(EnvContext *ctx)
+{
+	UseRecord *use;
+
+	while(NULL != (use = ctx->m_Precomp.m_Use)) {
+		ctx->m_Precomp.m_Use = use->m_Prev;
+		FreeUse(use);
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	InitPrecomp --- start using precompiled definitions after the options
+----------------------------------------------------------------------------*/
+void InitPrecomp(EnvContext *ctx)
+{
+	ctx->m_Precomp.m_Enabled = (NULL != ctx->m_Precomp.m_Dir
+		&& false == ctx->m_ListingFlags.m_CmdEnabled
+		&& false == ctx->m_ListingFlags.m_ListSymbols);
+
+	ResetPrecomp(ctx);
+}
+
+
+/*----------------------------------------------------------------------------
+	ResetPrecomp --- start matching the includes pass 1 loaded again
+----------------------------------------------------------------------------*/
+void ResetPrecomp(EnvContext *ctx)
+{
+	PopUses(ctx);
+
+	ctx->m_Precomp.m_NextSkip = 0;
+	ctx->m_Precomp.m_Ordinal = 0;
+	ctx->m_Precomp.m_PassOnly = 0;
+}
+
+
+/*----------------------------------------------------------------------------
+	ReleasePrecomp --- free the includes recorded and loaded
+----------------------------------------------------------------------------*/
+void ReleasePrecomp(EnvContext *ctx)
+{
+	int i;
+
+	PopUses(ctx);
+
+	for(i = 0; i < ctx->m_Precomp.m_SkipCount; i++) {
+		free(ctx->m_Precomp.m_Skips[i].m_Deps);
+		free(ctx->m_Precomp.m_Skips[i].m_Strings);
+	}
+
+	free(ctx->m_Precomp.m_Skips);
+	ctx->m_Precomp.m_Skips = NULL;
+	ctx->m_Precomp.m_SkipCount = 0;
+	ctx->m_Precomp.m_SkipSize = 0;
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompVeto --- keep the includes being recorded from being saved
+----------------------------------------------------------------------------*/
+void PrecompVeto(EnvContext *ctx)
+{
+	UseRecord *use;
+
+	for(use = ctx->m_Precomp.m_Use; NULL != use; use = use->m_Prev) {
+		use->m_Vetoed = true;
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	AddInput --- note a file read by the includes being recorded
+----------------------------------------------------------------------------*/
+static void AddInput(EnvContext *ctx, const char *name, const unsigned long long hash)
+{
+	UseRecord	*use;
+	int			i;
+
+	for(use = ctx->m_Precomp.m_Use; NULL != use; use = use->m_Prev) {
+		if(true == use->m_Vetoed) {
+			continue;
+		}
+
+		for(i = 0; i < use->m_InputCount; i++) {
+			if(0 == strcmp(use->m_Names + use->m_Inputs[i].m_Name, name)) {
+				break;
+			}
+		}
+
+		if(i == use->m_InputCount) {
+			use->m_Inputs = (UseInput*)GrowArray(use->m_Inputs, use->m_InputCount, &use->m_InputSize, sizeof(UseInput));
+			use->m_Inputs[i].m_Name = AddName(&use->m_Names, &use->m_NamesUsed, &use->m_NamesSize, name);
+			use->m_Inputs[i].m_Hash = hash;
+			use->m_InputCount++;
+		}
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompLookup --- note a symbol looked for by the includes being recorded
+
+	sym is the symbol found, or NULL.  Symbols an include defined itself
+	are not noted, and an include that uses an outside structure is not
+	saved, as the structure would not be its own to point to.
+----------------------------------------------------------------------------*/
+void PrecompLookup(EnvContext *ctx, const char *name, const Symbol *sym)
+{
+	UseRecord	*use;
+	UseLookup	*lookup;
+
+	if(1 != ctx->m_Pass) {
+		return;
+	}
+
+	for(use = ctx->m_Precomp.m_Use; NULL != use; use = use->m_Prev) {
+		if(true == use->m_Vetoed || (NULL != sym && sym->serial >= use->m_Serial)) {
+			continue;
+		}
+
+		if(NULL != sym && (SYM_STRUCTURE == sym->type || SYM_STRUCTDATA == sym->type || SYM_UNION == sym->type)) {
+			use->m_Vetoed = true;
+			continue;
+		}
+
+		use->m_Lookups = (UseLookup*)GrowArray(use->m_Lookups, use->m_LookupCount, &use->m_LookupSize, sizeof(UseLookup));
+		lookup = &use->m_Lookups[use->m_LookupCount++];
+		lookup->m_Name = AddName(&use->m_Names, &use->m_NamesUsed, &use->m_NamesSize, name);
+		lookup->m_Defined = (NULL != sym);
+		lookup->m_Type = (NULL != sym ? sym->type : SYM_VALUE);
+		lookup->m_Value = (NULL != sym ? (int)sym->value : 0);
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	FirstOwnStruct --- return the first structure an include defined
+----------------------------------------------------------------------------*/
+static Struct *FirstOwnStruct(EnvContext *ctx, const UseRecord *use)
+{
+	return (NULL == use->m_Structs ? ctx->m_Structs.m_Head : use->m_Structs->next);
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompStruct --- check a structure found by the includes being recorded
+----------------------------------------------------------------------------*/
+void PrecompStruct(EnvContext *ctx, const Struct *astruct)
+{
+	UseRecord	*use;
+	Struct		*own;
+
+	if(1 != ctx->m_Pass) {
+		return;
+	}
+
+	for(use = ctx->m_Precomp.m_Use; NULL != use; use = use->m_Prev) {
+		if(true == use->m_Vetoed) {
+			continue;
+		}
+
+		for(own = FirstOwnStruct(ctx, use); NULL != own && own != astruct; own = own->next) {
+		}
+
+		if(NULL == own) {
+			use->m_Vetoed = true;
+		}
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompFlush --- note that the includes being recorded flushed the output
+----------------------------------------------------------------------------*/
+void PrecompFlush(EnvContext *ctx)
+{
+	UseRecord *use;
+
+	for(use = ctx->m_Precomp.m_Use; NULL != use; use = use->m_Prev) {
+		use->m_Flushed = true;
+	}
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompLine --- check that a line of a recorded include is a definition
+
+	Only lines that define symbols, structures and macros, move the PC
+	without emitting code, or change state the saved copy brings back are
+	allowed.  Lines inside a structure are checked as its elements are
+	added.
+----------------------------------------------------------------------------*/
+void PrecompLine(EnvContext *ctx, const Mneumonic *mne)
+{
+	if(1 != ctx->m_Pass || true == ctx->m_Structs.m_InStruct) {
+		return;
+	}
+
+	/* A line with only a label defines nothing, any other is a macro */
+	if(NULL == mne) {
+		if(NULL != ctx->m_Opcode && EOS != *ctx->m_Opcode) {
+			PrecompVeto(ctx);
+		}
+		return;
+	}
+
+	if(PSEUDO == mne->optype) {
+		switch(mne->opcode) {
+		case RMB:
+		case RMD:
+		case RMQ:
+			/* Modules fill reserved memory with zeros */
+			if(MODBIN == ctx->m_OutputType) {
+				break;
+			}
+			return;
+
+		case NULL_OP:
+		case EQU:
+		case ORG:
+		case SETDP:
+		case LIB:
+		case NAMESPACE:
+		case ENDNS:
+		case MACRO:
+		case STRUCT:
+		case IF:
+		case IFN:
+		case IFNDEF:
+		case IFDEF:
+		case IFEQ:
+		case IFNE:
+		case IFGT:
+		case IFGE:
+		case IFLT:
+		case IFLE:
+		case COND:
+		case ELSE:
+		case ENDIF:
+		case ENDC:
+		case TITLE:
+		case NAME:
+		case PAGE:
+		case LIST:
+		case NLST:
+			return;
+		}
+	}
+
+	PrecompVeto(ctx);
+}
+
+
+/*----------------------------------------------------------------------------
+	CompareLookup --- qsort comparison of two lookups by name
+----------------------------------------------------------------------------*/
+static int CompareLookup(const void *a, const void *b)
+{
+	const UseLookup *x = (const UseLookup*)a;
+	const UseLookup *y = (const UseLookup*)b;
+	int result;
+
+	result = strcmp(x->m_Sort, y->m_Sort);
+	if(0 == result) {
+		result = (int)x->m_Defined - (int)y->m_Defined;
+	}
+
+	return result;
+}
+
+
+/*----------------------------------------------------------------------------
+	CompareSerial --- qsort comparison of two symbols by the order they were added
+----------------------------------------------------------------------------*/
+static int CompareSerial(const void *a, const void *b)
+{
+	u_int32 x = (*(const Symbol**)a)->serial;
+	u_int32 y = (*(const Symbol**)b)->serial;
+
+	return (x < y ? -1 : x > y);
+}
+
+
+/*----------------------------------------------------------------------------
+	FindOwnStruct --- return the number + 1 of a structure in a table,
+	0 for NULL or -1 if it is not there
+----------------------------------------------------------------------------*/
+static int FindOwnStruct(Struct **table, const int count, const Struct *astruct)
+{
+	int i;
+
+	if(NULL == astruct) {
+		return 0;
+	}
+
+	for(i = 0; i < count; i++) {
+		if(table[i] == astruct) {
+			return i + 1;
+		}
+	}
+
+	return -1;
+}
+
+
+/*----------------------------------------------------------------------------
+	SaveInclude --- write the saved copy of an include
+
+	The copy is written under a temporary name and renamed, so that other
+	assemblies sharing the directory never see part of one.  An include
+	whose structures point to structures it did not define is not saved.
+
+	A symbol looked for before the include defined it, as an ifndef guard
+	does, will be found on pass 2, so pass 2 has to assemble the include.
+----------------------------------------------------------------------------*/
+static void SaveInclude(EnvContext *ctx, UseRecord *use)
+{
+	SavedHeader		header;
+	SavedInput		*inputs;
+	SavedDep		*deps;
+	SavedSymbol		*symbols;
+	SavedStruct		*structs;
+	SavedElement	*elements;
+	Symbol			**own;
+	Symbol			*sym;
+	Struct			**table;
+	Struct			*astruct;
+	Element			*el;
+	u_char			*macros;
+	char			*strings;
+	size_t			stringsUsed;
+	size_t			stringsSize;
+	size_t			macroSize;
+	char			name[MAX_BUFFERSIZE];
+	char			temp[MAX_BUFFERSIZE + 48];
+	u_int32			slot;
+	int				count;
+	int				child;
+	int				i;
+	bool			ok;
+	FILE			*fp;
+
+	memset(&header, 0, sizeof(header));
+	strings = NULL;
+	stringsUsed = 0;
+	stringsSize = 0;
+	ok = true;
+
+	/* 1. The structures it defined, then the unions */
+	count = 0;
+	for(astruct = FirstOwnStruct(ctx, use); NULL != astruct; astruct = astruct->next) {
+		count++;
+	}
+	header.m_StructCount = count;
+
+	for(astruct = ctx->m_Structs.m_Unions; astruct != use->m_Unions; astruct = astruct->next) {
+		count++;
+	}
+	header.m_UnionCount = count - header.m_StructCount;
+
+	table = (Struct**)AllocMem((count + 1) * sizeof(Struct*));
+	structs = (SavedStruct*)AllocMem((count + 1) * sizeof(SavedStruct));
+
+	count = 0;
+	for(astruct = FirstOwnStruct(ctx, use); NULL != astruct; astruct = astruct->next) {
+		table[count++] = astruct;
+	}
+	for(astruct = ctx->m_Structs.m_Unions; astruct != use->m_Unions; astruct = astruct->next) {
+		table[count++] = astruct;
+	}
+
+	for(i = 0; i < count; i++) {
+		structs[i].m_Name = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, table[i]->name);
+		structs[i].m_Size = table[i]->size;
+		structs[i].m_Elements = 0;
+
+		for(el = table[i]->el_head; NULL != el; el = el->next) {
+			structs[i].m_Elements++;
+			header.m_ElementCount++;
+		}
+	}
+
+	elements = (SavedElement*)AllocMem((header.m_ElementCount + 1) * sizeof(SavedElement));
+	header.m_ElementCount = 0;
+
+	for(i = 0; i < count; i++) {
+		for(el = table[i]->el_head; NULL != el; el = el->next) {
+			child = FindOwnStruct(table, count, el->child);
+			ok = ok && child >= 0;
+
+			elements[header.m_ElementCount].m_Name = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, el->name);
+			elements[header.m_ElementCount].m_Offset = el->offset;
+			elements[header.m_ElementCount].m_Size = el->size;
+			elements[header.m_ElementCount].m_Count = el->count;
+			elements[header.m_ElementCount].m_Child = child;
+			header.m_ElementCount++;
+		}
+	}
+
+	if(ctx->m_Structs.m_LastFound == use->m_LastFound) {
+		header.m_LastFound = KEEP_LASTFOUND;
+	} else {
+		header.m_LastFound = FindOwnStruct(table, count, ctx->m_Structs.m_LastFound);
+		ok = ok && header.m_LastFound >= 0;
+	}
+
+	/* 2. The symbols it defined, in the order it defined them */
+	own = (Symbol**)AllocMem((ctx->m_Symbols.m_Count - use->m_Serial + 1) * sizeof(Symbol*));
+	for(slot = 0; slot < ctx->m_Symbols.m_TableSize; slot++) {
+		for(sym = ctx->m_Symbols.m_Table[slot]; NULL != sym; sym = sym->next) {
+			if(sym->serial >= use->m_Serial) {
+				own[header.m_SymbolCount++] = sym;
+			}
+		}
+	}
+
+	qsort(own, header.m_SymbolCount, sizeof(Symbol*), CompareSerial);
+
+	symbols = (SavedSymbol*)AllocMem((header.m_SymbolCount + 1) * sizeof(SavedSymbol));
+	for(i = 0; i < (int)header.m_SymbolCount; i++) {
+		sym = own[i];
+
+		switch(sym->type) {
+		case SYM_STRUCTURE:
+		case SYM_STRUCTDATA:
+		case SYM_UNION:
+			child = FindOwnStruct(table, count, sym->astruct);
+			ok = ok && child > 0;
+			break;
+
+		case SYM_ADDRESS:
+		case SYM_VALUE:
+			child = 0;
+			break;
+
+		default:
+			child = 0;
+			ok = false;
+			break;
+		}
+
+		symbols[i].m_Name = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, sym->name);
+		symbols[i].m_Type = sym->type;
+		symbols[i].m_Value = (int)sym->value;
+		symbols[i].m_Segment = sym->segment;
+		symbols[i].m_Struct = child;
+		symbols[i].m_Count = sym->stcount;
+		symbols[i].m_Line = (NULL != sym->L_list ? sym->L_list->L_num : 0);
+	}
+
+	/* 3. The outside symbols it looked for, once each */
+	for(i = 0; i < use->m_LookupCount; i++) {
+		use->m_Lookups[i].m_Sort = use->m_Names + use->m_Lookups[i].m_Name;
+	}
+
+	qsort(use->m_Lookups, use->m_LookupCount, sizeof(UseLookup), CompareLookup);
+
+	deps = (SavedDep*)AllocMem((use->m_LookupCount + 1) * sizeof(SavedDep));
+	for(i = 0; i < use->m_LookupCount; i++) {
+		const UseLookup *lookup = &use->m_Lookups[i];
+
+		if(i > 0 && 0 == CompareLookup(lookup, lookup - 1)) {
+			continue;
+		}
+
+		/* A symbol it looked for before defining it is its own */
+		if(false == lookup->m_Defined) {
+			sym = LookupSymbol(ctx, lookup->m_Sort);
+			if(NULL != sym && sym->serial >= use->m_Serial) {
+				header.m_Reread = 1;
+				continue;
+			}
+		}
+
+		deps[header.m_DepCount].m_Name = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, lookup->m_Sort);
+		deps[header.m_DepCount].m_Defined = lookup->m_Defined;
+		deps[header.m_DepCount].m_Type = lookup->m_Type;
+		deps[header.m_DepCount].m_Value = lookup->m_Value;
+		header.m_DepCount++;
+	}
+
+	/* 4. The files it read */
+	inputs = (SavedInput*)AllocMem((use->m_InputCount + 1) * sizeof(SavedInput));
+	for(i = 0; i < use->m_InputCount; i++) {
+		inputs[i].m_Name = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, use->m_Names + use->m_Inputs[i].m_Name);
+		inputs[i].m_Hash[0] = (unsigned int)use->m_Inputs[i].m_Hash;
+		inputs[i].m_Hash[1] = (unsigned int)(use->m_Inputs[i].m_Hash >> 32);
+	}
+	header.m_InputCount = use->m_InputCount;
+
+	/* 5. The macros it defined and the state it left */
+	macroSize = PackMacros(ctx, use->m_Macros, NULL);
+	macros = (u_char*)AllocMem(macroSize + 1);
+	PackMacros(ctx, use->m_Macros, macros);
+
+	memcpy(header.m_Magic, PRECOMP_MAGIC, 4);
+	header.m_ByteOrder = PRECOMP_BYTE_ORDER;
+	header.m_Key[0] = (unsigned int)use->m_Key;
+	header.m_Key[1] = (unsigned int)(use->m_Key >> 32);
+	header.m_Start = use->m_Start;
+	GetState(ctx, &header.m_End);
+	header.m_NameSpace = (unsigned int)AddName(&strings, &stringsUsed, &stringsSize, ctx->m_Symbols.m_NameSpace);
+	header.m_Lines = ctx->m_LineCount - use->m_LineCount;
+	header.m_Blanks = (u_int16)(ctx->m_Macros.m_Occur - use->m_Occur);
+	header.m_Flushed = use->m_Flushed;
+	header.m_StringSize = (unsigned int)stringsUsed;
+	header.m_MacroSize = (unsigned int)macroSize;
+
+	/* 6. Write it out */
+	if(true == ok && true == PrecompFileName(ctx, use->m_Path, use->m_Key, name)) {
+		sprintf(temp, "%s.%d.%lx", name, (int)getpid(), (unsigned long)(size_t)ctx);
+
+		fp = fopen(temp, "wb");
+		if(NULL != fp) {
+			ok = (1 == fwrite(&header, sizeof(header), 1, fp));
+			ok = ok && header.m_InputCount == fwrite(inputs, sizeof(SavedInput), header.m_InputCount, fp);
+			ok = ok && header.m_DepCount == fwrite(deps, sizeof(SavedDep), header.m_DepCount, fp);
+			ok = ok && header.m_SymbolCount == fwrite(symbols, sizeof(SavedSymbol), header.m_SymbolCount, fp);
+			ok = ok && (size_t)count == fwrite(structs, sizeof(SavedStruct), count, fp);
+			ok = ok && header.m_ElementCount == fwrite(elements, sizeof(SavedElement), header.m_ElementCount, fp);
+			ok = ok && stringsUsed == fwrite(strings, 1, stringsUsed, fp);
+			ok = ok && macroSize == fwrite(macros, 1, macroSize, fp);
+			ok = (0 == fclose(fp)) && ok;
+
+#ifdef _WIN32
+			if(true == ok) {
+				remove(name);
+			}
+#endif
+			if(false == ok || 0 != rename(temp, name)) {
+				remove(temp);
+			}
+		}
+	}
+
+	free(macros);
+	free(inputs);
+	free(deps);
+	free(symbols);
+	free(own);
+	free(elements);
+	free(structs);
+	free(table);
+	free(strings);
+}
+
+
+/*----------------------------------------------------------------------------
+	CheckDeps --- check that outside symbols are as an include found them
+----------------------------------------------------------------------------*/
+static bool CheckDeps(EnvContext *ctx, const SavedDep *deps, const unsigned int count, const char *strings)
+{
+	const Symbol	*sym;
+	unsigned int	i;
+
+	for(i = 0; i < count; i++) {
+		sym = LookupSymbol(ctx, strings + deps[i].m_Name);
+
+		if(0 != deps[i].m_Defined) {
+			if(NULL == sym || (int)sym->type != deps[i].m_Type || (int)sym->value != deps[i].m_Value) {
+				return false;
+			}
+		} else if(NULL != sym) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*----------------------------------------------------------------------------
+	LoadInclude --- bring in an include from its saved copy
+
+	Everything is checked before anything is added: the copy must be whole
+	and made from the same files, every outside symbol it looked for must
+	be as it found it and none of its names may be defined yet.
+----------------------------------------------------------------------------*/
+static bool LoadInclude(EnvContext *ctx, const char *path, const unsigned long long key, const u_int32 ordinal)
+{
+	const SavedHeader	*header;
+	const SavedInput	*inputs;
+	const SavedDep		*deps;
+	const SavedSymbol	*symbols;
+	const SavedStruct	*structs;
+	const SavedElement	*elements;
+	const char			*strings;
+	const u_char		*macros;
+	const char			*text;
+	PrecompState		state;
+	SkipRecord			*skip;
+	Struct				**made;
+	Struct				*astruct;
+	Element				*el;
+	char				name[MAX_BUFFERSIZE];
+	void				*data;
+	size_t				size;
+	size_t				textSize;
+	unsigned int		count;
+	unsigned int		next;
+	unsigned int		i;
+	unsigned int		j;
+	bool				ok;
+
+	if(false == PrecompFileName(ctx, path, key, name) || NULL == (data = MapFile(name, &size))) {
+		return false;
+	}
+
+	/* 1. The copy must be whole and made in this state */
+	header = (const SavedHeader*)data;
+	count = header->m_StructCount + header->m_UnionCount;
+	GetState(ctx, &state);
+
+	ok = (0 == memcmp(header->m_Magic, PRECOMP_MAGIC, 4)
+		&& PRECOMP_BYTE_ORDER == header->m_ByteOrder
+		&& (unsigned int)key == header->m_Key[0]
+		&& (unsigned int)(key >> 32) == header->m_Key[1]
+		&& 0 == memcmp(&state, &header->m_Start, sizeof(state))
+		&& 0 != header->m_InputCount
+		&& header->m_InputCount <= size && header->m_DepCount <= size
+		&& header->m_SymbolCount <= size && header->m_StructCount <= size
+		&& header->m_UnionCount <= size && header->m_ElementCount <= size
+		&& 0 != header->m_StringSize && header->m_StringSize <= size && header->m_MacroSize <= size
+		&& sizeof(SavedHeader)
+			+ header->m_InputCount * sizeof(SavedInput)
+			+ header->m_DepCount * sizeof(SavedDep)
+			+ header->m_SymbolCount * sizeof(SavedSymbol)
+			+ (size_t)count * sizeof(SavedStruct)
+			+ header->m_ElementCount * sizeof(SavedElement)
+			+ header->m_StringSize + header->m_MacroSize == size);
+
+	if(false == ok) {
+		UnmapFile(data, size);
+		return false;
+	}
+
+	inputs = (const SavedInput*)(header + 1);
+	deps = (const SavedDep*)(inputs + header->m_InputCount);
+	symbols = (const SavedSymbol*)(deps + header->m_DepCount);
+	structs = (const SavedStruct*)(symbols + header->m_SymbolCount);
+	elements = (const SavedElement*)(structs + count);
+	strings = (const char*)(elements + header->m_ElementCount);
+	macros = (const u_char*)(strings + header->m_StringSize);
+
+	/* Every name must be in the names, which must end with an EOS */
+	ok = (EOS == strings[header->m_StringSize - 1]
+		&& header->m_NameSpace < header->m_StringSize
+		&& strlen(strings + header->m_NameSpace) <= MAX_LABELSIZE
+		&& header->m_Blanks <= 0xffff
+		&& (KEEP_LASTFOUND == header->m_LastFound || (header->m_LastFound >= 0 && (unsigned int)header->m_LastFound <= count)));
+
+	for(i = 0; true == ok && i < header->m_InputCount; i++) {
+		ok = (inputs[i].m_Name < header->m_StringSize);
+	}
+
+	ok = ok && 0 == strcmp(strings + inputs[0].m_Name, path);
+
+	for(i = 0; true == ok && i < header->m_DepCount; i++) {
+		ok = (deps[i].m_Name < header->m_StringSize);
+	}
+
+	for(i = 0; true == ok && i < header->m_SymbolCount; i++) {
+		ok = (symbols[i].m_Name < header->m_StringSize
+			&& symbols[i].m_Segment >= SEGMENT_INVALID && symbols[i].m_Segment <= SEGMENT_BSS
+			&& symbols[i].m_Struct <= count);
+
+		switch(symbols[i].m_Type) {
+		case SYM_STRUCTURE:
+		case SYM_STRUCTDATA:
+		case SYM_UNION:
+			ok = ok && 0 != symbols[i].m_Struct;
+			break;
+
+		case SYM_ADDRESS:
+		case SYM_VALUE:
+			ok = ok && 0 == symbols[i].m_Struct;
+			break;
+
+		default:
+			ok = false;
+			break;
+		}
+	}
+
+	next = 0;
+	for(i = 0; true == ok && i < count; i++) {
+		ok = (structs[i].m_Name < header->m_StringSize
+			&& strlen(strings + structs[i].m_Name) < MAX_LABELSIZE
+			&& structs[i].m_Elements <= header->m_ElementCount - next);
+
+		if(true == ok) {
+			next += structs[i].m_Elements;
+		}
+	}
+
+	ok = ok && next == header->m_ElementCount;
+
+	for(i = 0; true == ok && i < header->m_ElementCount; i++) {
+		ok = (elements[i].m_Name < header->m_StringSize
+			&& strlen(strings + elements[i].m_Name) < MAX_LABELSIZE
+			&& elements[i].m_Child <= count);
+	}
+
+	/* 2. It must be made from the same files */
+	for(i = 0; true == ok && i < header->m_InputCount; i++) {
+		unsigned long long hash;
+
+		ok = GetSourceText(ctx, strings + inputs[i].m_Name, &text, &textSize);
+		if(true == ok) {
+			hash = HashBytes(HASH_BASIS, text, textSize);
+			ok = ((unsigned int)hash == inputs[i].m_Hash[0] && (unsigned int)(hash >> 32) == inputs[i].m_Hash[1]);
+		}
+	}
+
+	/* 3. The outside symbols must be as it found them, and its names free */
+	ok = ok && CheckDeps(ctx, deps, header->m_DepCount, strings);
+
+	for(i = 0; true == ok && i < header->m_SymbolCount; i++) {
+		ok = (NULL == LookupSymbol(ctx, strings + symbols[i].m_Name));
+	}
+
+	for(i = 0; true == ok && i < header->m_StructCount; i++) {
+		for(astruct = ctx->m_Structs.m_Head; NULL != astruct; astruct = astruct->next) {
+			if(0 == strcmp(astruct->name, strings + structs[i].m_Name)) {
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	ok = ok && UnpackMacros(ctx, macros, header->m_MacroSize, false);
+
+	if(false == ok) {
+		UnmapFile(data, size);
+		return false;
+	}
+
+	/* 4. The includes being recorded depend on what it read and looked for */
+	if(NULL != ctx->m_Precomp.m_Use) {
+		for(i = 0; i < header->m_InputCount; i++) {
+			AddInput(ctx, strings + inputs[i].m_Name, inputs[i].m_Hash[0] | ((unsigned long long)inputs[i].m_Hash[1] << 32));
+		}
+
+		for(i = 0; i < header->m_DepCount; i++) {
+			PrecompLookup(ctx, strings + deps[i].m_Name, LookupSymbol(ctx, strings + deps[i].m_Name));
+		}
+	}
+
+	/* 5. Bring in its structures, symbols and macros */
+	made = (Struct**)AllocMem((count + 1) * sizeof(Struct*));
+	next = 0;
+
+	for(i = 0; i < count; i++) {
+		made[i] = (Struct*)AllocMem(sizeof(Struct));
+		strcpy(made[i]->name, strings + structs[i].m_Name);
+		made[i]->size = structs[i].m_Size;
+		made[i]->el_head = NULL;
+		made[i]->el_tail = NULL;
+		made[i]->next = NULL;
+	}
+
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < structs[i].m_Elements; j++, next++) {
+			el = (Element*)AllocMem(sizeof(Element));
+			strcpy(el->name, strings + elements[next].m_Name);
+			el->offset = elements[next].m_Offset;
+			el->size = elements[next].m_Size;
+			el->count = elements[next].m_Count;
+			el->child = (0 == elements[next].m_Child ? NULL : made[elements[next].m_Child - 1]);
+			el->next = NULL;
+
+			if(NULL == made[i]->el_head) {
+				made[i]->el_head = el;
+			} else {
+				made[i]->el_tail->next = el;
+			}
+			made[i]->el_tail = el;
+		}
+	}
+
+	for(i = 0; i < header->m_StructCount; i++) {
+		if(NULL == ctx->m_Structs.m_Head) {
+			ctx->m_Structs.m_Head = made[i];
+		} else {
+			ctx->m_Structs.m_Tail->next = made[i];
+		}
+		ctx->m_Structs.m_Tail = made[i];
+	}
+
+	for(i = count; i > header->m_StructCount; i--) {
+		made[i - 1]->next = ctx->m_Structs.m_Unions;
+		ctx->m_Structs.m_Unions = made[i - 1];
+	}
+
+	for(i = 0; i < header->m_SymbolCount; i++) {
+		InsertSymbol(ctx, strings + symbols[i].m_Name, symbols[i].m_Value, (SYMBOL_TYPE)symbols[i].m_Type,
+			(SEGMENT)symbols[i].m_Segment, (0 == symbols[i].m_Struct ? NULL : made[symbols[i].m_Struct - 1]),
+			symbols[i].m_Count, symbols[i].m_Line);
+	}
+
+	UnpackMacros(ctx, macros, header->m_MacroSize, true);
+
+	if(KEEP_LASTFOUND != header->m_LastFound) {
+		ctx->m_Structs.m_LastFound = (0 == header->m_LastFound ? NULL : made[header->m_LastFound - 1]);
+	}
+
+	/* 6. Leave the state as it did */
+	SetEnd(ctx, &header->m_End, strings + header->m_NameSpace, header->m_Lines, header->m_Blanks, 0 != header->m_Flushed);
+
+	/* 7. Note it for pass 2 */
+	if(NO_ORDINAL != ordinal) {
+		ctx->m_Precomp.m_Skips = (SkipRecord*)GrowArray(ctx->m_Precomp.m_Skips, ctx->m_Precomp.m_SkipCount, &ctx->m_Precomp.m_SkipSize, sizeof(SkipRecord));
+		skip = &ctx->m_Precomp.m_Skips[ctx->m_Precomp.m_SkipCount++];
+
+		skip->m_Ordinal = ordinal;
+		skip->m_Key = key;
+		skip->m_Fallback = (0 != header->m_Reread);
+		skip->m_End = header->m_End;
+		skip->m_Lines = header->m_Lines;
+		skip->m_Blanks = header->m_Blanks;
+		skip->m_Flushed = (0 != header->m_Flushed);
+		skip->m_KeepLastFound = (KEEP_LASTFOUND == header->m_LastFound);
+		skip->m_LastFound = ctx->m_Structs.m_LastFound;
+		skip->m_DepCount = header->m_DepCount;
+		skip->m_Deps = (SavedDep*)AllocMem((header->m_DepCount + 1) * sizeof(SavedDep));
+		memcpy(skip->m_Deps, deps, header->m_DepCount * sizeof(SavedDep));
+		skip->m_Strings = (char*)AllocMem(header->m_StringSize);
+		memcpy(skip->m_Strings, strings, header->m_StringSize);
+		skip->m_NameSpace = header->m_NameSpace;
+	}
+
+	free(made);
+	UnmapFile(data, size);
+
+	return true;
+}
+
+
+/*----------------------------------------------------------------------------
+	SkipInclude --- skip an include on pass 2 that pass 1 loaded
+
+	An include is only skipped if it starts in the same state and the
+	outside symbols it looked for still have the values pass 1 gave them.
+	Once a pass has had to assemble it, every later pass does too, so
+	that its symbols are defined the same way on each of them.
+----------------------------------------------------------------------------*/
+static bool SkipInclude(EnvContext *ctx, SkipRecord *skip, const char *path)
+{
+	if(false == skip->m_Fallback) {
+		if(PrecompKey(ctx, path) != skip->m_Key || false == CheckDeps(ctx, skip->m_Deps, skip->m_DepCount, skip->m_Strings)) {
+			skip->m_Fallback = true;
+		}
+	}
+
+	if(true == skip->m_Fallback) {
+		return false;
+	}
+
+	SetEnd(ctx, &skip->m_End, skip->m_Strings + skip->m_NameSpace, skip->m_Lines, skip->m_Blanks, skip->m_Flushed);
+
+	if(false == skip->m_KeepLastFound) {
+		ctx->m_Structs.m_LastFound = skip->m_LastFound;
+	}
+
+	return true;
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompUse --- start on an include that has just been opened
+
+	Returns true if its definitions were loaded from the saved copy, or on
+	pass 2 skipped, and the caller should close it without reading it.
+	Otherwise the include is recorded on pass 1 so that it can be saved
+	when it is closed.
+----------------------------------------------------------------------------*/
+bool PrecompUse(EnvContext *ctx)
+{
+	UseRecord			*use;
+	SkipRecord			*skip;
+	const char			*path;
+	const char			*text;
+	size_t				size;
+	unsigned long long	key;
+	u_int32				ordinal;
+	bool				passOnly;
+	int					i;
+
+	if(false == ctx->m_Precomp.m_Enabled) {
+		return false;
+	}
+
+	path = GetCurrentFilePathname(ctx);
+	key = 0;
+	skip = NULL;
+
+	/* Number the includes both passes make so pass 2 can find them */
+	passOnly = false;
+	for(i = 0; i <= ctx->m_Cond.m_Count; i++) {
+		if(IFP1 == ctx->m_Cond.m_Cond[i].m_Op || IFP2 == ctx->m_Cond.m_Cond[i].m_Op) {
+			passOnly = true;
+		}
+	}
+
+	ordinal = NO_ORDINAL;
+	if(false == passOnly && 0 == ctx->m_Precomp.m_PassOnly) {
+		ordinal = ctx->m_Precomp.m_Ordinal++;
+	}
+
+	if(1 == ctx->m_Pass) {
+		key = PrecompKey(ctx, path);
+		if(true == LoadInclude(ctx, path, key, ordinal)) {
+			return true;
+		}
+	} else if(NO_ORDINAL != ordinal) {
+		while(ctx->m_Precomp.m_NextSkip < ctx->m_Precomp.m_SkipCount && ctx->m_Precomp.m_Skips[ctx->m_Precomp.m_NextSkip].m_Ordinal < ordinal) {
+			ctx->m_Precomp.m_NextSkip++;
+		}
+
+		if(ctx->m_Precomp.m_NextSkip < ctx->m_Precomp.m_SkipCount && ctx->m_Precomp.m_Skips[ctx->m_Precomp.m_NextSkip].m_Ordinal == ordinal) {
+			skip = &ctx->m_Precomp.m_Skips[ctx->m_Precomp.m_NextSkip++];
+			if(true == SkipInclude(ctx, skip, path)) {
+				return true;
+			}
+		}
+	}
+
+	/* Pass 2 only follows the includes that change the numbering */
+	if(1 != ctx->m_Pass && NULL == skip && false == passOnly) {
+		return false;
+	}
+
+	use = (UseRecord*)CAllocMem(1, sizeof(UseRecord));
+	use->m_Prev = ctx->m_Precomp.m_Use;
+	use->m_Depth = GetOpenFileCount(ctx);
+	use->m_PassOnly = passOnly;
+	use->m_Fallback = (NULL != skip);
+	ctx->m_Precomp.m_Use = use;
+
+	/* Includes in one that pass 1 loaded or only one pass reads aren't numbered */
+	if(true == use->m_PassOnly) {
+		ctx->m_Precomp.m_PassOnly++;
+	}
+	if(true == use->m_Fallback) {
+		ctx->m_Precomp.m_PassOnly++;
+	}
+
+	if(1 == ctx->m_Pass) {
+		use->m_Key = key;
+		use->m_Path = (char*)AllocMem(strlen(path) + 1);
+		strcpy(use->m_Path, path);
+		GetState(ctx, &use->m_Start);
+		use->m_Serial = ctx->m_Symbols.m_Count;
+		use->m_CondCount = ctx->m_Cond.m_Count;
+		use->m_ErrorCount = ctx->m_ErrorCount;
+		use->m_WarningCount = ctx->m_WarningCount;
+		use->m_LineCount = ctx->m_LineCount;
+		use->m_Occur = ctx->m_Macros.m_Occur;
+		use->m_Macros = ctx->m_Macros.m_Tail;
+		use->m_Structs = ctx->m_Structs.m_Tail;
+		use->m_Unions = ctx->m_Structs.m_Unions;
+		use->m_LastFound = ctx->m_Structs.m_LastFound;
+
+		if(true == GetSourceText(ctx, path, &text, &size)) {
+			AddInput(ctx, path, HashBytes(HASH_BASIS, text, size));
+		} else {
+			PrecompVeto(ctx);
+		}
+	}
+
+	return false;
+}
+
+
+/*----------------------------------------------------------------------------
+	PrecompEnd --- finish an include as the file at depth is closed
+
+	On pass 1 the include is saved if it held only definitions and left
+	no conditional, macro or structure open.
+----------------------------------------------------------------------------*/
+void PrecompEnd(EnvContext *ctx, const int depth)
+{
+	UseRecord *use = ctx->m_Precomp.m_Use;
+
+	if(NULL == use || depth != use->m_Depth) {
+		return;
+	}
+
+	ctx->m_Precomp.m_Use = use->m_Prev;
+
+	if(true == use->m_PassOnly) {
+		ctx->m_Precomp.m_PassOnly--;
+	}
+	if(true == use->m_Fallback) {
+		ctx->m_Precomp.m_PassOnly--;
+	}
+
+	if(1 == ctx->m_Pass
+		&& false == use->m_Vetoed
+		&& use->m_CondCount == ctx->m_Cond.m_Count
+		&& use->m_ErrorCount == ctx->m_ErrorCount
+		&& use->m_WarningCount == ctx->m_WarningCount
+		&& ctx->m_LineCount - use->m_LineCount <= 0xffff
+		&& false == IsProcessingMacro(ctx)
+		&& false == ctx->m_Structs.m_InStruct
+		&& NULL == ctx->m_Structs.m_Union
+		&& false == ctx->m_Finished) {
+		SaveInclude(ctx, use);
+	}
+
+	FreeUse(use);
+}
@@ -0,0 +1,26 @@
+/*****************************************************************************
+	precomp.h	- Precompiled definitions
+
+	Includes that hold only definitions, saved and loaded for -P<dir>.
+*****************************************************************************/
+#ifndef PRECOMP_H
+#define PRECOMP_H
+
+#include "context.h"
+#include "symtab.h"
+#include "table9.h"
+
+
+void InitPrecomp(EnvContext *ctx);
+void ResetPrecomp(EnvContext *ctx);
+void ReleasePrecomp(EnvContext *ctx);
+bool PrecompUse(EnvContext *ctx);
+void PrecompEnd(EnvContext *ctx, const int depth);
+void PrecompVeto(EnvContext *ctx);
+void PrecompLookup(EnvContext *ctx, const char *name, const Symbol *sym);
+void PrecompStruct(EnvContext *ctx, const Struct *astruct);
+void PrecompLine(EnvContext *ctx, const Mneumonic *mne);
+void PrecompFlush(EnvContext *ctx);
+
+
+#endif	/* PRECOMP_H */
@@ -44,7 +44,7 @@ void ProcShortBranch(EnvContext *ctx, const Mneumonic *op)
 	status = Evaluate(ctx, &result, EVAL_NORMAL, NULL);
 
 	if(true == status) {
-		dist = (int)result - (GetPCReg() + 2);
+		dist = (int)result - (GetPCReg(ctx) + 2);
 	} else {
 		dist = -2;
 	}
@@ -75,7 +75,24 @@ void ProcLongBranch(EnvContext *ctx, const Mneumonic *op)
 
 	status = Evaluate(ctx, &result, EVAL_NORMAL, NULL);
 
-	dist = (int)result - (GetPCReg() + offset);
+	/* When relaxing, use the short branch if it reaches the destination */
+	if(true == ctx->m_Relax.m_Enabled && 1 != ctx->m_Pass && true == status) {
+		const Mneumonic *shortOp;
+
+		dist = (int)result - (GetPCReg(ctx) + 2);
+
+		if((dist >= MIN_BYTE) && (dist <= MAX_BYTE)) {
+			shortOp = mne_look(ctx, op->mnemonic + 1);
+
+			if(NULL != shortOp && REL_SHORT == shortOp->optype) {
+				EmitOpCode(ctx, shortOp, 0);
+				EmitOpRelAddrByte(ctx, lobyte(dist));
+				return;
+			}
+		}
+	}
+
+	dist = (int)result - (GetPCReg(ctx) + offset);
 
 	if((dist >= MIN_BYTE) && (dist <= MAX_BYTE)) {
 		ctx->m_OptimizeLine = true;
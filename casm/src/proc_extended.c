@@ -52,7 +52,7 @@ void ProcExtended(EnvContext *ctx, const Mneumonic *op)
 		modifier = 0;
 	}
 
-	if(false == ctx->m_ForceWord && true == IsAddressInDirectPage(loword(result))) {
+	if(false == ctx->m_ForceWord && true == IsAddressInDirectPage(ctx, loword(result))) {
 		ctx->m_ForceByte = true;
 	}
 
@@ -331,7 +331,7 @@ void ProcIndexed(EnvContext *ctx, const Mneumonic *opinfo, u_char modifier)
 
 		/* BEGIN - new stuff */
 		if(REG_PCR == reg1) {
-			int32 pc = GetPCReg();
+			int32 pc = GetPCReg(ctx);
 			result = (int16)(loword(result - pc));
 
 			/* Adjust for the opcode and the post op byte */
@@ -91,7 +91,7 @@ void ProcLogicalMem(EnvContext *ctx, const Mneumonic *op)
 	case DIRECT:
 		Evaluate(ctx, &result, EVAL_NORMAL, NULL);
 
-		if(true == ctx->m_ForceByte || true == IsAddressInDirectPage(loword(result))) {
+		if(true == ctx->m_ForceByte || true == IsAddressInDirectPage(ctx, loword(result))) {
 			EmitOpCode(ctx, op, 0);
 			EmitOpPostByte(ctx, lobyte(logValue));
 			EmitOpPostByte(ctx, lobyte(result));
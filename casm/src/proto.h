@@ -60,12 +60,12 @@ bool Evaluate(EnvContext *line, int32 *result, EVAL_TYPE evalType, Symbol **retS
 /*------------------------------------------------------------------------
 	ffwd.c
 ------------------------------------------------------------------------*/
-void FwdRefInit(void);
+void FwdRefInit(EnvContext *ctx);
 void FwdRefReinit(EnvContext *ctx);
 void FwdRefMark(EnvContext *ctx);
 void FwdRefNext(EnvContext *ctx);
-void FwdRefDone(void);
-bool FwdRefIsRecord(const u_int32 lineNumber, const int fileno);
+void FwdRefDone(EnvContext *ctx);
+bool FwdRefIsRecord(EnvContext *ctx, const u_int32 lineNumber, const int fileno);
 
 void ProcOpcode(EnvContext *line, const Mneumonic *mnu);
 void ProcGeneral(EnvContext *line, const Mneumonic *op);
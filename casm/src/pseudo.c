@@ -87,7 +87,7 @@ static void PseudoSetDP(EnvContext *ctx)
 	if(result > MAX_UBYTE) {
 		warning(ctx, WARN_DPRANGE, "DP value cannot be larger than 8 bits - value truncated");
 	}
-	SetDPReg(lobyte(result));
+	SetDPReg(ctx, lobyte(result));
 }
 
 
@@ -123,8 +123,8 @@ static void PseudoModule(EnvContext *ctx)
 	}
 		
 	/* reset the PC register */
-	SetPCReg(0);
-	SetOldPCReg(0);
+	SetPCReg(ctx, 0);
+	SetOldPCReg(ctx, 0);
 
 	/* Process the module size */
 	status = Evaluate(ctx, &mod_size, EVAL_NORMAL, NULL);
@@ -254,9 +254,12 @@ static void PseudoEndSegment(EnvContext *ctx)
 static void PseudoInclude(EnvContext *ctx, const Mneumonic *op)
 {
 	char buffer[MAX_BUFFERSIZE];
+	char buffer2[MAX_BUFFERSIZE];
 	const char *src;
 	char *dst;
 	char delim;
+	bool opened;
+	int i;
 
 
 	src = ctx->m_Operand;
@@ -297,20 +300,23 @@ static void PseudoInclude(EnvContext *ctx, const Mneumonic *op)
 		dst++;
 	}
 
-	if (OpenInputFile(ctx, buffer, false) == false)
+	opened = OpenInputFile(ctx, buffer, false);
+	for (i = 0; false == opened && i < ctx->m_Files.m_IncludeCount; i++)
 	{
-		char buffer2[MAX_BUFFERSIZE];
-		int i;
-		
-		for (i = 0; i < includeCount; i++)
-		{
-			sprintf(buffer2, "%s/%s", includeDirectories[i], buffer);
+		sprintf(buffer2, "%s/%s", ctx->m_Files.m_IncludeDirs[i], buffer);
+		opened = OpenInputFile(ctx, buffer2, false);
+	}
 
-			if (OpenInputFile(ctx, buffer2, false) == true)
-			{
-				return;
-			}
-		}
+	/* A file that isn't there may be next time */
+	if (false == opened)
+	{
+		PrecompVeto(ctx);
+	}
+
+	/* Its definitions may have been loaded from a precompiled copy */
+	else if (true == PrecompUse(ctx))
+	{
+		CloseInputFile(ctx);
 	}
 }
 
@@ -323,7 +329,7 @@ static void PseudoRaw(EnvContext *ctx)
 	if(OpenInputFile(ctx, ctx->m_Operand, false) == true) {
 		int fill;
 		
-		fill = GetCurrentInputFileSize();
+		fill = GetCurrentInputFileSize(ctx);
 
 		if(fill < 0) {
 			error(ctx, ERR_GENERAL, "An unknown error occured while obtaining the length of %s", ctx->m_Operand);
@@ -335,10 +341,10 @@ static void PseudoRaw(EnvContext *ctx)
 		} else {
 			if(ctx->m_Pass == 1) {
 				/* FIXME - update for handling generation of obj files */
-				BumpPCReg(loword(fill));
+				BumpPCReg(ctx, loword(fill));
 			} else {
 				for(j = 0; j < fill; j++) {
-					EmitDataByte(ctx, lobyte(ReadInputByte()));
+					EmitDataByte(ctx, lobyte(ReadInputByte(ctx)));
 				}
 			}
 		}
@@ -391,7 +397,7 @@ static void PseudoSegmentBSS(EnvContext *ctx, const Mneumonic *op)
 ============================================================================*/
 static void PseudoMacro(EnvContext *ctx)
 {
-	if(IsProcessingMacro() == true) {
+	if(IsProcessingMacro(ctx) == true) {
 		error(ctx, ERR_GENERAL, "cascading macro declarations not allowed");
 	} else {
 		CreateMacro(ctx, ctx->m_Label, ctx->m_Operand);	/* create the macro FIXME */
@@ -418,7 +424,7 @@ static void PseudoALIGN(EnvContext *ctx)
 		return;
 	}
 
-	result = (result - ((GetPCReg() + result) % result));
+	result = (result - ((GetPCReg(ctx) + result) % result));
 	if(MOTBIN == ctx->m_OutputType) {
 		EmitUninitData(ctx, loword(result));
 	} else {
@@ -432,7 +438,7 @@ static void PseudoALIGN(EnvContext *ctx)
 
 static void PseudoEVEN(EnvContext *ctx)
 {
-	if(GetPCReg() & 0x01) {
+	if(GetPCReg(ctx) & 0x01) {
 		EmitOpDataByte(ctx, 0);
 	}
 }
@@ -440,7 +446,7 @@ static void PseudoEVEN(EnvContext *ctx)
 
 static void PseudoODD(EnvContext *ctx)
 {
-	if(!(GetPCReg() & 0x01)) {
+	if(!(GetPCReg(ctx) & 0x01)) {
 		EmitOpDataByte(ctx, 0);
 	}
 }
@@ -488,8 +494,8 @@ static void PseudoOrigin(EnvContext *ctx)
 	}
 
 	if(true == status) {
-		SetPCReg(loword(result));
-		SetOldPCReg(loword(result));
+		SetPCReg(ctx, loword(result));
+		SetOldPCReg(ctx, loword(result));
 		FlushOutput(ctx);     /* flush out bytes */
 
 		if(false == ctx->m_OriginSet) {
@@ -499,7 +505,7 @@ static void PseudoOrigin(EnvContext *ctx)
 
 	}
 
-	SetExportAddress(modMMUPage, (u_int16)result);
+	SetExportAddress(ctx, modMMUPage, (u_int16)result);
 }
 
 
@@ -521,7 +527,7 @@ static void PseudoOption(EnvContext *ctx)
 	strlwr(buffer);
 
 	if(true == ctx->m_ListingFlags.m_OptEnabled) {
-		Cpflag |= 2;	/* why is this here???? */
+		ctx->m_Misc.Cpflag |= 2;	/* why is this here???? */
 	}
 
 
@@ -573,7 +579,7 @@ static void PseudoOption(EnvContext *ctx)
 		else if(head(ptr,"noc")) {
 			ptr += 3;
 			ctx->m_Misc.Cflag = false;
-			Cpflag |= 1;
+			ctx->m_Misc.Cpflag |= 1;
 		}
 		
 		else if(head(ptr,"contc")) {
@@ -610,11 +616,11 @@ static void PseudoPage(EnvContext *ctx)
 	ctx->m_ListingFlags.P_force = false;
 	ctx->m_Misc.N_page = true;
 
-	if(ctx->m_Pass == 2 && true == ctx->m_ListingFlags.m_OptEnabled) {
-		printf("\f");
-		printf("%-40s", Argv[Cfn]);
-		printf("     ");
-		printf("page %3d\n", ctx->m_ListingFlags.m_PageNumber++);
+	if(ctx->m_Pass == 2 && false == ctx->m_Relax.m_Active && true == ctx->m_ListingFlags.m_OptEnabled) {
+		fprintf(ctx->m_Out, "\f");
+		fprintf(ctx->m_Out, "%-40s", ctx->m_Files.m_List[ctx->m_Files.m_Current - 1]);
+		fprintf(ctx->m_Out, "     ");
+		fprintf(ctx->m_Out, "page %3d\n", ctx->m_ListingFlags.m_PageNumber++);
 	}
 }
 
@@ -754,7 +760,7 @@ static void PseudoEQU(EnvContext *ctx, const Mneumonic *op)
 		Kludge - Set the old pc address so the EQU value is printed in the
 		listing as the PC address.
 	*/
-	SetOldPCReg(loword(result));
+	SetOldPCReg(ctx, loword(result));
 }
 
 
@@ -773,7 +779,7 @@ static void PseudoNAMESPACE(EnvContext *ctx)
 	const char *src;
 	int size;
 
-	if(true == IsInNamespace()) {
+	if(true == IsInNamespace(ctx)) {
 		error(ctx, ERR_GENERAL, "nested namespaces not allowed");
 		return;
 	}
@@ -1083,12 +1089,12 @@ static void PseudoStruct(EnvContext *ctx)
 	if(ctx->m_Pass == 1) {
 		StructCreate(ctx, ctx->m_Label);
 	} else {
-		laststructfound = StructLookup(ctx->m_Label);
-		ASSERTX(NULL != laststructfound);
-		SetOldPCReg(loword(laststructfound->size));
+		ctx->m_Structs.m_LastFound = StructLookup(ctx, ctx->m_Label);
+		ASSERTX(NULL != ctx->m_Structs.m_LastFound);
+		SetOldPCReg(ctx, loword(ctx->m_Structs.m_LastFound->size));
 	}
 	
-	instruct = true;
+	ctx->m_Structs.m_InStruct = true;
 }
 
 
@@ -1114,11 +1120,11 @@ static void PseudoStructDec(EnvContext *ctx)
 	}
 
 
-	AddSymbol(ctx, ctx->m_Label, GetPCReg(), SYM_STRUCTDATA, laststructfound, result);
-	result *= laststructfound->size;
+	AddSymbol(ctx, ctx->m_Label, GetPCReg(ctx), SYM_STRUCTDATA, ctx->m_Structs.m_LastFound, result);
+	result *= ctx->m_Structs.m_LastFound->size;
 
 	if(1 == ctx->m_Pass) {
-		BumpPCReg(loword(result));
+		BumpPCReg(ctx, loword(result));
 	} else {
 		while(result--) {
 			EmitDataByte(ctx, 0);
@@ -1202,7 +1208,7 @@ void ProcPseudo(EnvContext *ctx, const Mneumonic *op)
 
 	
 	/* If processing a macro, go no further */
-	if(IsProcessingMacro() == true) {
+	if(IsProcessingMacro(ctx) == true) {
 		return;
 	}
 	
@@ -1282,14 +1288,14 @@ void ProcPseudo(EnvContext *ctx, const Mneumonic *op)
 	}
 
 	if(0 != ctx->m_Label[0] && EQU != op->opcode && STRUCT != op->opcode && STRUCTDEC!= op->opcode && NAMESPACE != op->opcode) {
-		AddSymbol(ctx, ctx->m_Label, GetPCReg(), SYM_ADDRESS, NULL, 0);
+		AddSymbol(ctx, ctx->m_Label, GetPCReg(ctx), SYM_ADDRESS, NULL, 0);
 	}
 
 	ctx->m_ListingFlags.P_force = true;
 
 	switch(op->opcode) {
 	case PRINTDP:
-		note(ctx, "DP Value is %02X\n", GetDPReg());
+		note(ctx, "DP Value is %02X\n", GetDPReg(ctx));
 		break;
 
 	/* ignored psuedo ops */
@@ -1503,8 +1509,8 @@ void ProcPseudo(EnvContext *ctx, const Mneumonic *op)
 		break;
 
 	case REORG:	/* FIXME - not sure if this is the correct behavour */
-		SetPCReg(loword(ctx->m_OrgBase));
-		SetOldPCReg(loword(ctx->m_OrgBase));
+		SetPCReg(ctx, loword(ctx->m_OrgBase));
+		SetOldPCReg(ctx, loword(ctx->m_OrgBase));
 		FlushOutput(ctx);     /* flush out bytes */
 		break;
 
@@ -0,0 +1,237 @@
+/*****************************************************************************
+	stats.c	- Assembly statistics
+
+	-stats reports where the time of an assembly goes: the time taken by
+	pass 1, by the relaxation passes and by pass 2, the time spent reading
+	source files, the work done by the symbol table, the number of macros
+	expanded and the peak memory used.  -stats=json reports the same
+	figures as a JSON object so that scripts can follow them from build to
+	build.  Both are written with the module's messages, apart from any
+	listing.  In a batch the CPU time is that of the thread assembling the
+	module, while the peak memory is that of the whole process.
+*****************************************************************************/
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include <time.h>
+
+#include "as.h"
+#include "proto.h"
+
+
+static const char *passNames[STATS_PASSES] = {
+	"pass 1",
+	"relaxation",
+	"pass 2"
+};
+
+
+/*----------------------------------------------------------------------------
+	GetWallTime --- return the elapsed time in seconds from an arbitrary start
+----------------------------------------------------------------------------*/
+double GetWallTime(void)
+{
+#ifdef _WIN32
+	return (double)GetTickCount() / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
+#endif
+}
+
+
+/*----------------------------------------------------------------------------
+	GetCPUTime --- return the processor time used by this thread in seconds
+----------------------------------------------------------------------------*/
+double GetCPUTime(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec now;
+
+	if(0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now)) {
+		return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+	}
+#endif
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+/*----------------------------------------------------------------------------
+	GetPeakMemory --- return the most memory used in kilobytes, or -1
+----------------------------------------------------------------------------*/
+static long GetPeakMemory(void)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	struct rusage usage;
+
+	if(0 != getrusage(RUSAGE_SELF, &usage)) {
+		return -1;
+	}
+
+#ifdef __APPLE__
+	/* Darwin reports bytes rather than kilobytes */
+	return (long)(usage.ru_maxrss / 1024);
+#else
+	return (long)usage.ru_maxrss;
+#endif
+#endif
+}
+
+
+/*----------------------------------------------------------------------------
+	BeginPassStats --- note the time and line count as a pass starts
+----------------------------------------------------------------------------*/
+void BeginPassStats(EnvContext *ctx)
+{
+	ctx->m_Stats.m_StartWall = GetWallTime();
+	ctx->m_Stats.m_StartCPU = GetCPUTime();
+	ctx->m_Stats.m_StartLines = ctx->m_LineCount;
+}
+
+
+/*----------------------------------------------------------------------------
+	EndPassStats --- add the time and lines of the pass just made
+----------------------------------------------------------------------------*/
+void EndPassStats(EnvContext *ctx, const int pass)
+{
+	ctx->m_Stats.m_Pass[pass].m_Wall += GetWallTime() - ctx->m_Stats.m_StartWall;
+	ctx->m_Stats.m_Pass[pass].m_CPU += GetCPUTime() - ctx->m_Stats.m_StartCPU;
+	ctx->m_Stats.m_Pass[pass].m_Lines += ctx->m_LineCount - ctx->m_Stats.m_StartLines;
+	ctx->m_Stats.m_Pass[pass].m_Count++;
+}
+
+
+/*----------------------------------------------------------------------------
+	Rate --- return count per second, allowing for times too short to see
+----------------------------------------------------------------------------*/
+static double Rate(const double count, const double seconds)
+{
+	return (seconds > 0 ? count / seconds : 0);
+}
+
+
+/*----------------------------------------------------------------------------
+	PrintJSONString --- write a string with JSON quoting
+----------------------------------------------------------------------------*/
+static void PrintJSONString(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+
+	for(; EOS != *str; str++) {
+		if('"' == *str || '\\' == *str) {
+			fprintf(fp, "\\%c", *str);
+		} else if((u_char)*str < ' ') {
+			fprintf(fp, "\\u%04x", (u_char)*str);
+		} else {
+			fputc(*str, fp);
+		}
+	}
+
+	fputc('"', fp);
+}
+
+
+/*----------------------------------------------------------------------------
+	PrintStats --- report the figures gathered during the assembly
+----------------------------------------------------------------------------*/
+void PrintStats(EnvContext *ctx)
+{
+	double	wall;
+	double	cpu;
+	u_int32	lines;
+	double	probe;
+	long	peak;
+	int		pass;
+
+	wall = 0;
+	cpu = 0;
+	lines = 0;
+	for(pass = 0; pass < STATS_PASSES; pass++) {
+		wall += ctx->m_Stats.m_Pass[pass].m_Wall;
+		cpu += ctx->m_Stats.m_Pass[pass].m_CPU;
+		lines += ctx->m_Stats.m_Pass[pass].m_Lines;
+	}
+
+	probe = (0 != ctx->m_Stats.m_Lookups ? (double)ctx->m_Stats.m_Probes / ctx->m_Stats.m_Lookups : 0);
+	peak = GetPeakMemory();
+
+	if(STATS_JSON == ctx->m_Stats.m_Format) {
+		fprintf(ctx->m_Err, "{\n");
+		fprintf(ctx->m_Err, "  \"assembler\": \"casm\",\n");
+		fprintf(ctx->m_Err, "  \"module\": ");
+		PrintJSONString(ctx->m_Err, NULL != ctx->m_Files.m_List[0] ? ctx->m_Files.m_List[0] : "");
+		fprintf(ctx->m_Err, ",\n");
+		fprintf(ctx->m_Err, "  \"passes\": [\n");
+		for(pass = 0; pass < STATS_PASSES; pass++) {
+			fprintf(ctx->m_Err, "    {\"pass\": \"%s\", \"count\": %d, \"wall\": %.6f, \"cpu\": %.6f, \"lines\": %lu, \"lines_per_second\": %.0f}%s\n",
+				passNames[pass],
+				ctx->m_Stats.m_Pass[pass].m_Count,
+				ctx->m_Stats.m_Pass[pass].m_Wall,
+				ctx->m_Stats.m_Pass[pass].m_CPU,
+				(unsigned long)ctx->m_Stats.m_Pass[pass].m_Lines,
+				Rate(ctx->m_Stats.m_Pass[pass].m_Lines, ctx->m_Stats.m_Pass[pass].m_Wall),
+				pass < STATS_PASSES - 1 ? "," : "");
+		}
+		fprintf(ctx->m_Err, "  ],\n");
+		fprintf(ctx->m_Err, "  \"total\": {\"wall\": %.6f, \"cpu\": %.6f, \"lines\": %lu, \"lines_per_second\": %.0f},\n",
+			wall, cpu, (unsigned long)lines, Rate(lines, wall));
+		fprintf(ctx->m_Err, "  \"source\": {\"files\": %lu, \"bytes\": %lu, \"read_time\": %.6f},\n",
+			(unsigned long)ctx->m_Stats.m_FilesRead, (unsigned long)ctx->m_Stats.m_BytesRead, ctx->m_Stats.m_ReadTime);
+		fprintf(ctx->m_Err, "  \"symbols\": {\"lookups\": %lu, \"inserts\": %lu, \"probes\": %lu, \"average_probe\": %.3f, \"longest_probe\": %lu},\n",
+			(unsigned long)ctx->m_Stats.m_Lookups,
+			(unsigned long)ctx->m_Stats.m_Inserts,
+			(unsigned long)ctx->m_Stats.m_Probes,
+			probe,
+			(unsigned long)ctx->m_Stats.m_LongestProbe);
+		fprintf(ctx->m_Err, "  \"macro_expansions\": %lu,\n", (unsigned long)ctx->m_Stats.m_MacroExpansions);
+		if(peak >= 0) {
+			fprintf(ctx->m_Err, "  \"peak_memory_kb\": %ld\n", peak);
+		} else {
+			fprintf(ctx->m_Err, "  \"peak_memory_kb\": null\n");
+		}
+		fprintf(ctx->m_Err, "}\n");
+		return;
+	}
+
+	fprintf(ctx->m_Err, "\nAssembly statistics:\n");
+	for(pass = 0; pass < STATS_PASSES; pass++) {
+		if(0 == ctx->m_Stats.m_Pass[pass].m_Count) {
+			continue;
+		}
+
+		fprintf(ctx->m_Err, "  %-12s %8.3fs elapsed %8.3fs CPU %9lu lines %10.0f lines/s",
+			passNames[pass],
+			ctx->m_Stats.m_Pass[pass].m_Wall,
+			ctx->m_Stats.m_Pass[pass].m_CPU,
+			(unsigned long)ctx->m_Stats.m_Pass[pass].m_Lines,
+			Rate(ctx->m_Stats.m_Pass[pass].m_Lines, ctx->m_Stats.m_Pass[pass].m_Wall));
+		if(ctx->m_Stats.m_Pass[pass].m_Count > 1) {
+			fprintf(ctx->m_Err, " (%d passes)", ctx->m_Stats.m_Pass[pass].m_Count);
+		}
+		fprintf(ctx->m_Err, "\n");
+	}
+	fprintf(ctx->m_Err, "  %-12s %8.3fs elapsed %8.3fs CPU %9lu lines %10.0f lines/s\n",
+		"total", wall, cpu, (unsigned long)lines, Rate(lines, wall));
+	fprintf(ctx->m_Err, "  Source files: %lu read, %lu bytes in %.3fs\n",
+		(unsigned long)ctx->m_Stats.m_FilesRead, (unsigned long)ctx->m_Stats.m_BytesRead, ctx->m_Stats.m_ReadTime);
+	fprintf(ctx->m_Err, "  Symbols: %lu lookups, %lu inserts, %.2f compared per lookup, %lu at most\n",
+		(unsigned long)ctx->m_Stats.m_Lookups,
+		(unsigned long)ctx->m_Stats.m_Inserts,
+		probe,
+		(unsigned long)ctx->m_Stats.m_LongestProbe);
+	fprintf(ctx->m_Err, "  Macro expansions: %lu\n", (unsigned long)ctx->m_Stats.m_MacroExpansions);
+	if(peak >= 0) {
+		fprintf(ctx->m_Err, "  Peak memory: %ld KB\n", peak);
+	} else {
+		fprintf(ctx->m_Err, "  Peak memory: unknown\n");
+	}
+}
@@ -0,0 +1,19 @@
+/*****************************************************************************
+	stats.h	- Assembly statistics
+
+	Timing and table figures gathered for the -stats option.
+*****************************************************************************/
+#ifndef STATS_H
+#define STATS_H
+
+#include "context.h"
+
+
+double GetWallTime(void);
+double GetCPUTime(void);
+void BeginPassStats(EnvContext *ctx);
+void EndPassStats(EnvContext *ctx, const int pass);
+void PrintStats(EnvContext *ctx);
+
+
+#endif	/* STATS_H */
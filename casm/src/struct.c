@@ -31,12 +31,39 @@
 #include "as.h"
 #include "proto.h"
 
-bool			instruct = false;
-static bool		procflag = false;
-static Struct	*structhead = NULL;
-static Struct	*structtail = NULL;
-Struct			*laststructfound = NULL;
-static Struct	*unionStack = NULL;
+void InitStructs(EnvContext *ctx)
+{
+	memset(&ctx->m_Structs, 0, sizeof(ctx->m_Structs));
+}
+
+
+/*----------------------------------------------------------------------------
+	ReleaseStructs --- free the structures, unions and their elements
+----------------------------------------------------------------------------*/
+static void FreeStructList(Struct *list)
+{
+	Struct *astruct;
+	Element *el;
+
+	while(NULL != (astruct = list)) {
+		list = astruct->next;
+
+		while(NULL != (el = astruct->el_head)) {
+			astruct->el_head = el->next;
+			free(el);
+		}
+		free(astruct);
+	}
+}
+
+
+void ReleaseStructs(EnvContext *ctx)
+{
+	FreeStructList(ctx->m_Structs.m_Head);
+	FreeStructList(ctx->m_Structs.m_Unions);
+
+	InitStructs(ctx);
+}
 
 
 
@@ -70,7 +97,7 @@ static void AddElement(EnvContext *ctx,
 	el->child = child;
 	el->next = NULL;
 
-	if(astruct == unionStack) {
+	if(astruct == ctx->m_Structs.m_Union) {
 		int fullSize;
 
 		if(NULL != child) {
@@ -109,8 +136,8 @@ void StructCreate(EnvContext *ctx, const char *structName)
 	Struct *tempstruct;
 	Symbol *structSym;
 
-	/* Set procflag to false in case of error */
-	procflag = false;
+	/* Set the defining flag to false in case of error */
+	ctx->m_Structs.m_Defining = false;
 
 	/* Make sure we have a name for the structure */
 	if(*structName == EOS) {
@@ -137,22 +164,22 @@ void StructCreate(EnvContext *ctx, const char *structName)
 	}
 
 	/* Add to struct list */
-	if(structhead == NULL) {
-		structhead = tempstruct;
+	if(ctx->m_Structs.m_Head == NULL) {
+		ctx->m_Structs.m_Head = tempstruct;
 	}
 
 	else {
-		structtail->next = tempstruct;
+		ctx->m_Structs.m_Tail->next = tempstruct;
 	}
 
-	structtail = tempstruct;
-	structtail->size = 0;
-	structtail->next = NULL;
-	structtail->el_head = NULL;
-	structtail->el_tail = NULL;
+	ctx->m_Structs.m_Tail = tempstruct;
+	tempstruct->size = 0;
+	tempstruct->next = NULL;
+	tempstruct->el_head = NULL;
+	tempstruct->el_tail = NULL;
 
 	/* Reset processing flags */
-	procflag = true;
+	ctx->m_Structs.m_Defining = true;
 }
 
 
@@ -161,7 +188,7 @@ void UnionCreate(EnvContext *ctx, const char *unionName)
 {
 	Struct *tempstruct;
 
-	ASSERTX(NULL == unionStack);
+	ASSERTX(NULL == ctx->m_Structs.m_Union);
 
 	tempstruct = (Struct*)AllocMem(sizeof(Struct));
 
@@ -169,17 +196,21 @@ void UnionCreate(EnvContext *ctx, const char *unionName)
 	tempstruct->size = 0;
 	tempstruct->el_head = NULL;
 	tempstruct->el_tail = NULL;
-	tempstruct->next = NULL;
-	AddElement(ctx, structtail, unionName, 0, 1, tempstruct);
-	unionStack = tempstruct;
+
+	/* Unions are kept apart from the structures that can be looked up */
+	tempstruct->next = ctx->m_Structs.m_Unions;
+	ctx->m_Structs.m_Unions = tempstruct;
+
+	AddElement(ctx, ctx->m_Structs.m_Tail, unionName, 0, 1, tempstruct);
+	ctx->m_Structs.m_Union = tempstruct;
 }
 
 
 void UnionEnd(EnvContext *ctx)
 {
-	ASSERTX(NULL != unionStack);
-	structtail->size += unionStack->size;
-	unionStack = NULL;
+	ASSERTX(NULL != ctx->m_Structs.m_Union);
+	ctx->m_Structs.m_Tail->size += ctx->m_Structs.m_Union->size;
+	ctx->m_Structs.m_Union = NULL;
 
 	/* FIXME - reset size of union */
 }
@@ -197,7 +228,7 @@ void StructAddElement(EnvContext *ctx, const char *elementName, const char *elem
 	int			count;
 	Struct		*addTo;
 
-	ASSERTX(NULL != structtail);
+	ASSERTX(NULL != ctx->m_Structs.m_Tail);
 
 	/* Go find opcode */
 	opcode = mne_look(ctx, elementType);
@@ -211,7 +242,7 @@ void StructAddElement(EnvContext *ctx, const char *elementName, const char *elem
 
 	if(ENDUNION == opcode->opcode) {
 		if(1 == ctx->m_Pass) {
-			if(NULL == unionStack) {
+			if(NULL == ctx->m_Structs.m_Union) {
 				error(ctx, ERR_GENERAL, "endunion with no union declaration");
 				return;
 			}
@@ -224,19 +255,19 @@ void StructAddElement(EnvContext *ctx, const char *elementName, const char *elem
 
 	/* If we are at the end of a structure, close it */
 	if(ENDSTRUCT == opcode->opcode) {
-		if(procflag == true) {
-			if(ctx->m_Pass == 1 && structtail->size == 0) {
+		if(ctx->m_Structs.m_Defining == true) {
+			if(ctx->m_Pass == 1 && ctx->m_Structs.m_Tail->size == 0) {
 				warning(ctx, WARN_EMPTYSTRUCT, "structure declaration empty");
 			}
 		}
-		instruct = false;
-		procflag = false;
-		laststructfound = NULL;
+		ctx->m_Structs.m_InStruct = false;
+		ctx->m_Structs.m_Defining = false;
+		ctx->m_Structs.m_LastFound = NULL;
 		return;
 	}
 
 	/* If on pass 2, do not process elements */
-	if(ctx->m_Pass == 2 || procflag == false) {
+	if(ctx->m_Pass == 2 || ctx->m_Structs.m_Defining == false) {
 		return;
 	}
 
@@ -273,13 +304,13 @@ void StructAddElement(EnvContext *ctx, const char *elementName, const char *elem
 		break;
 
 	case STRUCTDEC:
-		ASSERTX(NULL != laststructfound);
-		ASSERTX(0 == strcmp(laststructfound->name, elementType));
-		size = laststructfound->size;
+		ASSERTX(NULL != ctx->m_Structs.m_LastFound);
+		ASSERTX(0 == strcmp(ctx->m_Structs.m_LastFound->name, elementType));
+		size = ctx->m_Structs.m_LastFound->size;
 		break;
 
 	case UNION:
-		if(NULL != unionStack) {
+		if(NULL != ctx->m_Structs.m_Union) {
 			error(ctx, ERR_GENERAL, "cascading unions not allowed");
 			return;
 		}
@@ -310,33 +341,37 @@ void StructAddElement(EnvContext *ctx, const char *elementName, const char *elem
 		count = 1;
 	}
 
-	if(NULL != unionStack) {
-		addTo = unionStack;
+	if(NULL != ctx->m_Structs.m_Union) {
+		addTo = ctx->m_Structs.m_Union;
 	} else {
-		addTo = structtail;
+		addTo = ctx->m_Structs.m_Tail;
 	}
 
 
 	if(0 != size) {
-		AddElement(ctx, addTo, elementName, size, count, laststructfound);
+		AddElement(ctx, addTo, elementName, size, count, ctx->m_Structs.m_LastFound);
 	}
 }
 
 
-Struct *StructLookup(const char *name)
+Struct *StructLookup(EnvContext *ctx, const char *name)
 {
 	Struct *list;
 
-	laststructfound = NULL;
-	list = structhead;
+	ctx->m_Structs.m_LastFound = NULL;
+	list = ctx->m_Structs.m_Head;
 
 	while(list) {
 		if(strcmp(list->name, name) == 0) {
-			return(laststructfound = list);
+			/* An include being recorded can only use its own structures */
+			if(NULL != ctx->m_Precomp.m_Use) {
+				PrecompStruct(ctx, list);
+			}
+			return(ctx->m_Structs.m_LastFound = list);
 		}
 		list = list->next;
 	}
-	return(laststructfound = NULL);
+	return(ctx->m_Structs.m_LastFound = NULL);
 }
 
 
@@ -59,9 +59,11 @@ struct _struct {
 };
 
 
+void InitStructs(EnvContext *ctx);
+void ReleaseStructs(EnvContext *ctx);
 void StructCreate(EnvContext *ctx, const char *structName);
 void StructAddElement(EnvContext *ctx, const char *elementName, const char *elementType);
-Struct *StructLookup(const char *);
+Struct *StructLookup(EnvContext *ctx, const char *);
 Element *StructGetElement(const Struct *, const char *);
 void UnionCreate(EnvContext *ctx, const char *unionName);
 void UnionEnd(EnvContext *ctx);
@@ -33,42 +33,103 @@
 #include "label.h"
 
 
-static Symbol	*root;			/* root node of the tree */
-static int		localoccur;		/* occurance of local labels			*/
-static int		localcount;
-static char		cNameSpace[MAX_LABELSIZE + 1];
+#define SYMTAB_INITIAL_SIZE	1024		/* hash slots to start with (power of 2)	*/
+#define SYMTAB_ARENA_SIZE	65536		/* bytes in each arena block				*/
+#define SYMTAB_ALIGN(n)		(((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+
+/* Block of memory symbols, their names and line lists are carved from */
+struct _symarena {
+	SymArena	*next;		/* previous block */
+	size_t		used;		/* bytes handed out */
+	size_t		size;		/* bytes in data */
+	void		*data;
+};
+
+
+/*----------------------------------------------------------------------------
+	ArenaAlloc --- hand out memory that lives as long as the symbol table
+----------------------------------------------------------------------------*/
+static void *ArenaAlloc(EnvContext *ctx, size_t nbytes)
+{
+	SymArena *arena;
+	void *ptr;
+
+	nbytes = SYMTAB_ALIGN(nbytes);
+	arena = ctx->m_Symbols.m_Arena;
+
+	if(NULL == arena || arena->used + nbytes > arena->size) {
+		size_t size = nbytes > SYMTAB_ARENA_SIZE ? nbytes : SYMTAB_ARENA_SIZE;
+
+		arena = (SymArena*)AllocMem(SYMTAB_ALIGN(sizeof(SymArena)) + size);
+		arena->next = ctx->m_Symbols.m_Arena;
+		arena->used = 0;
+		arena->size = size;
+		arena->data = (char*)arena + SYMTAB_ALIGN(sizeof(SymArena));
+		ctx->m_Symbols.m_Arena = arena;
+	}
+
+	ptr = (char*)arena->data + arena->used;
+	arena->used += nbytes;
+
+	return ptr;
+}
+
+
+/*----------------------------------------------------------------------------
+	HashSymbol --- hash a symbol name
+
+	Names are folded to lower case so that the same slot serves both case
+	sensitive and case insensitive lookups.
+----------------------------------------------------------------------------*/
+static u_int32 HashSymbol(const char *name)
+{
+	u_int32 hash = 2166136261u;
+
+	while(0 != *name) {
+		hash ^= (u_char)tolower((u_char)*(name++));
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
 
 
 void SetNamespace(EnvContext *ctx, const char *ns)
 {
-	strcpy(cNameSpace, ns);
+	strcpy(ctx->m_Symbols.m_NameSpace, ns);
 }
 
 void ClearNamespace(EnvContext *ctx)
 {
-	if(0 == cNameSpace[0]) {
+	if(0 == ctx->m_Symbols.m_NameSpace[0]) {
 		warning(ctx, WARN_NONAMESPACE, "namespace not set");
 		return;
 	}
 
-	cNameSpace[0] = 0;
+	ctx->m_Symbols.m_NameSpace[0] = 0;
 }
 
-bool IsInNamespace()
+bool IsInNamespace(EnvContext *ctx)
 {
-	return(0 != *cNameSpace);
+	return(0 != ctx->m_Symbols.m_NameSpace[0]);
 }
 
 void ResetLocalLabels(EnvContext *ctx)
 {
-	localoccur = 0;
-	localcount = 0;
+	ctx->m_Symbols.m_LocalOccur = 0;
+	ctx->m_Symbols.m_LocalCount = 0;
 }
 
 
 void InitSymbolTable(EnvContext *ctx)
 {
-	root = NULL;
+	ctx->m_Symbols.m_TableSize = SYMTAB_INITIAL_SIZE;
+	ctx->m_Symbols.m_Table = (Symbol**)CAllocMem(SYMTAB_INITIAL_SIZE, sizeof(Symbol*));
+	ctx->m_Symbols.m_Count = 0;
+	ctx->m_Symbols.m_Sorted = NULL;
+	ctx->m_Symbols.m_Arena = NULL;
+	ctx->m_Symbols.m_NameSpace[0] = 0;
 	ResetLocalLabels(ctx);
 
 	BeginSegment(ctx, SEGMENT_CODE);
@@ -88,13 +149,95 @@ void InitSymbolTable(EnvContext *ctx)
 }
 
 
+void ReleaseSymbolTable(EnvContext *ctx)
+{
+	SymArena *arena;
+
+	while(NULL != (arena = ctx->m_Symbols.m_Arena)) {
+		ctx->m_Symbols.m_Arena = arena->next;
+		free(arena);
+	}
+
+	free(ctx->m_Symbols.m_Table);
+	free(ctx->m_Symbols.m_Sorted);
+	ctx->m_Symbols.m_Table = NULL;
+	ctx->m_Symbols.m_Sorted = NULL;
+	ctx->m_Symbols.m_Count = 0;
+}
+
+
+static int CompareSymbol(EnvContext *ctx, const char *str1, const char *str2)
+{
+	int retval;
+
+	if(true == ctx->m_Compat.m_IgnoreCase) {
+		retval = stricmp(str1, str2);
+	} else {
+		retval = strcmp(str1, str2);
+	}
+
+	return retval;
+}
+
+
+static int CompareSymbolPtr(const void *a, const void *b)
+{
+	return strcmp((*(Symbol**)a)->name, (*(Symbol**)b)->name);
+}
+
+static int CompareSymbolPtrNoCase(const void *a, const void *b)
+{
+	return stricmp((*(Symbol**)a)->name, (*(Symbol**)b)->name);
+}
+
+
+/*----------------------------------------------------------------------------
+	SortSymbols --- list the symbols in alphabetical order
+
+	The listings are only produced once assembly is complete, so the
+	table is sorted once and the order kept for every listing.
+----------------------------------------------------------------------------*/
+static Symbol **SortSymbols(EnvContext *ctx)
+{
+	Symbol **sorted;
+	Symbol *sym;
+	u_int32 slot;
+	u_int32 count;
+
+	if(NULL != ctx->m_Symbols.m_Sorted) {
+		return ctx->m_Symbols.m_Sorted;
+	}
+
+	sorted = (Symbol**)AllocMem((ctx->m_Symbols.m_Count + 1) * sizeof(Symbol*));
+
+	count = 0;
+	for(slot = 0; slot < ctx->m_Symbols.m_TableSize; slot++) {
+		for(sym = ctx->m_Symbols.m_Table[slot]; NULL != sym; sym = sym->next) {
+			sorted[count++] = sym;
+		}
+	}
+
+	qsort(sorted, count, sizeof(Symbol*),
+		true == ctx->m_Compat.m_IgnoreCase ? CompareSymbolPtrNoCase : CompareSymbolPtr);
+
+	sorted[count] = NULL;
+	ctx->m_Symbols.m_Sorted = sorted;
+
+	return sorted;
+}
+
+
 /*
  *  DumpSymTable --- prints the symbol table in alphabetical order
  */
-void DumpSymTable2(EnvContext *ctx, Symbol *ptr)
+void DumpSymTable(EnvContext *ctx)
 {
-	if (ptr != NULL) {
-		DumpSymTable2(ctx, ptr->Lnext);
+	Symbol **list;
+	Symbol *ptr;
+
+	fprintf(ctx->m_Out, "\n\nSymbol table:\n------------------------------\n");
+
+	for(list = SortSymbols(ctx); NULL != (ptr = *list); list++) {
 		if('#' != *ptr->name) {
 			const char *type;
 
@@ -130,74 +273,85 @@ void DumpSymTable2(EnvContext *ctx, Symbol *ptr)
 
 			if(NULL != type) {
 				if(((u_int32)ptr->value) > 0xffff) {
-					fprintf(stdout, "%-16s %08lux  %s\n", ptr->name, (u_int32)ptr->value, type);
+					fprintf(ctx->m_Out, "%-16s %08lux  %s\n", ptr->name, (u_int32)ptr->value, type);
 				} else {
-					fprintf(stdout, "%-16s     %04x\t  %s\n", ptr->name, (u_int16)ptr->value, type);
+					fprintf(ctx->m_Out, "%-16s     %04x\t  %s\n", ptr->name, (u_int16)ptr->value, type);
 				}
 
-				fflush(stdout);
+				fflush(ctx->m_Out);
 			}
 		}
-		DumpSymTable2(ctx, ptr->Rnext);
 	}
 }
 
-void DumpSymTable(EnvContext *ctx)
-{
-	printf ("\n\nSymbol table:\n------------------------------\n");
-	DumpSymTable2(ctx, root);
-}
-
 
 
 /*
  *  DumpCrossRef  --  prints the cross reference table
  */
-void DumpCrossRef2(Symbol *point)
+void DumpCrossRef(EnvContext *ctx)
 {
+	Symbol **list;
+	Symbol *point;
 	Line *tp;
+	int i;
 
-	int i = 1;
-	if (point != NULL) {
-		DumpCrossRef2(point->Lnext);
+	fprintf(ctx->m_Out, "\n\nSymbol table cross reference:\n------------------------------\n");
+
+	for(list = SortSymbols(ctx); NULL != (point = *list); list++) {
+		i = 1;
 
 		if('#' != *point->name) {
-			fprintf(stdout, "%-16s %04x *", point->name, (u_int16)point->value);
+			fprintf(ctx->m_Out, "%-16s %04x *", point->name, (u_int16)point->value);
 			tp = point->L_list;
 			while (tp != NULL) {
 				if(i++ > 10) {
 					i = 1;
-					fprintf(stdout, "\n                       ");
+					fprintf(ctx->m_Out, "\n                       ");
 				}
-				fprintf(stdout, "%04d ",tp->L_num);
+				fprintf(ctx->m_Out, "%04d ",tp->L_num);
 				tp = tp->next;
 			}
-			fprintf(stdout, "\n");
+			fprintf(ctx->m_Out, "\n");
 		}
-		DumpCrossRef2(point->Rnext);
 	}
 }
 
-void DumpCrossRef()
+
+/*----------------------------------------------------------------------------
+	AddSymbolLine --- note a line that refers to a symbol
+----------------------------------------------------------------------------*/
+void AddSymbolLine(EnvContext *ctx, Symbol *sym, const int line)
 {
-	printf ("\n\nSymbol table cross reference:\n------------------------------\n");
-	DumpCrossRef2(root);
+	Line *lp;
+
+	lp = (Line*)ArenaAlloc(ctx, sizeof(Line));
+	lp->L_num = line;
+	lp->next = NULL;
+
+	if(NULL == sym->L_last) {
+		sym->L_list = lp;
+	} else {
+		sym->L_last->next = lp;
+	}
+
+	sym->L_last = lp;
 }
 
 
-int GetNextLocalLabel()
+int GetNextLocalLabel(EnvContext *ctx)
 {
-	if(0 != localcount) {
-		localcount = 0;
-		localoccur++;
+	if(0 != ctx->m_Symbols.m_LocalCount) {
+		ctx->m_Symbols.m_LocalCount = 0;
+		ctx->m_Symbols.m_LocalOccur++;
 	}
 
-	return localoccur;
+	return ctx->m_Symbols.m_LocalOccur;
 }
 
-int GetLocalLabel()
+static int GetLocalLabel(EnvContext *ctx)
 {
-	return localoccur;
+	return ctx->m_Symbols.m_LocalOccur;
 }
 
 /*----------------------------------------------------------------------------
@@ -217,17 +371,22 @@ static bool proclabel(EnvContext *ctx, const char *str, char *newname, const boo
 
 	if(true == isLocal) {	/* if first character of label is an @ symbol, its a local */
 
-		localcount++;
+		ctx->m_Symbols.m_LocalCount++;
+
+		/* Local label numbers depend on the lines around an include */
+		if(NULL != ctx->m_Precomp.m_Use) {
+			PrecompVeto(ctx);
+		}
 
 		if(length > MAX_LABELSIZE - 7) {
 			error(ctx, ERR_GENERAL, "local label too long");
 			return(false);
 		}
 
-		if(true == IsMacroOpen()) {
-			sprintf(newname,"#m%s-%d", str, GetMacroLocalLabel());
+		if(true == IsMacroOpen(ctx)) {
+			sprintf(newname,"#m%s-%d", str, GetMacroLocalLabel(ctx));
 		} else {
-			sprintf(newname,"#s%s-%d", str, GetLocalLabel());
+			sprintf(newname,"#s%s-%d", str, GetLocalLabel(ctx));
 		}
 	} else {
 		*newname = 0;
@@ -237,8 +396,8 @@ static bool proclabel(EnvContext *ctx, const char *str, char *newname, const boo
 				str++;
 			}
 			
-			else if(0 != cNameSpace[0]) {
-				strcpy(newname, cNameSpace);
+			else if(0 != ctx->m_Symbols.m_NameSpace[0]) {
+				strcpy(newname, ctx->m_Symbols.m_NameSpace);
 				strcat(newname, ":");
 			}
 		}
@@ -250,45 +409,87 @@ static bool proclabel(EnvContext *ctx, const char *str, char *newname, const boo
 }
 
 
-static int CompareSymbol(EnvContext *ctx, const char *str1, const char *str2)
+static Symbol *FindSymbol2(EnvContext *ctx, const char *name)
 {
-	int retval;
+	Symbol	*list;
+	u_int32	probes;
 
-	if(true == ctx->m_Compat.m_IgnoreCase) {
-		retval = stricmp(str1, str2);
-	} else {
-		retval = strcmp(str1, str2);
+	/* Point to the hash slot for the name */
+	list = ctx->m_Symbols.m_Table[HashSymbol(name) & (ctx->m_Symbols.m_TableSize - 1)];
+
+	/* Find the label */
+	probes = 0;
+	while(list) {
+		probes++;
+		if(0 == CompareSymbol(ctx, name, list->name)) {
+			break;
+		}
+
+		list = list->next;
 	}
 
-	return retval;
+	/* Count the symbols compared for -stats */
+	ctx->m_Stats.m_Lookups++;
+	ctx->m_Stats.m_Probes += probes;
+	if(probes > ctx->m_Stats.m_LongestProbe) {
+		ctx->m_Stats.m_LongestProbe = probes;
+	}
+
+	/* An include being recorded depends on the outside symbols it looks for */
+	if(NULL != ctx->m_Precomp.m_Use) {
+		PrecompLookup(ctx, name, list);
+	}
+
+	return (list);
 }
-	
 
-static Symbol *FindSymbol2(EnvContext *ctx, const char *name)
+
+/*----------------------------------------------------------------------------
+	LookupSymbol --- find a symbol by its full name
+
+	The name is used as it is, with no namespace added, and the lookup is
+	not counted for -stats.
+----------------------------------------------------------------------------*/
+Symbol *LookupSymbol(EnvContext *ctx, const char *name)
 {
 	Symbol	*list;
 
-	/* Point to the root of the label tree */
-	list = root;
+	list = ctx->m_Symbols.m_Table[HashSymbol(name) & (ctx->m_Symbols.m_TableSize - 1)];
+	while(NULL != list && 0 != CompareSymbol(ctx, name, list->name)) {
+		list = list->next;
+	}
+
+	return list;
+}
 
-	/* Find the label */
-	while(list) {
-		int result;
-		result = CompareSymbol(ctx, name, list->name);
-		if(0 == result) {
-			return (list);
-		}
-		
-		else if(result < 0) {
-			list = list->Lnext;
-		}
 
-		else {
-			list = list->Rnext;
+/*----------------------------------------------------------------------------
+	GrowSymbolTable --- double the hash slots once they average one symbol
+----------------------------------------------------------------------------*/
+static void GrowSymbolTable(EnvContext *ctx)
+{
+	Symbol **table;
+	Symbol *sym;
+	Symbol *next;
+	u_int32 size;
+	u_int32 slot;
+	u_int32 newSlot;
+
+	size = ctx->m_Symbols.m_TableSize * 2;
+	table = (Symbol**)CAllocMem(size, sizeof(Symbol*));
+
+	for(slot = 0; slot < ctx->m_Symbols.m_TableSize; slot++) {
+		for(sym = ctx->m_Symbols.m_Table[slot]; NULL != sym; sym = next) {
+			next = sym->next;
+			newSlot = sym->hash & (size - 1);
+			sym->next = table[newSlot];
+			table[newSlot] = sym;
 		}
 	}
 
-	return (NULL);
+	free(ctx->m_Symbols.m_Table);
+	ctx->m_Symbols.m_Table = table;
+	ctx->m_Symbols.m_TableSize = size;
 }
 
 Symbol *FindSymbol(EnvContext *ctx, const char *name, const bool noerror, const bool onlyns)
@@ -332,10 +533,7 @@ Symbol *AddSymbol(EnvContext *ctx,
 				  Struct *astruct,
 				  const int stcount)
 {
-	Line *lp;
 	Symbol *new_sym;
-	Symbol *list;
-	Symbol *save;
 	char newname[MAX_LABELSIZE * 3];
 
 	if(false == IsLabelStart(ctx, *labelIn) && 0 != stricmp("?rts", labelIn)) {
@@ -364,6 +562,13 @@ Symbol *AddSymbol(EnvContext *ctx,
 					return new_sym;
 				}
 
+				/* While relaxing, a moved symbol takes its new value for the next pass */
+				else if(true == ctx->m_Relax.m_Active && true == ctx->m_Relax.m_Enabled) {
+					new_sym->value = val;
+					ctx->m_Relax.m_Moved = true;
+					return new_sym;
+				}
+
 				else {
 					error(ctx, ERR_PHASING, "symbol %s was defined as %04X and is now %04X", labelIn, new_sym->value, val);
 					return new_sym;
@@ -380,10 +585,28 @@ Symbol *AddSymbol(EnvContext *ctx,
 	}
 
 
-	/* enter new symbol */
-	new_sym = (Symbol*)AllocMem(sizeof(Symbol));
-	new_sym->name = (char*)AllocMem(strlen(newname) + 1);
-	strcpy(new_sym->name, newname);
+	return InsertSymbol(ctx, newname, val, type, GetCurrentSegment(ctx), astruct, stcount, ctx->m_LineNumber);
+}
+
+
+/*----------------------------------------------------------------------------
+	InsertSymbol --- enter a new symbol under its full name
+----------------------------------------------------------------------------*/
+Symbol *InsertSymbol(EnvContext *ctx,
+					 const char *name,
+					 const int val,
+					 const SYMBOL_TYPE type,
+					 const SEGMENT segment,
+					 Struct *astruct,
+					 const int stcount,
+					 const int line)
+{
+	Symbol *new_sym;
+	u_int32 slot;
+
+	new_sym = (Symbol*)ArenaAlloc(ctx, sizeof(Symbol));
+	new_sym->name = (char*)ArenaAlloc(ctx, strlen(name) + 1);
+	strcpy(new_sym->name, name);
 	switch(type) {
 	case SYM_STRUCTURE:
 	case SYM_STRUCTDATA:
@@ -412,47 +635,72 @@ Symbol *AddSymbol(EnvContext *ctx,
 		break;
 	}
 
-	new_sym->segment = GetCurrentSegment(ctx);
+	new_sym->segment = segment;
 	new_sym->type = type;
 	new_sym->value = val;
-	new_sym->Lnext = NULL;
-	new_sym->Rnext = NULL;
-	new_sym->L_list = lp = (Line*)AllocMem(sizeof(Line));;
-	lp->L_num = ctx->m_LineNumber;
-	lp->next = NULL;
+	new_sym->L_list = NULL;
+	new_sym->L_last = NULL;
+	AddSymbolLine(ctx, new_sym, line);
 
-	if(root == NULL) {
-		root = new_sym;
+	/* link it into its hash slot, growing the table as it fills */
+	if(ctx->m_Symbols.m_Count >= ctx->m_Symbols.m_TableSize) {
+		GrowSymbolTable(ctx);
 	}
 
-	else {
-		list = root;
-		save = NULL;
-		while(list != NULL) {
-			save = list;
-			if(CompareSymbol(ctx, newname, list->name) < 0) {
-				list = list->Lnext;
-			}
-			else {
-				list = list->Rnext;
-			}
-		}
+	new_sym->hash = HashSymbol(name);
+	new_sym->serial = ctx->m_Symbols.m_Count;
+	slot = new_sym->hash & (ctx->m_Symbols.m_TableSize - 1);
+	new_sym->next = ctx->m_Symbols.m_Table[slot];
+	ctx->m_Symbols.m_Table[slot] = new_sym;
+	ctx->m_Symbols.m_Count++;
+	free(ctx->m_Symbols.m_Sorted);
+	ctx->m_Symbols.m_Sorted = NULL;
+	ctx->m_Stats.m_Inserts++;
 
-		if(save == NULL) {
-			internal((ctx, "unable to install symbol"));
-		}
+	return new_sym;
+}
 
-		
-		if(CompareSymbol(ctx, newname, save->name) < 0) {
-			save->Lnext = new_sym;
-		}
 
-		else {
-			save->Rnext = new_sym;
+/*----------------------------------------------------------------------------
+	SaveSymbolValues --- copy the value of every symbol in table order
+----------------------------------------------------------------------------*/
+int32 *SaveSymbolValues(EnvContext *ctx)
+{
+	int32	*values;
+	Symbol	*sym;
+	u_int32	slot;
+	u_int32	count;
+
+	values = (int32*)AllocMem((ctx->m_Symbols.m_Count + 1) * sizeof(int32));
+
+	count = 0;
+	for(slot = 0; slot < ctx->m_Symbols.m_TableSize; slot++) {
+		for(sym = ctx->m_Symbols.m_Table[slot]; NULL != sym; sym = sym->next) {
+			values[count++] = sym->value;
 		}
 	}
 
-	return new_sym;
+	return values;
+}
+
+
+/*----------------------------------------------------------------------------
+	RestoreSymbolValues --- put back values copied by SaveSymbolValues
+
+	No symbols may be added in between, so the table order still matches.
+----------------------------------------------------------------------------*/
+void RestoreSymbolValues(EnvContext *ctx, const int32 *values)
+{
+	Symbol	*sym;
+	u_int32	slot;
+	u_int32	count;
+
+	count = 0;
+	for(slot = 0; slot < ctx->m_Symbols.m_TableSize; slot++) {
+		for(sym = ctx->m_Symbols.m_Table[slot]; NULL != sym; sym = sym->next) {
+			sym->value = values[count++];
+		}
+	}
 }
 
 
@@ -49,6 +49,7 @@ typedef enum {
 
 typedef struct _symbol Symbol;
 typedef struct _line Line;
+typedef struct _symarena SymArena;
 
 
 
@@ -67,28 +68,37 @@ struct _symbol {
 	int32		value;		/* Value of the symbol */
 	Struct		*astruct;	/* Pointer to structure */
 	int			stcount;	/* Structure count */
-	Symbol		*Lnext;		/* left node of the tree leaf */
-	Symbol		*Rnext;		/* right node of the tree leaf */
+	Symbol		*next;		/* next symbol in the same hash slot */
+	u_int32		hash;		/* hash of the name */
+	u_int32		serial;		/* number of symbols added before this one */
 	Line		*L_list;	/* pointer to linked list of line numbers */
+	Line		*L_last;	/* last line in L_list */
 };
 
 /*------------------------------------------------------------------------
 	symtab.c
 ------------------------------------------------------------------------*/
 void InitSymbolTable(EnvContext *ctx);
+void ReleaseSymbolTable(EnvContext *ctx);
 void ResetLocalLabels(EnvContext *ctx);
 Symbol *AddSymbol(EnvContext *ctx, const char *str, const int val, const SYMBOL_TYPE type, Struct *astruct, const int astructCount);
 Symbol *FindSymbol(EnvContext *ctx, const char *name, const bool noerror, const bool onlyns);
+Symbol *LookupSymbol(EnvContext *ctx, const char *name);
+Symbol *InsertSymbol(EnvContext *ctx, const char *name, const int val, const SYMBOL_TYPE type, const SEGMENT segment, Struct *astruct, const int astructCount, const int line);
+int32 *SaveSymbolValues(EnvContext *ctx);
+void RestoreSymbolValues(EnvContext *ctx, const int32 *values);
 void AddExport(EnvContext *info, const char *name);
 void EmitExports(EnvContext *ctx, FILE *outputFile);
 void InitExports(EnvContext *ctx);
-void SetExportAddress(const int mmuPage, const u_int16 address);
-int GetNextLocalLabel();
+void ReleaseExports(EnvContext *ctx);
+void SetExportAddress(EnvContext *ctx, const int mmuPage, const u_int16 address);
+int GetNextLocalLabel(EnvContext *ctx);
+void AddSymbolLine(EnvContext *ctx, Symbol *sym, const int line);
 void DumpSymTable(EnvContext *ctx);
-void DumpCrossRef();
+void DumpCrossRef(EnvContext *ctx);
 void SetNamespace(EnvContext *ctx, const char *ns);
 void ClearNamespace(EnvContext *ctx);
-bool IsInNamespace();
+bool IsInNamespace(EnvContext *ctx);
 
 
 #endif	/* SYMTAB_H */
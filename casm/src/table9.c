@@ -36,9 +36,6 @@
 #include "proto.h"
 
 
-static int16	pseudomap[256];
-static int16	opcodemap[256];
-
 static const Mneumonic STLIST = {
 	ASM_ALL,
 	CPU_6809,
@@ -540,87 +537,232 @@ zmb		Reserve memory bytes (all set to zero)
 */
 
 
-static void buildmap(const Mneumonic *otable, int16 *etable)
+/*
+ *	Mnemonics are found through a perfect hash of the names that can be
+ *	used under the current compatibility mode and CPU.  Every name has a
+ *	slot of its own, so a lookup is one hash and one compare.  Names are
+ *	hashed in lower case, which folds the case of the source.  The table is
+ *	built the first time it is needed, and again if the mode or CPU changes.
+ */
+#define OPHASH_BUCKET_LOAD	4		/* Names per displacement bucket			*/
+#define OPHASH_MAX_TRIES	65536	/* Displacements tried before growing		*/
+
+#define OPHASH_SLOT(hash, displace, shift)	\
+	((u_int32)((((hash) ^ (displace)) * 2654435761UL) & 0xffffffffUL) >> (shift))
+
+
+/*----------------------------------------------------------------------------
+	HashMnemonic --- hash a mnemonic, ignoring case
+----------------------------------------------------------------------------*/
+static u_int32 HashMnemonic(const char *str)
 {
-	int16	 i, loc;
+	u_int32 hash;
 
-	for(i = 0; i < 256; i++) {
-		etable[i] = -1;
+	hash = 2166136261UL;
+	while(EOS != *str) {
+		hash = ((hash ^ (u_char)tolower(*str)) * 16777619UL) & 0xffffffffUL;
+		str++;
 	}
 
-	i = 0;
-	while(NULL != otable->mnemonic && EOS != *otable->mnemonic) {
-		loc = (int16)(*otable->mnemonic);
-		if(etable[loc] == -1) {
-			etable[loc] = i;
-		}
-		i++;
-		otable++;
-	}
+	return hash;
 }
 
-void InitOpcodeTable()
-{
-	buildmap(op_table, opcodemap);
-	buildmap(pseudo_table, pseudomap);
-}
 
 /*----------------------------------------------------------------------------
-	mne_look --- mnemonic lookup
-
-	Return pointer to an oper structure if found.
-	Searches both the machine mnemonic table and the pseudo table.
+	PlaceBucket --- find a displacement that puts every name of a bucket
+					in a free slot
 ----------------------------------------------------------------------------*/
-const Mneumonic *mne_look(EnvContext *ctx, const char *str)
+static bool PlaceBucket(EnvContext *ctx, const Mneumonic **names, const u_int32 *hashes, const int *members, const int count, const u_int32 bucket)
 {
-	const Mneumonic *mid;
-	int pchr;
-	char chr;
+	u_int32	displace;
+	u_int32	slot;
+	int		i;
+	int		j;
+
+	for(displace = 0; displace < OPHASH_MAX_TRIES; displace++) {
+		for(i = 0; i < count; i++) {
+			slot = OPHASH_SLOT(hashes[members[i]], displace, ctx->m_Opcodes.m_SlotShift);
+			if(NULL != ctx->m_Opcodes.m_Slots[slot]) {
+				break;
+			}
+			ctx->m_Opcodes.m_Slots[slot] = names[members[i]];
+		}
+
+		if(i == count) {
+			ctx->m_Opcodes.m_Displace[bucket] = displace;
+			return true;
+		}
+
+		/* Take back the names placed with this displacement */
+		for(j = 0; j < i; j++) {
+			ctx->m_Opcodes.m_Slots[OPHASH_SLOT(hashes[members[j]], displace, ctx->m_Opcodes.m_SlotShift)] = NULL;
+		}
+	}
+
+	return false;
+}
 
-	chr = (char)tolower(*str);
 
-	/* Search machine mnemonics first */
-	if((pchr = opcodemap[(u_char)chr]) != -1) {
-		mid = &op_table[(u_char)pchr];	/* point to start */
-		while(NULL != mid->mnemonic && *mid->mnemonic == chr) {	/* keep going until end of letter */
+/*----------------------------------------------------------------------------
+	BuildOpcodeHash --- build the perfect hash for the current mode and CPU
+----------------------------------------------------------------------------*/
+static void BuildOpcodeHash(EnvContext *ctx)
+{
+	const Mneumonic	*op;
+	const Mneumonic	**names;
+	u_int32			*hashes;
+	int				*bucketOf;
+	int				*bucketSize;
+	int				*members;
+	int				count;
+	int				maxSize;
+	int				size;
+	int				pass;
+	int				i;
+	int				j;
+	u_int32			bucket;
+	bool			placed;
+
+	names = (const Mneumonic**)AllocMem(((sizeof(op_table) + sizeof(pseudo_table)) / sizeof(Mneumonic)) * sizeof(Mneumonic*));
+	hashes = (u_int32*)AllocMem(((sizeof(op_table) + sizeof(pseudo_table)) / sizeof(Mneumonic)) * sizeof(u_int32));
+
+	/* 1. Collect the usable names.  Machine mnemonics come first so they
+		  win over a pseudo op of the same name */
+	count = 0;
+	for(pass = 0; pass < 2; pass++) {
+		for(op = (0 == pass ? op_table : pseudo_table); NULL != op->mnemonic && EOS != *op->mnemonic; op++) {
+			u_int32 hash;
 
-			/* Check for compatibility */
-			if(0 == (mid->compatMask & ctx->m_Compat.m_AsmOpMask)) {
-				mid++;
+			if(0 == (op->compatMask & ctx->m_Compat.m_AsmOpMask)) {
 				continue;
 			}
 
 			/* If we are assembling for 6809 only, skip 6309 ops */
-			if(CPU_6809 == ctx->m_CPUType && CPU_6309 == mid->cputype) {
-				mid++;
+			if(0 == pass && CPU_6809 == ctx->m_CPUType && CPU_6309 == op->cputype) {
 				continue;
 			}
 
-			if(stricmp(mid->mnemonic, str) == 0) {
-				return(mid);
+			hash = HashMnemonic(op->mnemonic);
+			for(i = 0; i < count; i++) {
+				if(hashes[i] == hash && 0 == stricmp(names[i]->mnemonic, op->mnemonic)) {
+					break;
+				}
+			}
+
+			if(i == count) {
+				names[count] = op;
+				hashes[count] = hash;
+				count++;
 			}
-			mid++;
 		}
 	}
 
-	/* Check for pseudo ops */
-	if((pchr = pseudomap[(u_char)chr]) != -1) {
-		mid = &pseudo_table[(u_char)pchr];	/* point to start */
-		while(NULL != mid->mnemonic && *mid->mnemonic == chr) { 	/* keep going until end of list */
-			/* Check for compatibility */
-			if(0 == (mid->compatMask & ctx->m_Compat.m_AsmOpMask)) {
-				mid++;
-				continue;
+	bucketOf = (int*)AllocMem((count + 1) * sizeof(int));
+	members = (int*)AllocMem((count + 1) * sizeof(int));
+
+	/* 2. Start with twice as many slots as names, and grow until every
+		  bucket finds a displacement */
+	ctx->m_Opcodes.m_SlotCount = 2;
+	ctx->m_Opcodes.m_SlotShift = 31;
+	while(ctx->m_Opcodes.m_SlotCount < (u_int32)count * 2) {
+		ctx->m_Opcodes.m_SlotCount <<= 1;
+		ctx->m_Opcodes.m_SlotShift--;
+	}
+
+	do {
+		ctx->m_Opcodes.m_BucketCount = 1;
+		while(ctx->m_Opcodes.m_BucketCount * OPHASH_BUCKET_LOAD < (u_int32)count) {
+			ctx->m_Opcodes.m_BucketCount <<= 1;
+		}
+
+		free((void*)ctx->m_Opcodes.m_Slots);
+		free(ctx->m_Opcodes.m_Displace);
+		ctx->m_Opcodes.m_Slots = (const Mneumonic**)CAllocMem(ctx->m_Opcodes.m_SlotCount, sizeof(Mneumonic*));
+		ctx->m_Opcodes.m_Displace = (u_int32*)CAllocMem(ctx->m_Opcodes.m_BucketCount, sizeof(u_int32));
+		bucketSize = (int*)CAllocMem(ctx->m_Opcodes.m_BucketCount, sizeof(int));
+
+		maxSize = 0;
+		for(i = 0; i < count; i++) {
+			bucketOf[i] = (int)(hashes[i] & (ctx->m_Opcodes.m_BucketCount - 1));
+			bucketSize[bucketOf[i]]++;
+			if(bucketSize[bucketOf[i]] > maxSize) {
+				maxSize = bucketSize[bucketOf[i]];
 			}
+		}
 
-			if(stricmp(str, mid->mnemonic) == 0) {
-				return(mid);
+		/* 3. Place the fullest buckets first, while there is the most room */
+		placed = true;
+		for(size = maxSize; size > 0 && true == placed; size--) {
+			for(bucket = 0; bucket < ctx->m_Opcodes.m_BucketCount && true == placed; bucket++) {
+				if(size != bucketSize[bucket]) {
+					continue;
+				}
+
+				for(i = 0, j = 0; i < count; i++) {
+					if((u_int32)bucketOf[i] == bucket) {
+						members[j++] = i;
+					}
+				}
+
+				placed = PlaceBucket(ctx, names, hashes, members, size, bucket);
 			}
-			mid++;
 		}
+
+		free(bucketSize);
+
+		if(false == placed) {
+			ctx->m_Opcodes.m_SlotCount <<= 1;
+			ctx->m_Opcodes.m_SlotShift--;
+		}
+	} while(false == placed);
+
+	free(members);
+	free(bucketOf);
+	free(hashes);
+	free(names);
+
+	ctx->m_Opcodes.m_Mask = ctx->m_Compat.m_AsmOpMask;
+	ctx->m_Opcodes.m_CPU = ctx->m_CPUType;
+}
+
+
+void InitOpcodeTable(EnvContext *ctx)
+{
+	/* The hash is built for the mode and CPU of the first lookup */
+	ctx->m_Opcodes.m_Slots = NULL;
+	ctx->m_Opcodes.m_Displace = NULL;
+}
+
+
+void ReleaseOpcodeTable(EnvContext *ctx)
+{
+	free((void*)ctx->m_Opcodes.m_Slots);
+	free(ctx->m_Opcodes.m_Displace);
+	InitOpcodeTable(ctx);
+}
+
+/*----------------------------------------------------------------------------
+	mne_look --- mnemonic lookup
+
+	Return pointer to an oper structure if found.
+	Searches both the machine mnemonic table and the pseudo table.
+----------------------------------------------------------------------------*/
+const Mneumonic *mne_look(EnvContext *ctx, const char *str)
+{
+	const Mneumonic *mne;
+	u_int32 hash;
+
+	if(NULL == ctx->m_Opcodes.m_Slots || ctx->m_Opcodes.m_Mask != ctx->m_Compat.m_AsmOpMask || ctx->m_Opcodes.m_CPU != ctx->m_CPUType) {
+		BuildOpcodeHash(ctx);
+	}
+
+	hash = HashMnemonic(str);
+	mne = ctx->m_Opcodes.m_Slots[OPHASH_SLOT(hash, ctx->m_Opcodes.m_Displace[hash & (ctx->m_Opcodes.m_BucketCount - 1)], ctx->m_Opcodes.m_SlotShift)];
+	if(NULL != mne && 0 == stricmp(mne->mnemonic, str)) {
+		return(mne);
 	}
 
-	if(StructLookup(str) != NULL) {
+	if(StructLookup(ctx, str) != NULL) {
 		return(&STLIST);
 	}
 	/* Search structure list */
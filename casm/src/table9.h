@@ -45,7 +45,7 @@ typedef struct {
 	int		m_Inherent;
 } CycleCount;
 
-typedef struct {
+typedef struct _mneumonic {
 	u_int16		compatMask;		/* The level this mneumonic is allowed */
 	CPUTYPE		cputype;		/* CPU type (6809/6309) */
 	char		*mnemonic;		/* its name */
@@ -57,7 +57,8 @@ typedef struct {
 	CycleCount	cycles6309;		/* its base # of cycles */
 } Mneumonic;
 
-void InitOpcodeTable();
+void InitOpcodeTable(EnvContext *ctx);
+void ReleaseOpcodeTable(EnvContext *ctx);
 
 const Mneumonic *mne_look(EnvContext *ctx, const char *str);
 int GetCycleCount(EnvContext *ctx, const Mneumonic *op, const ADDR_MODE mode, const CPUTYPE cpu);
@@ -171,6 +171,19 @@ void *CAllocMem(const size_t count, const size_t nbytes)
 }
 
 
+/*----------------------------------------------------------------------------
+	ReallocMem --- resize a block of memory
+----------------------------------------------------------------------------*/
+void *ReallocMem(void *ptr, const size_t nbytes)
+{
+	ptr = realloc(ptr, nbytes);
+	if(ptr == NULL) {
+		internal((NULL, "out of memory"));
+	}
+	return(ptr);
+}
+
+
 /*----------------------------------------------------------------------------
 	SkipWS --- move pointer to next non-whitespace char
 ----------------------------------------------------------------------------*/
@@ -50,6 +50,7 @@ char *strlwr(char *str);
 
 void *AllocMem(const size_t nbytes);
 void *CAllocMem(const size_t count, const size_t nbytes);
+void *ReallocMem(void *ptr, const size_t nbytes);
 
 char *SkipWS(char *ptr);
 #define SkipConstWS(x)	((const char*)SkipWS((char*)x))
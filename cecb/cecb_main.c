@@ -26,6 +26,8 @@ static char const * const helpMessage[] =
 	"     -f <n>    = Set bit delineation frequency (for WAV files).\n",
 	"     -p <e|o>  = Set even or odd WAV file parity (for WAV files).\n",
 	"     -s <n>    = Start at sample/bit n in WAV/CAS file.\n",
+	"     -c        = Use a constant bit delineation frequency (for WAV files).\n",
+	"     -v        = Report per block decode confidence (for WAV files).\n",
 	"\n",
 	"     % is a decimal number between 0 and 1.\n",
 	NULL
@@ -103,6 +105,14 @@ int main(int argc, char *argv[])
 							cecb_start_sample = strtol( &(argv[i][2]), NULL, 0 );
 						break;
 					
+					case 'c':
+						cecb_adaptive = 0;
+						break;
+					
+					case 'v':
+						cecb_verbose = 1;
+						break;
+					
 					case 'p':
 						if( strlen(argv[i]) == 2 )
 						{
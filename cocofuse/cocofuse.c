@@ -4,6 +4,8 @@
  * $Id$
  ********************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
@@ -29,71 +31,798 @@
 #endif
 
 #include <fuse.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 static int coco_open(const char *path, struct fuse_file_info *fi);
 
-/* DSK image filename pointer */
-static char dsk[1024];
+#define HANDLE_TABLE_GROW	64
+#define CACHE_BUCKETS		256
+#define CACHE_MAX_ENTRIES	4096			/* paths cached before old ones are evicted */
+#define MAX_IO_SIZE			(128 * 1024)	/* largest read/write we ask the kernel for */
 
+/* Open handle table entry; fi->fh holds the slot index plus one */
+typedef struct
+{
+	coco_path_id	path;
+	int				mode;			/* FAM_* mode the path was opened with */
+	pthread_mutex_t	lock;			/* keeps seek and read/write on the path together */
+} coco_handle;
+
+/* Cached getattr and readdir results for one pathname in the image */
+typedef struct _coco_cache_entry
+{
+	struct _coco_cache_entry	*next;
+	char			*name;
+	int				busy;			/* callers using the entry; it is not evicted meanwhile */
+	int				referenced;		/* used since the eviction hand last passed */
+	int				stat_valid;
+	int				stat_ec;		/* result of the getattr that filled stat */
+	struct stat		stat;
+	int				dir_valid;
+	int				dir_count;
+	char			**dir_names;
+} coco_cache_entry;
+
+/* Free space accounting, so statfs need not rescan the allocation map */
+typedef struct
+{
+	int				valid;			/* counts below describe the image */
+	int				rescan;			/* an allocation split the longest free run */
+	pthread_mutex_t	lock;			/* serializes the first load and rescans among readers */
+	u_int			unit_bytes;		/* bytes in a cluster (OS-9) or granule (DECB) */
+	u_int			units;			/* clusters or granules on the image */
+	u_int			free_units;
+	u_int			largest_start;	/* first unit of the longest free run */
+	u_int			largest_free;	/* length of the longest free run */
+	u_char			*map;			/* allocation map, kept in step by space_note */
+	int				map_bytes;
+} coco_space;
+
+/* The mounted image session */
+typedef struct
+{
+	char				dsk[1024];		/* DSK image filename */
+	_path_type			type;			/* image type, identified at mount */
+	int					read_only;		/* mounted ro, so the kernel may keep cached pages */
+	pthread_rwlock_t	image_lock;		/* shared to read the image, exclusive to change it */
+	pthread_mutex_t		table_lock;		/* protects the handle table and cache */
+	coco_handle			**handles;
+	uint64_t			handle_count;
+	coco_cache_entry	*cache[CACHE_BUCKETS];
+	int					cache_count;	/* entries in the cache */
+	int					cache_hand;		/* bucket the eviction hand is on */
+	coco_space			space;
+} coco_session;
+
+static coco_session session =
+{
+	.image_lock = PTHREAD_RWLOCK_INITIALIZER,
+	.table_lock = PTHREAD_MUTEX_INITIALIZER,
+	.space.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+
+/*
+ * handle_add - stores an open path in the handle table and returns its handle
+ */
+static uint64_t handle_add(coco_path_id p, int mode)
+{
+	coco_handle *h;
+	uint64_t i;
+
+	if ((h = malloc(sizeof(coco_handle))) == NULL)
+	{
+		return 0;
+	}
+	h->path = p;
+	h->mode = mode;
+	pthread_mutex_init(&h->lock, NULL);
+
+	pthread_mutex_lock(&session.table_lock);
+	for (i = 0; i < session.handle_count; i++)
+	{
+		if (session.handles[i] == NULL)
+		{
+			break;
+		}
+	}
+
+	if (i == session.handle_count)
+	{
+		coco_handle **t = realloc(session.handles, (session.handle_count + HANDLE_TABLE_GROW) * sizeof(coco_handle *));
+
+		if (t == NULL)
+		{
+			pthread_mutex_unlock(&session.table_lock);
+			pthread_mutex_destroy(&h->lock);
+			free(h);
+			return 0;
+		}
+
+		memset(&t[session.handle_count], 0, HANDLE_TABLE_GROW * sizeof(coco_handle *));
+		session.handles = t;
+		session.handle_count += HANDLE_TABLE_GROW;
+	}
+
+	session.handles[i] = h;
+	pthread_mutex_unlock(&session.table_lock);
+
+	return i + 1;
+}
+
+
+/*
+ * handle_get - returns the handle for fi, or NULL if it is not open
+ */
+static coco_handle *handle_get(struct fuse_file_info *fi)
+{
+	coco_handle *h = NULL;
+
+	pthread_mutex_lock(&session.table_lock);
+	if (fi->fh != 0 && fi->fh <= session.handle_count)
+	{
+		h = session.handles[fi->fh - 1];
+	}
+	pthread_mutex_unlock(&session.table_lock);
+
+	return h;
+}
+
+
+/*
+ * handle_remove - takes the handle for fi out of the table and returns it
+ */
+static coco_handle *handle_remove(struct fuse_file_info *fi)
+{
+	coco_handle *h = NULL;
+
+	pthread_mutex_lock(&session.table_lock);
+	if (fi->fh != 0 && fi->fh <= session.handle_count)
+	{
+		h = session.handles[fi->fh - 1];
+		session.handles[fi->fh - 1] = NULL;
+	}
+	pthread_mutex_unlock(&session.table_lock);
+	fi->fh = 0;
+
+	return h;
+}
+
+
+/*
+ * handle_close - closes the path a removed handle held and frees it
+ */
+static error_code handle_close(coco_handle *h)
+{
+	error_code ec = _coco_close(h->path);
+
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+
+	return ec;
+}
+
+
+static unsigned int cache_hash(const char *path)
+{
+	unsigned int h = 5381;
+
+	while (*path != '\0')
+	{
+		h = (h * 33) ^ (u_char)*path++;
+	}
+
+	return h % CACHE_BUCKETS;
+}
+
+
+static void cache_free_entry(coco_cache_entry *e);
+
+
+/*
+ * cache_evict - frees entries that have not been used lately, to keep the cache bounded
+ *
+ * Notes: called with table_lock held.  The hand sweeps the buckets clock
+ * fashion: an entry used since the hand last passed gets a second chance,
+ * and entries a caller is still using are skipped.  Eviction stops once
+ * the cache is down to seven eighths of its limit.
+ */
+static void cache_evict(void)
+{
+	int sweeps;
+
+	for (sweeps = 0; sweeps < 2 * CACHE_BUCKETS && session.cache_count > CACHE_MAX_ENTRIES - CACHE_MAX_ENTRIES / 8; sweeps++)
+	{
+		coco_cache_entry **pe = &session.cache[session.cache_hand];
+
+		while (*pe != NULL)
+		{
+			coco_cache_entry *e = *pe;
+
+			if (e->busy == 0 && !e->referenced)
+			{
+				*pe = e->next;
+				cache_free_entry(e);
+				session.cache_count--;
+				continue;
+			}
+			e->referenced = 0;
+			pe = &e->next;
+		}
+		session.cache_hand = (session.cache_hand + 1) % CACHE_BUCKETS;
+	}
+}
+
+
+/*
+ * cache_lookup - finds the cache entry for a path, creating an empty one if needed
+ *
+ * Notes: called with table_lock held.  The entry is marked busy so it
+ * cannot be evicted; the caller gives it back with cache_release.
+ */
+static coco_cache_entry *cache_lookup(const char *path)
+{
+	unsigned int b = cache_hash(path);
+	coco_cache_entry *e;
+
+	for (e = session.cache[b]; e != NULL; e = e->next)
+	{
+		if (strcmp(e->name, path) == 0)
+		{
+			e->busy++;
+			e->referenced = 1;
+			return e;
+		}
+	}
+
+	if (session.cache_count >= CACHE_MAX_ENTRIES)
+	{
+		cache_evict();
+	}
+
+	e = calloc(1, sizeof(coco_cache_entry));
+	if (e == NULL)
+	{
+		return NULL;
+	}
+	e->name = strdup(path);
+	if (e->name == NULL)
+	{
+		free(e);
+		return NULL;
+	}
+	e->busy = 1;
+	e->referenced = 1;
+	e->next = session.cache[b];
+	session.cache[b] = e;
+	session.cache_count++;
+
+	return e;
+}
+
+
+/*
+ * cache_release - gives back an entry returned by cache_lookup or cache_dir
+ *
+ * Notes: called with table_lock held.
+ */
+static void cache_release(coco_cache_entry *e)
+{
+	e->busy--;
+}
+
+
+static void cache_free_entry(coco_cache_entry *e)
+{
+	int i;
+
+	for (i = 0; i < e->dir_count; i++)
+	{
+		free(e->dir_names[i]);
+	}
+	free(e->dir_names);
+	free(e->name);
+	free(e);
+}
+
+
+/*
+ * cache_forget - drops cached results for one path (its contents or attributes changed)
+ *
+ * Notes: called with image_lock held exclusively.
+ */
+static void cache_forget(const char *path)
+{
+	coco_cache_entry **pe = &session.cache[cache_hash(path)];
+
+	while (*pe != NULL)
+	{
+		if (strcmp((*pe)->name, path) == 0)
+		{
+			coco_cache_entry *e = *pe;
+
+			*pe = e->next;
+			cache_free_entry(e);
+			session.cache_count--;
+			return;
+		}
+		pe = &(*pe)->next;
+	}
+}
+
+
+/*
+ * cache_flush - drops all cached results (the directory tree changed)
+ *
+ * Notes: called with image_lock held exclusively.
+ */
+static void cache_flush(void)
+{
+	int b;
+
+	for (b = 0; b < CACHE_BUCKETS; b++)
+	{
+		while (session.cache[b] != NULL)
+		{
+			coco_cache_entry *e = session.cache[b];
+
+			session.cache[b] = e->next;
+			cache_free_entry(e);
+		}
+	}
+	session.cache_count = 0;
+}
+
+
+/*
+ * cache_dir - returns the cache entry for a directory with its listing loaded
+ *
+ * Notes: called with image_lock held.  Once loaded, the listing does not
+ * change until a writer takes image_lock exclusively, so callers may walk
+ * it without table_lock.  On success the entry is busy until the caller
+ * gives it back with cache_release.
+ */
+static int cache_dir(const char *path, coco_cache_entry **cep)
+{
+	error_code ec;
+	coco_cache_entry *ce;
+	coco_path_id p;
+	coco_dir_entry e;
+	char buff[1024];
+	char **dir_names = NULL;
+	int dir_count = 0, size = 0, i;
+
+	pthread_mutex_lock(&session.table_lock);
+	ce = cache_lookup(path);
+	i = (ce != NULL && ce->dir_valid);
+	pthread_mutex_unlock(&session.table_lock);
+
+	if (ce == NULL)
+	{
+		return -ENOMEM;
+	}
+	*cep = ce;
+	if (i)
+	{
+		return 0;
+	}
+
+	sprintf(buff, "%s,%s", session.dsk, path);
+	if (_coco_open(&p, buff, FAM_READ | FAM_DIR) != 0)
+	{
+		/* DECB doesn't use FAM_DIR */
+		if ((ec = _coco_open(&p, buff, FAM_READ)) != 0)
+		{
+			pthread_mutex_lock(&session.table_lock);
+			cache_release(ce);
+			pthread_mutex_unlock(&session.table_lock);
+			return -CoCoToUnixError(ec);
+		}
+	}
+
+	while (_coco_readdir(p, &e) == 0)
+	{
+		char *name = NULL;
+		u_char cstring[24];
+
+		switch (e.type)
+		{
+			case OS9:
+				if (e.dentry.os9.name[0] != '\0')
+				{
+					/* entry is not empty, add it */
+					name = (char *)OS9StringToCString(e.dentry.os9.name);
+				}
+				break;
+
+			case DECB:
+				if (e.dentry.decb.filename[0] != 0 && e.dentry.decb.filename[0] != 255 )
+				{
+					DECBStringToCString(e.dentry.decb.filename, e.dentry.decb.file_extension, cstring);
+					name = (char *)cstring;
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		if (name == NULL)
+		{
+			continue;
+		}
+
+		if (dir_count == size)
+		{
+			char **names = realloc(dir_names, (size + 32) * sizeof(char *));
+
+			if (names == NULL)
+			{
+				break;
+			}
+			dir_names = names;
+			size += 32;
+		}
+
+		if ((dir_names[dir_count] = strdup(name)) == NULL)
+		{
+			break;
+		}
+		dir_count++;
+	}
+
+	_coco_close(p);
+
+	/* Another reader may have loaded the listing meanwhile */
+	pthread_mutex_lock(&session.table_lock);
+	if (!ce->dir_valid)
+	{
+		ce->dir_names = dir_names;
+		ce->dir_count = dir_count;
+		ce->dir_valid = 1;
+		dir_names = NULL;
+		dir_count = 0;
+	}
+	pthread_mutex_unlock(&session.table_lock);
+
+	for (i = 0; i < dir_count; i++)
+	{
+		free(dir_names[i]);
+	}
+	free(dir_names);
+
+	return 0;
+}
+
+
+
+/*
+ * space_unit_free - returns non-zero if a cluster (OS-9) or granule (DECB) is free
+ */
+static int space_unit_free(u_char *map, u_int unit)
+{
+	if (session.type == DECB)
+	{
+		return map[unit] == 0xFF;
+	}
+
+	return (map[unit / 8] & (1 << (7 - unit % 8))) == 0;
+}
+
+
+/*
+ * space_unit_set - marks a unit free or allocated in the session's copy of the map
+ */
+static void space_unit_set(u_char *map, u_int unit, int allocated)
+{
+	if (session.type == DECB)
+	{
+		/* only free or not matters here, not the chain the FAT holds */
+		map[unit] = allocated ? 0xC0 : 0xFF;
+	}
+	else if (allocated)
+	{
+		map[unit / 8] |= 1 << (7 - unit % 8);
+	}
+	else
+	{
+		map[unit / 8] &= ~(1 << (7 - unit % 8));
+	}
+}
+
+
+/*
+ * space_run - returns the length of the free run holding a unit, and where it starts
+ */
+static u_int space_run(u_char *map, u_int unit, u_int *start)
+{
+	u_int first = unit, last = unit;
+
+	while (first > 0 && space_unit_free(map, first - 1))
+	{
+		first--;
+	}
+	while (last + 1 < session.space.units && space_unit_free(map, last + 1))
+	{
+		last++;
+	}
+	*start = first;
+
+	return last - first + 1;
+}
+
+
+/*
+ * space_scan - counts free units and finds the longest free run in a whole map
+ */
+static void space_scan(u_char *map)
+{
+	coco_space *sp = &session.space;
+	u_int i, run = 0;
+
+	sp->free_units = 0;
+	sp->largest_free = 0;
+	sp->largest_start = 0;
+	for (i = 0; i < sp->units; i++)
+	{
+		if (!space_unit_free(map, i))
+		{
+			run = 0;
+			continue;
+		}
+		sp->free_units++;
+		if (++run > sp->largest_free)
+		{
+			sp->largest_free = run;
+			sp->largest_start = i + 1 - run;
+		}
+	}
+	sp->rescan = 0;
+}
+
+
+/*
+ * space_decb_granules - returns the number of granules on the Disk BASIC drive a path is on
+ *
+ * Notes: every drive of an HDB-DOS image is a 35 track drive, laid end to
+ * end at a stride of 161280 bytes, so the size of the image file says
+ * nothing about one of them.  A lone disk image is one drive, and its
+ * track count follows from its size as decb dskini lays it out.
+ */
+static u_int space_decb_granules(decb_path_id p)
+{
+	struct stat st;
+	u_int tracks;
+
+	if (p->drive != 0 || p->hdbdos_offset != 0)
+	{
+		return 68;
+	}
+	if (fstat(fileno(p->fd), &st) != 0)
+	{
+		return 68;
+	}
+	if (st.st_size > 161280 && st.st_size % 161280 == 0)
+	{
+		/* more than one HDB-DOS drive; this is the first */
+		return 68;
+	}
+
+	tracks = st.st_size / (18 * 256);
+	if (tracks >= 80)
+	{
+		return 156;
+	}
+	if (tracks >= 40)
+	{
+		return 78;
+	}
+
+	return 68;
+}
+
+
+/*
+ * space_load - reads the allocation map and geometry of the image
+ *
+ * Notes: for OS-9 the map is the LSN0 bitmap, one bit per cluster.
+ * For Disk BASIC it is the FAT, one byte per granule.
+ */
+static error_code space_load(u_char **map, int *map_bytes, u_int *units, u_int *unit_bytes)
+{
+	error_code ec;
+	char buff[1024];
+
+	if (session.type == OS9)
+	{
+		os9_path_id p;
+		u_int spc;
+
+		sprintf(buff, "%s,@", session.dsk);
+		if ((ec = _os9_open(&p, buff, FAM_READ)) != 0)
+		{
+			return ec;
+		}
+		if ((spc = int2(p->lsn0->dd_bit)) == 0)
+		{
+			spc = 1;
+		}
+		*units = int3(p->lsn0->dd_tot) / spc;
+		*unit_bytes = spc * p->bps;
+		*map_bytes = p->bitmap_bytes;
+		if (*units > (u_int)*map_bytes * 8)
+		{
+			*units = *map_bytes * 8;
+		}
+		if ((*map = malloc(*map_bytes)) != NULL)
+		{
+			memcpy(*map, p->bitmap, *map_bytes);
+		}
+		_os9_close(p);
+	}
+	else if (session.type == DECB)
+	{
+		decb_path_id p;
+
+		sprintf(buff, "%s,", session.dsk);
+		if ((ec = _decb_open(&p, buff, FAM_READ)) != 0)
+		{
+			return ec;
+		}
+		*units = space_decb_granules(p);
+		*unit_bytes = 9 * 256;
+		*map_bytes = sizeof(p->FAT);
+		if ((*map = malloc(*map_bytes)) != NULL)
+		{
+			memcpy(*map, p->FAT, *map_bytes);
+		}
+		_decb_close(p);
+	}
+	else
+	{
+		return EOS_BPNAM;
+	}
+
+	return *map == NULL ? EOS_MF : 0;
+}
+
+
+/*
+ * space_refresh - reads the free space counts from the image
+ *
+ * Notes: called with image_lock held and space.lock taken, on the first
+ * statfs only.  From then on the allocator keeps the counts up to date
+ * through space_note.
+ */
+static error_code space_refresh(void)
+{
+	coco_space *sp = &session.space;
+	error_code ec;
+	u_char *map;
+	int map_bytes;
+	u_int units, unit_bytes;
+
+	if ((ec = space_load(&map, &map_bytes, &units, &unit_bytes)) != 0)
+	{
+		return ec;
+	}
+
+	free(sp->map);
+	sp->map = map;
+	sp->map_bytes = map_bytes;
+	sp->units = units;
+	sp->unit_bytes = unit_bytes;
+	space_scan(map);
+	sp->valid = 1;
+
+	return 0;
+}
+
+
+/*
+ * space_note - keeps the free space counts up to date as a unit is allocated or freed
+ *
+ * Notes: called from librbf and libdecb as they change the allocation
+ * map, with image_lock held exclusively.  A freed unit may join up into
+ * a longer free run; an allocation inside the longest run means that run
+ * has to be found again, which the next statfs does from the session's
+ * copy of the map.
+ */
+static void space_note(u_int unit, int allocated)
+{
+	coco_space *sp = &session.space;
+	u_int start, run;
+
+	if (!sp->valid || unit >= sp->units || space_unit_free(sp->map, unit) == !allocated)
+	{
+		return;
+	}
+
+	space_unit_set(sp->map, unit, allocated);
+	if (allocated)
+	{
+		sp->free_units--;
+		if (unit >= sp->largest_start && unit < sp->largest_start + sp->largest_free)
+		{
+			sp->rescan = 1;
+		}
+	}
+	else
+	{
+		sp->free_units++;
+		if (!sp->rescan && (run = space_run(sp->map, unit, &start)) > sp->largest_free)
+		{
+			sp->largest_free = run;
+			sp->largest_start = start;
+		}
+	}
+}
+
+
+static void space_os9_cluster(int cluster, int allocated)
+{
+	if (session.type == OS9)
+	{
+		space_note(cluster, allocated);
+	}
+}
+
+
+static void space_decb_granule(int granule, int allocated)
+{
+	if (session.type == DECB)
+	{
+		space_note(granule, allocated);
+	}
+}
 
 
 /*
  * coco_statfs - returns status of the file system
+ *
+ * Notes: the counts are read from the image once and then kept by the
+ * allocator, so repeated calls cost nothing.
  */
 static int coco_statfs(const char *path, struct statvfs *stbuf)
 {
-	_path_type type;
-	char buff[1024], dname[32];
-	u_int month, day, year, bps, total_sectors, bytes_free, free_sectors;
-	u_int largest_free_block, sectors_per_cluster, largest_count, sector_count;
-	
-	sprintf(buff, "%s,%s", dsk, path);
-	_coco_identify_image(buff, &type);
-	/* Here we revert to RBF or Disk BASIC to get details about the disk */
-	switch (type)
-	{
-		case OS9:
-			if (TSRBFFree(buff, dname, &month, &day, &year, &bps, &total_sectors, &bytes_free, &free_sectors, &largest_free_block, &sectors_per_cluster, &largest_count, &sector_count) == 0)
-			{
-				stbuf->f_bsize = stbuf->f_frsize = bps;
-				stbuf->f_blocks = total_sectors;
-				stbuf->f_bfree = free_sectors;
-				stbuf->f_bavail = free_sectors;
-				stbuf->f_files = 1000;
-				stbuf->f_ffree = 1000;
-				stbuf->f_favail = 1000;
-				stbuf->f_fsid = 6809;
-				stbuf->f_namemax = 29;
-			}
-			break;
-			
-		case DECB:
-			{
-				/* TODO: Put values here that make sense */
-				stbuf->f_bsize = stbuf->f_frsize = 256;
-				stbuf->f_blocks = 68;
-				stbuf->f_bfree = 68;
-				stbuf->f_bavail = 68;
-				stbuf->f_files = 1000;
-				stbuf->f_ffree = 1000;
-				stbuf->f_favail = 1000;
-				stbuf->f_fsid = 6809;
-				stbuf->f_namemax = 11;
-			}
-			break;
+	coco_space *sp = &session.space;
+	error_code ec = 0;
 
-               default:
-                        break;
+	pthread_rwlock_rdlock(&session.image_lock);
+	pthread_mutex_lock(&sp->lock);
+	if (!sp->valid)
+	{
+		ec = space_refresh();
+	}
+	else if (sp->rescan)
+	{
+		space_scan(sp->map);
 	}
+	if (ec == 0)
+	{
+		stbuf->f_bsize = stbuf->f_frsize = sp->unit_bytes;
+		stbuf->f_blocks = sp->units;
+		stbuf->f_bfree = sp->free_units;
+		stbuf->f_bavail = sp->free_units;
+		stbuf->f_files = 1000;
+		stbuf->f_ffree = 1000;
+		stbuf->f_favail = 1000;
+		stbuf->f_fsid = 6809;
+		stbuf->f_namemax = (session.type == DECB) ? 11 : 29;
+	}
+	pthread_mutex_unlock(&sp->lock);
+	pthread_rwlock_unlock(&session.image_lock);
 	
 #ifdef DEBUG
 # if defined(__APPLE__)
-	NSLog(@"coco_statfs(%s) = %d", path, type);
+	NSLog(@"coco_statfs(%s) = %d free %u largest %u", path, ec, sp->free_units, sp->largest_free);
 # else
-	syslog(LOG_DEBUG,"coco_statfs(%s) = %d", path, type);
+	syslog(LOG_DEBUG,"coco_statfs(%s) = %d free %u largest %u", path, ec, sp->free_units, sp->largest_free);
 # endif
 #endif
-	return 0;
+	return -CoCoToUnixError(ec);
 }
 
 #if 0
@@ -106,7 +835,7 @@ static int coco_statfs(const char *path, struct statvfs *stbuf)
 static int coco_fgetattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi)
 {
 	error_code ec = 0;
-	coco_path_id p = (coco_path_id)(int32_t)fi->fh;
+	coco_path_id p = handle_get(fi)->path;
 	
         memset(stbuf, 0, sizeof(struct stat));
 
@@ -165,10 +894,27 @@ static int coco_getattr(const char *path, struct stat *stbuf)
 {
 	error_code ec = 0;
 	coco_file_stat fdbuf;
+	coco_cache_entry *ce;
 	char buff[1024];
 	
+	pthread_rwlock_rdlock(&session.image_lock);
+
+	pthread_mutex_lock(&session.table_lock);
+	ce = cache_lookup(path);
+	if (ce != NULL && ce->stat_valid)
+	{
+		memcpy(stbuf, &ce->stat, sizeof(struct stat));
+		ec = ce->stat_ec;
+		cache_release(ce);
+		pthread_mutex_unlock(&session.table_lock);
+		pthread_rwlock_unlock(&session.image_lock);
+
+		return ec;
+	}
+	pthread_mutex_unlock(&session.table_lock);
+
     memset(stbuf, 0, sizeof(struct stat));
-	sprintf(buff, "%s,%s", dsk, path);
+	sprintf(buff, "%s,%s", session.dsk, path);
 	if ((ec = -CoCoToUnixError(_coco_gs_fd_pathlist(buff, &fdbuf))) == 0)
 	{
 		u_int filesize;
@@ -193,6 +939,18 @@ static int coco_getattr(const char *path, struct stat *stbuf)
 		stbuf->st_gid = getgid();
     }
 
+	if (ce != NULL)
+	{
+		pthread_mutex_lock(&session.table_lock);
+		memcpy(&ce->stat, stbuf, sizeof(struct stat));
+		ce->stat_ec = ec;
+		ce->stat_valid = 1;
+		cache_release(ce);
+		pthread_mutex_unlock(&session.table_lock);
+	}
+
+	pthread_rwlock_unlock(&session.image_lock);
+
 #ifdef DEBUG
 # if defined(__APPLE__)
 	NSLog(@"coco_getattr(%s) = %d", path, ec);
@@ -213,8 +971,11 @@ static int coco_mkdir(const char *path, mode_t mode)
 	error_code ec;
 	char buff[1024];
 
-	sprintf(buff, "%s,%s", dsk, path);
+	pthread_rwlock_wrlock(&session.image_lock);
+	sprintf(buff, "%s,%s", session.dsk, path);
 	ec = -CoCoToUnixError(_coco_makdir(buff));
+	cache_flush();
+	pthread_rwlock_unlock(&session.image_lock);
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -236,8 +997,11 @@ static int coco_unlink(const char *path)
 	error_code ec;
 	char buff[1024];
 
-	sprintf(buff, "%s,%s", dsk, path);
+	pthread_rwlock_wrlock(&session.image_lock);
+	sprintf(buff, "%s,%s", session.dsk, path);
 	ec = -CoCoToUnixError(_coco_delete(buff));
+	cache_flush();
+	pthread_rwlock_unlock(&session.image_lock);
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -259,7 +1023,7 @@ static int coco_rmdir(const char *path)
 	error_code ec = 0;
 	char buff[1024];
 
-	sprintf(buff, "%s,%s", dsk, path);
+	sprintf(buff, "%s,%s", session.dsk, path);
 //	ec = -CoCoToUnixError(_coco_deldir(buff)); //, CoCoToUnixPerm(mode));
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -309,7 +1073,7 @@ static int coco_rename(const char *path, const char *newname)
 	
 	*p1 = '/'; *p2 = '/';
 	
-	sprintf(buff1, "%s,%s", dsk, path);
+	sprintf(buff1, "%s,%s", session.dsk, path);
 	ec = -CoCoToUnixError(_coco_rename(buff1, p2 + 1));
 #endif
 #ifdef DEBUG
@@ -333,12 +1097,15 @@ static int coco_chmod(const char *path, mode_t mode)
 	char buff[1024];
 	coco_path_id p;
 
-	sprintf(buff, "%s,%s", dsk, path);
+	pthread_rwlock_wrlock(&session.image_lock);
+	sprintf(buff, "%s,%s", session.dsk, path);
 	if ((ec = -CoCoToUnixError(_coco_open(&p, buff, FAM_WRITE))) == 0)
 	{
 		ec = -CoCoToUnixError(_coco_ss_attr(p, UnixToCoCoPerms(mode)));
 		_coco_close(p);
 	}
+	cache_forget(path);
+	pthread_rwlock_unlock(&session.image_lock);
 	
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -361,13 +1128,16 @@ static int coco_truncate(const char *path, off_t size)
 	char buff[1024];
 	coco_path_id p;
 
-	sprintf(buff, "%s,%s", dsk, path);
+	pthread_rwlock_wrlock(&session.image_lock);
+	sprintf(buff, "%s,%s", session.dsk, path);
 	ec = -CoCoToUnixError(_coco_open(&p, buff, FAM_WRITE));
 	if (ec == 0)
 	{
 		ec = -CoCoToUnixError(_coco_ss_size(p, size));
 		_coco_close(p);
 	}
+	cache_forget(path);
+	pthread_rwlock_unlock(&session.image_lock);
 	
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -388,16 +1158,25 @@ static int coco_open(const char *path, struct fuse_file_info *fi)
 	char buff[1024];
 	int mflags = FAM_READ;
 
-	sprintf(buff, "%s,%s", dsk, path);
+	sprintf(buff, "%s,%s", session.dsk, path);
 
 	if ((fi->flags & O_ACCMODE) != O_RDONLY)
 	{
 		mflags |= FAM_WRITE;
 	}
+	pthread_rwlock_rdlock(&session.image_lock);
 	if ((ec =  -CoCoToUnixError(_coco_open(&p, buff, mflags))) == 0)
 	{
-		fi->fh = (uint32_t)p;
+		if ((fi->fh = handle_add(p, mflags)) == 0)
+		{
+			_coco_close(p);
+			ec = -ENOMEM;
+		}
 	}
+	pthread_rwlock_unlock(&session.image_lock);
+
+	/* Nothing can change a read-only image behind the kernel's back */
+	fi->keep_cache = session.read_only;
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -411,16 +1190,41 @@ static int coco_open(const char *path, struct fuse_file_info *fi)
 }
 
 
+/*
+ * coco_read - reads from an open path
+ *
+ * Notes: returns the number of bytes actually read, which is short
+ * (or zero) at end of file.
+ */
 static int coco_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
 {
-	error_code ec;
-	uint32_t _size = size;
+	error_code ec = 0;
+	uint32_t _size;
+	size_t done = 0;
+
+	coco_handle *h;
 
-	coco_path_id p = (coco_path_id)(uint32_t)fi->fh;
-	_coco_seek(p, offset, SEEK_SET);
-	if ((ec = -CoCoToUnixError(_coco_read(p, buf, &_size))) != 0)
+	if ((h = handle_get(fi)) == NULL)
 	{
-		return ec;
+		return -EBADF;
+	}
+	pthread_rwlock_rdlock(&session.image_lock);
+	pthread_mutex_lock(&h->lock);
+	_coco_seek(h->path, offset, SEEK_SET);
+	while (done < size)
+	{
+		_size = size - done;
+		if ((ec = _coco_read(h->path, buf + done, &_size)) != 0 || _size == 0)
+		{
+			break;
+		}
+		done += _size;
+	}
+	pthread_mutex_unlock(&h->lock);
+	pthread_rwlock_unlock(&session.image_lock);
+	if (ec != 0 && ec != EOS_EOF && done == 0)
+	{
+		return -CoCoToUnixError(ec);
 	}
 
 #ifdef DEBUG
@@ -431,7 +1235,7 @@ static int coco_read(const char *path, char *buf, size_t size, off_t offset, str
 # endif
 #endif
 
-	return size;
+	return done;
 }
 
 
@@ -440,9 +1244,18 @@ static int coco_write(const char *path, const char *buf, size_t size, off_t offs
 	error_code ec;
 	uint32_t _size = size;
 
-	coco_path_id p = (coco_path_id)(uint32_t)fi->fh;
-	_coco_seek(p, offset, SEEK_SET);
-	if ((ec = -CoCoToUnixError(_coco_write(p, (char *)buf, &_size))) != 0)
+	coco_handle *h;
+
+	if ((h = handle_get(fi)) == NULL)
+	{
+		return -EBADF;
+	}
+	pthread_rwlock_wrlock(&session.image_lock);
+	_coco_seek(h->path, offset, SEEK_SET);
+	ec = -CoCoToUnixError(_coco_write(h->path, (char *)buf, &_size));
+	cache_forget(path);
+	pthread_rwlock_unlock(&session.image_lock);
+	if (ec != 0)
 	{
 		return ec;
 	}
@@ -455,7 +1268,7 @@ static int coco_write(const char *path, const char *buf, size_t size, off_t offs
 # endif
 #endif
 
-	return size;
+	return _size;
 }
 
 
@@ -467,9 +1280,23 @@ static int coco_write(const char *path, const char *buf, size_t size, off_t offs
  */
 static int coco_release(const char *path, struct fuse_file_info *fi)
 {
-	error_code ec;
+	error_code ec = 0;
+	coco_handle *h;
 	
-	ec = -CoCoToUnixError(_coco_close((coco_path_id)(int32_t)fi->fh));
+	if ((h = handle_remove(fi)) != NULL)
+	{
+		/* Closing a path opened for writing may flush to the image */
+		if (h->mode & FAM_WRITE)
+		{
+			pthread_rwlock_wrlock(&session.image_lock);
+		}
+		else
+		{
+			pthread_rwlock_rdlock(&session.image_lock);
+		}
+		ec = -CoCoToUnixError(handle_close(h));
+		pthread_rwlock_unlock(&session.image_lock);
+	}
 	
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -493,19 +1320,27 @@ static int coco_create(const char *path, mode_t perms, struct fuse_file_info * f
 	int mflags = FAM_READ | FAM_WRITE;
 	fstat.perms = FAP_READ | FAP_WRITE;
 	
-	sprintf(buff, "%s,%s", dsk, path);
+	sprintf(buff, "%s,%s", session.dsk, path);
 
 	if ((fi->flags & O_ACCMODE) != O_RDONLY)
 	{
 		fstat.perms |= FAM_WRITE;
 	}
 
+	pthread_rwlock_wrlock(&session.image_lock);
+	cache_flush();
 	if ((ec = -CoCoToUnixError(_coco_create(&p, buff, mflags, &fstat))) != 0)
 	{
+		pthread_rwlock_unlock(&session.image_lock);
 		return ec;
 	}
 
-	fi->fh = (uint32_t)p;
+	if ((fi->fh = handle_add(p, mflags)) == 0)
+	{
+		_coco_close(p);
+		ec = -ENOMEM;
+	}
+	pthread_rwlock_unlock(&session.image_lock);
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -519,25 +1354,26 @@ static int coco_create(const char *path, mode_t perms, struct fuse_file_info * f
 }
 
 
+/*
+ * coco_opendir - loads the directory listing into the cache
+ *
+ * Notes: no path is held open; coco_readdir serves the cached names.
+ */
 static int coco_opendir(const char *path, struct fuse_file_info *fi)
 {
-	error_code ec;
-	coco_path_id p;
-	char buff[1024];
-	int mflags = FAM_READ;
-
-	sprintf(buff, "%s,%s", dsk, path);
-
-	mflags |= FAM_DIR;
+	error_code ec = 0;
+	coco_cache_entry *ce;
 
-	if ((fi->flags & O_ACCMODE) != O_RDONLY)
-	{
-		mflags |= FAM_WRITE;
-	}
-	if ((ec =  -CoCoToUnixError(_coco_open(&p, buff, mflags))) == 0)
+	pthread_rwlock_rdlock(&session.image_lock);
+	if ((ec = cache_dir(path, &ce)) == 0)
 	{
-		fi->fh = (uint32_t)p;
+		pthread_mutex_lock(&session.table_lock);
+		cache_release(ce);
+		pthread_mutex_unlock(&session.table_lock);
 	}
+	pthread_rwlock_unlock(&session.image_lock);
+
+	fi->fh = 0;
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -554,54 +1390,21 @@ static int coco_opendir(const char *path, struct fuse_file_info *fi)
 static int coco_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
 {
 	error_code ec = 0;
-	coco_path_id p;
-	coco_dir_entry e;
-	char buff[1024];
+	coco_cache_entry *ce;
+	int i;
 
-#if !0
-	sprintf(buff, "%s,%s", dsk, path);
-	if (_coco_open(&p, buff, FAM_READ | FAM_DIR) != 0)
+	pthread_rwlock_rdlock(&session.image_lock);
+	if ((ec = cache_dir(path, &ce)) == 0)
 	{
-		/* DECB doesn't use FAM_DIR */
-		if (_coco_open(&p, buff, FAM_READ) != 0)
+		for (i = 0; i < ce->dir_count; i++)
 		{
-			return -ENOENT;
+			filler(buf, ce->dir_names[i], NULL, 0);
 		}
+		pthread_mutex_lock(&session.table_lock);
+		cache_release(ce);
+		pthread_mutex_unlock(&session.table_lock);
 	}
-#else
-	p = (coco_path_id)fi->fh;
-#endif
-
-	while (_coco_readdir(p, &e) == 0)
-	{
-		switch (e.type)
-		{
-			case OS9:
-				if (e.dentry.os9.name[0] != '\0')
-				{
-					/* entry is not empty, add it */
-					filler(buf, (char *)OS9StringToCString(e.dentry.os9.name), NULL, 0);
-				}
-				break;
-
-			case DECB:
-				if (e.dentry.decb.filename[0] != 0 && e.dentry.decb.filename[0] != 255 )
-				{
-					u_char cstring[24];
-
-					DECBStringToCString(e.dentry.decb.filename, e.dentry.decb.file_extension, cstring);
-					filler(buf, (char *)cstring, NULL, 0);
-				}
-				break;
-
-			default:
-				break;
-		}
-	}	
-
-#if !0
-	_coco_close(p);
-#endif
+	pthread_rwlock_unlock(&session.image_lock);
 
 #ifdef DEBUG
 # if defined(__APPLE__)
@@ -615,6 +1418,60 @@ static int coco_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 }
 
 
+static int coco_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	return 0;
+}
+
+
+/*
+ * coco_init - negotiates large reads and writes with the kernel, and hooks the allocators
+ */
+static void *coco_init(struct fuse_conn_info *conn)
+{
+#ifdef FUSE_CAP_BIG_WRITES
+	if (conn->capable & FUSE_CAP_BIG_WRITES)
+	{
+		conn->want |= FUSE_CAP_BIG_WRITES;
+	}
+#endif
+	conn->max_write = MAX_IO_SIZE;
+	conn->max_readahead = MAX_IO_SIZE;
+
+	/* Let the allocators keep the free space counts */
+	_os9_set_bitmap_hook(space_os9_cluster);
+	_decb_set_fat_hook(space_decb_granule);
+
+	return NULL;
+}
+
+
+/*
+ * coco_destroy - closes any handles left open and frees the cache at unmount
+ */
+static void coco_destroy(void *private_data)
+{
+	uint64_t i;
+
+	pthread_rwlock_wrlock(&session.image_lock);
+	for (i = 0; i < session.handle_count; i++)
+	{
+		if (session.handles[i] != NULL)
+		{
+			handle_close(session.handles[i]);
+		}
+	}
+	free(session.handles);
+	session.handles = NULL;
+	session.handle_count = 0;
+	cache_flush();
+	free(session.space.map);
+	session.space.map = NULL;
+	session.space.valid = 0;
+	pthread_rwlock_unlock(&session.image_lock);
+}
+
+
 static int coco_utimens(const char *path, const struct timespec *tv)
 {
 	return 0;
@@ -638,7 +1495,9 @@ static struct fuse_operations coco_filesystem_operations =
 	.release = coco_release,
 	.create = coco_create,
 	.opendir = coco_opendir,
-	.releasedir = coco_release,
+	.releasedir = coco_releasedir,
+	.init = coco_init,
+	.destroy = coco_destroy,
  	.utimens = coco_utimens
 };
 
@@ -646,26 +1505,72 @@ void usage(char* name)
 {
 	printf("cocofuse from Toolshed " TOOLSHED_VERSION "\n");
 	printf("Usage: %s: dskimage mountpoint [FUSE options]\n", name);
+	printf("       -o ro lets the kernel keep file pages cached between opens\n");
 	exit(1);
 }
 
 
+/*
+ * has_ro_option - returns non-zero if "ro" is among the -o mount options
+ */
+static int has_ro_option(int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		char *opts = NULL, *o, *last;
+		int found = 0;
+
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			opts = strdup(argv[++i]);
+		}
+		else if (strncmp(argv[i], "-o", 2) == 0)
+		{
+			opts = strdup(argv[i] + 2);
+		}
+
+		if (opts == NULL)
+		{
+			continue;
+		}
+
+		for (o = strtok_r(opts, ",", &last); o != NULL; o = strtok_r(NULL, ",", &last))
+		{
+			if (strcmp(o, "ro") == 0)
+			{
+				found = 1;
+			}
+		}
+		free(opts);
+
+		if (found)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
 int make_absolute( const char *path )
 {
         if(path[0] == '/') 
         {
                 /* absolute path - use as-is */
-                strcpy(dsk, path);
+                strcpy(session.dsk, path);
         }
         else 
         {
                 /* relative path */
-                if (getcwd(dsk, 1024)==NULL) return -1;
+                if (getcwd(session.dsk, 1024)==NULL) return -1;
                 /* Allow one for terminating null and 1 for separator
                    slash */
-                if((1024 - strlen(dsk)) < (strlen(path)+2)) return -1;
-                strcat(dsk, "/");
-                strcat(dsk, path);
+                if((1024 - strlen(session.dsk)) < (strlen(path)+2)) return -1;
+                strcat(session.dsk, "/");
+                strcat(session.dsk, path);
         }
         return 0;
 }
@@ -676,6 +1581,7 @@ int main(int argc, char **argv)
 		usage(argv[0]);
 
         int rc;
+        char buff[1040];
         if(make_absolute(argv[1])<0)
         {
                 fprintf(stderr, "Disk image path too long\n");
@@ -683,11 +1589,33 @@ int main(int argc, char **argv)
         }
         else 
         {
+                sprintf(buff, "%s,", session.dsk);
+                if(_coco_identify_image(buff, &session.type) != 0)
+                {
+                        fprintf(stderr, "Cannot identify disk image %s\n", session.dsk);
+                        return 1;
+                }
 #ifdef DEBUG
                 openlog("cocofuse", LOG_PID, LOG_DAEMON);
 #endif        
                 argv[1] = argv[0];
-                rc = fuse_main(argc - 1, &argv[1], &coco_filesystem_operations, NULL);
+                struct fuse_args args = FUSE_ARGS_INIT(argc - 1, &argv[1]);
+
+                session.read_only = has_ro_option(args.argc, args.argv);
+                if(!session.read_only && access(session.dsk, W_OK) != 0)
+                {
+                        /* Image is not writable; mount it read-only */
+                        fuse_opt_add_arg(&args, "-oro");
+                        session.read_only = 1;
+                }
+#ifdef __linux__
+                char ioopts[64];
+
+                snprintf(ioopts, sizeof(ioopts), "-obig_writes,max_read=%d,max_write=%d", MAX_IO_SIZE, MAX_IO_SIZE);
+                fuse_opt_add_arg(&args, ioopts);
+#endif
+                rc = fuse_main(args.argc, args.argv, &coco_filesystem_operations, NULL);
+                fuse_opt_free_args(&args);
 #ifdef DEBUG
                 closelog();
 #endif
@@ -81,6 +81,32 @@ typedef enum { AUTO=0, ODD, EVEN } _wave_parity;
 
 #define WAV_SAMPLE_MUL (path->wav_bits_per_sample == 8 ? 1 : 2)
 
+#define CECB_WAV_MACOUNT	5
+#define CECB_WAV_MASIZE		20
+
+/* Moving averages used while analyzing the leader */
+typedef struct
+{
+	double	sum[CECB_WAV_MACOUNT];
+	double	history[CECB_WAV_MACOUNT][CECB_WAV_MASIZE];
+	int		index[CECB_WAV_MACOUNT];
+	int		full[CECB_WAV_MACOUNT];
+} cecb_wav_movingavg;
+
+/* WAV decoder statistics */
+typedef struct
+{
+	long	bits;					/* Bits decoded */
+	long	weak_bits;				/* Bits decoded with low confidence */
+	long	blocks;					/* Blocks decoded */
+	long	crc_failures;			/* Blocks with a bad checksum */
+	long	block_start_sample;		/* Sample where the current block starts */
+	long	block_bits;				/* Bits decoded in current block */
+	long	block_weak_bits;		/* Low confidence bits in current block */
+	double	block_confidence_sum;	/* Sum of bit confidences in current block */
+	double	block_confidence_min;	/* Lowest bit confidence in current block */
+} cecb_wav_stats;
+
 typedef struct _cecb_path_id
 {
 	int				mode;					/* access mode */
@@ -114,6 +140,11 @@ typedef struct _cecb_path_id
 	long			wav_current_sample;		/* Current sample position in WAV file */
 	_wave_parity	wav_parity;				/* Even or Odd wav type */
 	signed int		wav_ss1, wav_ss2;		/* Wave Phase timing */
+	int				wav_adaptive;			/* Track bit periods while decoding */
+	double			wav_period_short;		/* Tracked period of a one bit, in samples */
+	double			wav_period_long;		/* Tracked period of a zero bit, in samples */
+	cecb_wav_movingavg	wav_ma;				/* Leader analysis state */
+	cecb_wav_stats	wav_stats;				/* Decoder confidence statistics */
 	unsigned char	*buffer_1200,			/* WAV data used for writing */
 					*buffer_2400;
 	int             buffer_1200_length,
@@ -139,6 +170,9 @@ error_code _cecb_read_next_block( cecb_path_id path, unsigned char *block_type,
 error_code _cecb_read_bits( cecb_path_id path, int count, unsigned char *result );
 error_code _cecb_read_bits_wav( cecb_path_id path, int count, unsigned char *result );
 error_code _cecb_read_bits_cas( cecb_path_id path, int count, unsigned char *result );
+void _cecb_wav_block_begin( cecb_path_id path );
+void _cecb_wav_block_end( cecb_path_id path, unsigned char block_type, unsigned char block_length, error_code ec );
+void _cecb_wav_report( cecb_path_id path );
 error_code _cecb_write_cas_data( cecb_path_id path, char *buffer, int total_length);
 int _cecb_write_wav_audio(cecb_path_id path, char *buffer, int total_length);
 int _cecb_write_wav_audio_repeat_byte(cecb_path_id path, int length, char byte);
@@ -156,6 +190,8 @@ extern double cecb_threshold;
 extern double cecb_frequency;
 extern _wave_parity cecb_wave_parity;
 extern long cecb_start_sample;
+extern int cecb_adaptive;
+extern int cecb_verbose;
 
 #include <cocopath.h>
 
@@ -22,6 +22,9 @@ extern "C" {
 #ifdef  WIN32
 typedef unsigned char u_char;
 typedef unsigned int u_int;
+#if !defined(__MINGW64_VERSION_MAJOR)
+#define strtok_r strtok_s
+#endif
 #else
 #if !defined(__u_char_defined) && !defined(__APPLE__) && !defined(sun)
 typedef unsigned char u_char;
@@ -96,6 +96,9 @@ typedef struct
 	int		file_size;		/* file size */
 } decb_file_stat, *Decb_file_stat;
 
+/* called with a granule number and 1 when it is allocated, 0 when it is freed */
+typedef void (*decb_fat_hook)(int granule, int allocated);
+
 /* Disk BASIC Prototypes */
 
 error_code _decb_open(decb_path_id *, char *, int);
@@ -105,6 +108,8 @@ error_code _decb_read(decb_path_id path, void *buffer, u_int *size);
 error_code _decb_readln(decb_path_id path, void *buffer, u_int *size);
 error_code _decb_write(decb_path_id path, void *buffer, u_int *size);
 error_code _decb_kill(char *filename);
+void _decb_set_fat_hook(decb_fat_hook hook);
+void _decb_fat_set(decb_path_id path, int granule, u_char value);
 error_code _decb_seek(decb_path_id, int, int);
 error_code _decb_readdir(decb_path_id path, decb_dir_entry *de);
 error_code _decb_ncpy_name(decb_dir_entry e, u_char *name, size_t len);
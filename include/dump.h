@@ -0,0 +1,52 @@
+/********************************************************************
+ * dump.h - Formatted dump functions header file
+ *
+ * $Id$
+ ********************************************************************/
+
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <cocotypes.h>
+
+/* Dump layouts */
+#define DUMP_HEX		0	/* address, hex words and characters */
+#define DUMP_FCB		1	/* assembler fcb lines in hex */
+#define DUMP_BINARY		2	/* assembler fcb lines in binary */
+
+#define DUMP_BUFSIZ		65536
+
+typedef struct
+{
+	FILE	*out;
+	int		format;
+	int		displayASCII;
+	int		displayHeader;
+	int		displayLabel;
+	u_int	chunk;				/* bytes per line */
+	u_int	byte_count;			/* bytes dumped so far */
+	u_char	line[16];			/* bytes held back until a line is full */
+	u_int	line_count;
+	char	hex[256][2];		/* lookup tables filled by dump_init() */
+	char	HEX[256][2];
+	char	bin[256][8];
+	char	ascii[256];
+	size_t	used;
+	char	buffer[DUMP_BUFSIZ];
+} dump_context;
+
+
+void dump_init(dump_context *d, FILE *out, int format);
+void dump_bytes(dump_context *d, u_char *data, size_t num_bytes);
+void dump_finish(dump_context *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _DUMP_H */
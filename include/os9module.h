@@ -188,6 +188,9 @@ typedef enum os9_attr_t
 
 #define INT(foo) (foo[0] * 256 + foo[1])
 
+u_int _os9_crc_init(void);
+u_int _os9_crc_update(u_int crc, u_char *ptr, u_int sz);
+u_int _os9_crc_final(u_int crc);
 error_code _os9_crc_compute(u_char *ptr, u_int sz, u_char *crc);
 error_code _os9_crc(OS9_MODULE_t *mod);
 u_char  _os9_header(OS9_MODULE_t *mod);
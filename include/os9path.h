@@ -114,6 +114,10 @@ typedef struct _os9_path_id
 #define	DT_os9	1
 
 
+/* called with a cluster number and 1 when it is allocated, 0 when it is freed */
+typedef void (*os9_bitmap_hook)(int cluster, int allocated);
+
+
 /* prototypes */
 
 error_code _os9_open(os9_path_id *, char *, int);
@@ -125,6 +129,7 @@ error_code _os9_ncpy_name( os9_dir_entry e, u_char *name, size_t len );
 error_code _os9_seek(os9_path_id, int, int);
 error_code _os9_allbit(u_char *bitmap, int firstbit, int numbits);
 error_code _os9_delbit(u_char *bitmap, int firstbit, int numbits);
+void _os9_set_bitmap_hook(os9_bitmap_hook hook);
 int _os9_ckbit( u_char *bitmap, int LSN );
 int _os9_getfreebit( u_char *bitmap, int bitmap_bytes );
 int _os9_maximum_file_size( fd_stats fd_sector, int cluster_size );
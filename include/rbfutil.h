@@ -25,6 +25,7 @@ extern "C" {
 /* Function prototypes for supported os9 commands are here */
 
 int os9attr(int, char **);
+int os9build(int, char **);
 int os9cmp(int, char **);
 int os9copy(int, char **);
 int os9dcheck(int, char **);
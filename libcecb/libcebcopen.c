@@ -10,6 +10,8 @@ double cecb_threshold = 0.1;
 double cecb_frequency = 0;
 _wave_parity cecb_wave_parity = AUTO;
 long cecb_start_sample = 0;
+int cecb_adaptive = 1;
+int cecb_verbose = 0;
 
 static error_code parse_header( cecb_path_id path  );
 static error_code validate_pathlist(cecb_path_id path, char *pathlist);
@@ -76,6 +78,7 @@ error_code _cecb_create(cecb_path_id *path, char *pathlist, int mode, int file_t
 	(*path)->wav_threshold = cecb_threshold;
 	(*path)->wav_frequency_limit = cecb_frequency;
 	(*path)->wav_parity = cecb_wave_parity;
+	(*path)->wav_adaptive = cecb_adaptive;
 	
 	ec = parse_header( *path );
 
@@ -292,6 +295,7 @@ error_code _cecb_open(cecb_path_id *path, char *pathlist, int mode )
 	(*path)->wav_threshold = cecb_threshold;
 	(*path)->wav_frequency_limit = cecb_frequency;
 	(*path)->wav_parity = cecb_wave_parity;
+	(*path)->wav_adaptive = cecb_adaptive;
 	
 	ec = parse_header( *path );
 
@@ -387,6 +391,12 @@ error_code _cecb_close(cecb_path_id path)
 	}
 
 	
+	/* Report decoder statistics. */
+
+	if( (path->tape_type == WAV) && (cecb_verbose != 0) )
+		_cecb_wav_report( path );
+
+
 	/* Close path. */
 
 	fclose(path->fd);
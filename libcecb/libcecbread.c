@@ -145,13 +145,16 @@ error_code _cecb_ncpy_name( cecb_dir_entry e, u_char *name, size_t len )
 error_code _cecb_read_next_block( cecb_path_id path, unsigned char *block_type, unsigned char *block_length, unsigned char *data  )
 {
 	error_code ec = 0;
-	unsigned char find_block;
+	unsigned short find_block;
 	unsigned char checksum, checksum_ck;
 	int i;
 	
 	find_block = 0;
 
-	while( find_block != 0x3c )
+	/* Noise in front of a WAV leader can look like a sync byte, so
+	   there the sync byte must follow a leader byte. */
+
+	while( ((find_block >> 8) != 0x3c) || ((path->tape_type == WAV) && ((find_block & 0xff) != 0x55)) )
 	{
 		unsigned char newbit;
 		
@@ -162,11 +165,14 @@ error_code _cecb_read_next_block( cecb_path_id path, unsigned char *block_type,
 		if( ec != 0 )
 			return ec;
 		
-		find_block |= (unsigned short)newbit;
+		find_block |= (unsigned short)newbit << 8;
 		
 		//printf( "find_block: %4.4x, sample: %d\n", find_block, path->wav_current_sample );
 	}
 	
+	if( path->tape_type == WAV )
+		_cecb_wav_block_begin( path );
+	
 	ec = _cecb_read_bits( path, 8, block_type );
 	ec = _cecb_read_bits( path, 8, block_length );
 	
@@ -186,6 +192,9 @@ error_code _cecb_read_next_block( cecb_path_id path, unsigned char *block_type,
 	if( checksum != checksum_ck )
 		ec = EOS_CRC;
 		
+	if( path->tape_type == WAV )
+		_cecb_wav_block_end( path, *block_type, *block_length, ec );
+
 	return ec;
 }
 
@@ -9,8 +9,14 @@
 
 #define PI 3.1415926
 
+#define WEAK_CONFIDENCE	0.25	/* Bits below this confidence are counted as weak */
+#define TRACK_GAIN		0.125	/* How quickly tracked periods follow the tape */
+#define TRACK_MIN_RATIO	1.25	/* Smallest allowed long to short period ratio */
+#define TRACK_MAX_SPAN	2.0		/* Cycles further out than this are not tracked */
+
 static error_code analyze_wav_leader( cecb_path_id path );
-static double movingavg(int which, double newvalue);
+static double movingavg(cecb_path_id path, int which, double newvalue);
+static void classify_period( cecb_path_id path, int diff, unsigned char *bit );
 static int numbers_close_double( double a, double b, double p );
 static int numbers_close_signed( int a, int b, double p );
 static error_code advance_to_next_zero_crossing( cecb_path_id path, int *diff );
@@ -31,7 +37,7 @@ static void build_sinusoidal_bufer_16(_wave_parity parity, short *buffer, int le
 error_code _cecb_read_bits_wav( cecb_path_id path, int count, unsigned char *result )
 {
 	error_code ec = 0;
-	double freq;
+	unsigned char bit;
 	int diff;
 	
 	*result = 0;
@@ -56,15 +62,11 @@ error_code _cecb_read_bits_wav( cecb_path_id path, int count, unsigned char *res
 			return EOS_EOF;
 		}
 		
-		freq = ((float)path->wav_sample_rate/(float)diff);
-		
-		if( freq < path->wav_frequency_limit ) /* 1200 Hz range */
-			(*result) >>= 1;
-		else /* 2400 HZ range */
-		{
-			(*result) >>= 1;
+		classify_period( path, diff, &bit );
+
+		(*result) >>= 1;
+		if( bit != 0 )
 			(*result) |= 0x80;
-		}
 
 		count--;
 	}
@@ -207,7 +209,7 @@ static error_code analyze_wav_leader( cecb_path_id path )
 	int diff1, diff2, diff3, diff4, diff5;
 	double ma1, ma2, ma3, ma4, mah, mal, ratio;
 
-	ratio = movingavg( 4, 1.0 ); /* Seed ratio with out of range number */
+	ratio = movingavg( path, 4, 1.0 ); /* Seed ratio with out of range number */
 
 	if( path->wav_frequency_limit == 0 )
 	{
@@ -229,15 +231,15 @@ static error_code analyze_wav_leader( cecb_path_id path )
 				break;
 			}
 			
-			ma1 = movingavg( 0, (double)path->wav_sample_rate/(diff1+diff2) );
-			ma2 = movingavg( 1, (double)path->wav_sample_rate/(diff2+diff3) );
-			ma3 = movingavg( 2, (double)path->wav_sample_rate/(diff3+diff4) );
-			ma4 = movingavg( 3, (double)path->wav_sample_rate/(diff4+diff5) );
+			ma1 = movingavg( path, 0, (double)path->wav_sample_rate/(diff1+diff2) );
+			ma2 = movingavg( path, 1, (double)path->wav_sample_rate/(diff2+diff3) );
+			ma3 = movingavg( path, 2, (double)path->wav_sample_rate/(diff3+diff4) );
+			ma4 = movingavg( path, 3, (double)path->wav_sample_rate/(diff4+diff5) );
 
 			mal = fmin( fmin( fmin( ma1, ma2 ), ma3 ), ma4 );
 			mah = fmax( fmax( fmax( ma1, ma2 ), ma3 ), ma4 );
 
-			ratio = movingavg( 4, mal / mah );
+			ratio = movingavg( path, 4, mal / mah );
 			
 			if( numbers_close_double( ratio, 0.5, 0.1 ) == 1 )
 			{
@@ -254,6 +256,10 @@ static error_code analyze_wav_leader( cecb_path_id path )
 			fprintf( stderr, "Error: If you set frequency limit, you need to set parity.\n" );
 			return EOS_IA;
 		}
+
+		/* Derive tone frequencies from the limit, assuming a 1:2 ratio */
+		mal = path->wav_frequency_limit / 1.5;
+		mah = mal * 2.0;
 	}
 	
 //	printf( "path->wav_frequency_limit = %f, path->wav_threshold = %f\n", path->wav_frequency_limit, path->wav_threshold );
@@ -300,6 +306,11 @@ static error_code analyze_wav_leader( cecb_path_id path )
 		}
 	}
 	
+	/* Seed the tracked bit periods */
+
+	path->wav_period_long = path->wav_sample_rate / mal;
+	path->wav_period_short = path->wav_sample_rate / mah;
+
 	/* Create sinusoidal write buffers */
 
 	path->buffer_1200_length = (path->wav_sample_rate / mal) * WAV_SAMPLE_MUL;
@@ -327,40 +338,174 @@ static error_code analyze_wav_leader( cecb_path_id path )
 	return ec;
 }
 
-#define MACOUNT 5
-#define MASIZE 20
-
-static double movingavg(int which, double newvalue)
+static double movingavg(cecb_path_id path, int which, double newvalue)
 {
-	static double sum[MACOUNT] = {0.0, 0.0, 0.0, 0.0, 0.0};
-	static int index[MACOUNT] = {0, 0, 0, 0, 0};
-	static double history[MACOUNT][MASIZE] = {{ 0.0, 0.0, 0.0, 0.0, 0.0 },
-												{ 0.0, 0.0, 0.0, 0.0, 0.0 },
-												{ 0.0, 0.0, 0.0, 0.0, 0.0 },
-												{ 0.0, 0.0, 0.0, 0.0, 0.0 },
-												{ 0.0, 0.0, 0.0, 0.0, 0.0 } };
-	static int full[MACOUNT] = {0, 0, 0, 0, 0};
-
-	if( which < MACOUNT )
+	cecb_wav_movingavg *ma = &(path->wav_ma);
+
+	if( which < CECB_WAV_MACOUNT )
 	{
-		sum[which] -= history[which][index[which]];
-		sum[which] += (history[which][index[which]++] = newvalue);
-		if (index[which] >= MASIZE)
+		ma->sum[which] -= ma->history[which][ma->index[which]];
+		ma->sum[which] += (ma->history[which][ma->index[which]++] = newvalue);
+		if (ma->index[which] >= CECB_WAV_MASIZE)
 		{
-			index[which] -= MASIZE;
-			full[which] = 1;
+			ma->index[which] -= CECB_WAV_MASIZE;
+			ma->full[which] = 1;
 		}
 
-		if (full[which])
-			return sum[which] / MASIZE;
+		if (ma->full[which])
+			return ma->sum[which] / CECB_WAV_MASIZE;
 		else
-			return sum[which] / index[which];
+			return ma->sum[which] / ma->index[which];
 	}
 	
-	fprintf( stderr, "Error: Moving average call with 'which' >= than %d\n", MACOUNT );
+	fprintf( stderr, "Error: Moving average call with 'which' >= than %d\n", CECB_WAV_MACOUNT );
 	exit( -1 );
 }
 
+/*
+ * classify_period()
+ *
+ * Decide if a cycle of 'diff' samples is a zero or a one bit.
+ *
+ * In adaptive mode the periods of both tones are tracked while
+ * decoding and the frequency limit follows them, so tapes with
+ * speed drift or wow decode in one pass. The bit confidence is
+ * how far the cycle is from the limit, relative to the distance
+ * between the limit and the tracked period of the decoded tone.
+ */
+
+static void classify_period( cecb_path_id path, int diff, unsigned char *bit )
+{
+	cecb_wav_stats *stats = &(path->wav_stats);
+	double freq, limit, threshold, target, span, confidence;
+
+	if( (path->wav_period_short <= 0.0) || (path->wav_period_long <= 0.0) )
+	{
+		path->wav_period_long = path->wav_sample_rate / (path->wav_frequency_limit / 1.5);
+		path->wav_period_short = path->wav_period_long / 2.0;
+	}
+
+	if( path->wav_adaptive != 0 )
+		limit = ((path->wav_sample_rate / path->wav_period_short) + (path->wav_sample_rate / path->wav_period_long)) / 2.0;
+	else
+		limit = path->wav_frequency_limit;
+
+	freq = ((float)path->wav_sample_rate/(float)diff);
+	
+	if( freq < limit ) /* 1200 Hz range */
+	{
+		*bit = 0;
+		target = path->wav_period_long;
+	}
+	else /* 2400 HZ range */
+	{
+		*bit = 1;
+		target = path->wav_period_short;
+	}
+
+	threshold = path->wav_sample_rate / limit;
+	span = fabs( diff - threshold ) / fabs( target - threshold );
+	confidence = span > 1.0 ? 1.0 : span;
+
+	/* Gaps and dropouts must not drag the tracked periods */
+	if( (path->wav_adaptive != 0) && (span >= WEAK_CONFIDENCE) && (span <= TRACK_MAX_SPAN) )
+	{
+		double period_short = path->wav_period_short;
+		double period_long = path->wav_period_long;
+
+		if( *bit == 0 )
+			period_long += (diff - period_long) * TRACK_GAIN;
+		else
+			period_short += (diff - period_short) * TRACK_GAIN;
+
+		if( period_long >= period_short * TRACK_MIN_RATIO )
+		{
+			path->wav_period_short = period_short;
+			path->wav_period_long = period_long;
+		}
+	}
+
+	stats->bits++;
+	stats->block_bits++;
+	stats->block_confidence_sum += confidence;
+
+	if( confidence < stats->block_confidence_min )
+		stats->block_confidence_min = confidence;
+
+	if( confidence < WEAK_CONFIDENCE )
+	{
+		stats->weak_bits++;
+		stats->block_weak_bits++;
+	}
+}
+
+/*
+ * _cecb_wav_block_begin()
+ *
+ * Reset per block statistics once a block sync byte has been found.
+ */
+
+void _cecb_wav_block_begin( cecb_path_id path )
+{
+	cecb_wav_stats *stats = &(path->wav_stats);
+
+	stats->block_start_sample = path->wav_current_sample;
+	stats->block_bits = 0;
+	stats->block_weak_bits = 0;
+	stats->block_confidence_sum = 0.0;
+	stats->block_confidence_min = 1.0;
+}
+
+/*
+ * _cecb_wav_block_end()
+ *
+ * Account for a decoded block and report it when verbose.
+ */
+
+void _cecb_wav_block_end( cecb_path_id path, unsigned char block_type, unsigned char block_length, error_code ec )
+{
+	cecb_wav_stats *stats = &(path->wav_stats);
+	double average = 0.0;
+
+	stats->blocks++;
+
+	if( ec == EOS_CRC )
+		stats->crc_failures++;
+
+	if( cecb_verbose == 0 )
+		return;
+
+	if( stats->block_bits > 0 )
+		average = stats->block_confidence_sum / stats->block_bits;
+
+	fprintf( stderr, "Block at sample %ld: type %2.2x, length %3d, confidence %.2f (min %.2f), %ld weak bits%s\n",
+		stats->block_start_sample, block_type, block_length, average,
+		stats->block_confidence_min, stats->block_weak_bits,
+		ec == EOS_CRC ? ", checksum failed" : "" );
+}
+
+/*
+ * _cecb_wav_report()
+ *
+ * Print decoder statistics for a path.
+ */
+
+void _cecb_wav_report( cecb_path_id path )
+{
+	cecb_wav_stats *stats = &(path->wav_stats);
+
+	if( stats->bits == 0 )
+		return;
+
+	fprintf( stderr, "Decoded %ld blocks, %ld checksum failures, %ld of %ld bits weak\n",
+		stats->blocks, stats->crc_failures, stats->weak_bits, stats->bits );
+
+	if( path->wav_adaptive != 0 )
+		fprintf( stderr, "Tracked tones: %.1f Hz and %.1f Hz\n",
+			path->wav_sample_rate / path->wav_period_long,
+			path->wav_sample_rate / path->wav_period_short );
+}
+
 /* Determine if A is within P percent of B */
 static int numbers_close_signed( int a, int b, double p )
 {
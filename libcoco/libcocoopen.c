@@ -196,7 +196,7 @@ error_code _coco_close(coco_path_id path)
 error_code _coco_identify_image(char *pathlist, _path_type *type)
 {
 	error_code		ec = 0;
-    char *p;
+    char *p, *last;
     char *tmppathlist;
 	FILE *fp;
 
@@ -215,7 +215,7 @@ error_code _coco_identify_image(char *pathlist, _path_type *type)
 
     tmppathlist = strdup(pathlist);
 
-    p = strtok(tmppathlist, ",");
+    p = strtok_r(tmppathlist, ",", &last);
 
     if (p == NULL)
     {
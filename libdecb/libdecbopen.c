@@ -240,7 +240,7 @@ error_code _decb_create(decb_path_id *path, char *pathlist, int mode, int file_t
 			return ec;
 		}
 		
-		(*path)->FAT[new_granule] = 0xC1;
+		_decb_fat_set(*path, new_granule, 0xC1);
 		(*path)->dir_entry.first_granule = new_granule;
 		
 		_int2(0, (*path)->dir_entry.last_sector_size);
@@ -43,8 +43,22 @@ error_code _decb_read(decb_path_id path, void *buffer, u_int *size)
         }
 		else
 		{
+			size_t	read_size;
+
+			/* Don't read past the end of the disk, and treat a short
+			 * image file as zero filled.
+			 */
+			if (*size > disksize - path->filepos)
+			{
+				*size = disksize - path->filepos;
+			}
+
 			fseek(path->fd, path->filepos, SEEK_SET);
-			fread(buffer, 1, *size, path->fd);
+			read_size = fread(buffer, 1, *size, path->fd);
+			if (read_size < *size)
+			{
+				memset((char *)buffer + read_size, 0, *size - read_size);
+			}
 			path->filepos += *size;
 		}
 
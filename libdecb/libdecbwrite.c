@@ -15,6 +15,10 @@ static error_code extend_fat_chain(decb_path_id path, int current_size, int new_
 error_code find_free_granule(decb_path_id path, int *granule, int next_to);
 
 
+/* Told of each granule that is allocated or freed, so a caller can keep free counts */
+static decb_fat_hook fat_hook = NULL;
+
+
 error_code _decb_write(decb_path_id path, void *buffer, u_int *size)
 {
     error_code	ec = EOS_WRITE;
@@ -247,16 +251,23 @@ static error_code extend_fat_chain(decb_path_id path, int current_size, int new_
 	
 			if (find_free_granule(path, &new_granule, curr_granule) != 0)
 			{
-				/* 1. Could not find any free granules. */
-		
-				memcpy(path->FAT, tmp_FAT, 256);
+				int i;
+
+				/* 1. Could not find any free granules; put the FAT back. */
+				for (i = 0; i < 256; i++)
+				{
+					if (path->FAT[i] != tmp_FAT[i])
+					{
+						_decb_fat_set(path, i, tmp_FAT[i]);
+					}
+				}
 
 				return EOS_DF;
 			}
 		
-			path->FAT[curr_granule] = new_granule;
+			_decb_fat_set(path, curr_granule, new_granule);
 			curr_granule = new_granule;
-			path->FAT[curr_granule] = 0xC0;
+			_decb_fat_set(path, curr_granule, 0xC0);
 			max_size_with_curr_granules_allocated += 2304;
 		}
 		while (new_size > max_size_with_curr_granules_allocated);
@@ -358,3 +369,27 @@ error_code find_free_granule(decb_path_id path, int *granule, int next_to)
 
 
 
+void _decb_set_fat_hook(decb_fat_hook hook)
+{
+	fat_hook = hook;
+}
+
+
+
+/*
+ * _decb_fat_set: change a FAT entry, telling the hook if the granule was
+ * allocated or freed.
+ */
+
+void _decb_fat_set(decb_path_id path, int granule, u_char value)
+{
+	if (fat_hook != NULL && (path->FAT[granule] == 0xFF) != (value == 0xFF))
+	{
+		fat_hook(granule, value != 0xFF);
+	}
+
+	path->FAT[granule] = value;
+}
+
+
+
@@ -0,0 +1,327 @@
+/********************************************************************
+ * Formatted dump functions
+ *
+ * These functions render the hex, assembler (fcb) and binary dump
+ * layouts shared by the dump commands.  Whole lines are built in a
+ * buffer from lookup tables and written out with large fwrite()s.
+ *
+ * dump_init()
+ * 		sets up a dump context for a layout; the display flags may
+ * 		be changed after this call
+ *
+ * dump_bytes()
+ * 		dumps a block of bytes, holding back a partial line until the
+ * 		next call
+ *
+ * dump_finish()
+ * 		dumps any partial line, ends the dump and flushes the output
+ *
+ * $Id$
+ ********************************************************************/
+#include <string.h>
+
+#include <dump.h>
+
+#define	LINE_MAX_BYTES	1024		/* longest line, header included */
+
+
+void dump_init(dump_context *d, FILE *out, int format)
+{
+	static const char lower[] = "0123456789abcdef";
+	static const char upper[] = "0123456789ABCDEF";
+	int i, j;
+
+	d->out = out;
+	d->format = format;
+	d->displayASCII = 1;
+	d->displayHeader = 1;
+	d->displayLabel = 1;
+	d->byte_count = 0;
+	d->line_count = 0;
+	d->used = 0;
+
+	switch (format)
+	{
+		case DUMP_FCB:
+			d->chunk = 8;
+			break;
+
+		case DUMP_BINARY:
+			d->chunk = 1;
+			break;
+
+		default:
+			d->chunk = 16;
+			break;
+	}
+
+	for (i = 0; i < 256; i++)
+	{
+		d->hex[i][0] = lower[i >> 4];
+		d->hex[i][1] = lower[i & 0x0F];
+		d->HEX[i][0] = upper[i >> 4];
+		d->HEX[i][1] = upper[i & 0x0F];
+
+		for (j = 0; j < 8; j++)
+		{
+			d->bin[i][j] = (i & (1 << (7 - j))) ? '1' : '0';
+		}
+
+		if (i >= 32 && i < 127)
+		{
+			d->ascii[i] = i;
+		}
+		else if (i >= 128 + 32 && i <= 128 + 'z')
+		{
+			d->ascii[i] = i - 128;
+		}
+		else
+		{
+			d->ascii[i] = '.';
+		}
+	}
+}
+
+
+
+static void flush_buffer(dump_context *d)
+{
+	if (d->used > 0)
+	{
+		fwrite(d->buffer, 1, d->used, d->out);
+		d->used = 0;
+	}
+}
+
+
+
+/* Append a value in hex with at least width digits, like %0*x or %0*X. */
+
+static char *put_hex(char *o, u_int value, int width, const char (*table)[2])
+{
+	char digits[8];
+	int n = 0;
+
+	do
+	{
+		digits[n++] = table[value & 0x0F][1];
+		value >>= 4;
+	}
+	while (value != 0 || n < width);
+
+	while (n > 0)
+	{
+		*o++ = digits[--n];
+	}
+
+	return o;
+}
+
+
+
+static char *put_string(char *o, const char *s)
+{
+	size_t len = strlen(s);
+
+	memcpy(o, s, len);
+
+	return o + len;
+}
+
+
+
+static char *put_spaces(char *o, int n)
+{
+	memset(o, ' ', n);
+
+	return o + n;
+}
+
+
+
+static char *put_byte(dump_context *d, char *o, u_char b)
+{
+	switch (d->format)
+	{
+		case DUMP_HEX:
+			*o++ = d->hex[b][0];
+			*o++ = d->hex[b][1];
+			break;
+
+		case DUMP_FCB:
+			*o++ = '$';
+			*o++ = d->HEX[b][0];
+			*o++ = d->HEX[b][1];
+			break;
+
+		case DUMP_BINARY:
+			*o++ = '%';
+			memcpy(o, d->bin[b], 8);
+			o += 8;
+			break;
+	}
+
+	return o;
+}
+
+
+
+/* Render one line of count bytes, preceded by the header every 256 bytes. */
+
+static void dump_line(dump_context *d, u_char *data, u_int count)
+{
+	char *o;
+	u_int i, pad;
+
+	if (d->used > DUMP_BUFSIZ - LINE_MAX_BYTES)
+	{
+		flush_buffer(d);
+	}
+
+	o = d->buffer + d->used;
+
+	/* 1. Header. */
+
+	if (d->byte_count % 256 == 0 && d->format == DUMP_HEX && d->displayHeader == 1)
+	{
+		o = put_string(o, "\n\n  Addr     0 1  2 3  4 5  6 7  8 9  A B  C D  E F");
+		if (d->displayASCII == 1)
+		{
+			o = put_string(o, " 0 2 4 6 8 A C E");
+		}
+		o = put_string(o, "\n--------  ---- ---- ---- ---- ---- ---- ---- ----");
+		if (d->displayASCII == 1)
+		{
+			o = put_string(o, " ----------------");
+		}
+	}
+
+	/* 2. Line label. */
+
+	*o++ = '\n';
+	if (d->format == DUMP_HEX)
+	{
+		if (d->displayLabel == 1)
+		{
+			o = put_hex(o, d->byte_count, 8, d->hex);
+			o = put_spaces(o, 2);
+		}
+	}
+	else
+	{
+		if (d->displayLabel == 1)
+		{
+			*o++ = 'L';
+			o = put_hex(o, d->byte_count, 4, d->HEX);
+			o = put_string(o, "    fcb   ");
+		}
+		else
+		{
+			o = put_string(o, "         fcb   ");
+		}
+	}
+
+	/* 3. Bytes: hex is grouped in words, fcb and binary are comma separated. */
+
+	for (i = 0; i < count; i++)
+	{
+		o = put_byte(d, o, data[i]);
+
+		if (d->format == DUMP_HEX)
+		{
+			if (i % 2 == 1)
+			{
+				*o++ = ' ';
+			}
+		}
+		else if (i < count - 1)
+		{
+			*o++ = ',';
+		}
+	}
+
+	/* 4. Characters, lined up under a full line. */
+
+	if (d->displayASCII == 1)
+	{
+		pad = d->chunk - count;
+
+		if (d->format == DUMP_FCB)
+		{
+			o = put_spaces(o, 3);
+		}
+
+		if (pad % 2 != 0)
+		{
+			o = put_spaces(o, d->format == DUMP_FCB ? 5 : 3);
+		}
+
+		o = put_spaces(o, (pad / 2) * (d->format == DUMP_FCB ? 8 : 5));
+
+		for (i = 0; i < count; i++)
+		{
+			*o++ = d->ascii[data[i]];
+		}
+	}
+
+	d->used = o - d->buffer;
+	d->byte_count += count;
+}
+
+
+
+void dump_bytes(dump_context *d, u_char *data, size_t num_bytes)
+{
+	/* 1. Top up a line held back from the last call. */
+
+	if (d->line_count > 0)
+	{
+		while (d->line_count < d->chunk && d->line_count < sizeof(d->line) && num_bytes > 0)
+		{
+			d->line[d->line_count++] = *data++;
+			num_bytes--;
+		}
+
+		if (d->line_count < d->chunk)
+		{
+			return;
+		}
+
+		dump_line(d, d->line, d->line_count);
+		d->line_count = 0;
+	}
+
+	/* 2. Whole lines straight from the caller's data. */
+
+	while (num_bytes >= d->chunk)
+	{
+		dump_line(d, data, d->chunk);
+		data += d->chunk;
+		num_bytes -= d->chunk;
+	}
+
+	/* 3. Hold back the rest. */
+
+	memcpy(d->line, data, num_bytes);
+	d->line_count = num_bytes;
+}
+
+
+
+void dump_finish(dump_context *d)
+{
+	if (d->line_count > 0)
+	{
+		dump_line(d, d->line, d->line_count);
+		d->line_count = 0;
+	}
+
+	if (d->used >= DUMP_BUFSIZ)
+	{
+		flush_buffer(d);
+	}
+
+	d->buffer[d->used++] = '\n';
+	flush_buffer(d);
+	fflush(d->out);
+}
@@ -11,6 +11,16 @@
 #include "os9path.h"
 
 
+/* Told of each cluster that changes state, so a caller can keep free counts */
+static os9_bitmap_hook bitmap_hook = NULL;
+
+
+void _os9_set_bitmap_hook(os9_bitmap_hook hook)
+{
+    bitmap_hook = hook;
+}
+
+
 /* Allocate a bit from the bitmap for numbits, starting at firstbit
  *
  * Note: range checking isn't done here; it is assumed that the caller
@@ -34,6 +44,11 @@ int _os9_allbit(u_char *bitmap, int firstbit, int numbits)
             startbyte++;	/* and increase byte counter */
         }
 
+        if (bitmap_hook != NULL && !(bitmap[startbyte] & (1 << (7 - startbit))))
+        {
+            bitmap_hook(firstbit + i, 1);
+        }
+
         bitmap[startbyte] |= (1 << (7 - startbit++));
     }
 
@@ -64,6 +79,11 @@ int _os9_delbit(u_char *bitmap, int firstbit, int numbits)
             startbit = 0;	/* reset bit counter */
             startbyte++;	/* and increase byte counter */
         }
+
+        if (bitmap_hook != NULL && (bitmap[startbyte] & (1 << (7 - startbit))))
+        {
+            bitmap_hook(firstbit + i, 0);
+        }
         
         bitmap[startbyte] &= ~(1 << (7 - startbit++));
     }
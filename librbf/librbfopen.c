@@ -262,7 +262,7 @@ aa:
 error_code _os9_open(os9_path_id *path, char *pathlist, int mode)
 {
     error_code	ec = 0;
-    char		*p;
+    char		*p, *last;
 	char		*tmppathlist;
 
 
@@ -375,7 +375,7 @@ error_code _os9_open(os9_path_id *path, char *pathlist, int mode)
     (*path)->pl_fd_lsn = int3((*path)->lsn0->dd_dir);
 
     tmppathlist = strdup((*path)->pathlist);
-    p = strtok(tmppathlist, "/");
+    p = strtok_r(tmppathlist, "/", &last);
 	if (p == NULL)
 	{
     	p = ".";
@@ -416,7 +416,7 @@ error_code _os9_open(os9_path_id *path, char *pathlist, int mode)
                 break;
             }
         }
-    } while (ec == 0 && (p = strtok(NULL, "/")) != 0);
+    } while (ec == 0 && (p = strtok_r(NULL, "/", &last)) != 0);
 
 
     /* 10. If error encountered, return. */
@@ -685,7 +685,7 @@ int _os9_maximum_file_size(fd_stats fd_sector, int bytesPerSector)
  */
 int validate_pathlist(os9_path_id *path, char *pathlist)
 {
-    char *p;
+    char *p, *last;
     char *tmppathlist;
 
 
@@ -699,7 +699,7 @@ int validate_pathlist(os9_path_id *path, char *pathlist)
 	
     tmppathlist = strdup(pathlist);
 
-    p = strtok(tmppathlist, ",");
+    p = strtok_r(tmppathlist, ",", &last);
 
     if (p == NULL)
     {
@@ -713,7 +713,7 @@ int validate_pathlist(os9_path_id *path, char *pathlist)
 	
     strcpy((*path)->imgfile, p);
 
-    p = strtok(NULL, ",");
+    p = strtok_r(NULL, ",", &last);
 
     if (p == NULL)
     {
@@ -57,8 +57,20 @@ error_code _os9_read(os9_path_id path, void *buffer, u_int *size)
             return EOS_EOF;
         }
 
+        /* Don't read past the end of the disk, and treat a short image
+         * file as zero filled rather than leaving stale data behind.
+         */
+        if (*size > disksize - path->filepos)
+        {
+            *size = disksize - path->filepos;
+        }
+
         fseek(path->fd, path->filepos, SEEK_SET);
-        fread(buffer, 1, *size, path->fd);
+        read_size = fread(buffer, 1, *size, path->fd);
+        if (read_size < *size)
+        {
+            memset(buf_ptr + read_size, 0, *size - read_size);
+        }
         path->filepos += *size;
 
 
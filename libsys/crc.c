@@ -9,43 +9,49 @@
 #include <cocotypes.h>
 #include <os9module.h>
 
+#include "crctab.h"
+
+
+/* The CRC starts out as all ones */
+
+u_int _os9_crc_init(void)
+{
+	return 0xFFFFFF;
+}
+
+
+
+/* Run bytes through the CRC, eight at a time while there are enough */
+
+u_int _os9_crc_update(u_int crc, u_char *ptr, u_int sz)
+{
+	return crc_table_update(crc, ptr, sz);
+}
+
+
+
+/* The CRC stored at the end of a module is the complement */
+
+u_int _os9_crc_final(u_int crc)
+{
+	return (crc ^ 0xFFFFFF) & 0xFFFFFF;
+}
+
+
+
+/* Update the CRC in crc[], returning 1 if it now shows a good module */
 
 error_code _os9_crc_compute(u_char *ptr, u_int sz, u_char *crc)
 {
-	error_code	ec = 0;
-	u_char  a;
-	u_int   i;
+	u_int	value;
 
-	for (i = 0; i < sz; i++)
-	{
-		a = *(ptr++);
-
-		a ^= crc[0];
-		crc[0] = crc[1];
-		crc[1] = crc[2];
-		crc[1] ^= (a >> 7);
-		crc[2] = (a << 1);
-		crc[1] ^= (a >> 2);
-		crc[2] ^= (a << 6);
-		a ^= (a << 1);
-		a ^= (a << 2);
-		a ^= (a << 4);
-
-		if (a & 0x80)
-		{
-			crc[0] ^= 0x80;
-			crc[2] ^= 0x21;
-		}
-	}
+	value = _os9_crc_update((crc[0] << 16) | (crc[1] << 8) | crc[2], ptr, sz);
 
-	if ((crc[0] == OS9_CRC0) &&
-		(crc[1] == OS9_CRC1) &&
-		(crc[2] == OS9_CRC2))
-	{
-		ec = 1;
-	}
+	crc[0] = (value >> 16) & 0xFF;
+	crc[1] = (value >> 8) & 0xFF;
+	crc[2] = value & 0xFF;
 
-	return ec;
+	return (crc[0] == OS9_CRC0) && (crc[1] == OS9_CRC1) && (crc[2] == OS9_CRC2);
 }
 
 
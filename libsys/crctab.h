@@ -0,0 +1,407 @@
+/********************************************************************
+ * crctab.h - OS-9 module CRC lookup tables
+ *
+ * The CRC is kept in the top 24 bits of a 32 bit word.  crc_table[0]
+ * holds the CRC of each byte value shifted through the polynomial
+ * $800063; crc_table[k][n] is crc_table[k - 1][n] moved on one more
+ * zero byte, so that eight bytes can be taken at a time.
+ *
+ * crc_table_update runs bytes through the tables.  It is kept here so
+ * that casm, which is built apart from libsys, can share it.
+ *
+ * $Id$
+ ********************************************************************/
+
+static const unsigned int crc_table[8][256] =
+{
+	{
+		0x00000000, 0x80006300, 0x8000A500, 0x0000C600, 0x80012900, 0x00014A00,
+		0x00018C00, 0x8001EF00, 0x80023100, 0x00025200, 0x00029400, 0x8002F700,
+		0x00031800, 0x80037B00, 0x8003BD00, 0x0003DE00, 0x80040100, 0x00046200,
+		0x0004A400, 0x8004C700, 0x00052800, 0x80054B00, 0x80058D00, 0x0005EE00,
+		0x00063000, 0x80065300, 0x80069500, 0x0006F600, 0x80071900, 0x00077A00,
+		0x0007BC00, 0x8007DF00, 0x80086100, 0x00080200, 0x0008C400, 0x8008A700,
+		0x00094800, 0x80092B00, 0x8009ED00, 0x00098E00, 0x000A5000, 0x800A3300,
+		0x800AF500, 0x000A9600, 0x800B7900, 0x000B1A00, 0x000BDC00, 0x800BBF00,
+		0x000C6000, 0x800C0300, 0x800CC500, 0x000CA600, 0x800D4900, 0x000D2A00,
+		0x000DEC00, 0x800D8F00, 0x800E5100, 0x000E3200, 0x000EF400, 0x800E9700,
+		0x000F7800, 0x800F1B00, 0x800FDD00, 0x000FBE00, 0x8010A100, 0x0010C200,
+		0x00100400, 0x80106700, 0x00118800, 0x8011EB00, 0x80112D00, 0x00114E00,
+		0x00129000, 0x8012F300, 0x80123500, 0x00125600, 0x8013B900, 0x0013DA00,
+		0x00131C00, 0x80137F00, 0x0014A000, 0x8014C300, 0x80140500, 0x00146600,
+		0x80158900, 0x0015EA00, 0x00152C00, 0x80154F00, 0x80169100, 0x0016F200,
+		0x00163400, 0x80165700, 0x0017B800, 0x8017DB00, 0x80171D00, 0x00177E00,
+		0x0018C000, 0x8018A300, 0x80186500, 0x00180600, 0x8019E900, 0x00198A00,
+		0x00194C00, 0x80192F00, 0x801AF100, 0x001A9200, 0x001A5400, 0x801A3700,
+		0x001BD800, 0x801BBB00, 0x801B7D00, 0x001B1E00, 0x801CC100, 0x001CA200,
+		0x001C6400, 0x801C0700, 0x001DE800, 0x801D8B00, 0x801D4D00, 0x001D2E00,
+		0x001EF000, 0x801E9300, 0x801E5500, 0x001E3600, 0x801FD900, 0x001FBA00,
+		0x001F7C00, 0x801F1F00, 0x80212100, 0x00214200, 0x00218400, 0x8021E700,
+		0x00200800, 0x80206B00, 0x8020AD00, 0x0020CE00, 0x00231000, 0x80237300,
+		0x8023B500, 0x0023D600, 0x80223900, 0x00225A00, 0x00229C00, 0x8022FF00,
+		0x00252000, 0x80254300, 0x80258500, 0x0025E600, 0x80240900, 0x00246A00,
+		0x0024AC00, 0x8024CF00, 0x80271100, 0x00277200, 0x0027B400, 0x8027D700,
+		0x00263800, 0x80265B00, 0x80269D00, 0x0026FE00, 0x00294000, 0x80292300,
+		0x8029E500, 0x00298600, 0x80286900, 0x00280A00, 0x0028CC00, 0x8028AF00,
+		0x802B7100, 0x002B1200, 0x002BD400, 0x802BB700, 0x002A5800, 0x802A3B00,
+		0x802AFD00, 0x002A9E00, 0x802D4100, 0x002D2200, 0x002DE400, 0x802D8700,
+		0x002C6800, 0x802C0B00, 0x802CCD00, 0x002CAE00, 0x002F7000, 0x802F1300,
+		0x802FD500, 0x002FB600, 0x802E5900, 0x002E3A00, 0x002EFC00, 0x802E9F00,
+		0x00318000, 0x8031E300, 0x80312500, 0x00314600, 0x8030A900, 0x0030CA00,
+		0x00300C00, 0x80306F00, 0x8033B100, 0x0033D200, 0x00331400, 0x80337700,
+		0x00329800, 0x8032FB00, 0x80323D00, 0x00325E00, 0x80358100, 0x0035E200,
+		0x00352400, 0x80354700, 0x0034A800, 0x8034CB00, 0x80340D00, 0x00346E00,
+		0x0037B000, 0x8037D300, 0x80371500, 0x00377600, 0x80369900, 0x0036FA00,
+		0x00363C00, 0x80365F00, 0x8039E100, 0x00398200, 0x00394400, 0x80392700,
+		0x0038C800, 0x8038AB00, 0x80386D00, 0x00380E00, 0x003BD000, 0x803BB300,
+		0x803B7500, 0x003B1600, 0x803AF900, 0x003A9A00, 0x003A5C00, 0x803A3F00,
+		0x003DE000, 0x803D8300, 0x803D4500, 0x003D2600, 0x803CC900, 0x003CAA00,
+		0x003C6C00, 0x803C0F00, 0x803FD100, 0x003FB200, 0x003F7400, 0x803F1700,
+		0x003EF800, 0x803E9B00, 0x803E5D00, 0x003E3E00
+	},
+	{
+		0x00000000, 0x80422100, 0x80842100, 0x00C60000, 0x81082100, 0x014A0000,
+		0x018C0000, 0x81CE2100, 0x82102100, 0x02520000, 0x02940000, 0x82D62100,
+		0x03180000, 0x835A2100, 0x839C2100, 0x03DE0000, 0x84202100, 0x04620000,
+		0x04A40000, 0x84E62100, 0x05280000, 0x856A2100, 0x85AC2100, 0x05EE0000,
+		0x06300000, 0x86722100, 0x86B42100, 0x06F60000, 0x87382100, 0x077A0000,
+		0x07BC0000, 0x87FE2100, 0x88402100, 0x08020000, 0x08C40000, 0x88862100,
+		0x09480000, 0x890A2100, 0x89CC2100, 0x098E0000, 0x0A500000, 0x8A122100,
+		0x8AD42100, 0x0A960000, 0x8B582100, 0x0B1A0000, 0x0BDC0000, 0x8B9E2100,
+		0x0C600000, 0x8C222100, 0x8CE42100, 0x0CA60000, 0x8D682100, 0x0D2A0000,
+		0x0DEC0000, 0x8DAE2100, 0x8E702100, 0x0E320000, 0x0EF40000, 0x8EB62100,
+		0x0F780000, 0x8F3A2100, 0x8FFC2100, 0x0FBE0000, 0x90802100, 0x10C20000,
+		0x10040000, 0x90462100, 0x11880000, 0x91CA2100, 0x910C2100, 0x114E0000,
+		0x12900000, 0x92D22100, 0x92142100, 0x12560000, 0x93982100, 0x13DA0000,
+		0x131C0000, 0x935E2100, 0x14A00000, 0x94E22100, 0x94242100, 0x14660000,
+		0x95A82100, 0x15EA0000, 0x152C0000, 0x956E2100, 0x96B02100, 0x16F20000,
+		0x16340000, 0x96762100, 0x17B80000, 0x97FA2100, 0x973C2100, 0x177E0000,
+		0x18C00000, 0x98822100, 0x98442100, 0x18060000, 0x99C82100, 0x198A0000,
+		0x194C0000, 0x990E2100, 0x9AD02100, 0x1A920000, 0x1A540000, 0x9A162100,
+		0x1BD80000, 0x9B9A2100, 0x9B5C2100, 0x1B1E0000, 0x9CE02100, 0x1CA20000,
+		0x1C640000, 0x9C262100, 0x1DE80000, 0x9DAA2100, 0x9D6C2100, 0x1D2E0000,
+		0x1EF00000, 0x9EB22100, 0x9E742100, 0x1E360000, 0x9FF82100, 0x1FBA0000,
+		0x1F7C0000, 0x9F3E2100, 0xA1002100, 0x21420000, 0x21840000, 0xA1C62100,
+		0x20080000, 0xA04A2100, 0xA08C2100, 0x20CE0000, 0x23100000, 0xA3522100,
+		0xA3942100, 0x23D60000, 0xA2182100, 0x225A0000, 0x229C0000, 0xA2DE2100,
+		0x25200000, 0xA5622100, 0xA5A42100, 0x25E60000, 0xA4282100, 0x246A0000,
+		0x24AC0000, 0xA4EE2100, 0xA7302100, 0x27720000, 0x27B40000, 0xA7F62100,
+		0x26380000, 0xA67A2100, 0xA6BC2100, 0x26FE0000, 0x29400000, 0xA9022100,
+		0xA9C42100, 0x29860000, 0xA8482100, 0x280A0000, 0x28CC0000, 0xA88E2100,
+		0xAB502100, 0x2B120000, 0x2BD40000, 0xAB962100, 0x2A580000, 0xAA1A2100,
+		0xAADC2100, 0x2A9E0000, 0xAD602100, 0x2D220000, 0x2DE40000, 0xADA62100,
+		0x2C680000, 0xAC2A2100, 0xACEC2100, 0x2CAE0000, 0x2F700000, 0xAF322100,
+		0xAFF42100, 0x2FB60000, 0xAE782100, 0x2E3A0000, 0x2EFC0000, 0xAEBE2100,
+		0x31800000, 0xB1C22100, 0xB1042100, 0x31460000, 0xB0882100, 0x30CA0000,
+		0x300C0000, 0xB04E2100, 0xB3902100, 0x33D20000, 0x33140000, 0xB3562100,
+		0x32980000, 0xB2DA2100, 0xB21C2100, 0x325E0000, 0xB5A02100, 0x35E20000,
+		0x35240000, 0xB5662100, 0x34A80000, 0xB4EA2100, 0xB42C2100, 0x346E0000,
+		0x37B00000, 0xB7F22100, 0xB7342100, 0x37760000, 0xB6B82100, 0x36FA0000,
+		0x363C0000, 0xB67E2100, 0xB9C02100, 0x39820000, 0x39440000, 0xB9062100,
+		0x38C80000, 0xB88A2100, 0xB84C2100, 0x380E0000, 0x3BD00000, 0xBB922100,
+		0xBB542100, 0x3B160000, 0xBAD82100, 0x3A9A0000, 0x3A5C0000, 0xBA1E2100,
+		0x3DE00000, 0xBDA22100, 0xBD642100, 0x3D260000, 0xBCE82100, 0x3CAA0000,
+		0x3C6C0000, 0xBC2E2100, 0xBFF02100, 0x3FB20000, 0x3F740000, 0xBF362100,
+		0x3EF80000, 0xBEBA2100, 0xBE7C2100, 0x3E3E0000
+	},
+	{
+		0x00000000, 0xC2002100, 0x04002100, 0xC6000000, 0x08004200, 0xCA006300,
+		0x0C006300, 0xCE004200, 0x10008400, 0xD200A500, 0x1400A500, 0xD6008400,
+		0x1800C600, 0xDA00E700, 0x1C00E700, 0xDE00C600, 0x20010800, 0xE2012900,
+		0x24012900, 0xE6010800, 0x28014A00, 0xEA016B00, 0x2C016B00, 0xEE014A00,
+		0x30018C00, 0xF201AD00, 0x3401AD00, 0xF6018C00, 0x3801CE00, 0xFA01EF00,
+		0x3C01EF00, 0xFE01CE00, 0x40021000, 0x82023100, 0x44023100, 0x86021000,
+		0x48025200, 0x8A027300, 0x4C027300, 0x8E025200, 0x50029400, 0x9202B500,
+		0x5402B500, 0x96029400, 0x5802D600, 0x9A02F700, 0x5C02F700, 0x9E02D600,
+		0x60031800, 0xA2033900, 0x64033900, 0xA6031800, 0x68035A00, 0xAA037B00,
+		0x6C037B00, 0xAE035A00, 0x70039C00, 0xB203BD00, 0x7403BD00, 0xB6039C00,
+		0x7803DE00, 0xBA03FF00, 0x7C03FF00, 0xBE03DE00, 0x80042000, 0x42040100,
+		0x84040100, 0x46042000, 0x88046200, 0x4A044300, 0x8C044300, 0x4E046200,
+		0x9004A400, 0x52048500, 0x94048500, 0x5604A400, 0x9804E600, 0x5A04C700,
+		0x9C04C700, 0x5E04E600, 0xA0052800, 0x62050900, 0xA4050900, 0x66052800,
+		0xA8056A00, 0x6A054B00, 0xAC054B00, 0x6E056A00, 0xB005AC00, 0x72058D00,
+		0xB4058D00, 0x7605AC00, 0xB805EE00, 0x7A05CF00, 0xBC05CF00, 0x7E05EE00,
+		0xC0063000, 0x02061100, 0xC4061100, 0x06063000, 0xC8067200, 0x0A065300,
+		0xCC065300, 0x0E067200, 0xD006B400, 0x12069500, 0xD4069500, 0x1606B400,
+		0xD806F600, 0x1A06D700, 0xDC06D700, 0x1E06F600, 0xE0073800, 0x22071900,
+		0xE4071900, 0x26073800, 0xE8077A00, 0x2A075B00, 0xEC075B00, 0x2E077A00,
+		0xF007BC00, 0x32079D00, 0xF4079D00, 0x3607BC00, 0xF807FE00, 0x3A07DF00,
+		0xFC07DF00, 0x3E07FE00, 0x80082300, 0x42080200, 0x84080200, 0x46082300,
+		0x88086100, 0x4A084000, 0x8C084000, 0x4E086100, 0x9008A700, 0x52088600,
+		0x94088600, 0x5608A700, 0x9808E500, 0x5A08C400, 0x9C08C400, 0x5E08E500,
+		0xA0092B00, 0x62090A00, 0xA4090A00, 0x66092B00, 0xA8096900, 0x6A094800,
+		0xAC094800, 0x6E096900, 0xB009AF00, 0x72098E00, 0xB4098E00, 0x7609AF00,
+		0xB809ED00, 0x7A09CC00, 0xBC09CC00, 0x7E09ED00, 0xC00A3300, 0x020A1200,
+		0xC40A1200, 0x060A3300, 0xC80A7100, 0x0A0A5000, 0xCC0A5000, 0x0E0A7100,
+		0xD00AB700, 0x120A9600, 0xD40A9600, 0x160AB700, 0xD80AF500, 0x1A0AD400,
+		0xDC0AD400, 0x1E0AF500, 0xE00B3B00, 0x220B1A00, 0xE40B1A00, 0x260B3B00,
+		0xE80B7900, 0x2A0B5800, 0xEC0B5800, 0x2E0B7900, 0xF00BBF00, 0x320B9E00,
+		0xF40B9E00, 0x360BBF00, 0xF80BFD00, 0x3A0BDC00, 0xFC0BDC00, 0x3E0BFD00,
+		0x000C0300, 0xC20C2200, 0x040C2200, 0xC60C0300, 0x080C4100, 0xCA0C6000,
+		0x0C0C6000, 0xCE0C4100, 0x100C8700, 0xD20CA600, 0x140CA600, 0xD60C8700,
+		0x180CC500, 0xDA0CE400, 0x1C0CE400, 0xDE0CC500, 0x200D0B00, 0xE20D2A00,
+		0x240D2A00, 0xE60D0B00, 0x280D4900, 0xEA0D6800, 0x2C0D6800, 0xEE0D4900,
+		0x300D8F00, 0xF20DAE00, 0x340DAE00, 0xF60D8F00, 0x380DCD00, 0xFA0DEC00,
+		0x3C0DEC00, 0xFE0DCD00, 0x400E1300, 0x820E3200, 0x440E3200, 0x860E1300,
+		0x480E5100, 0x8A0E7000, 0x4C0E7000, 0x8E0E5100, 0x500E9700, 0x920EB600,
+		0x540EB600, 0x960E9700, 0x580ED500, 0x9A0EF400, 0x5C0EF400, 0x9E0ED500,
+		0x600F1B00, 0xA20F3A00, 0x640F3A00, 0xA60F1B00, 0x680F5900, 0xAA0F7800,
+		0x6C0F7800, 0xAE0F5900, 0x700F9F00, 0xB20FBE00, 0x740FBE00, 0xB60F9F00,
+		0x780FDD00, 0xBA0FFC00, 0x7C0FFC00, 0xBE0FDD00
+	},
+	{
+		0x00000000, 0x80102500, 0x80202900, 0x00300C00, 0x80403100, 0x00501400,
+		0x00601800, 0x80703D00, 0x80800100, 0x00902400, 0x00A02800, 0x80B00D00,
+		0x00C03000, 0x80D01500, 0x80E01900, 0x00F03C00, 0x81006100, 0x01104400,
+		0x01204800, 0x81306D00, 0x01405000, 0x81507500, 0x81607900, 0x01705C00,
+		0x01806000, 0x81904500, 0x81A04900, 0x01B06C00, 0x81C05100, 0x01D07400,
+		0x01E07800, 0x81F05D00, 0x8200A100, 0x02108400, 0x02208800, 0x8230AD00,
+		0x02409000, 0x8250B500, 0x8260B900, 0x02709C00, 0x0280A000, 0x82908500,
+		0x82A08900, 0x02B0AC00, 0x82C09100, 0x02D0B400, 0x02E0B800, 0x82F09D00,
+		0x0300C000, 0x8310E500, 0x8320E900, 0x0330CC00, 0x8340F100, 0x0350D400,
+		0x0360D800, 0x8370FD00, 0x8380C100, 0x0390E400, 0x03A0E800, 0x83B0CD00,
+		0x03C0F000, 0x83D0D500, 0x83E0D900, 0x03F0FC00, 0x84012100, 0x04110400,
+		0x04210800, 0x84312D00, 0x04411000, 0x84513500, 0x84613900, 0x04711C00,
+		0x04812000, 0x84910500, 0x84A10900, 0x04B12C00, 0x84C11100, 0x04D13400,
+		0x04E13800, 0x84F11D00, 0x05014000, 0x85116500, 0x85216900, 0x05314C00,
+		0x85417100, 0x05515400, 0x05615800, 0x85717D00, 0x85814100, 0x05916400,
+		0x05A16800, 0x85B14D00, 0x05C17000, 0x85D15500, 0x85E15900, 0x05F17C00,
+		0x06018000, 0x8611A500, 0x8621A900, 0x06318C00, 0x8641B100, 0x06519400,
+		0x06619800, 0x8671BD00, 0x86818100, 0x0691A400, 0x06A1A800, 0x86B18D00,
+		0x06C1B000, 0x86D19500, 0x86E19900, 0x06F1BC00, 0x8701E100, 0x0711C400,
+		0x0721C800, 0x8731ED00, 0x0741D000, 0x8751F500, 0x8761F900, 0x0771DC00,
+		0x0781E000, 0x8791C500, 0x87A1C900, 0x07B1EC00, 0x87C1D100, 0x07D1F400,
+		0x07E1F800, 0x87F1DD00, 0x88022100, 0x08120400, 0x08220800, 0x88322D00,
+		0x08421000, 0x88523500, 0x88623900, 0x08721C00, 0x08822000, 0x88920500,
+		0x88A20900, 0x08B22C00, 0x88C21100, 0x08D23400, 0x08E23800, 0x88F21D00,
+		0x09024000, 0x89126500, 0x89226900, 0x09324C00, 0x89427100, 0x09525400,
+		0x09625800, 0x89727D00, 0x89824100, 0x09926400, 0x09A26800, 0x89B24D00,
+		0x09C27000, 0x89D25500, 0x89E25900, 0x09F27C00, 0x0A028000, 0x8A12A500,
+		0x8A22A900, 0x0A328C00, 0x8A42B100, 0x0A529400, 0x0A629800, 0x8A72BD00,
+		0x8A828100, 0x0A92A400, 0x0AA2A800, 0x8AB28D00, 0x0AC2B000, 0x8AD29500,
+		0x8AE29900, 0x0AF2BC00, 0x8B02E100, 0x0B12C400, 0x0B22C800, 0x8B32ED00,
+		0x0B42D000, 0x8B52F500, 0x8B62F900, 0x0B72DC00, 0x0B82E000, 0x8B92C500,
+		0x8BA2C900, 0x0BB2EC00, 0x8BC2D100, 0x0BD2F400, 0x0BE2F800, 0x8BF2DD00,
+		0x0C030000, 0x8C132500, 0x8C232900, 0x0C330C00, 0x8C433100, 0x0C531400,
+		0x0C631800, 0x8C733D00, 0x8C830100, 0x0C932400, 0x0CA32800, 0x8CB30D00,
+		0x0CC33000, 0x8CD31500, 0x8CE31900, 0x0CF33C00, 0x8D036100, 0x0D134400,
+		0x0D234800, 0x8D336D00, 0x0D435000, 0x8D537500, 0x8D637900, 0x0D735C00,
+		0x0D836000, 0x8D934500, 0x8DA34900, 0x0DB36C00, 0x8DC35100, 0x0DD37400,
+		0x0DE37800, 0x8DF35D00, 0x8E03A100, 0x0E138400, 0x0E238800, 0x8E33AD00,
+		0x0E439000, 0x8E53B500, 0x8E63B900, 0x0E739C00, 0x0E83A000, 0x8E938500,
+		0x8EA38900, 0x0EB3AC00, 0x8EC39100, 0x0ED3B400, 0x0EE3B800, 0x8EF39D00,
+		0x0F03C000, 0x8F13E500, 0x8F23E900, 0x0F33CC00, 0x8F43F100, 0x0F53D400,
+		0x0F63D800, 0x8F73FD00, 0x8F83C100, 0x0F93E400, 0x0FA3E800, 0x8FB3CD00,
+		0x0FC3F000, 0x8FD3D500, 0x8FE3D900, 0x0FF3FC00
+	},
+	{
+		0x00000000, 0x90042100, 0xA0082100, 0x300C0000, 0xC0102100, 0x50140000,
+		0x60180000, 0xF01C2100, 0x00202100, 0x90240000, 0xA0280000, 0x302C2100,
+		0xC0300000, 0x50342100, 0x60382100, 0xF03C0000, 0x00404200, 0x90446300,
+		0xA0486300, 0x304C4200, 0xC0506300, 0x50544200, 0x60584200, 0xF05C6300,
+		0x00606300, 0x90644200, 0xA0684200, 0x306C6300, 0xC0704200, 0x50746300,
+		0x60786300, 0xF07C4200, 0x00808400, 0x9084A500, 0xA088A500, 0x308C8400,
+		0xC090A500, 0x50948400, 0x60988400, 0xF09CA500, 0x00A0A500, 0x90A48400,
+		0xA0A88400, 0x30ACA500, 0xC0B08400, 0x50B4A500, 0x60B8A500, 0xF0BC8400,
+		0x00C0C600, 0x90C4E700, 0xA0C8E700, 0x30CCC600, 0xC0D0E700, 0x50D4C600,
+		0x60D8C600, 0xF0DCE700, 0x00E0E700, 0x90E4C600, 0xA0E8C600, 0x30ECE700,
+		0xC0F0C600, 0x50F4E700, 0x60F8E700, 0xF0FCC600, 0x01010800, 0x91052900,
+		0xA1092900, 0x310D0800, 0xC1112900, 0x51150800, 0x61190800, 0xF11D2900,
+		0x01212900, 0x91250800, 0xA1290800, 0x312D2900, 0xC1310800, 0x51352900,
+		0x61392900, 0xF13D0800, 0x01414A00, 0x91456B00, 0xA1496B00, 0x314D4A00,
+		0xC1516B00, 0x51554A00, 0x61594A00, 0xF15D6B00, 0x01616B00, 0x91654A00,
+		0xA1694A00, 0x316D6B00, 0xC1714A00, 0x51756B00, 0x61796B00, 0xF17D4A00,
+		0x01818C00, 0x9185AD00, 0xA189AD00, 0x318D8C00, 0xC191AD00, 0x51958C00,
+		0x61998C00, 0xF19DAD00, 0x01A1AD00, 0x91A58C00, 0xA1A98C00, 0x31ADAD00,
+		0xC1B18C00, 0x51B5AD00, 0x61B9AD00, 0xF1BD8C00, 0x01C1CE00, 0x91C5EF00,
+		0xA1C9EF00, 0x31CDCE00, 0xC1D1EF00, 0x51D5CE00, 0x61D9CE00, 0xF1DDEF00,
+		0x01E1EF00, 0x91E5CE00, 0xA1E9CE00, 0x31EDEF00, 0xC1F1CE00, 0x51F5EF00,
+		0x61F9EF00, 0xF1FDCE00, 0x02021000, 0x92063100, 0xA20A3100, 0x320E1000,
+		0xC2123100, 0x52161000, 0x621A1000, 0xF21E3100, 0x02223100, 0x92261000,
+		0xA22A1000, 0x322E3100, 0xC2321000, 0x52363100, 0x623A3100, 0xF23E1000,
+		0x02425200, 0x92467300, 0xA24A7300, 0x324E5200, 0xC2527300, 0x52565200,
+		0x625A5200, 0xF25E7300, 0x02627300, 0x92665200, 0xA26A5200, 0x326E7300,
+		0xC2725200, 0x52767300, 0x627A7300, 0xF27E5200, 0x02829400, 0x9286B500,
+		0xA28AB500, 0x328E9400, 0xC292B500, 0x52969400, 0x629A9400, 0xF29EB500,
+		0x02A2B500, 0x92A69400, 0xA2AA9400, 0x32AEB500, 0xC2B29400, 0x52B6B500,
+		0x62BAB500, 0xF2BE9400, 0x02C2D600, 0x92C6F700, 0xA2CAF700, 0x32CED600,
+		0xC2D2F700, 0x52D6D600, 0x62DAD600, 0xF2DEF700, 0x02E2F700, 0x92E6D600,
+		0xA2EAD600, 0x32EEF700, 0xC2F2D600, 0x52F6F700, 0x62FAF700, 0xF2FED600,
+		0x03031800, 0x93073900, 0xA30B3900, 0x330F1800, 0xC3133900, 0x53171800,
+		0x631B1800, 0xF31F3900, 0x03233900, 0x93271800, 0xA32B1800, 0x332F3900,
+		0xC3331800, 0x53373900, 0x633B3900, 0xF33F1800, 0x03435A00, 0x93477B00,
+		0xA34B7B00, 0x334F5A00, 0xC3537B00, 0x53575A00, 0x635B5A00, 0xF35F7B00,
+		0x03637B00, 0x93675A00, 0xA36B5A00, 0x336F7B00, 0xC3735A00, 0x53777B00,
+		0x637B7B00, 0xF37F5A00, 0x03839C00, 0x9387BD00, 0xA38BBD00, 0x338F9C00,
+		0xC393BD00, 0x53979C00, 0x639B9C00, 0xF39FBD00, 0x03A3BD00, 0x93A79C00,
+		0xA3AB9C00, 0x33AFBD00, 0xC3B39C00, 0x53B7BD00, 0x63BBBD00, 0xF3BF9C00,
+		0x03C3DE00, 0x93C7FF00, 0xA3CBFF00, 0x33CFDE00, 0xC3D3FF00, 0x53D7DE00,
+		0x63DBDE00, 0xF3DFFF00, 0x03E3FF00, 0x93E7DE00, 0xA3EBDE00, 0x33EFFF00,
+		0xC3F3DE00, 0x53F7FF00, 0x63FBFF00, 0xF3FFDE00
+	},
+	{
+		0x00000000, 0x04042000, 0x08084000, 0x0C0C6000, 0x10108000, 0x1414A000,
+		0x1818C000, 0x1C1CE000, 0x20210000, 0x24252000, 0x28294000, 0x2C2D6000,
+		0x30318000, 0x3435A000, 0x3839C000, 0x3C3DE000, 0x40420000, 0x44462000,
+		0x484A4000, 0x4C4E6000, 0x50528000, 0x5456A000, 0x585AC000, 0x5C5EE000,
+		0x60630000, 0x64672000, 0x686B4000, 0x6C6F6000, 0x70738000, 0x7477A000,
+		0x787BC000, 0x7C7FE000, 0x80840000, 0x84802000, 0x888C4000, 0x8C886000,
+		0x90948000, 0x9490A000, 0x989CC000, 0x9C98E000, 0xA0A50000, 0xA4A12000,
+		0xA8AD4000, 0xACA96000, 0xB0B58000, 0xB4B1A000, 0xB8BDC000, 0xBCB9E000,
+		0xC0C60000, 0xC4C22000, 0xC8CE4000, 0xCCCA6000, 0xD0D68000, 0xD4D2A000,
+		0xD8DEC000, 0xDCDAE000, 0xE0E70000, 0xE4E32000, 0xE8EF4000, 0xECEB6000,
+		0xF0F78000, 0xF4F3A000, 0xF8FFC000, 0xFCFBE000, 0x81086300, 0x850C4300,
+		0x89002300, 0x8D040300, 0x9118E300, 0x951CC300, 0x9910A300, 0x9D148300,
+		0xA1296300, 0xA52D4300, 0xA9212300, 0xAD250300, 0xB139E300, 0xB53DC300,
+		0xB931A300, 0xBD358300, 0xC14A6300, 0xC54E4300, 0xC9422300, 0xCD460300,
+		0xD15AE300, 0xD55EC300, 0xD952A300, 0xDD568300, 0xE16B6300, 0xE56F4300,
+		0xE9632300, 0xED670300, 0xF17BE300, 0xF57FC300, 0xF973A300, 0xFD778300,
+		0x018C6300, 0x05884300, 0x09842300, 0x0D800300, 0x119CE300, 0x1598C300,
+		0x1994A300, 0x1D908300, 0x21AD6300, 0x25A94300, 0x29A52300, 0x2DA10300,
+		0x31BDE300, 0x35B9C300, 0x39B5A300, 0x3DB18300, 0x41CE6300, 0x45CA4300,
+		0x49C62300, 0x4DC20300, 0x51DEE300, 0x55DAC300, 0x59D6A300, 0x5DD28300,
+		0x61EF6300, 0x65EB4300, 0x69E72300, 0x6DE30300, 0x71FFE300, 0x75FBC300,
+		0x79F7A300, 0x7DF38300, 0x8210A500, 0x86148500, 0x8A18E500, 0x8E1CC500,
+		0x92002500, 0x96040500, 0x9A086500, 0x9E0C4500, 0xA231A500, 0xA6358500,
+		0xAA39E500, 0xAE3DC500, 0xB2212500, 0xB6250500, 0xBA296500, 0xBE2D4500,
+		0xC252A500, 0xC6568500, 0xCA5AE500, 0xCE5EC500, 0xD2422500, 0xD6460500,
+		0xDA4A6500, 0xDE4E4500, 0xE273A500, 0xE6778500, 0xEA7BE500, 0xEE7FC500,
+		0xF2632500, 0xF6670500, 0xFA6B6500, 0xFE6F4500, 0x0294A500, 0x06908500,
+		0x0A9CE500, 0x0E98C500, 0x12842500, 0x16800500, 0x1A8C6500, 0x1E884500,
+		0x22B5A500, 0x26B18500, 0x2ABDE500, 0x2EB9C500, 0x32A52500, 0x36A10500,
+		0x3AAD6500, 0x3EA94500, 0x42D6A500, 0x46D28500, 0x4ADEE500, 0x4EDAC500,
+		0x52C62500, 0x56C20500, 0x5ACE6500, 0x5ECA4500, 0x62F7A500, 0x66F38500,
+		0x6AFFE500, 0x6EFBC500, 0x72E72500, 0x76E30500, 0x7AEF6500, 0x7EEB4500,
+		0x0318C600, 0x071CE600, 0x0B108600, 0x0F14A600, 0x13084600, 0x170C6600,
+		0x1B000600, 0x1F042600, 0x2339C600, 0x273DE600, 0x2B318600, 0x2F35A600,
+		0x33294600, 0x372D6600, 0x3B210600, 0x3F252600, 0x435AC600, 0x475EE600,
+		0x4B528600, 0x4F56A600, 0x534A4600, 0x574E6600, 0x5B420600, 0x5F462600,
+		0x637BC600, 0x677FE600, 0x6B738600, 0x6F77A600, 0x736B4600, 0x776F6600,
+		0x7B630600, 0x7F672600, 0x839CC600, 0x8798E600, 0x8B948600, 0x8F90A600,
+		0x938C4600, 0x97886600, 0x9B840600, 0x9F802600, 0xA3BDC600, 0xA7B9E600,
+		0xABB58600, 0xAFB1A600, 0xB3AD4600, 0xB7A96600, 0xBBA50600, 0xBFA12600,
+		0xC3DEC600, 0xC7DAE600, 0xCBD68600, 0xCFD2A600, 0xD3CE4600, 0xD7CA6600,
+		0xDBC60600, 0xDFC22600, 0xE3FFC600, 0xE7FBE600, 0xEBF78600, 0xEFF3A600,
+		0xF3EF4600, 0xF7EB6600, 0xFBE70600, 0xFFE32600
+	},
+	{
+		0x00000000, 0x84212900, 0x88423100, 0x0C631800, 0x90840100, 0x14A52800,
+		0x18C63000, 0x9CE71900, 0xA1086100, 0x25294800, 0x294A5000, 0xAD6B7900,
+		0x318C6000, 0xB5AD4900, 0xB9CE5100, 0x3DEF7800, 0xC210A100, 0x46318800,
+		0x4A529000, 0xCE73B900, 0x5294A000, 0xD6B58900, 0xDAD69100, 0x5EF7B800,
+		0x6318C000, 0xE739E900, 0xEB5AF100, 0x6F7BD800, 0xF39CC100, 0x77BDE800,
+		0x7BDEF000, 0xFFFFD900, 0x04212100, 0x80000800, 0x8C631000, 0x08423900,
+		0x94A52000, 0x10840900, 0x1CE71100, 0x98C63800, 0xA5294000, 0x21086900,
+		0x2D6B7100, 0xA94A5800, 0x35AD4100, 0xB18C6800, 0xBDEF7000, 0x39CE5900,
+		0xC6318000, 0x4210A900, 0x4E73B100, 0xCA529800, 0x56B58100, 0xD294A800,
+		0xDEF7B000, 0x5AD69900, 0x6739E100, 0xE318C800, 0xEF7BD000, 0x6B5AF900,
+		0xF7BDE000, 0x739CC900, 0x7FFFD100, 0xFBDEF800, 0x08424200, 0x8C636B00,
+		0x80007300, 0x04215A00, 0x98C64300, 0x1CE76A00, 0x10847200, 0x94A55B00,
+		0xA94A2300, 0x2D6B0A00, 0x21081200, 0xA5293B00, 0x39CE2200, 0xBDEF0B00,
+		0xB18C1300, 0x35AD3A00, 0xCA52E300, 0x4E73CA00, 0x4210D200, 0xC631FB00,
+		0x5AD6E200, 0xDEF7CB00, 0xD294D300, 0x56B5FA00, 0x6B5A8200, 0xEF7BAB00,
+		0xE318B300, 0x67399A00, 0xFBDE8300, 0x7FFFAA00, 0x739CB200, 0xF7BD9B00,
+		0x0C636300, 0x88424A00, 0x84215200, 0x00007B00, 0x9CE76200, 0x18C64B00,
+		0x14A55300, 0x90847A00, 0xAD6B0200, 0x294A2B00, 0x25293300, 0xA1081A00,
+		0x3DEF0300, 0xB9CE2A00, 0xB5AD3200, 0x318C1B00, 0xCE73C200, 0x4A52EB00,
+		0x4631F300, 0xC210DA00, 0x5EF7C300, 0xDAD6EA00, 0xD6B5F200, 0x5294DB00,
+		0x6F7BA300, 0xEB5A8A00, 0xE7399200, 0x6318BB00, 0xFFFFA200, 0x7BDE8B00,
+		0x77BD9300, 0xF39CBA00, 0x10848400, 0x94A5AD00, 0x98C6B500, 0x1CE79C00,
+		0x80008500, 0x0421AC00, 0x0842B400, 0x8C639D00, 0xB18CE500, 0x35ADCC00,
+		0x39CED400, 0xBDEFFD00, 0x2108E400, 0xA529CD00, 0xA94AD500, 0x2D6BFC00,
+		0xD2942500, 0x56B50C00, 0x5AD61400, 0xDEF73D00, 0x42102400, 0xC6310D00,
+		0xCA521500, 0x4E733C00, 0x739C4400, 0xF7BD6D00, 0xFBDE7500, 0x7FFF5C00,
+		0xE3184500, 0x67396C00, 0x6B5A7400, 0xEF7B5D00, 0x14A5A500, 0x90848C00,
+		0x9CE79400, 0x18C6BD00, 0x8421A400, 0x00008D00, 0x0C639500, 0x8842BC00,
+		0xB5ADC400, 0x318CED00, 0x3DEFF500, 0xB9CEDC00, 0x2529C500, 0xA108EC00,
+		0xAD6BF400, 0x294ADD00, 0xD6B50400, 0x52942D00, 0x5EF73500, 0xDAD61C00,
+		0x46310500, 0xC2102C00, 0xCE733400, 0x4A521D00, 0x77BD6500, 0xF39C4C00,
+		0xFFFF5400, 0x7BDE7D00, 0xE7396400, 0x63184D00, 0x6F7B5500, 0xEB5A7C00,
+		0x18C6C600, 0x9CE7EF00, 0x9084F700, 0x14A5DE00, 0x8842C700, 0x0C63EE00,
+		0x0000F600, 0x8421DF00, 0xB9CEA700, 0x3DEF8E00, 0x318C9600, 0xB5ADBF00,
+		0x294AA600, 0xAD6B8F00, 0xA1089700, 0x2529BE00, 0xDAD66700, 0x5EF74E00,
+		0x52945600, 0xD6B57F00, 0x4A526600, 0xCE734F00, 0xC2105700, 0x46317E00,
+		0x7BDE0600, 0xFFFF2F00, 0xF39C3700, 0x77BD1E00, 0xEB5A0700, 0x6F7B2E00,
+		0x63183600, 0xE7391F00, 0x1CE7E700, 0x98C6CE00, 0x94A5D600, 0x1084FF00,
+		0x8C63E600, 0x0842CF00, 0x0421D700, 0x8000FE00, 0xBDEF8600, 0x39CEAF00,
+		0x35ADB700, 0xB18C9E00, 0x2D6B8700, 0xA94AAE00, 0xA529B600, 0x21089F00,
+		0xDEF74600, 0x5AD66F00, 0x56B57700, 0xD2945E00, 0x4E734700, 0xCA526E00,
+		0xC6317600, 0x42105F00, 0x7FFF2700, 0xFBDE0E00, 0xF7BD1600, 0x739C3F00,
+		0xEF7B2600, 0x6B5A0F00, 0x67391700, 0xE3183E00
+	},
+	{
+		0x00000000, 0x21090800, 0x42121000, 0x631B1800, 0x84242000, 0xA52D2800,
+		0xC6363000, 0xE73F3800, 0x88482300, 0xA9412B00, 0xCA5A3300, 0xEB533B00,
+		0x0C6C0300, 0x2D650B00, 0x4E7E1300, 0x6F771B00, 0x90902500, 0xB1992D00,
+		0xD2823500, 0xF38B3D00, 0x14B40500, 0x35BD0D00, 0x56A61500, 0x77AF1D00,
+		0x18D80600, 0x39D10E00, 0x5ACA1600, 0x7BC31E00, 0x9CFC2600, 0xBDF52E00,
+		0xDEEE3600, 0xFFE73E00, 0xA1202900, 0x80292100, 0xE3323900, 0xC23B3100,
+		0x25040900, 0x040D0100, 0x67161900, 0x461F1100, 0x29680A00, 0x08610200,
+		0x6B7A1A00, 0x4A731200, 0xAD4C2A00, 0x8C452200, 0xEF5E3A00, 0xCE573200,
+		0x31B00C00, 0x10B90400, 0x73A21C00, 0x52AB1400, 0xB5942C00, 0x949D2400,
+		0xF7863C00, 0xD68F3400, 0xB9F82F00, 0x98F12700, 0xFBEA3F00, 0xDAE33700,
+		0x3DDC0F00, 0x1CD50700, 0x7FCE1F00, 0x5EC71700, 0xC2403100, 0xE3493900,
+		0x80522100, 0xA15B2900, 0x46641100, 0x676D1900, 0x04760100, 0x257F0900,
+		0x4A081200, 0x6B011A00, 0x081A0200, 0x29130A00, 0xCE2C3200, 0xEF253A00,
+		0x8C3E2200, 0xAD372A00, 0x52D01400, 0x73D91C00, 0x10C20400, 0x31CB0C00,
+		0xD6F43400, 0xF7FD3C00, 0x94E62400, 0xB5EF2C00, 0xDA983700, 0xFB913F00,
+		0x988A2700, 0xB9832F00, 0x5EBC1700, 0x7FB51F00, 0x1CAE0700, 0x3DA70F00,
+		0x63601800, 0x42691000, 0x21720800, 0x007B0000, 0xE7443800, 0xC64D3000,
+		0xA5562800, 0x845F2000, 0xEB283B00, 0xCA213300, 0xA93A2B00, 0x88332300,
+		0x6F0C1B00, 0x4E051300, 0x2D1E0B00, 0x0C170300, 0xF3F03D00, 0xD2F93500,
+		0xB1E22D00, 0x90EB2500, 0x77D41D00, 0x56DD1500, 0x35C60D00, 0x14CF0500,
+		0x7BB81E00, 0x5AB11600, 0x39AA0E00, 0x18A30600, 0xFF9C3E00, 0xDE953600,
+		0xBD8E2E00, 0x9C872600, 0x04800100, 0x25890900, 0x46921100, 0x679B1900,
+		0x80A42100, 0xA1AD2900, 0xC2B63100, 0xE3BF3900, 0x8CC82200, 0xADC12A00,
+		0xCEDA3200, 0xEFD33A00, 0x08EC0200, 0x29E50A00, 0x4AFE1200, 0x6BF71A00,
+		0x94102400, 0xB5192C00, 0xD6023400, 0xF70B3C00, 0x10340400, 0x313D0C00,
+		0x52261400, 0x732F1C00, 0x1C580700, 0x3D510F00, 0x5E4A1700, 0x7F431F00,
+		0x987C2700, 0xB9752F00, 0xDA6E3700, 0xFB673F00, 0xA5A02800, 0x84A92000,
+		0xE7B23800, 0xC6BB3000, 0x21840800, 0x008D0000, 0x63961800, 0x429F1000,
+		0x2DE80B00, 0x0CE10300, 0x6FFA1B00, 0x4EF31300, 0xA9CC2B00, 0x88C52300,
+		0xEBDE3B00, 0xCAD73300, 0x35300D00, 0x14390500, 0x77221D00, 0x562B1500,
+		0xB1142D00, 0x901D2500, 0xF3063D00, 0xD20F3500, 0xBD782E00, 0x9C712600,
+		0xFF6A3E00, 0xDE633600, 0x395C0E00, 0x18550600, 0x7B4E1E00, 0x5A471600,
+		0xC6C03000, 0xE7C93800, 0x84D22000, 0xA5DB2800, 0x42E41000, 0x63ED1800,
+		0x00F60000, 0x21FF0800, 0x4E881300, 0x6F811B00, 0x0C9A0300, 0x2D930B00,
+		0xCAAC3300, 0xEBA53B00, 0x88BE2300, 0xA9B72B00, 0x56501500, 0x77591D00,
+		0x14420500, 0x354B0D00, 0xD2743500, 0xF37D3D00, 0x90662500, 0xB16F2D00,
+		0xDE183600, 0xFF113E00, 0x9C0A2600, 0xBD032E00, 0x5A3C1600, 0x7B351E00,
+		0x182E0600, 0x39270E00, 0x67E01900, 0x46E91100, 0x25F20900, 0x04FB0100,
+		0xE3C43900, 0xC2CD3100, 0xA1D62900, 0x80DF2100, 0xEFA83A00, 0xCEA13200,
+		0xADBA2A00, 0x8CB32200, 0x6B8C1A00, 0x4A851200, 0x299E0A00, 0x08970200,
+		0xF7703C00, 0xD6793400, 0xB5622C00, 0x946B2400, 0x73541C00, 0x525D1400,
+		0x31460C00, 0x104F0400, 0x7F381F00, 0x5E311700, 0x3D2A0F00, 0x1C230700,
+		0xFB1C3F00, 0xDA153700, 0xB90E2F00, 0x98072700
+	}
+};
+
+
+/* Run bytes through a 24 bit CRC, eight at a time while there are enough */
+
+static unsigned int crc_table_update(unsigned int crc, const unsigned char *ptr, unsigned int sz)
+{
+	unsigned int	reg = (crc & 0xFFFFFF) << 8;
+	unsigned int	one, two;
+
+	while (sz >= 8)
+	{
+		one = reg ^ (((unsigned int)ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3]);
+		two = ((unsigned int)ptr[4] << 24) | (ptr[5] << 16) | (ptr[6] << 8) | ptr[7];
+
+		reg = crc_table[7][one >> 24] ^ crc_table[6][(one >> 16) & 0xFF] ^
+			crc_table[5][(one >> 8) & 0xFF] ^ crc_table[4][one & 0xFF] ^
+			crc_table[3][two >> 24] ^ crc_table[2][(two >> 16) & 0xFF] ^
+			crc_table[1][(two >> 8) & 0xFF] ^ crc_table[0][two & 0xFF];
+
+		ptr += 8;
+		sz -= 8;
+	}
+
+	while (sz-- > 0)
+	{
+		reg = (reg << 8) ^ crc_table[0][(reg >> 24) ^ *(ptr++)];
+	}
+
+	return reg >> 8;
+}
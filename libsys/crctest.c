@@ -0,0 +1,198 @@
+/********************************************************************
+ * $Id$
+ *
+ * Checks the table driven OS-9 module CRC against the original
+ * byte at a time routine, and measures how fast each one runs.
+ *
+ * crctest        compare the two on random buffers
+ * crctest -b     report the throughput of each
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <cocopath.h>
+#include <cocotypes.h>
+#include <os9module.h>
+
+
+#define TEST_RUNS		200000
+#define TEST_MAX_SIZE	4096
+#define BENCH_SIZE		(1024 * 1024)
+#define BENCH_SECONDS	1.0
+
+
+/* The CRC as _os9_crc_compute worked it out before the tables */
+
+static error_code crc_reference(u_char *ptr, u_int sz, u_char *crc)
+{
+	error_code	ec = 0;
+	u_char  a;
+	u_int   i;
+
+	for (i = 0; i < sz; i++)
+	{
+		a = *(ptr++);
+
+		a ^= crc[0];
+		crc[0] = crc[1];
+		crc[1] = crc[2];
+		crc[1] ^= (a >> 7);
+		crc[2] = (a << 1);
+		crc[1] ^= (a >> 2);
+		crc[2] ^= (a << 6);
+		a ^= (a << 1);
+		a ^= (a << 2);
+		a ^= (a << 4);
+
+		if (a & 0x80)
+		{
+			crc[0] ^= 0x80;
+			crc[2] ^= 0x21;
+		}
+	}
+
+	if ((crc[0] == OS9_CRC0) &&
+		(crc[1] == OS9_CRC1) &&
+		(crc[2] == OS9_CRC2))
+	{
+		ec = 1;
+	}
+
+	return ec;
+}
+
+
+
+/* Compare the two on random buffers, lengths, alignments and starting CRCs */
+
+static int crc_test(void)
+{
+	u_char	*buffer;
+	u_char	want[3], got[3];
+	u_int	run, sz, offset, i;
+	error_code	want_ec, got_ec;
+	int		failures = 0;
+
+	if ((buffer = malloc(TEST_MAX_SIZE + 8)) == NULL)
+	{
+		fprintf(stderr, "crctest: out of memory\n");
+		return 1;
+	}
+
+	srand(6809);
+
+	for (run = 0; run < TEST_RUNS; run++)
+	{
+		sz = rand() % (run < 1000 ? 64 : TEST_MAX_SIZE + 1);
+		offset = rand() % 8;
+
+		for (i = 0; i < sz; i++)
+		{
+			buffer[offset + i] = rand() & 0xFF;
+		}
+
+		if (run % 2 == 0)
+		{
+			want[0] = want[1] = want[2] = 0xFF;
+		}
+		else
+		{
+			want[0] = rand() & 0xFF;
+			want[1] = rand() & 0xFF;
+			want[2] = rand() & 0xFF;
+		}
+		memcpy(got, want, sizeof(got));
+
+		want_ec = crc_reference(buffer + offset, sz, want);
+		got_ec = _os9_crc_compute(buffer + offset, sz, got);
+
+		if (memcmp(want, got, sizeof(got)) != 0 || want_ec != got_ec)
+		{
+			fprintf(stderr, "crctest: run %u, %u bytes: expected %02X%02X%02X, got %02X%02X%02X\n",
+				run, sz, want[0], want[1], want[2], got[0], got[1], got[2]);
+
+			if (++failures == 10)
+			{
+				break;
+			}
+		}
+	}
+
+	free(buffer);
+
+	if (failures > 0)
+	{
+		return 1;
+	}
+
+	printf("crctest: %u random buffers agree\n", TEST_RUNS);
+
+	return 0;
+}
+
+
+
+/* Time one routine over a buffer for about BENCH_SECONDS */
+
+static double crc_time(error_code (*compute)(u_char *, u_int, u_char *), u_char *buffer)
+{
+	u_char	crc[3] = {0xFF, 0xFF, 0xFF};
+	clock_t	start = clock();
+	double	seconds;
+	u_int	rounds = 0;
+
+	do
+	{
+		compute(buffer, BENCH_SIZE, crc);
+		rounds++;
+		seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	} while (seconds < BENCH_SECONDS);
+
+	return (double)rounds * BENCH_SIZE / (1024 * 1024) / seconds;
+}
+
+
+
+static int crc_bench(void)
+{
+	u_char	*buffer;
+	double	before, after;
+	u_int	i;
+
+	if ((buffer = malloc(BENCH_SIZE)) == NULL)
+	{
+		fprintf(stderr, "crctest: out of memory\n");
+		return 1;
+	}
+
+	srand(6809);
+	for (i = 0; i < BENCH_SIZE; i++)
+	{
+		buffer[i] = rand() & 0xFF;
+	}
+
+	before = crc_time(crc_reference, buffer);
+	after = crc_time(_os9_crc_compute, buffer);
+
+	printf("byte at a time: %8.1f MB/s\n", before);
+	printf("table driven:   %8.1f MB/s (%.1fx)\n", after, after / before);
+
+	free(buffer);
+
+	return 0;
+}
+
+
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "-b") == 0)
+	{
+		return crc_bench();
+	}
+
+	return crc_test();
+}
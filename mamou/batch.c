@@ -0,0 +1,461 @@
+/***************************************************************************
+* batch.c: assemble a list of modules
+*
+* $Id$
+*
+* The Mamou Assembler - A Hitachi 6309 assembler
+*
+* An argument of the form @<file> names a module list.  Each line of the
+* list holds the arguments for one module, which are added after the
+* options given on the command line.  Every module is assembled in this
+* process with an assembler state of its own, so no state carries over
+* from one module to the next; with -j<n>, up to n modules are assembled
+* at once on worker threads.  The output of each module is held back and
+* shown in list order.
+*
+* The modules share the source cache, so a file that several of them use
+* is read from disk once.  The mnemonic table is shared the same way.
+***************************************************************************/
+
+#include <pthread.h>
+#include "mamou.h"
+
+
+/* one module of the batch */
+struct batch_module
+{
+	char			*name;		/* the line of the list it came from */
+	int				argc;
+	char			**argv;
+	FILE			*out;		/* held standard output */
+	FILE			*err;		/* held standard error */
+	int				done;
+	int				failed;
+};
+
+
+struct batch
+{
+	int					count;
+	int					max;
+	struct batch_module	*module;
+	int					num_common;
+	char				**common;	/* arguments given to every module */
+	int					next;		/* next module to assemble */
+	int					hold;		/* hold each module's output */
+	pthread_mutex_t		lock;		/* guards next and the done flags */
+	pthread_cond_t		finished;	/* signalled as each module finishes */
+};
+
+
+/*!
+	@function batch_split
+	@discussion Splits a line of a module list into arguments.
+	@discussion Arguments are separated by white space, and may be
+	@discussion enclosed in double quotes.
+	@param line The line, which is modified
+	@param args Set to the array of arguments
+	@result the number of arguments
+ */
+static int batch_split(char *line, char ***args)
+{
+	char	**list = NULL;
+	int		count = 0, max = 0;
+	char	*p = line, *q;
+
+	while (1)
+	{
+		while (isspace((unsigned char)*p))
+		{
+			p++;
+		}
+
+		if (*p == EOS)
+		{
+			break;
+		}
+
+		if (count == max)
+		{
+			max = max == 0 ? 8 : max * 2;
+
+			list = (char **)realloc(list, max * sizeof(char *));
+			if (list == NULL)
+			{
+				fatal("Out of memory");
+			}
+		}
+
+		list[count++] = q = p;
+
+		while (*p != EOS && !isspace((unsigned char)*p))
+		{
+			if (*p == '"')
+			{
+				p++;
+
+				while (*p != EOS && *p != '"')
+				{
+					*q++ = *p++;
+				}
+
+				if (*p == '"')
+				{
+					p++;
+				}
+			}
+			else
+			{
+				*q++ = *p++;
+			}
+		}
+
+		if (*p != EOS)
+		{
+			p++;
+		}
+
+		*q = EOS;
+	}
+
+	*args = list;
+
+	return count;
+}
+
+
+/*!
+	@function batch_read
+	@discussion Adds the modules in a list file to the batch.
+	@discussion Blank lines and lines starting with '#' or '*' are skipped.
+	@param b The batch
+	@param argv0 The name the assembler was run as
+	@param list The name of the list file
+	@result 0 on success, 1 if the list can't be read
+ */
+static int batch_read(struct batch *b, char *argv0, char *list)
+{
+	FILE	*fp;
+	char	line[4 * MAXBUF];
+
+	fp = fopen(list, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "mamou: can't open module list %s\n", list);
+
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		struct batch_module	*m;
+		char				*name, **args;
+		int					i, count;
+
+		line[strcspn(line, "\r\n")] = EOS;
+
+		name = line;
+		while (isspace((unsigned char)*name))
+		{
+			name++;
+		}
+
+		if (*name == EOS || *name == '#' || *name == '*')
+		{
+			continue;
+		}
+
+		if (b->count == b->max)
+		{
+			b->max = b->max == 0 ? 64 : b->max * 2;
+
+			b->module = (struct batch_module *)realloc(b->module, b->max * sizeof(struct batch_module));
+			if (b->module == NULL)
+			{
+				fatal("Out of memory");
+			}
+		}
+
+		m = &b->module[b->count++];
+		memset(m, 0, sizeof(struct batch_module));
+
+		m->name = strdup(name);
+		if (m->name == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		count = batch_split(name, &args);
+
+		/* The assembler's name, the common arguments, then the module's own. */
+		m->argv = (char **)malloc((1 + b->num_common + count + 1) * sizeof(char *));
+		if (m->argv == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		m->argv[m->argc++] = argv0;
+
+		for (i = 0; i < b->num_common; i++)
+		{
+			m->argv[m->argc++] = b->common[i];
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			m->argv[m->argc++] = strdup(args[i]);
+		}
+
+		m->argv[m->argc] = NULL;
+
+		free(args);
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+
+/*!
+	@function batch_free
+	@discussion Frees the modules of a batch
+	@param b The batch
+ */
+static void batch_free(struct batch *b)
+{
+	int		i, j;
+
+	/* A module's own arguments follow the assembler's name and the common ones. */
+	for (i = 0; i < b->count; i++)
+	{
+		struct batch_module	*m = &b->module[i];
+
+		for (j = 1 + b->num_common; j < m->argc; j++)
+		{
+			free(m->argv[j]);
+		}
+
+		free(m->argv);
+		free(m->name);
+	}
+
+	free(b->module);
+	free(b->common);
+}
+
+
+/*!
+	@function batch_show
+	@discussion Copies held output to a stream and closes it
+	@param fp The held output, or NULL
+	@param to The stream to copy it to
+ */
+static void batch_show(FILE *fp, FILE *to)
+{
+	char	buffer[4096];
+	size_t	n;
+
+	if (fp == NULL)
+	{
+		return;
+	}
+
+	rewind(fp);
+
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+	{
+		fwrite(buffer, 1, n, to);
+	}
+
+	fclose(fp);
+
+	fflush(to);
+}
+
+
+/*!
+	@function batch_worker
+	@discussion Assembles modules of the batch until none are left.
+	@discussion If a module's output can't be held it is written out as
+	@discussion it is produced.
+	@param arg The batch
+ */
+static void *batch_worker(void *arg)
+{
+	struct batch	*b = (struct batch *)arg;
+
+	pthread_mutex_lock(&b->lock);
+
+	while (b->next < b->count)
+	{
+		struct batch_module	*m = &b->module[b->next++];
+		FILE				*out = stdout;
+		FILE				*err = stderr;
+		int					ret;
+
+		pthread_mutex_unlock(&b->lock);
+
+		if (b->hold)
+		{
+			m->out = tmpfile();
+			m->err = tmpfile();
+
+			if (m->out != NULL && m->err != NULL)
+			{
+				out = m->out;
+				err = m->err;
+			}
+		}
+
+		ret = mamou_run(m->argc, m->argv, out, err);
+
+		pthread_mutex_lock(&b->lock);
+		m->failed = ret != 0;
+		m->done = 1;
+		pthread_cond_broadcast(&b->finished);
+	}
+
+	pthread_mutex_unlock(&b->lock);
+
+	return NULL;
+}
+
+
+/*!
+	@function mamou_batch
+	@discussion Assembles the modules in the lists named on the command line
+	@param argc argument count
+	@param argv argument vector
+	@result 0 if every module assembled, else 1
+ */
+int mamou_batch(int argc, char **argv)
+{
+	struct batch	b;
+	pthread_t		*threads = NULL;
+	int				i, jobs = 1, started = 0, failed = 0;
+
+	memset(&b, 0, sizeof(b));
+
+	b.common = (char **)malloc(argc * sizeof(char *));
+	if (b.common == NULL)
+	{
+		fatal("Out of memory");
+	}
+
+	/* 1. Sort out the job count and the arguments every module gets. */
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-' && argv[i][1] == 'j')
+		{
+			if (argv[i][2] != EOS)
+			{
+				jobs = atoi(&argv[i][2]);
+			}
+			else
+			{
+#ifdef _SC_NPROCESSORS_ONLN
+				jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+			}
+		}
+		else if (argv[i][0] != '@')
+		{
+			b.common[b.num_common++] = argv[i];
+		}
+	}
+
+	/* 2. Read the module lists. */
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '@' && batch_read(&b, argv[0], &argv[i][1]) != 0)
+		{
+			batch_free(&b);
+
+			return 1;
+		}
+	}
+
+	if (jobs > b.count)
+	{
+		jobs = b.count;
+	}
+
+	if (jobs < 1)
+	{
+		jobs = 1;
+	}
+
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.finished, NULL);
+
+	/* 3. With more than one job the modules are assembled on worker
+	   threads, while this one shows their output in list order. */
+	b.hold = jobs > 1;
+
+	if (b.hold)
+	{
+		threads = (pthread_t *)malloc(jobs * sizeof(pthread_t));
+		if (threads == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		while (started < jobs && pthread_create(&threads[started], NULL, batch_worker, &b) == 0)
+		{
+			started++;
+		}
+	}
+
+	if (started == 0)
+	{
+		b.hold = 0;
+		batch_worker(&b);
+	}
+
+	pthread_mutex_lock(&b.lock);
+
+	for (i = 0; i < b.count; i++)
+	{
+		struct batch_module	*m = &b.module[i];
+
+		while (!m->done)
+		{
+			pthread_cond_wait(&b.finished, &b.lock);
+		}
+
+		pthread_mutex_unlock(&b.lock);
+
+		batch_show(m->out, stdout);
+		batch_show(m->err, stderr);
+
+		if (m->failed)
+		{
+			failed++;
+		}
+
+		pthread_mutex_lock(&b.lock);
+	}
+
+	pthread_mutex_unlock(&b.lock);
+
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+
+	if (failed != 0)
+	{
+		fflush(stdout);
+		fprintf(stderr, "mamou: %d of %d modules failed\n", failed, b.count);
+	}
+
+	batch_free(&b);
+
+	pthread_cond_destroy(&b.finished);
+	pthread_mutex_destroy(&b.lock);
+
+	return failed != 0 ? 1 : 0;
+}
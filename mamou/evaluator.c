@@ -48,11 +48,6 @@ static int compute(int left, char op, int right);
 static char getop(char **eptr);
 
 
-/* Static variables */
-static int forward = 0;
-
-
-
 /*!
 	@function evaluate
 	@discussion Evaluates mathematical expressions and symbols
@@ -69,7 +64,7 @@ int evaluate(assembler *as, int *result, char **eptr, int ignoreUndefined)
 	/* show any debugging output. */
 	if (as->o_debug)
 	{
-		printf("Evaluating %s\n", *eptr);
+		fprintf(as->out, "Evaluating %s\n", *eptr);
 	}	
 	
 	/* assume no forcing of result size for this line */
@@ -99,9 +94,9 @@ int evaluate(assembler *as, int *result, char **eptr, int ignoreUndefined)
 	/* print debugging information if requested */
 	if (as->o_debug)
 	{
-		printf("Result     $%x\n", (int)*result);
-		printf("force_byte %d\n", as->line.force_byte);
-		printf("force_word %d\n", as->line.force_word);
+		fprintf(as->out, "Result     $%x\n", (int)*result);
+		fprintf(as->out, "force_byte %d\n", as->line.force_byte);
+		fprintf(as->out, "force_word %d\n", as->line.force_word);
 	}
 
 	return retval;
@@ -129,7 +124,7 @@ static int expr(assembler *as, int *result, char **eptr, int ignoreUndefined)
 	while (**eptr)
 	{
 		/* pickup term part of expression */
-		if ((term(as, &value, eptr, ignoreUndefined) == 0) && (forward == 0))
+		if ((term(as, &value, eptr, ignoreUndefined) == 0) && (as->eval_forward == 0))
 		{
 			value = 0;
 		}
@@ -235,7 +230,7 @@ static int term(assembler *as, int *result, char **eptr, int ignoreUndefined)
 	struct nlist	*pointer;
 	struct link		*pnt, *bpnt;
 
-	forward = 0;
+	as->eval_forward = 0;
 
 	/* if we encounter end of string, something's wrong */
 	if (!**eptr)
@@ -406,6 +401,8 @@ static int term(assembler *as, int *result, char **eptr, int ignoreUndefined)
 
 		pointer = symbol_find(as, hold, ignoreUndefined);
 
+		precomp_lookup(as, hold, pointer);
+
 		if (pointer != NULL)
 		{
 			/* SYMBOL FOUND! */
@@ -463,7 +460,7 @@ static int term(assembler *as, int *result, char **eptr, int ignoreUndefined)
 					force_word = 1;
 				}
 #endif
-				forward = 1;
+				as->eval_forward = 1;
 				*result = 0;
 
 				return 0;
@@ -10,31 +10,24 @@
 
 #include "mamou.h"
 
-coco_path_id	forward_path;		/* temp file's file descriptor	*/
-
-char	fwd_name[] = { "fwd_refs" } ;
+/*
+ * Forward references used to go to a "fwd_refs" file in the current
+ * directory.  They are kept with the assembler state instead, so that
+ * several assemblies can run side by side in one directory.  The list
+ * is read and written like the file was: pass 2 reads it in order, and
+ * a forward reference marked in pass 2 replaces the entry at the read
+ * position.
+ */
 
 /*!
 	@function fwd_init
-	@discussion Initializes the forward reference file
+	@discussion Initializes the forward reference list
 	@param as The assembler state structure
  */
 void fwd_init(assembler *as)
 {
-	coco_file_stat fstat;
-	
-	fstat.perms = FAP_READ | FAP_WRITE;
-	if (_coco_create(&forward_path, fwd_name, FAM_READ | FAM_WRITE, &fstat) != 0)
-	{
-		fatal("Cannot create forward reference file.");
-	}
-
-	_coco_close(forward_path); /* close and reopen for reads and writes */
-
-	if (_coco_open(&forward_path, fwd_name, FAM_READ | FAM_WRITE) != 0)
-	{
-		fatal("Cannot open forward reference file.");
-	}
+	as->fwd_count = 0;
+	as->fwd_position = 0;
 
 	return;
 }
@@ -42,14 +35,17 @@ void fwd_init(assembler *as)
 
 /*!
 	@function fwd_deinit
-	@discussion Deinitializes the forward reference file
+	@discussion Deinitializes the forward reference list
 	@param as The assembler state structure
  */
 void fwd_deinit(assembler *as)
 {
-	_coco_close(forward_path);
+	free(as->fwd_refs);
 
-	_coco_delete(fwd_name);
+	as->fwd_refs = NULL;
+	as->fwd_count = 0;
+	as->fwd_max = 0;
+	as->fwd_position = 0;
 
 	return;
 }
@@ -57,29 +53,27 @@ void fwd_deinit(assembler *as)
 
 /*!
 	@function fwd_reinit
-	@discussion Reinitializes the forward reference file
+	@discussion Reinitializes the forward reference list
 	@param as The assembler state structure
  */
 void fwd_reinit(assembler *as)
 {
-	u_int			size;
-	
 	as->F_ref   = 0;
 	as->Ffn     = 0;
 
-	_coco_seek(forward_path, 0L, SEEK_SET);   /* rewind forward refs */
-
-	size = sizeof(as->Ffn);
-	
-	_coco_read(forward_path, (char *)&as->Ffn, &size);
+	as->fwd_position = 0;	/* rewind forward refs */
 
-	size = sizeof(as->F_ref);
-	
-	_coco_read(forward_path, (char *)&as->F_ref, &size); /* read first forward ref into mem */
+	if (as->fwd_count > 0)
+	{
+		/* read first forward ref into mem */
+		as->Ffn = as->fwd_refs[0].file;
+		as->F_ref = as->fwd_refs[0].line;
+		as->fwd_position = 1;
+	}
 
 	if (as->o_debug)
 	{
-		printf("First fwd ref: %d,%u\n", as->Ffn, (unsigned int)as->F_ref);
+		fprintf(as->out, "First fwd ref: %d,%u\n", as->Ffn, (unsigned int)as->F_ref);
 	}
 
 	return;
@@ -93,13 +87,31 @@ void fwd_reinit(assembler *as)
  */
 void fwd_mark(assembler *as)
 {
-	u_int		size;
-	
-	size = sizeof(as->current_filename_index);	
-	_coco_write(forward_path, (char *)&as->current_filename_index, &size);
+	if (as->fwd_position == as->fwd_max)
+	{
+		struct fwd_ref	*refs;
+		u_int			max;
+
+		max = as->fwd_max == 0 ? 256 : as->fwd_max * 2;
 
-	size = sizeof(as->current_file->current_line);
-	_coco_write(forward_path, (char *)&(as->current_file->current_line), &size);
+		refs = (struct fwd_ref *)realloc(as->fwd_refs, max * sizeof(struct fwd_ref));
+		if (refs == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		as->fwd_refs = refs;
+		as->fwd_max = max;
+	}
+
+	as->fwd_refs[as->fwd_position].file = as->current_filename_index;
+	as->fwd_refs[as->fwd_position].line = as->current_file->current_line;
+	as->fwd_position++;
+
+	if (as->fwd_position > as->fwd_count)
+	{
+		as->fwd_count = as->fwd_position;
+	}
 
 	return;
 }
@@ -112,25 +124,13 @@ void fwd_mark(assembler *as)
  */
 void fwd_next(assembler *as)
 {
-	u_int size;
-	
-	size = sizeof(as->Ffn);
-	_coco_read(forward_path, (char *)&as->Ffn, &size);
-
-	if (as->o_debug)
+	if (as->fwd_position < as->fwd_count)
 	{
-		printf("Ffn stat=%d ", size);
+		as->Ffn = as->fwd_refs[as->fwd_position].file;
+		as->F_ref = as->fwd_refs[as->fwd_position].line;
+		as->fwd_position++;
 	}
-
-	size = sizeof(as->F_ref);
-	 _coco_read(forward_path, (char *)&as->F_ref, &size);
-
-	if (as->o_debug)
-	{
-		printf("F_ref stat=%d  ", size);
-	}
-
-	if (size < 2)
+	else
 	{
 		as->F_ref = 0;
 		as->Ffn = 0;
@@ -138,7 +138,7 @@ void fwd_next(assembler *as)
 
 	if (as->o_debug)
 	{
-		printf("Next Fwd ref: %d,%u\n", as->Ffn, (unsigned int)as->F_ref);
+		fprintf(as->out, "Next Fwd ref: %d,%u\n", as->Ffn, (unsigned int)as->F_ref);
 	}
 
 	return;
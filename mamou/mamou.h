@@ -108,9 +108,54 @@ typedef enum _rma_sect
 } rma_sect;
 
 
+/* a source file read into memory */
+struct source
+{
+	struct source	*next;
+	char			*name;		/* path the file was opened with */
+	error_code		ec;			/* error opening the file, if any */
+	char			*text;		/* the lines, each ending in a NUL */
+	u_int			text_size;
+	u_int			*line;		/* offset of each line in text */
+	u_int			num_lines;
+};
+
+
+/* a line that referred to a symbol before its definition */
+struct fwd_ref
+{
+	u_int			file;		/* index of the file on the command line */
+	u_int			line;		/* line number within that file */
+};
+
+
+/* figures gathered for --stats */
+#define STATS_NONE	0
+#define STATS_TEXT	1
+#define STATS_JSON	2
+
+struct stats
+{
+	int				format;			/* STATS_NONE, STATS_TEXT or STATS_JSON */
+	double			start_wall;		/* when the current pass started */
+	double			start_cpu;
+	double			wall[3];		/* elapsed time of each pass */
+	double			cpu[3];			/* processor time of each pass */
+	u_int			lines[3];		/* lines assembled in each pass */
+	double			read_time;		/* time spent reading source files */
+	u_int			files_read;		/* source files read */
+	unsigned long	bytes_read;		/* bytes of source read */
+	unsigned long	lookups;		/* symbol table lookups */
+	unsigned long	inserts;		/* symbols added to a table */
+	unsigned long	probes;			/* table slots examined by lookups */
+	u_int			longest_probe;	/* most slots examined by one lookup */
+};
+
+
 struct filestack
 {
-	coco_path_id	fd;
+	struct source	*source;
+	u_int			next_line;	/* next line to read from source */
 	char			file[FNAMESIZE];
 	u_int			current_line;
 	int				num_blank_lines;
@@ -129,15 +174,45 @@ struct link
 
 struct nlist
 {	/* basic symbol table entry */
-	char			*name;
+	char			*name;		/* interned name */
+	u_int			hash;		/* hash of the name */
 	int				def;
 	int				overridable;
-	struct nlist	*Lnext;		/* left node of the tree leaf */
-	struct nlist	*Rnext;		/* right node of the tree leaf */ 
+	u_int			serial;		/* order in which the symbol was defined */
 	struct link		*L_list;	/* pointer to linked list of line numbers */
 };
 
 
+/* open addressing symbol table, keyed by interned name */
+struct symtab
+{
+	struct nlist	**slot;		/* NULL until the first insert */
+	u_int			size;		/* number of slots, a power of two */
+	u_int			count;		/* number of symbols */
+};
+
+
+/* table of interned symbol names */
+struct namepool
+{
+	char			**slot;
+	u_int			size;
+	u_int			count;
+	char			*block;		/* current name storage block */
+	char			*avail;		/* next free byte in the block */
+	u_int			block_left;
+};
+
+
+/* temporary label scope, opened per file and at each blank line */
+struct tmpscope
+{
+	struct symtab	labels;
+	u_int			ordinal;	/* order of the scope within the pass */
+	struct tmpscope	*prev;		/* scope of the including file */
+};
+
+
 struct psect
 {
 	int		org;
@@ -275,6 +350,10 @@ typedef struct _assembler
 	char			*includes[INCSIZE];	
 	u_int			Ffn;						/* forward ref file #           */
 	u_int			F_ref;						/* next line with forward ref   */
+	struct fwd_ref	*fwd_refs;					/* forward references, in order */
+	u_int			fwd_count;
+	u_int			fwd_max;
+	u_int			fwd_position;				/* next forward ref to read or write */
 	char			**arguments;				/* pointer to file names        */
 	u_int			E_total;					/* total # bytes for one line   */
 	char			E_bytes[E_LIMIT + MAXBUF];  /* Emitted held bytes           */
@@ -315,6 +394,7 @@ typedef struct _assembler
 #define	CONDSTACKLEN	256
 	u_int			conditional_stack_index;
 	char			conditional_stack[CONDSTACKLEN];
+	char			conditional_pass[CONDSTACKLEN];	/* conditional tests the pass (ifp1/ifp2) */
 	int				o_do_parsing;
 	int				o_cpuclass;
 	u_int			code_bytes;					/* number of emitted code bytes */
@@ -322,24 +402,41 @@ typedef struct _assembler
 #define TTLLEN NAMLEN
 	u_char			name_header[NAMLEN];
 	u_char			title_header[TTLLEN];
-	struct nlist	*bucket;					/* root node of the tree */
+	struct symtab	bucket;						/* global symbols */
+	struct namepool	names;						/* interned symbol names */
+	struct tmpscope	*scope;						/* current temporary label scope */
+	u_int			scope_ordinal;				/* scopes opened so far this pass */
+	struct symtab	*scope_labels;				/* pass 1 temporary labels, by scope */
+	u_int			scope_count;
+	u_int			pass_only_depth;			/* depth of uses that only this pass makes */
+	u_int			symbol_serial;				/* symbols defined so far */
+	char			*precomp_dir;				/* precompiled definitions directory */
+	struct precomp	*precomp;					/* precompiled definitions state */
+	struct stats	stats;						/* figures for --stats */
 	struct psect	psect[256];
 	int				current_psect;
 	int				code_segment_start;
 	u_int			decb_exec_address;
 	int				newstyle;
 	int				pseudoUppercase;
+	int				eval_forward;				/* expression used a forward reference */
+	FILE			*out;						/* listing and report output */
+	FILE			*err;						/* diagnostics */
 } assembler;
 
 
 /* function prototypes */
 /* mamou.c */
 int main(int argc, char **argv);
+int mamou_run(int argc, char **argv, FILE *out, FILE *err);
 void mamou_pass(assembler *as);
 void mamou_parse_line(assembler *as, char *input_line);
 void process(assembler *as);
 void mamou_init_assembler(assembler *as);
 
+/* batch.c */
+int mamou_batch(int argc, char **argv);
+
 /* h6309.c */
 void local_init(void);
 
@@ -356,18 +453,43 @@ void fwd_mark(assembler *as);
 void fwd_next(assembler *as);
 void fwd_reinit(assembler *as);
 
+/* precomp.c */
+void precomp_init(assembler *as);
+void precomp_free(assembler *as);
+int precomp_use(assembler *as, char *path);
+void precomp_end(assembler *as);
+void precomp_line(assembler *as);
+void precomp_lookup(assembler *as, char *name, struct nlist *np);
+void precomp_redefine(assembler *as, struct nlist *np);
+void precomp_veto(assembler *as);
+
 /* print.c */
 void print_line(assembler *as, int override, char infochar, int counter);
 void print_summary(assembler *as);
 void print_header(assembler *as);
 void print_footer(assembler *as);
 
+/* source.c */
+error_code source_open(assembler *as, char *path, struct source **src);
+error_code source_readln(struct filestack *file, char *buffer);
+void source_free(void);
+
+/* stats.c */
+double stats_wall_time(void);
+double stats_cpu_time(void);
+void stats_pass_begin(assembler *as);
+void stats_pass_end(assembler *as);
+void stats_print(assembler *as);
+
 /* symbol_bucket.c */
 struct nlist *symbol_add(assembler *as, char *str, int val, int override);
 struct nlist *symbol_find(assembler *as, char *name, int);
 int mne_look(assembler *as, char *str, mnemonic *m);
-void symbol_dump_bucket(struct nlist *ptr, int type);
-void symbol_cross_reference(struct nlist *ptr);
+void symbol_dump_bucket(assembler *as, struct symtab *table, int type);
+void symbol_cross_reference(assembler *as, struct symtab *table);
+void symbol_scope_open(assembler *as);
+void symbol_scope_close(assembler *as);
+void symbol_free(assembler *as);
 
 /* util.c */
 char *extractfilename(char *pathlist);
@@ -392,6 +514,7 @@ int hiword(int i);
 int loword(int i);
 u_int hibyte(int i);
 int lobyte(int i);
+void local_time(time_t t, struct tm *tm);
 char mapdn(char c);
 char *skip_white(char *ptr);
 
@@ -14,8 +14,9 @@
 /* Static functions. */
 
 static int mamou_assemble(assembler *as);
-static void mamou_initialize(assembler *as);
+static int mamou_initialize(assembler *as);
 static void mamou_deinitialize(assembler *as);
+static int mamou_finish(assembler *as, int ret);
 
 char product_name[256];
 char product_copyright[256];
@@ -28,9 +29,53 @@ char product_copyright[256];
 	@param argv argument vector
  */
 int main(int argc, char **argv)
+{
+	int				j;
+	int				ret;
+
+	fprintf(stderr, "MAMOU IS DEPRECATED! USE LWTOOLS INSTEAD!!!\n");
+	sprintf(product_name, "The Mamou Assembler Version %02d.%02d",
+			VERSION_MAJOR, VERSION_MINOR);
+	
+	sprintf(product_copyright, "Copyright (C) 2004 Boisy G. Pitre");
+
+	/* A module list on the command line means a batch of assemblies. */
+	for (j = 1; j < argc; j++)
+	{
+		if (argv[j][0] == '@')
+		{
+			break;
+		}
+	}
+
+	if (j < argc)
+	{
+		ret = mamou_batch(argc, argv);
+	}
+	else
+	{
+		ret = mamou_run(argc, argv, stdout, stderr);
+	}
+
+	source_free();
+
+	return ret;
+}
+
+
+/*!
+	@function mamou_run
+	@discussion Parses the command line and assembles one module
+	@param argc argument count
+	@param argv argument vector
+	@param out Where the listing and reports go
+	@param err Where diagnostics go
+ */
+int mamou_run(int argc, char **argv, FILE *out, FILE *err)
 {
 	char			*p;
 	char			*i;
+	char			name[MAXBUF];
 	int				j = 0;
     int				v;
 	assembler		as;
@@ -39,52 +84,54 @@ int main(int argc, char **argv)
     as.arguments = argv;
 
     mamou_init_assembler(&as);
- 
-	fprintf(stderr, "MAMOU IS DEPRECATED! USE LWTOOLS INSTEAD!!!\n");
-	sprintf(product_name, "The Mamou Assembler Version %02d.%02d",
-			VERSION_MAJOR, VERSION_MINOR);
-	
-	sprintf(product_copyright, "Copyright (C) 2004 Boisy G. Pitre");
 
+	as.out = out;
+	as.err = err;
+ 
 	/* 2. Display help, if necessary. */	
 	if (argc < 2)
     {
-		fprintf(stderr, "%s\n", product_name);
-		fprintf(stderr, "%s\n", product_copyright);
-		fprintf(stderr, "\n");
-		fprintf(stderr, "General options:\n");
-        fprintf(stderr, " -D<sym>[=<val>] assign val to sym\n");
-        fprintf(stderr, " -d        debug mode\n");
-        fprintf(stderr, " -e        enhanced 6309 assembler mode\n");
-		fprintf(stderr, " -ee       enhanced 6309 and X9 assembler mode\n");
-        fprintf(stderr, " -I<dir>   additional include directories\n");
-        fprintf(stderr, " -p        don't assemble, just parse\n");
-        fprintf(stderr, " -q        quiet mode\n");
-        fprintf(stderr, " -x        suppress warnings and errors\n");
-        fprintf(stderr, " -y        include instruction cycle count\n");
-        fprintf(stderr, " -z        suppress conditionals in assembly list output\n");
-		fprintf(stderr, "Source listing options:\n");
-        fprintf(stderr, " -c        show symbol cross reference table\n");
-        fprintf(stderr, " -l        list file\n");
-        fprintf(stderr, " -ls       source only list (no line numbers)\n");
-        fprintf(stderr, " -ln       format source in 'new style' assembly\n");
-        fprintf(stderr, " -lt       use tabs instead of spaces\n");
-        fprintf(stderr, " -lu       force pseudo-ops to print in uppercase\n");
-        fprintf(stderr, " -np       suppress 'page' pseudo output\n");
-        fprintf(stderr, " -o<file>  output to file\n");
-        fprintf(stderr, " -s        show symbol table (multi-column format)\n");
-        fprintf(stderr, " -sa       show symbol table (assembler format)\n");
-		fprintf(stderr, "Assembler modes (select only one):\n");
-        fprintf(stderr, " -m9       OS-9/6809 (default)\n");
-        fprintf(stderr, " -mm       Microware RMA\n");
-        fprintf(stderr, " -mb       Disk BASIC (short form -b)\n");
-		fprintf(stderr, " -mr       ROM Absolute (short form -r)\n");
-		fprintf(stderr, "Object generation options (select only one):\n");
-        fprintf(stderr, " -tb       binary object output (default)\n");
-        fprintf(stderr, " -th       hex object output\n");
-        fprintf(stderr, " -ts       s-record object output\n");
-
-        exit(1);
+		fprintf(as.err, "%s\n", product_name);
+		fprintf(as.err, "%s\n", product_copyright);
+		fprintf(as.err, "\n");
+		fprintf(as.err, "General options:\n");
+        fprintf(as.err, " -D<sym>[=<val>] assign val to sym\n");
+        fprintf(as.err, " -d        debug mode\n");
+        fprintf(as.err, " -e        enhanced 6309 assembler mode\n");
+		fprintf(as.err, " -ee       enhanced 6309 and X9 assembler mode\n");
+        fprintf(as.err, " -I<dir>   additional include directories\n");
+        fprintf(as.err, " -j<n>     assemble up to n modules at once\n");
+        fprintf(as.err, " -p        don't assemble, just parse\n");
+        fprintf(as.err, " -P<dir>   keep precompiled definitions in dir\n");
+        fprintf(as.err, " -q        quiet mode\n");
+        fprintf(as.err, " -x        suppress warnings and errors\n");
+        fprintf(as.err, " -y        include instruction cycle count\n");
+        fprintf(as.err, " -z        suppress conditionals in assembly list output\n");
+        fprintf(as.err, " --stats   report timing and symbol table statistics\n");
+        fprintf(as.err, " --stats=json  the same, as JSON\n");
+        fprintf(as.err, " @<file>   assemble each module listed in file\n");
+		fprintf(as.err, "Source listing options:\n");
+        fprintf(as.err, " -c        show symbol cross reference table\n");
+        fprintf(as.err, " -l        list file\n");
+        fprintf(as.err, " -ls       source only list (no line numbers)\n");
+        fprintf(as.err, " -ln       format source in 'new style' assembly\n");
+        fprintf(as.err, " -lt       use tabs instead of spaces\n");
+        fprintf(as.err, " -lu       force pseudo-ops to print in uppercase\n");
+        fprintf(as.err, " -np       suppress 'page' pseudo output\n");
+        fprintf(as.err, " -o<file>  output to file\n");
+        fprintf(as.err, " -s        show symbol table (multi-column format)\n");
+        fprintf(as.err, " -sa       show symbol table (assembler format)\n");
+		fprintf(as.err, "Assembler modes (select only one):\n");
+        fprintf(as.err, " -m9       OS-9/6809 (default)\n");
+        fprintf(as.err, " -mm       Microware RMA\n");
+        fprintf(as.err, " -mb       Disk BASIC (short form -b)\n");
+		fprintf(as.err, " -mr       ROM Absolute (short form -r)\n");
+		fprintf(as.err, "Object generation options (select only one):\n");
+        fprintf(as.err, " -tb       binary object output (default)\n");
+        fprintf(as.err, " -th       hex object output\n");
+        fprintf(as.err, " -ts       s-record object output\n");
+
+        return 1;
     }
 
     /* 3. Parse command line for options */
@@ -116,8 +163,9 @@ int main(int argc, char **argv)
 
 						default:
 							/* Bad option */
-							fprintf(stderr, "Unknown option\n");
-							exit(1);
+							fprintf(as.err, "Unknown option\n");
+							symbol_free(&as);
+							return 1;
 					}
 					break;
 					
@@ -136,19 +184,22 @@ int main(int argc, char **argv)
 
                     if (*p != EOS)
                     {
-						i = p;
+						/* The arguments may be shared with other modules of a batch,
+						 * so the name is copied out rather than cut off in place.
+						 */
+						i = name;
 
-						while (*i != '=' && *i != '\0')
+						while (*p != '=' && *p != '\0' && i < name + sizeof(name) - 1)
 						{
-							i++;
+							*i++ = *p++;
 						}
 
-						/* Now i points to '=' or \0 */
-						if (*i == '=')
+						*i = '\0';
+
+						/* Now p points to '=' or \0 */
+						if (*p == '=')
 						{
-							*i = '\0';
-							i++;
-							v = atoi(i);
+							v = atoi(p + 1);
 						}
 						else
 						{
@@ -156,7 +207,7 @@ int main(int argc, char **argv)
 						}
 						
 						/* Add value */
-						symbol_add(&as, p, v, 0);
+						symbol_add(&as, name, v, 0);
 					}
                     break;
 					
@@ -165,6 +216,24 @@ int main(int argc, char **argv)
                     as.o_show_cross_reference = 1;
                     break;
 					
+                case '-':
+                    /* Long options */
+                    if (strcmp(&argv[j][2], "stats") == 0)
+                    {
+                        as.stats.format = STATS_TEXT;
+                    }
+                    else if (strcmp(&argv[j][2], "stats=json") == 0)
+                    {
+                        as.stats.format = STATS_JSON;
+                    }
+                    else
+                    {
+                        fprintf(as.err, "Unknown option\n");
+                        symbol_free(&as);
+                        return 0;
+                    }
+                    break;
+					
                 case 'd':
                     /* Debug mode */
                     as.o_debug = 1;
@@ -182,7 +251,7 @@ int main(int argc, char **argv)
                     if (as.include_index + 1 == INCSIZE)
                     {
                         /* Reached our capacity */
-						fprintf(stderr,"Include file limit exceeded\n");
+						fprintf(as.err,"Include file limit exceeded\n");
                         break;
                     }
                     p = &argv[j][2];
@@ -193,6 +262,10 @@ int main(int argc, char **argv)
                     as.includes[as.include_index++] = p;
                     break;
 					
+                case 'j':
+                    /* Job count, used by module lists */
+                    break;
+					
                 case 'l':
                     /* List file */
                     if (tolower(argv[j][2]) == 's')
@@ -235,6 +308,16 @@ int main(int argc, char **argv)
                     as.o_do_parsing = 0;
                     break;
 					
+                case 'P':
+                    /* Precompiled definitions directory */
+                    p = &argv[j][2];
+                    if (*p == '=')
+                    {
+                        p++;
+                    }
+                    as.precomp_dir = *p != EOS ? p : NULL;
+                    break;
+					
                 case 'q':
                     /* Quiet mode */
                     as.o_quiet_mode = 1;
@@ -268,7 +351,7 @@ int main(int argc, char **argv)
                     }
 					else
                     {
-						fprintf(stderr, "bad option\n");
+						fprintf(as.err, "bad option\n");
                     }
                     break;
 					
@@ -288,8 +371,9 @@ int main(int argc, char **argv)
                     
                 default:
                     /* Bad option */
-                    fprintf(stderr, "Unknown option\n");
-                    exit(0);
+                    fprintf(as.err, "Unknown option\n");
+                    symbol_free(&as);
+                    return 0;
             }
         }
         else if (as.file_index + 1 < MAXAFILE)
@@ -321,7 +405,12 @@ int mamou_assemble(assembler *as)
 	/* Initialize the assembler for the first pass. */
 	as->pass = 1;
 	
-    mamou_initialize(as);
+    if (mamou_initialize(as) != 0)
+	{
+		return mamou_finish(as, 1);
+	}
+
+	stats_pass_begin(as);
 
 	/* For each file we have to assemble... */
     for (as->current_filename_index = 0; as->current_filename_index < as->file_index; as->current_filename_index++)
@@ -332,24 +421,24 @@ int mamou_assemble(assembler *as)
 		as->current_file = &root_file;
 		
 		strncpy(root_file.file, as->file_name[as->current_filename_index], FNAMESIZE);
+		root_file.next_line = 0;
 		root_file.current_line = 0;
 		root_file.num_blank_lines = 0;
 		root_file.num_comment_lines = 0;
 		root_file.end_encountered = 0;
 		
 		/* Open a path to the file. */
-        if (_coco_open(&(root_file.fd), root_file.file, FAM_READ) != 0)
+        if (source_open(as, root_file.file, &root_file.source) != 0)
         {
-            printf("mamou: can't open %s\n", root_file.file);
+            fprintf(as->out, "mamou: can't open %s\n", root_file.file);
 
-            return 1;
+            return mamou_finish(as, 1);
         }
 
 		/* Make the first pass. */		
+		symbol_scope_open(as);
 		mamou_pass(as);
-
-		/* Close the file. */		
-		_coco_close(root_file.fd);
+		symbol_scope_close(as);
 		
 		/* Did we have more 'ifs' than 'endcs' ? */
 		if (as->conditional_stack_index != 0)
@@ -358,6 +447,8 @@ int mamou_assemble(assembler *as)
 		}
     }
 
+	stats_pass_end(as);
+
 	/* If the assembly pass above yielded no errors... */
     if (as->num_errors == 0)
     {
@@ -367,8 +458,13 @@ int mamou_assemble(assembler *as)
         as->pass++;
 		
 		/* Re-initialize the assembler. */
-        mamou_initialize(as);
+        if (mamou_initialize(as) != 0)
+		{
+			return mamou_finish(as, 1);
+		}
 		
+		stats_pass_begin(as);
+
 		/* Walk the file list again... */
         for (as->current_filename_index = 0; as->current_filename_index < as->file_index; as->current_filename_index++)
         {
@@ -378,24 +474,24 @@ int mamou_assemble(assembler *as)
 			as->current_file = &root_file;
 			
 			strncpy(root_file.file, as->file_name[as->current_filename_index], FNAMESIZE);
+			root_file.next_line = 0;
 			root_file.current_line = 0;
 			root_file.num_blank_lines = 0;
 			root_file.num_comment_lines = 0;
 			root_file.end_encountered = 0;
 			
 			/* Open a path to the file. */
-			if (_coco_open(&(root_file.fd), root_file.file, FAM_READ) != 0)
+			if (source_open(as, root_file.file, &root_file.source) != 0)
 			{
-				printf("mamou: can't open %s\n", root_file.file);
+				fprintf(as->out, "mamou: can't open %s\n", root_file.file);
 				
-				return 1;
+				return mamou_finish(as, 1);
 			}			
 			
 			/* Make the second pass. */
+			symbol_scope_open(as);
 			mamou_pass(as);			
-			
-			/* Close the file. */
-			_coco_close(root_file.fd);
+			symbol_scope_close(as);
         }		
 
 		if (as->o_asm_mode == ASM_DECB)
@@ -404,17 +500,19 @@ int mamou_assemble(assembler *as)
 			decb_trailer_emit(as, 0xEEAA);
 		}
 		
+		stats_pass_end(as);
+		
 		/* Do we show the symbol table? */		
         if (as->o_show_symbol_table != 0)
         {
-            symbol_dump_bucket(as->bucket, as->o_show_symbol_table);
+            symbol_dump_bucket(as, &as->bucket, as->o_show_symbol_table);
         }
         
         if (as->o_show_cross_reference == 1)
         {
-            printf("\f");
+            fprintf(as->out, "\f");
 			
-            symbol_cross_reference(as->bucket);
+            symbol_cross_reference(as, &as->bucket);
         }
 
         finish_outfile(as);
@@ -425,6 +523,31 @@ int mamou_assemble(assembler *as)
         print_summary(as);
     }
 
+    if (as->stats.format != STATS_NONE)
+    {
+        stats_print(as);
+    }
+
+	return mamou_finish(as, ret);
+}
+
+
+/*!
+	@function mamou_finish
+	@discussion Releases what an assembly holds, however far it got
+	@param as The assembler state structure
+	@param ret The exit status so far
+	@result the exit status of the assembly
+ */
+static int mamou_finish(assembler *as, int ret)
+{
+	/* An assembly that stopped early leaves the object file open. */
+	if (as->fd_object != NULL)
+	{
+		_coco_close(as->fd_object);
+		as->fd_object = NULL;
+	}
+
 	/* Terminate the forward reference file. */
     fwd_deinit(as);
 
@@ -447,12 +570,13 @@ int mamou_assemble(assembler *as)
 	@function mamou_initialize
 	@discussion Initialize the assembler for each pass
 	@param as The assembler state structure
+	@result 0 on success, 1 if the object file can't be created
  */
-static void mamou_initialize(assembler *as)
+static int mamou_initialize(assembler *as)
 {
     if (as->o_debug)
     {
-        printf("Initializing for pass %u\n", (unsigned int)as->pass);
+        fprintf(as->out, "Initializing for pass %u\n", (unsigned int)as->pass);
     }
 
 	if (as->pass == 1)
@@ -470,6 +594,8 @@ static void mamou_initialize(assembler *as)
 		as->Ctotal					= 0;
 		as->f_new_page				= 0;
 		as->use_depth				= 0;
+		as->scope_ordinal			= 0;
+		as->pass_only_depth			= 0;
 		
 		as->conditional_stack_index = 0;
 		as->conditional_stack[0]	= 1;
@@ -483,7 +609,9 @@ static void mamou_initialize(assembler *as)
 			if (_coco_create(&(as->fd_object), as->object_name,
 				FAM_READ | FAM_WRITE, &fstat) != 0)
 			{
-				fatal("Can't create object file");
+				fprintf(as->err, "Can't create object file\n");
+
+				return 1;
 			}
 			
 			/* This code sets the binary file type for Disk BASIC Files - tjl 8/8/2004 */
@@ -533,6 +661,8 @@ static void mamou_initialize(assembler *as)
 		as->Ctotal			= 0;
 		as->f_new_page		= 0;
 		as->use_depth		= 0;
+		as->scope_ordinal	= 0;
+		as->pass_only_depth	= 0;
 				
 		fwd_reinit(as);
 
@@ -541,7 +671,9 @@ static void mamou_initialize(assembler *as)
 //		as->conditional_stack[as->conditional_stack_index] = 1;
 	}
 
-    return;
+	precomp_init(as);
+
+    return 0;
 }
 
 
@@ -554,9 +686,12 @@ static void mamou_deinitialize(assembler *as)
 {
     if (as->o_debug)
     {
-        printf("Deinitializing\n");
+        fprintf(as->out, "Deinitializing\n");
     }
 
+	precomp_free(as);
+	symbol_free(as);
+
     return;
 }
 
@@ -568,24 +703,21 @@ static void mamou_deinitialize(assembler *as)
  */
 void mamou_pass(assembler *as)
 {
-	u_int		size = MAXBUF - 1;
-	char		input_line[1024];
+	char		input_line[MAXBUF];
 	
 	/* 1. If debug mode is on, show output. */
     if (as->o_debug)
     {
-        printf("\n------");
-        printf("\nPass %u", (unsigned int)as->pass);
-        printf("\n------\n");
+        fprintf(as->out, "\n------");
+        fprintf(as->out, "\nPass %u", (unsigned int)as->pass);
+        fprintf(as->out, "\n------\n");
     }
 	
 	/* 2. While we haven't encountered 'end' and there are more lines to read... */
-	while (as->current_file->end_encountered == 0 && _coco_readln(as->current_file->fd, input_line, &size) == 0)
+	while (as->current_file->end_encountered == 0 && source_readln(as->current_file, input_line) == 0)
 	{
 		char *p = strchr(input_line, 0x0D);
 
-		size = MAXBUF - 1;
-
 		if (p != NULL)
 		{
 #ifdef WIN32
@@ -616,6 +748,10 @@ void mamou_pass(assembler *as)
 			if (as->line.type == LINETYPE_BLANK)
 			{
 				as->current_file->num_blank_lines++;
+
+				/* A blank line ends the scope of temporary symbols. */
+				symbol_scope_close(as);
+				symbol_scope_open(as);
 				as->cumulative_blank_lines++;
 			}
 			else
@@ -824,10 +960,10 @@ void mamou_parse_line(assembler *as, char *input_line)
     /* If debug mode is on, print the line information. */	
     if (as->o_debug)
     {
-        printf("\n");
-        printf("Label      %s\n", as->line.label);
-        printf("Op         %s\n", as->line.Op);
-        printf("Operand    %s\n", as->line.operand);
+        fprintf(as->out, "\n");
+        fprintf(as->out, "Label      %s\n", as->line.label);
+        fprintf(as->out, "Op         %s\n", as->line.Op);
+        fprintf(as->out, "Operand    %s\n", as->line.operand);
     }
 	
 	as->line.type = LINETYPE_SOURCE;
@@ -848,6 +984,9 @@ void process(assembler *as)
  	
 	/* Point to beginning of operand field */
     as->line.optr = as->line.operand;
+
+	/* Files with more than definitions can't be precompiled */
+	precomp_line(as);
 	
 	/* Determine if we are in a FALSE conditional */
     if (as->conditional_stack[as->conditional_stack_index] == 0)
@@ -0,0 +1,1210 @@
+/***************************************************************************
+* precomp.c: precompiled definitions
+*
+* $Id$
+*
+* The Mamou Assembler - A Hitachi 6309 assembler
+*
+* With -P<dir>, a file brought in by use that holds only definitions (equ,
+* set, rmb, org and conditionals) is saved at the end of pass 1 as the
+* symbols it defined, the counters it left behind, the outside symbols it
+* looked at and a hash of every file it read.  A later run that uses the
+* same file, with the same contents and the same outside symbols, maps the
+* saved copy in instead of assembling the file again.
+***************************************************************************/
+
+#include "mamou.h"
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+
+#define PRECOMP_MAGIC		"MPC1"
+#define PRECOMP_BYTE_ORDER	0x01020304
+#define HASH_BASIS			14695981039346656037ULL
+#define HASH_PRIME			1099511628211ULL
+#define NO_ORDINAL			((u_int)-1)
+
+
+/* counters a definitions file may change */
+struct precomp_state
+{
+	u_int	program_counter;
+	u_int	data_counter;
+	u_int	DP;
+	int		code_segment_start;
+};
+
+
+/* A precompiled definitions file is this header, the input, lookup and
+ * symbol tables, then the names they refer to.  Every field is 32 bits,
+ * in the byte order of the machine that wrote it.
+ */
+struct precomp_header
+{
+	char					magic[4];
+	u_int					byte_order;
+	u_int					key[2];			/* low and high words of the key */
+	struct precomp_state	start;
+	struct precomp_state	end;
+	u_int					lines[3];		/* total, blank and comment lines */
+	u_int					num_inputs;
+	u_int					num_lookups;
+	u_int					num_symbols;
+	u_int					strings_size;
+};
+
+struct precomp_input
+{
+	u_int	name;
+	u_int	hash[2];
+};
+
+struct precomp_dep
+{
+	u_int	name;
+	u_int	defined;
+	int		value;
+};
+
+struct precomp_symbol
+{
+	u_int	name;
+	int		value;
+	int		overridable;
+};
+
+
+/* a file read while recording a use */
+struct precomp_file
+{
+	char				*name;
+	unsigned long long	hash;
+};
+
+
+/* an outside symbol a file looked at */
+struct precomp_lookup
+{
+	char			*name;
+	struct nlist	*np;		/* NULL if it was undefined */
+	int				value;
+};
+
+
+/* a use being assembled */
+struct precomp_use
+{
+	struct precomp_use		*prev;		/* use of the including file */
+	char					*path;
+	unsigned long long		key;
+	int						vetoed;		/* the file can't be precompiled */
+	int						fallback;	/* pass 2 is assembling a file pass 1 took from the cache */
+	u_int					serial;		/* symbols after this one are the file's own */
+	u_int					conditional_stack_index;
+	struct precomp_state	start;
+	u_int					lines[3];
+	struct precomp_file		*input;
+	u_int					num_inputs;
+	u_int					max_inputs;
+	struct precomp_lookup	*lookup;
+	u_int					num_lookups;
+	u_int					max_lookups;
+};
+
+
+/* a use pass 1 took from the cache, for pass 2 to skip */
+struct precomp_skip
+{
+	u_int					ordinal;
+	struct precomp_state	end;
+	u_int					lines[3];
+	int						undefined;	/* the file looked at an undefined symbol */
+};
+
+
+struct precomp
+{
+	int					enabled;
+	unsigned long long	defines;		/* hash of the command line symbols */
+	u_int				ordinal;		/* uses made on both passes so far */
+	struct precomp_use	*use;			/* innermost use */
+	struct precomp_skip	*skip;
+	u_int				num_skips;
+	u_int				max_skips;
+	u_int				next_skip;
+};
+
+
+/* Pseudo ops that only define symbols or move the counters. */
+static int (*precomp_pseudo[])() =
+{
+	_equ, _set, _rmb, _rmd, _rmq, _org, _setdp,
+	_ifeq, _ifne, _iflt, _ifle, _ifgt, _ifge, _else, _endc,
+	_nam, _ttl, _opt, _spc, _page, _null_op, _use,
+	NULL
+};
+
+
+/*!
+	@function precomp_hash
+	@discussion Adds bytes to a hash (64 bit FNV-1a)
+	@param hash The hash so far
+	@param data The bytes to add
+	@param size The number of bytes
+	@result The new hash
+ */
+static unsigned long long precomp_hash(unsigned long long hash, const void *data, size_t size)
+{
+	const u_char	*p = (const u_char *)data;
+
+	while (size-- > 0)
+	{
+		hash ^= *p++;
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+
+/*!
+	@function precomp_file_hash
+	@discussion Hashes the contents of a file.  Files that can only be read
+	@discussion through the CoCo path routines are hashed as the lines
+	@discussion the assembler reads.
+	@param as The assembler state structure
+	@param path The path of the file
+	@param hash Set to the hash
+	@result 0 on success, else 1
+ */
+static int precomp_file_hash(assembler *as, char *path, unsigned long long *hash)
+{
+	struct source	*src;
+	char			buffer[8192];
+	size_t			size;
+	FILE			*fp;
+
+	fp = fopen(path, "rb");
+	if (fp != NULL)
+	{
+		*hash = HASH_BASIS;
+
+		while ((size = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		{
+			*hash = precomp_hash(*hash, buffer, size);
+		}
+
+		size = ferror(fp);
+		fclose(fp);
+
+		return size != 0;
+	}
+
+	if (source_open(as, path, &src) != 0)
+	{
+		return 1;
+	}
+
+	*hash = precomp_hash(HASH_BASIS, src->text, src->text_size);
+
+	return 0;
+}
+
+
+/*!
+	@function precomp_grow
+	@discussion Makes room for one more entry in an array
+	@param array The array
+	@param count Entries in use
+	@param max Entries allocated, updated
+	@param size Size of an entry
+	@result the array, which may have moved
+ */
+static void *precomp_grow(void *array, u_int count, u_int *max, size_t size)
+{
+	if (count == *max)
+	{
+		*max = *max == 0 ? 64 : *max * 2;
+
+		array = realloc(array, *max * size);
+		if (array == NULL)
+		{
+			fatal("Out of memory");
+		}
+	}
+
+	return array;
+}
+
+
+/*!
+	@function precomp_get_state
+	@discussion Reads the counters a definitions file may change
+	@param as The assembler state structure
+	@param state Filled in with the counters
+ */
+static void precomp_get_state(assembler *as, struct precomp_state *state)
+{
+	memset(state, 0, sizeof(struct precomp_state));
+
+	state->program_counter = as->program_counter;
+	state->data_counter = as->data_counter;
+	state->DP = as->DP;
+	state->code_segment_start = as->code_segment_start;
+}
+
+
+/*!
+	@function precomp_set_state
+	@discussion Leaves the assembler as a definitions file did
+	@param as The assembler state structure
+	@param state The counters at the end of the file
+	@param lines The lines the file added to the totals
+ */
+static void precomp_set_state(assembler *as, struct precomp_state *state, u_int *lines)
+{
+	as->program_counter = state->program_counter;
+	as->data_counter = state->data_counter;
+	as->DP = state->DP;
+	as->code_segment_start = state->code_segment_start;
+
+	as->cumulative_total_lines += lines[0];
+	as->cumulative_blank_lines += lines[1];
+	as->cumulative_comment_lines += lines[2];
+}
+
+
+/*!
+	@function precomp_key
+	@discussion Hashes what a use depends on besides its lookups: the file,
+	@discussion the options, the command line symbols and the counters
+	@param as The assembler state structure
+	@param path The path of the file
+	@result The key
+ */
+static unsigned long long precomp_key(assembler *as, char *path)
+{
+	struct precomp_state	state;
+	unsigned long long		key;
+	u_int					i;
+
+	precomp_get_state(as, &state);
+
+	key = precomp_hash(as->precomp->defines, path, strlen(path) + 1);
+	key = precomp_hash(key, &as->o_cpuclass, sizeof(as->o_cpuclass));
+	key = precomp_hash(key, &as->o_asm_mode, sizeof(as->o_asm_mode));
+	key = precomp_hash(key, &state, sizeof(state));
+
+	for (i = 0; i < as->include_index; i++)
+	{
+		key = precomp_hash(key, as->includes[i], strlen(as->includes[i]) + 1);
+	}
+
+	return key;
+}
+
+
+/*!
+	@function precomp_file_name
+	@discussion Makes the name of the precompiled file for a use
+	@param as The assembler state structure
+	@param path The path of the file
+	@param key The key of the use
+	@param name Buffer of FNAMESIZE bytes for the name
+ */
+static void precomp_file_name(assembler *as, char *path, unsigned long long key, char *name)
+{
+	snprintf(name, FNAMESIZE, "%s/%s.%08x%08x.mpc", as->precomp_dir, extractfilename(path),
+		(unsigned int)(key >> 32), (unsigned int)key);
+}
+
+
+/*!
+	@function precomp_init
+	@discussion Initializes precompiled definitions for a pass.  They are
+	@discussion used only when nothing lists the lines they would skip.
+	@param as The assembler state structure
+ */
+void precomp_init(assembler *as)
+{
+	struct precomp	*p;
+	u_int			i, serial;
+
+	if (as->precomp_dir == NULL)
+	{
+		return;
+	}
+
+	if (as->pass == 1)
+	{
+		precomp_free(as);
+
+		p = (struct precomp *)calloc(1, sizeof(struct precomp));
+		if (p == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		as->precomp = p;
+
+		p->enabled = (as->o_show_listing == 0 && as->o_show_cross_reference == 0 && as->o_do_parsing == 1);
+
+		/* The only symbols so far came from the command line; hash them in order. */
+		p->defines = HASH_BASIS;
+
+		for (serial = 1; serial <= as->symbol_serial; serial++)
+		{
+			for (i = 0; i < as->bucket.size; i++)
+			{
+				struct nlist	*np = as->bucket.slot[i];
+
+				if (np != NULL && np->serial == serial)
+				{
+					p->defines = precomp_hash(p->defines, np->name, strlen(np->name) + 1);
+					p->defines = precomp_hash(p->defines, &np->def, sizeof(np->def));
+				}
+			}
+		}
+	}
+
+	if (as->precomp != NULL)
+	{
+		as->precomp->ordinal = 0;
+		as->precomp->next_skip = 0;
+	}
+}
+
+
+/*!
+	@function precomp_free
+	@discussion Frees the precompiled definitions state
+	@param as The assembler state structure
+ */
+void precomp_free(assembler *as)
+{
+	struct precomp		*p = as->precomp;
+	struct precomp_use	*use;
+	u_int				i;
+
+	if (p == NULL)
+	{
+		return;
+	}
+
+	while ((use = p->use) != NULL)
+	{
+		p->use = use->prev;
+
+		for (i = 0; i < use->num_lookups; i++)
+		{
+			if (use->lookup[i].np == NULL)
+			{
+				free(use->lookup[i].name);
+			}
+		}
+
+		for (i = 0; i < use->num_inputs; i++)
+		{
+			free(use->input[i].name);
+		}
+
+		free(use->lookup);
+		free(use->input);
+		free(use);
+	}
+
+	free(p->skip);
+	free(p);
+
+	as->precomp = NULL;
+}
+
+
+/*!
+	@function precomp_veto
+	@discussion Marks the files being recorded as not precompilable
+	@param as The assembler state structure
+ */
+void precomp_veto(assembler *as)
+{
+	struct precomp_use	*use;
+
+	if (as->precomp == NULL)
+	{
+		return;
+	}
+
+	for (use = as->precomp->use; use != NULL; use = use->prev)
+	{
+		use->vetoed = 1;
+	}
+}
+
+
+/*!
+	@function precomp_input
+	@discussion Notes a file read by the files being recorded
+	@param as The assembler state structure
+	@param name The path of the file
+	@param hash The hash of its contents
+ */
+static void precomp_input(assembler *as, char *name, unsigned long long hash)
+{
+	struct precomp_use	*use;
+	u_int				i;
+
+	for (use = as->precomp->use; use != NULL; use = use->prev)
+	{
+		for (i = 0; i < use->num_inputs; i++)
+		{
+			if (strcmp(use->input[i].name, name) == 0)
+			{
+				break;
+			}
+		}
+
+		if (i == use->num_inputs)
+		{
+			use->input = (struct precomp_file *)precomp_grow(use->input, use->num_inputs, &use->max_inputs, sizeof(struct precomp_file));
+			use->input[use->num_inputs].name = strdup(name);
+			use->input[use->num_inputs].hash = hash;
+
+			if (use->input[use->num_inputs++].name == NULL)
+			{
+				fatal("Out of memory");
+			}
+		}
+	}
+}
+
+
+/*!
+	@function precomp_lookup
+	@discussion Notes a symbol looked at on pass 1.  Symbols defined before
+	@discussion a file was used become part of what its copy depends on.
+	@param as The assembler state structure
+	@param name The name of the symbol
+	@param np The symbol, or NULL if it is not defined
+ */
+void precomp_lookup(assembler *as, char *name, struct nlist *np)
+{
+	struct precomp_use	*use;
+	u_int				i;
+
+	if (as->precomp == NULL || as->pass != 1 || as->precomp->use == NULL)
+	{
+		return;
+	}
+
+	if (strchr(name, '@') != NULL)
+	{
+		/* Temporary labels are the file's own, but pass 2 must resolve forward ones. */
+		if (np == NULL)
+		{
+			precomp_veto(as);
+		}
+
+		return;
+	}
+
+	if (np == NULL && name[0] == '_' && name[1] == '$')
+	{
+		/* The evaluator defines these from the environment. */
+		precomp_veto(as);
+
+		return;
+	}
+
+	for (use = as->precomp->use; use != NULL; use = use->prev)
+	{
+		if (np != NULL && np->serial > use->serial)
+		{
+			continue;
+		}
+
+		if (np == NULL)
+		{
+			for (i = 0; i < use->num_lookups; i++)
+			{
+				if (use->lookup[i].np == NULL && strcmp(use->lookup[i].name, name) == 0)
+				{
+					break;
+				}
+			}
+
+			if (i < use->num_lookups)
+			{
+				continue;
+			}
+		}
+
+		use->lookup = (struct precomp_lookup *)precomp_grow(use->lookup, use->num_lookups, &use->max_lookups, sizeof(struct precomp_lookup));
+
+		if (np != NULL)
+		{
+			use->lookup[use->num_lookups].name = np->name;
+			use->lookup[use->num_lookups].value = np->def;
+		}
+		else
+		{
+			use->lookup[use->num_lookups].name = strdup(name);
+			use->lookup[use->num_lookups].value = 0;
+
+			if (use->lookup[use->num_lookups].name == NULL)
+			{
+				fatal("Out of memory");
+			}
+		}
+
+		use->lookup[use->num_lookups++].np = np;
+	}
+}
+
+
+/*!
+	@function precomp_redefine
+	@discussion Notes a change to an existing symbol.  A file that changes a
+	@discussion symbol from outside can't be precompiled.
+	@param as The assembler state structure
+	@param np The symbol
+ */
+void precomp_redefine(assembler *as, struct nlist *np)
+{
+	struct precomp_use	*use;
+
+	if (as->precomp == NULL || as->pass != 1)
+	{
+		return;
+	}
+
+	for (use = as->precomp->use; use != NULL; use = use->prev)
+	{
+		if (np->serial <= use->serial)
+		{
+			use->vetoed = 1;
+		}
+	}
+}
+
+
+/*!
+	@function precomp_line
+	@discussion Checks a source line on pass 1 for anything besides definitions
+	@param as The assembler state structure
+ */
+void precomp_line(assembler *as)
+{
+	u_int	i;
+
+	if (as->precomp == NULL || as->pass != 1 || as->precomp->use == NULL)
+	{
+		return;
+	}
+
+	if (as->conditional_stack[as->conditional_stack_index] == 0)
+	{
+		/* Pseudo ops still run in a FALSE conditional; mod resets the CRC before it checks. */
+		if (as->line.mnemonic.type == OPCODE_PSEUDO && as->line.mnemonic.opcode.pseudo->func == _mod)
+		{
+			precomp_veto(as);
+		}
+
+		return;
+	}
+
+	if (*as->line.Op == EOS)
+	{
+		/* A label on its own. */
+		return;
+	}
+
+	if (as->line.mnemonic.type == OPCODE_PSEUDO)
+	{
+		for (i = 0; precomp_pseudo[i] != NULL; i++)
+		{
+			if (as->line.mnemonic.opcode.pseudo->func == precomp_pseudo[i])
+			{
+				return;
+			}
+		}
+	}
+
+	precomp_veto(as);
+}
+
+
+/*!
+	@function lookup_compare
+	@discussion qsort comparison of two lookups by name
+ */
+static int lookup_compare(const void *a, const void *b)
+{
+	return strcmp(((struct precomp_lookup *)a)->name, ((struct precomp_lookup *)b)->name);
+}
+
+
+/*!
+	@function serial_compare
+	@discussion qsort comparison of two symbols by the order they were defined
+ */
+static int serial_compare(const void *a, const void *b)
+{
+	u_int	x = (*(struct nlist **)a)->serial, y = (*(struct nlist **)b)->serial;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/*!
+	@function precomp_string
+	@discussion Adds a name to the string table of a precompiled file
+	@param strings The string table
+	@param size Bytes in use, updated
+	@param max Bytes allocated, updated
+	@param name The name
+	@result offset of the name
+ */
+static u_int precomp_string(char **strings, u_int *size, u_int *max, char *name)
+{
+	u_int	offset = *size, len = strlen(name) + 1;
+
+	while (*size + len > *max)
+	{
+		*max = *max == 0 ? 4096 : *max * 2;
+
+		*strings = (char *)realloc(*strings, *max);
+		if (*strings == NULL)
+		{
+			fatal("Out of memory");
+		}
+	}
+
+	memcpy(*strings + offset, name, len);
+	*size += len;
+
+	return offset;
+}
+
+
+/*!
+	@function precomp_save
+	@discussion Writes the precompiled file for a use.  The file is written
+	@discussion under a temporary name and renamed, so that other assemblers
+	@discussion sharing the directory never see part of one.
+	@param as The assembler state structure
+	@param use The use
+ */
+static void precomp_save(assembler *as, struct precomp_use *use)
+{
+	struct precomp_header	header;
+	struct precomp_input	*inputs;
+	struct precomp_dep		*deps;
+	struct precomp_symbol	*symbols;
+	struct nlist			**list;
+	char					name[FNAMESIZE], temp[FNAMESIZE + 32];
+	char					*strings = NULL;
+	u_int					i, n, strings_max = 0;
+	FILE					*fp;
+	int						ok;
+
+	/* 1. The symbols the file defined, in the order it defined them. */
+	list = (struct nlist **)malloc((as->bucket.count + 1) * sizeof(struct nlist *));
+	inputs = (struct precomp_input *)malloc((use->num_inputs + 1) * sizeof(struct precomp_input));
+	deps = (struct precomp_dep *)malloc((use->num_lookups + 1) * sizeof(struct precomp_dep));
+
+	if (list == NULL || inputs == NULL || deps == NULL)
+	{
+		fatal("Out of memory");
+	}
+
+	for (i = 0, n = 0; i < as->bucket.size; i++)
+	{
+		if (as->bucket.slot[i] != NULL && as->bucket.slot[i]->serial > use->serial)
+		{
+			list[n++] = as->bucket.slot[i];
+		}
+	}
+
+	qsort(list, n, sizeof(struct nlist *), serial_compare);
+
+	symbols = (struct precomp_symbol *)malloc((n + 1) * sizeof(struct precomp_symbol));
+	if (symbols == NULL)
+	{
+		fatal("Out of memory");
+	}
+
+	/* 2. Fill in the header and tables. */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PRECOMP_MAGIC, 4);
+	header.byte_order = PRECOMP_BYTE_ORDER;
+	header.key[0] = (u_int)use->key;
+	header.key[1] = (u_int)(use->key >> 32);
+	header.start = use->start;
+	precomp_get_state(as, &header.end);
+	header.lines[0] = as->cumulative_total_lines - use->lines[0];
+	header.lines[1] = as->cumulative_blank_lines - use->lines[1];
+	header.lines[2] = as->cumulative_comment_lines - use->lines[2];
+
+	for (i = 0; i < use->num_inputs; i++)
+	{
+		inputs[i].name = precomp_string(&strings, &header.strings_size, &strings_max, use->input[i].name);
+		inputs[i].hash[0] = (u_int)use->input[i].hash;
+		inputs[i].hash[1] = (u_int)(use->input[i].hash >> 32);
+	}
+
+	header.num_inputs = use->num_inputs;
+
+	qsort(use->lookup, use->num_lookups, sizeof(struct precomp_lookup), lookup_compare);
+
+	for (i = 0; i < use->num_lookups; i++)
+	{
+		if (i > 0 && strcmp(use->lookup[i].name, use->lookup[i - 1].name) == 0)
+		{
+			continue;
+		}
+
+		deps[header.num_lookups].name = precomp_string(&strings, &header.strings_size, &strings_max, use->lookup[i].name);
+		deps[header.num_lookups].defined = use->lookup[i].np != NULL;
+		deps[header.num_lookups].value = use->lookup[i].value;
+		header.num_lookups++;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		symbols[i].name = precomp_string(&strings, &header.strings_size, &strings_max, list[i]->name);
+		symbols[i].value = list[i]->def;
+		symbols[i].overridable = list[i]->overridable;
+	}
+
+	header.num_symbols = n;
+
+	/* 3. Write it out. */
+	precomp_file_name(as, use->path, use->key, name);
+	snprintf(temp, sizeof(temp), "%s.%d", name, (int)getpid());
+
+	fp = fopen(temp, "wb");
+	if (fp != NULL)
+	{
+		ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+		ok = ok && fwrite(inputs, sizeof(struct precomp_input), header.num_inputs, fp) == header.num_inputs;
+		ok = ok && fwrite(deps, sizeof(struct precomp_dep), header.num_lookups, fp) == header.num_lookups;
+		ok = ok && fwrite(symbols, sizeof(struct precomp_symbol), header.num_symbols, fp) == header.num_symbols;
+		ok = ok && fwrite(strings, 1, header.strings_size, fp) == header.strings_size;
+		ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+		if (ok)
+		{
+			remove(name);
+		}
+#endif
+		if (!ok || rename(temp, name) != 0)
+		{
+			remove(temp);
+		}
+	}
+
+	free(strings);
+	free(symbols);
+	free(deps);
+	free(inputs);
+	free(list);
+}
+
+
+/*!
+	@function precomp_map
+	@discussion Maps a precompiled file into memory
+	@param name The name of the file
+	@param size Set to the size of the file
+	@result pointer to the contents, or NULL
+ */
+static void *precomp_map(char *name, size_t *size)
+{
+	void		*data = NULL;
+#ifdef _WIN32
+	FILE		*fp;
+	long		length;
+
+	fp = fopen(name, "rb");
+	if (fp == NULL)
+	{
+		return NULL;
+	}
+
+	if (fseek(fp, 0, SEEK_END) == 0 && (length = ftell(fp)) >= (long)sizeof(struct precomp_header))
+	{
+		*size = length;
+		data = malloc(*size);
+
+		if (data != NULL && (fseek(fp, 0, SEEK_SET) != 0 || fread(data, 1, *size, fp) != *size))
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+
+	fclose(fp);
+#else
+	struct stat	st;
+	int			fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct precomp_header))
+	{
+		*size = st.st_size;
+		data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED)
+		{
+			data = NULL;
+		}
+	}
+
+	close(fd);
+#endif
+
+	return data;
+}
+
+
+/*!
+	@function precomp_unmap
+	@discussion Releases a precompiled file mapped by precomp_map
+	@param data The contents
+	@param size The size of the file
+ */
+static void precomp_unmap(void *data, size_t size)
+{
+#ifdef _WIN32
+	free(data);
+#else
+	munmap(data, size);
+#endif
+}
+
+
+/*!
+	@function precomp_load
+	@discussion Brings in a use from its precompiled file, if there is one
+	@discussion and everything it was made from is unchanged
+	@param as The assembler state structure
+	@param path The path of the file
+	@param key The key of the use
+	@param ordinal The order of the use on both passes, or NO_ORDINAL
+	@result 0 if the use was loaded, else 1
+ */
+static int precomp_load(assembler *as, char *path, unsigned long long key, u_int ordinal)
+{
+	struct precomp_header	*header;
+	struct precomp_input	*inputs;
+	struct precomp_dep		*deps;
+	struct precomp_symbol	*symbols;
+	struct precomp_state	state;
+	struct nlist			*np;
+	char					name[FNAMESIZE], *strings;
+	size_t					size, tables;
+	int						undefined = 0;
+	u_int					i;
+
+	precomp_file_name(as, path, key, name);
+
+	header = (struct precomp_header *)precomp_map(name, &size);
+	if (header == NULL)
+	{
+		return 1;
+	}
+
+	/* 1. Check that the file is whole and was made for this use. */
+	tables = header->num_inputs * sizeof(struct precomp_input) +
+			header->num_lookups * sizeof(struct precomp_dep) +
+			header->num_symbols * sizeof(struct precomp_symbol);
+
+	inputs = (struct precomp_input *)(header + 1);
+	deps = (struct precomp_dep *)(inputs + header->num_inputs);
+	symbols = (struct precomp_symbol *)(deps + header->num_lookups);
+	strings = (char *)(symbols + header->num_symbols);
+
+	precomp_get_state(as, &state);
+
+	if (memcmp(header->magic, PRECOMP_MAGIC, 4) != 0 ||
+		header->byte_order != PRECOMP_BYTE_ORDER ||
+		header->key[0] != (u_int)key || header->key[1] != (u_int)(key >> 32) ||
+		memcmp(&header->start, &state, sizeof(state)) != 0 ||
+		header->num_inputs == 0 ||
+		header->num_inputs > size || header->num_lookups > size || header->num_symbols > size ||
+		sizeof(struct precomp_header) + tables + header->strings_size != size ||
+		header->strings_size == 0 || strings[header->strings_size - 1] != EOS)
+	{
+		precomp_unmap(header, size);
+
+		return 1;
+	}
+
+	for (i = 0; i < header->num_inputs; i++)
+	{
+		if (inputs[i].name >= header->strings_size)
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	for (i = 0; i < header->num_lookups; i++)
+	{
+		if (deps[i].name >= header->strings_size)
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	for (i = 0; i < header->num_symbols; i++)
+	{
+		if (symbols[i].name >= header->strings_size)
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	/* 2. Every file it read must be unchanged. */
+	if (strcmp(strings + inputs[0].name, path) != 0)
+	{
+		precomp_unmap(header, size);
+
+		return 1;
+	}
+
+	for (i = 0; i < header->num_inputs; i++)
+	{
+		unsigned long long	hash;
+
+		if (precomp_file_hash(as, strings + inputs[i].name, &hash) != 0 ||
+			inputs[i].hash[0] != (u_int)hash || inputs[i].hash[1] != (u_int)(hash >> 32))
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	/* 3. Every symbol it looked at must be as it was, and none it defines may exist yet. */
+	for (i = 0; i < header->num_lookups; i++)
+	{
+		np = symbol_find(as, strings + deps[i].name, 1);
+
+		if (deps[i].defined != 0 ? (np == NULL || np->def != deps[i].value) : np != NULL)
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	for (i = 0; i < header->num_symbols; i++)
+	{
+		if (symbol_find(as, strings + symbols[i].name, 1) != NULL)
+		{
+			precomp_unmap(header, size);
+
+			return 1;
+		}
+	}
+
+	/* 4. Bring it in, and tell any file being recorded what it took. */
+	for (i = 0; i < header->num_lookups; i++)
+	{
+		np = symbol_find(as, strings + deps[i].name, 1);
+
+		precomp_lookup(as, strings + deps[i].name, np);
+
+		if (np == NULL)
+		{
+			undefined = 1;
+		}
+	}
+
+	for (i = 0; i < header->num_inputs; i++)
+	{
+		precomp_input(as, strings + inputs[i].name, inputs[i].hash[0] | (unsigned long long)inputs[i].hash[1] << 32);
+	}
+
+	for (i = 0; i < header->num_symbols; i++)
+	{
+		symbol_add(as, strings + symbols[i].name, symbols[i].value, symbols[i].overridable);
+	}
+
+	precomp_set_state(as, &header->end, header->lines);
+
+	/* 5. Pass 2 skips the file too, unless it has to see symbols defined later. */
+	if (ordinal != NO_ORDINAL)
+	{
+		struct precomp			*p = as->precomp;
+		struct precomp_skip		*skip;
+
+		p->skip = (struct precomp_skip *)precomp_grow(p->skip, p->num_skips, &p->max_skips, sizeof(struct precomp_skip));
+
+		skip = &p->skip[p->num_skips++];
+		skip->ordinal = ordinal;
+		skip->end = header->end;
+		memcpy(skip->lines, header->lines, sizeof(skip->lines));
+		skip->undefined = undefined;
+	}
+
+	precomp_unmap(header, size);
+
+	return 0;
+}
+
+
+/*!
+	@function precomp_use
+	@discussion Starts a use.  On pass 1 the file comes from its precompiled
+	@discussion copy if it can, and is otherwise recorded.  On pass 2 a file
+	@discussion pass 1 took from the cache is skipped.  Unless this returns 1,
+	@discussion the caller assembles the file and then calls precomp_end.
+	@param as The assembler state structure
+	@param path The path the file was opened with
+	@result 1 if the file has been dealt with, else 0
+ */
+int precomp_use(assembler *as, char *path)
+{
+	struct precomp		*p = as->precomp;
+	struct precomp_use	*use;
+	struct precomp_skip	*skip = NULL;
+	unsigned long long	key = 0, hash;
+	u_int				ordinal = NO_ORDINAL;
+
+	if (p == NULL || p->enabled == 0)
+	{
+		return 0;
+	}
+
+	/* 1. Number the uses both passes make, so pass 2 can find pass 1's. */
+	if (as->pass_only_depth == 0)
+	{
+		ordinal = p->ordinal++;
+	}
+
+	if (as->pass == 1)
+	{
+		key = precomp_key(as, path);
+
+		if (precomp_load(as, path, key, ordinal) == 0)
+		{
+			return 1;
+		}
+	}
+	else if (ordinal != NO_ORDINAL && p->next_skip < p->num_skips && p->skip[p->next_skip].ordinal == ordinal)
+	{
+		skip = &p->skip[p->next_skip++];
+
+		if (skip->undefined == 0 && as->o_show_listing == 0)
+		{
+			precomp_set_state(as, &skip->end, skip->lines);
+
+			f_record(as);
+
+			return 1;
+		}
+	}
+
+	/* 2. Note the use. */
+	use = (struct precomp_use *)calloc(1, sizeof(struct precomp_use));
+	if (use == NULL)
+	{
+		fatal("Out of memory");
+	}
+
+	use->prev = p->use;
+	p->use = use;
+
+	if (as->pass == 1)
+	{
+		use->path = path;
+		use->key = key;
+		use->serial = as->symbol_serial;
+		use->conditional_stack_index = as->conditional_stack_index;
+		use->lines[0] = as->cumulative_total_lines;
+		use->lines[1] = as->cumulative_blank_lines;
+		use->lines[2] = as->cumulative_comment_lines;
+		precomp_get_state(as, &use->start);
+
+		/* Hash the file now, as close as we can to when it was read. */
+		if (precomp_file_hash(as, path, &hash) == 0)
+		{
+			precomp_input(as, path, hash);
+		}
+		else
+		{
+			use->vetoed = 1;
+		}
+	}
+	else if (skip != NULL)
+	{
+		/* Pass 1 never opened this file's scopes or uses; keep pass 2 in step. */
+		use->fallback = 1;
+		as->pass_only_depth++;
+	}
+
+	return 0;
+}
+
+
+/*!
+	@function precomp_end
+	@discussion Finishes a use started by precomp_use, saving its
+	@discussion precompiled copy if it held only definitions
+	@param as The assembler state structure
+ */
+void precomp_end(assembler *as)
+{
+	struct precomp		*p = as->precomp;
+	struct precomp_use	*use;
+	u_int				i;
+
+	if (p == NULL || p->enabled == 0 || (use = p->use) == NULL)
+	{
+		return;
+	}
+
+	p->use = use->prev;
+
+	if (use->fallback != 0)
+	{
+		as->pass_only_depth--;
+	}
+
+	if (as->pass == 1 && use->vetoed == 0 && use->conditional_stack_index == as->conditional_stack_index)
+	{
+		precomp_save(as, use);
+	}
+
+	for (i = 0; i < use->num_lookups; i++)
+	{
+		if (use->lookup[i].np == NULL)
+		{
+			free(use->lookup[i].name);
+		}
+	}
+
+	for (i = 0; i < use->num_inputs; i++)
+	{
+		free(use->input[i].name);
+	}
+
+	free(use->lookup);
+	free(use->input);
+	free(use);
+}
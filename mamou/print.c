@@ -223,7 +223,7 @@ void print_line(assembler *as, int override, char infochar, int counter)
 	/* Print out the built up line. */	
 	strncpy(Tmp_buff, Line_buff, as->o_pagewidth);
 	Tmp_buff[as->o_pagewidth] = EOS;
-	printf("%s\n", Tmp_buff);
+	fprintf(as->out, "%s\n", Tmp_buff);
 
 	/* Check if we are at last line before footer should be printed. */
 	if (as->o_format_only == 0)
@@ -248,10 +248,10 @@ void print_line(assembler *as, int override, char infochar, int counter)
  */
 void print_summary(assembler *as)
 {
-	printf("\n");
-	printf("Assembler Summary:\n");
-	printf(" - %u errors, %u warnings\n", (unsigned int)as->num_errors, (unsigned int)as->num_warnings);
-	printf(" - %u lines (%u source, %u blank, %u comment)\n",
+	fprintf(as->out, "\n");
+	fprintf(as->out, "Assembler Summary:\n");
+	fprintf(as->out, " - %u errors, %u warnings\n", (unsigned int)as->num_errors, (unsigned int)as->num_warnings);
+	fprintf(as->out, " - %u lines (%u source, %u blank, %u comment)\n",
 		(unsigned int)as->cumulative_total_lines,
 		(unsigned int)(as->cumulative_total_lines - (as->cumulative_blank_lines + as->cumulative_comment_lines)),
 		(unsigned int)as->cumulative_blank_lines,
@@ -260,14 +260,14 @@ void print_summary(assembler *as)
 
 	if ((as->o_asm_mode == ASM_DECB) || (as->o_asm_mode == ASM_ROM))
 	{
-		printf(" - $%04X (%u) bytes generated\n",
+		fprintf(as->out, " - $%04X (%u) bytes generated\n",
 			   (unsigned int)as->code_bytes,
 			   (unsigned int)as->code_bytes
 			);
 	}
 	else
 	{
-		printf(" - $%04X (%u) program bytes, $%04X (%u) data bytes\n",
+		fprintf(as->out, " - $%04X (%u) program bytes, $%04X (%u) data bytes\n",
 			   (unsigned int)as->code_bytes,
 			   (unsigned int)as->code_bytes,
 			   (unsigned int)as->data_counter,
@@ -277,11 +277,11 @@ void print_summary(assembler *as)
 	
 	if (as->object_name[0] == '\0')
 	{
-		printf(" - No output file\n");
+		fprintf(as->out, " - No output file\n");
 	}
 	else
 	{
-		printf(" - Output file: \"%s\"\n", as->object_name);
+		fprintf(as->out, " - Output file: \"%s\"\n", as->object_name);
 	}
 
 	return;
@@ -295,11 +295,11 @@ void print_summary(assembler *as)
  */
 void print_header(assembler *as)
 {
-	struct tm *tm;
+	struct tm lt, *tm = &lt;
 	
-	tm = localtime(&as->start_time);
+	local_time(as->start_time, tm);
 	
-	printf("The Mamou Assembler Version %02d.%02d      %02d/%02d/%02d %02d:%02d:%02d      Page %03u\n",
+	fprintf(as->out, "The Mamou Assembler Version %02d.%02d      %02d/%02d/%02d %02d:%02d:%02d      Page %03u\n",
 		   VERSION_MAJOR,
 		   VERSION_MINOR,
 	       tm->tm_mon + 1, tm->tm_mday, tm->tm_year + 1900,
@@ -308,22 +308,22 @@ void print_header(assembler *as)
 
 	if (as->name_header[0] != EOS && as->title_header[0] != EOS)
 	{
-		printf("%s - %s\n", as->name_header, as->title_header);
+		fprintf(as->out, "%s - %s\n", as->name_header, as->title_header);
 	}
 	else if (as->name_header[0] != EOS)
 	{
-		printf("%s\n", as->name_header);
+		fprintf(as->out, "%s\n", as->name_header);
 	}
 	else if (as->title_header[0] != EOS)
 	{
-		printf("%s\n", as->title_header);
+		fprintf(as->out, "%s\n", as->title_header);
 	}
 	else
 	{
-		printf("\n");
+		fprintf(as->out, "\n");
 	}
 
-	printf("\n");
+	fprintf(as->out, "\n");
 	
 	as->current_line += as->header_depth;
 
@@ -338,9 +338,9 @@ void print_header(assembler *as)
  */
 void print_footer(assembler *as)
 {
-	printf("\n");
-	printf("\n");
-	printf("\n");
+	fprintf(as->out, "\n");
+	fprintf(as->out, "\n");
+	fprintf(as->out, "\n");
 	
 	as->current_line += as->footer_depth;
 
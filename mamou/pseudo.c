@@ -12,6 +12,41 @@
 #include "mamou.h"
 
 
+/*!
+	@function next_field
+	@discussion Splits the next comma separated field off an operand, as strtok() would
+	@param next The rest of the operand, advanced past the field
+	@result the field, or NULL if there are no more
+ */
+static char *next_field(char **next)
+{
+	char *p = *next, *end;
+
+	while (*p == ',')
+	{
+		p++;
+	}
+
+	if (*p == EOS)
+	{
+		return NULL;
+	}
+
+	end = strchr(p, ',');
+	if (end != NULL)
+	{
+		*end = EOS;
+		*next = end + 1;
+	}
+	else
+	{
+		*next = p + strlen(p);
+	}
+
+	return p;
+}
+
+
 /*!
 	@function _dts
 	@discussion Generate current date/timestamp string
@@ -19,8 +54,11 @@
  */
 int _dts(assembler *as)
 {
-	char *t;
-	time_t tp;
+	static const char *day[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char *month[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	char stamp[64], *t;
+	struct tm lt;
 	
 	/* If we are currently in a FALSE conditional, just return. */	
 	if (as->conditional_stack[as->conditional_stack_index] == 0)
@@ -28,8 +66,12 @@ int _dts(assembler *as)
 		return 0;
 	}
 	
-	tp = time(NULL);
-	t = ctime(&tp);
+	/* The ctime() layout, built without its shared buffer. */
+	local_time(time(NULL), &lt);
+	sprintf(stamp, "%.3s %.3s%3d %.2d:%.2d:%.2d %d\n",
+		day[lt.tm_wday], month[lt.tm_mon], lt.tm_mday,
+		lt.tm_hour, lt.tm_min, lt.tm_sec, 1900 + lt.tm_year);
+	t = stamp;
 	
 	while (*t != '\n')
 	{
@@ -56,8 +98,7 @@ int _dts(assembler *as)
  */
 int _dtb(assembler *as)
 {
-	struct tm *t;
-	time_t tp;
+	struct tm lt, *t = &lt;
 	
 	/* If we are currently in a FALSE conditional, just return. */
 	if (as->conditional_stack[as->conditional_stack_index] == 0)
@@ -65,8 +106,7 @@ int _dtb(assembler *as)
 		return 0;
 	}
 	
-	tp = time(NULL);
-	t = localtime(&tp);
+	local_time(time(NULL), t);
 	
 	emit(as, t->tm_year);
 	emit(as, t->tm_mon + 1);
@@ -106,7 +146,7 @@ int _mod(assembler *as)
 	unsigned char header_check;
 	int modinfo[6], i;
 	int module_size, name_offset;
-	char *operand;
+	char *operand, *next;
 	
 	as->old_program_counter = as->program_counter = 0;
 	as->data_counter = 0;
@@ -132,7 +172,9 @@ int _mod(assembler *as)
 	/* Obtain first parameter -- length of module */
 	operand = strdup(as->line.optr);
 	
-	if ((p = strtok(operand, ",")) == NULL)
+	next = operand;
+
+	if ((p = next_field(&next)) == NULL)
 	{
 		/* Error */
 		error(as, "missing parameter");
@@ -147,7 +189,7 @@ int _mod(assembler *as)
 	/* Obtain rest of parameters */
 	for (i = 1; i < 6; i++)
 	{
-		if ((p = strtok(NULL, ",")) == NULL)
+		if ((p = next_field(&next)) == NULL)
 		{
 			/* Error */
 			error(as, "missing parameter");
@@ -304,6 +346,7 @@ static int _generic_if(assembler *as, conditional whichone)
 		/* Current conditional false, make this one false as well. */
 		
 		as->conditional_stack[++as->conditional_stack_index] = 0;
+		as->conditional_pass[as->conditional_stack_index] = 0;
 
 		return 0;
 	}
@@ -320,6 +363,7 @@ static int _generic_if(assembler *as, conditional whichone)
 	}
 
 	as->conditional_stack_index++;
+	as->conditional_pass[as->conditional_stack_index] = (whichone == _IFP1 || whichone == _IFP2);
 
 	switch (whichone)
 	{
@@ -711,16 +755,16 @@ int _page(assembler *as)
 		{
 			if (as->o_format_only == 1)
 			{
-				printf("* ");
+				fprintf(as->out, "* ");
 			}
 			else
 			{
-				printf("\f");
+				fprintf(as->out, "\f");
 			}
 	
-			printf("%-10s", extractfilename(as->file_name[as->file_index -1]));
-			printf("                                   ");
-			printf("page %3u\n", (unsigned int)as->page_number++);
+			fprintf(as->out, "%-10s", extractfilename(as->file_name[as->file_index -1]));
+			fprintf(as->out, "                                   ");
+			fprintf(as->out, "page %3u\n", (unsigned int)as->page_number++);
 		}
 	}
 
@@ -1300,6 +1344,28 @@ int _spc(assembler *as)	/* TODO! */
 }
 
 
+/*!
+	@function _pass_conditional
+	@discussion Tells whether any open conditional tests the pass
+	@param as The assembler state structure
+	@result 1 if an ifp1 or ifp2 is open, else 0
+ */
+static u_int _pass_conditional(assembler *as)
+{
+	u_int	i;
+
+	for (i = 1; i <= as->conditional_stack_index; i++)
+	{
+		if (as->conditional_pass[i] != 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
 /*!
 	@function use
 	@discussion Include other assembly or definition files
@@ -1328,7 +1394,7 @@ int _use(assembler *as)
 	{
 		struct filestack use_file, *prev_file;
 		char		path[FNAMESIZE];
-		u_int		i = 0;
+		u_int		i = 0, pass_only;
 		
 		/* Set up the structure. */
 		prev_file = as->current_file;
@@ -1337,6 +1403,7 @@ int _use(assembler *as)
 		
 		strncpy(use_file.file, as->line.optr, FNAMESIZE);
 
+		use_file.next_line = 0;
 		use_file.current_line = 0;
 		use_file.num_blank_lines = 0;
 		use_file.num_comment_lines = 0;
@@ -1347,7 +1414,7 @@ int _use(assembler *as)
 
 		do
 		{
-			ec = _coco_open(&(use_file.fd), path, FAM_READ);
+			ec = source_open(as, path, &use_file.source);
 
 			if (ec != 0 && i < as->include_index)
 			{
@@ -1360,19 +1427,32 @@ int _use(assembler *as)
 		
 		if (ec == 0)
 		{
-			/* Make the first pass. */
+			/* A use under ifp1 or ifp2 is only made on one pass. */
+			pass_only = _pass_conditional(as);
+
+			/* Make the first pass, unless the file was precompiled. */
 			as->use_depth++;
+			as->pass_only_depth += pass_only;
+
+			if (precomp_use(as, path) == 0)
+			{
+				symbol_scope_open(as);
 			
-			mamou_pass(as);
-			
-			/* Close the file. */
-			_coco_close(use_file.fd);
+				mamou_pass(as);
 
+				symbol_scope_close(as);
+				precomp_end(as);
+			}
+
+			as->pass_only_depth -= pass_only;
 			as->use_depth--;
 		}
 		else
 		{
-			printf("mamou: can't open %s\n", use_file.file);
+			fprintf(as->out, "mamou: can't open %s\n", use_file.file);
+
+			/* The file might be there next time. */
+			precomp_veto(as);
 		}	
 
 		as->current_file = prev_file;			
@@ -0,0 +1,225 @@
+/***************************************************************************
+* source.c: source file cache
+*
+* $Id$
+*
+* The Mamou Assembler - A Hitachi 6309 assembler
+*
+* Each source and use file is read once, the first time it is opened, and
+* kept in memory as a list of lines.  The second pass and repeated uses of
+* the same file are served from memory.
+*
+* The cache belongs to the process rather than to one assembly, so modules
+* assembled on batch threads share it.  Entries never change once loaded.
+***************************************************************************/
+
+#include <pthread.h>
+#include "mamou.h"
+
+
+/* Static variables */
+static struct source	*sources = NULL;
+static pthread_mutex_t	source_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*!
+	@function source_load
+	@discussion Reads a file line by line into a cache entry
+	@param src The cache entry to fill
+	@param path The path to read
+	@result 0 on success, or the error from opening the file
+ */
+static error_code source_load(struct source *src, char *path)
+{
+	coco_path_id	fd;
+	error_code		ec;
+	char			line[MAXBUF];
+	u_int			size, len, text_max = 0, line_max = 0;
+
+	ec = _coco_open(&fd, path, FAM_READ);
+	if (ec != 0)
+	{
+		return ec;
+	}
+
+	while (1)
+	{
+		/* 1. Clear the buffer, so we can tell if a terminator was stored. */
+		memset(line, 0, sizeof(line));
+		size = MAXBUF - 1;
+
+		if (_coco_readln(fd, line, &size) != 0)
+		{
+			break;
+		}
+
+		len = size;
+		if (len < MAXBUF - 1 && line[len] == 0x0D)
+		{
+			len++;
+		}
+
+		/* 2. Make room for the line and its NUL. */
+		if (src->text_size + len + 1 > text_max)
+		{
+			char	*text;
+
+			text_max = text_max == 0 ? 65536 : text_max * 2;
+			while (src->text_size + len + 1 > text_max)
+			{
+				text_max *= 2;
+			}
+
+			text = (char *)realloc(src->text, text_max);
+			if (text == NULL)
+			{
+				ec = EOS_OM;
+				break;
+			}
+
+			src->text = text;
+		}
+
+		if (src->num_lines == line_max)
+		{
+			u_int	*lines;
+
+			line_max = line_max == 0 ? 1024 : line_max * 2;
+
+			lines = (u_int *)realloc(src->line, line_max * sizeof(u_int));
+			if (lines == NULL)
+			{
+				ec = EOS_OM;
+				break;
+			}
+
+			src->line = lines;
+		}
+
+		/* 3. Store it. */
+		src->line[src->num_lines++] = src->text_size;
+		memcpy(src->text + src->text_size, line, len);
+		src->text_size += len;
+		src->text[src->text_size++] = '\0';
+	}
+
+	_coco_close(fd);
+
+	return ec;
+}
+
+
+/*!
+	@function source_open
+	@discussion Finds a file in the source cache, reading it if it is new.
+	@discussion Files that fail to open are remembered as well.
+	@param as The assembler state structure
+	@param path The path of the file
+	@param src Set to the cache entry
+	@result 0 on success, or the error from opening the file
+ */
+error_code source_open(assembler *as, char *path, struct source **src)
+{
+	struct source	*s;
+	double			start;
+
+	*src = NULL;
+
+	pthread_mutex_lock(&source_lock);
+
+	for (s = sources; s != NULL; s = s->next)
+	{
+		if (strcmp(s->name, path) == 0)
+		{
+			break;
+		}
+	}
+
+	if (s == NULL)
+	{
+		s = (struct source *)calloc(1, sizeof(struct source));
+		if (s == NULL)
+		{
+			pthread_mutex_unlock(&source_lock);
+
+			return EOS_OM;
+		}
+
+		s->name = (char *)malloc(strlen(path) + 1);
+		if (s->name == NULL)
+		{
+			free(s);
+			pthread_mutex_unlock(&source_lock);
+
+			return EOS_OM;
+		}
+
+		strcpy(s->name, path);
+
+		start = stats_wall_time();
+		s->ec = source_load(s, path);
+		as->stats.read_time += stats_wall_time() - start;
+
+		if (s->ec == 0)
+		{
+			as->stats.files_read++;
+			as->stats.bytes_read += s->text_size;
+		}
+
+		s->next = sources;
+		sources = s;
+	}
+
+	pthread_mutex_unlock(&source_lock);
+
+	if (s->ec == 0)
+	{
+		*src = s;
+	}
+
+	return s->ec;
+}
+
+
+/*!
+	@function source_readln
+	@discussion Reads the next line of a file into a buffer
+	@param file The file being read
+	@param buffer Buffer of at least MAXBUF bytes
+	@result 0 if a line was read, else EOS_EOF
+ */
+error_code source_readln(struct filestack *file, char *buffer)
+{
+	char	*p;
+
+	if (file->next_line >= file->source->num_lines)
+	{
+		return EOS_EOF;
+	}
+
+	p = file->source->text + file->source->line[file->next_line++];
+
+	strcpy(buffer, p);
+
+	return 0;
+}
+
+
+/*!
+	@function source_free
+	@discussion Frees the source cache once no assembly is using it
+ */
+void source_free(void)
+{
+	struct source	*s;
+
+	while ((s = sources) != NULL)
+	{
+		sources = s->next;
+
+		free(s->line);
+		free(s->text);
+		free(s->name);
+		free(s);
+	}
+}
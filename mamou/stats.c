@@ -0,0 +1,225 @@
+/***************************************************************************
+* stats.c: assembler statistics
+*
+* $Id$
+*
+* The Mamou Assembler - A Hitachi 6309 assembler
+*
+* --stats reports where the time of an assembly goes: the time of each
+* pass, the time spent reading source files, the work done by the symbol
+* tables and the peak memory used.  --stats=json reports the same figures
+* as a JSON object, so that scripts can track them from build to build.
+* Both go to standard error, away from any listing.
+***************************************************************************/
+
+#include "mamou.h"
+#include <time.h>
+
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+
+/*!
+	@function stats_wall_time
+	@discussion Reads a clock of elapsed time
+	@result the time in seconds from an arbitrary start
+ */
+double stats_wall_time(void)
+{
+#ifdef _WIN32
+	struct _timeb	tb;
+
+	_ftime(&tb);
+
+	return tb.time + tb.millitm / 1000.0;
+#else
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+
+/*!
+	@function stats_cpu_time
+	@discussion Reads the processor time used by the assembler
+	@result the time in seconds
+ */
+double stats_cpu_time(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+/*!
+	@function stats_peak_memory
+	@discussion Finds the most memory the assembler has had in use
+	@result the peak in kilobytes, or -1 if it can't be found
+ */
+static long stats_peak_memory(void)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	struct rusage	usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return -1;
+	}
+
+#ifdef __APPLE__
+	/* Darwin reports bytes, the others kilobytes. */
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+
+/*!
+	@function stats_pass_begin
+	@discussion Starts timing a pass
+	@param as The assembler state structure
+ */
+void stats_pass_begin(assembler *as)
+{
+	as->stats.start_wall = stats_wall_time();
+	as->stats.start_cpu = stats_cpu_time();
+}
+
+
+/*!
+	@function stats_pass_end
+	@discussion Records the time and lines of the pass just made
+	@param as The assembler state structure
+ */
+void stats_pass_end(assembler *as)
+{
+	as->stats.wall[as->pass] += stats_wall_time() - as->stats.start_wall;
+	as->stats.cpu[as->pass] += stats_cpu_time() - as->stats.start_cpu;
+	as->stats.lines[as->pass] = as->cumulative_total_lines;
+}
+
+
+/*!
+	@function stats_rate
+	@discussion Works out a rate, allowing for a time too short to measure
+	@param count The number of things done
+	@param seconds The time taken to do them
+	@result things per second
+ */
+static double stats_rate(double count, double seconds)
+{
+	return seconds > 0 ? count / seconds : 0;
+}
+
+
+/*!
+	@function stats_json_string
+	@discussion Writes a string as a JSON string
+	@param fp The stream to write to
+	@param str The string
+ */
+static void stats_json_string(FILE *fp, char *str)
+{
+	fputc('"', fp);
+
+	for (; *str != EOS; str++)
+	{
+		if (*str == '"' || *str == '\\')
+		{
+			fprintf(fp, "\\%c", *str);
+		}
+		else if ((unsigned char)*str < ' ')
+		{
+			fprintf(fp, "\\u%04x", (unsigned char)*str);
+		}
+		else
+		{
+			fputc(*str, fp);
+		}
+	}
+
+	fputc('"', fp);
+}
+
+
+/*!
+	@function stats_print
+	@discussion Reports the figures gathered during the assembly
+	@param as The assembler state structure
+ */
+void stats_print(assembler *as)
+{
+	struct stats	*s = &as->stats;
+	double			wall = s->wall[1] + s->wall[2];
+	double			cpu = s->cpu[1] + s->cpu[2];
+	u_int			lines = s->lines[1] + s->lines[2];
+	double			probe = s->lookups > 0 ? (double)s->probes / s->lookups : 0;
+	long			peak = stats_peak_memory();
+	int				pass;
+
+	if (s->format == STATS_JSON)
+	{
+		fprintf(as->err, "{\n");
+		fprintf(as->err, "  \"assembler\": \"mamou\",\n");
+		fprintf(as->err, "  \"module\": ");
+		stats_json_string(as->err, as->file_index > 0 ? as->file_name[0] : "");
+		fprintf(as->err, ",\n");
+		fprintf(as->err, "  \"passes\": [\n");
+		for (pass = 1; pass <= 2; pass++)
+		{
+			fprintf(as->err, "    {\"pass\": %d, \"wall\": %.6f, \"cpu\": %.6f, \"lines\": %u, \"lines_per_second\": %.0f}%s\n",
+				pass, s->wall[pass], s->cpu[pass], s->lines[pass],
+				stats_rate(s->lines[pass], s->wall[pass]), pass < 2 ? "," : "");
+		}
+		fprintf(as->err, "  ],\n");
+		fprintf(as->err, "  \"total\": {\"wall\": %.6f, \"cpu\": %.6f, \"lines\": %u, \"lines_per_second\": %.0f},\n",
+			wall, cpu, lines, stats_rate(lines, wall));
+		fprintf(as->err, "  \"source\": {\"files\": %u, \"bytes\": %lu, \"read_time\": %.6f},\n",
+			s->files_read, s->bytes_read, s->read_time);
+		fprintf(as->err, "  \"symbols\": {\"lookups\": %lu, \"inserts\": %lu, \"probes\": %lu, \"average_probe\": %.3f, \"longest_probe\": %u},\n",
+			s->lookups, s->inserts, s->probes, probe, s->longest_probe);
+		if (peak >= 0)
+		{
+			fprintf(as->err, "  \"peak_memory_kb\": %ld\n", peak);
+		}
+		else
+		{
+			fprintf(as->err, "  \"peak_memory_kb\": null\n");
+		}
+		fprintf(as->err, "}\n");
+
+		return;
+	}
+
+	fprintf(as->err, "\n");
+	fprintf(as->err, "Assembler Statistics:\n");
+	for (pass = 1; pass <= 2; pass++)
+	{
+		fprintf(as->err, " - pass %d: %.3fs elapsed, %.3fs CPU, %u lines (%.0f lines/s)\n",
+			pass, s->wall[pass], s->cpu[pass], s->lines[pass], stats_rate(s->lines[pass], s->wall[pass]));
+	}
+	fprintf(as->err, " - total: %.3fs elapsed, %.3fs CPU, %u lines (%.0f lines/s)\n",
+		wall, cpu, lines, stats_rate(lines, wall));
+	fprintf(as->err, " - source: %u files, %lu bytes read in %.3fs\n",
+		s->files_read, s->bytes_read, s->read_time);
+	fprintf(as->err, " - symbols: %lu lookups, %lu inserts, %.2f slots per lookup, %u at most\n",
+		s->lookups, s->inserts, probe, s->longest_probe);
+	if (peak >= 0)
+	{
+		fprintf(as->err, " - peak memory: %ld KB\n", peak);
+	}
+	else
+	{
+		fprintf(as->err, " - peak memory: unknown\n");
+	}
+}
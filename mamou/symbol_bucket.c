@@ -8,12 +8,269 @@
 * (C) 2004 Boisy G. Pitre
 ***************************************************************************/
 
+#include <pthread.h>
 #include "mamou.h"
 #include "h6309.h"
 #include "pseudo.h"
 #include "util.h"
 
 
+#ifdef CASE_SENSITIVE
+#define SYMCMP(a, b)	strcmp(a, b)
+#define SYMCHAR(c)		(c)
+#else
+#define SYMCMP(a, b)	strcasecmp(a, b)
+#define SYMCHAR(c)		tolower(c)
+#endif
+
+#define NAME_BLOCK	4096		/* bytes of name storage allocated at a time */
+#define TABLE_MIN	64			/* initial slots in a name or symbol table */
+#define SCOPE_MIN	16			/* initial slots in a temporary label table */
+#define SCOPE_UNSAVED	((u_int)-1)	/* ordinal of a scope only one pass opens */
+
+
+/*!
+	@function symbol_hash
+	@discussion Hashes a symbol name (FNV-1a), folding case like the compares do
+	@param name The name to hash
+	@result The hash value
+ */
+static u_int symbol_hash(char *name)
+{
+	u_int	h = 2166136261u;
+
+	while (*name != EOS)
+	{
+		h ^= (u_char)SYMCHAR((u_char)*name);
+		h *= 16777619u;
+		name++;
+	}
+
+	return h;
+}
+
+
+/*!
+	@function name_intern
+	@discussion Finds the one stored copy of a symbol name
+	@param as The assembler state structure
+	@param name The name to look for
+	@param hash The hash of the name
+	@param create Store the name if it has not been seen before
+	@result pointer to the stored name, or NULL if it was not found
+ */
+static char *name_intern(assembler *as, char *name, u_int hash, int create)
+{
+	struct namepool	*pool = &as->names;
+	char			*p;
+	u_int			i, len;
+
+	/* 1. Look for the name. */
+	if (pool->slot != NULL)
+	{
+		for (i = hash & (pool->size - 1); pool->slot[i] != NULL; i = (i + 1) & (pool->size - 1))
+		{
+			if (SYMCMP(name, pool->slot[i]) == 0)
+			{
+				return pool->slot[i];
+			}
+		}
+	}
+
+	if (create == 0)
+	{
+		return NULL;
+	}
+
+	/* 2. Keep the pool at most three quarters full. */
+	if ((pool->count + 1) * 4 > pool->size * 3)
+	{
+		char	**old = pool->slot;
+		u_int	old_size = pool->size;
+
+		pool->size = old_size == 0 ? TABLE_MIN : old_size * 2;
+		pool->slot = (char **)calloc(pool->size, sizeof(char *));
+		if (pool->slot == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		for (i = 0; i < old_size; i++)
+		{
+			if (old[i] != NULL)
+			{
+				u_int	j = symbol_hash(old[i]) & (pool->size - 1);
+
+				while (pool->slot[j] != NULL)
+				{
+					j = (j + 1) & (pool->size - 1);
+				}
+
+				pool->slot[j] = old[i];
+			}
+		}
+
+		free(old);
+	}
+
+	/* 3. Copy the name into the current block.  Each block starts with a
+	 *    pointer to the one before it so they can all be freed.
+	 */
+	len = strlen(name) + 1;
+
+	if (len > pool->block_left)
+	{
+		u_int	size = len > NAME_BLOCK ? len : NAME_BLOCK;
+
+		p = (char *)malloc(sizeof(char *) + size);
+		if (p == NULL)
+		{
+			fatal("Out of memory");
+		}
+
+		*(char **)p = pool->block;
+		pool->block = p;
+		pool->avail = p + sizeof(char *);
+		pool->block_left = size;
+	}
+
+	p = pool->avail;
+	memcpy(p, name, len);
+	pool->avail += len;
+	pool->block_left -= len;
+
+	/* 4. Enter it in the pool. */
+	for (i = hash & (pool->size - 1); pool->slot[i] != NULL; i = (i + 1) & (pool->size - 1))
+	{
+	}
+
+	pool->slot[i] = p;
+	pool->count++;
+
+	return p;
+}
+
+
+/*!
+	@function table_slot
+	@discussion Finds the slot holding a symbol, or the empty slot it would go in
+	@param table The symbol table to search; it must have slots
+	@param name The interned name of the symbol
+	@param hash The hash of the name
+	@result pointer to the slot
+ */
+static struct nlist **table_slot(struct symtab *table, char *name, u_int hash)
+{
+	u_int	i;
+
+	for (i = hash & (table->size - 1); table->slot[i] != NULL; i = (i + 1) & (table->size - 1))
+	{
+		/* Interned names compare by address. */
+		if (table->slot[i]->name == name)
+		{
+			break;
+		}
+	}
+
+	return &table->slot[i];
+}
+
+
+/*!
+	@function table_grow
+	@discussion Makes room in a symbol table for one more entry
+	@param table The symbol table
+	@param min_size Number of slots for a table that has none yet
+	@result 0 on success, 1 if memory ran out
+ */
+static int table_grow(struct symtab *table, u_int min_size)
+{
+	struct nlist	**old = table->slot;
+	u_int			old_size = table->size;
+	u_int			i;
+
+	/* 1. Keep the table at most three quarters full. */
+	if ((table->count + 1) * 4 <= table->size * 3)
+	{
+		return 0;
+	}
+
+	table->size = old_size == 0 ? min_size : old_size * 2;
+	table->slot = (struct nlist **)calloc(table->size, sizeof(struct nlist *));
+	if (table->slot == NULL)
+	{
+		table->slot = old;
+		table->size = old_size;
+
+		return 1;
+	}
+
+	/* 2. Rehash the existing entries. */
+	for (i = 0; i < old_size; i++)
+	{
+		if (old[i] != NULL)
+		{
+			*table_slot(table, old[i]->name, old[i]->hash) = old[i];
+		}
+	}
+
+	free(old);
+
+	return 0;
+}
+
+
+/*!
+	@function table_free
+	@discussion Frees a symbol table and the symbols in it
+	@param table The symbol table
+ */
+static void table_free(struct symtab *table)
+{
+	struct link	*lp, *next;
+	u_int		i;
+
+	for (i = 0; i < table->size; i++)
+	{
+		if (table->slot[i] != NULL)
+		{
+			for (lp = table->slot[i]->L_list; lp != NULL; lp = next)
+			{
+				next = lp->next;
+				free(lp);
+			}
+
+			free(table->slot[i]);
+		}
+	}
+
+	free(table->slot);
+
+	table->slot = NULL;
+	table->size = 0;
+	table->count = 0;
+}
+
+
+/*!
+	@function symbol_table
+	@discussion Picks the table a symbol belongs in.  Temporary symbols (those
+	@discussion with an '@' in the name) live in the current scope.
+	@param as The assembler state structure
+	@param name The name of the symbol
+	@result pointer to the table
+ */
+static struct symtab *symbol_table(assembler *as, char *name)
+{
+	if (as->scope != NULL && strchr(name, '@') != NULL)
+	{
+		return &as->scope->labels;
+	}
+
+	return &as->bucket;
+}
+
+
 /*!
 	@function symbol_add
 	@discussion Adds a symbol to the symbol bucket
@@ -25,11 +282,11 @@
 struct nlist *symbol_add(assembler *as, char *name, int val, int override)
 {
 	struct link		*lp;
-	struct nlist	*np, *p, *backp;
-	int				i;
-	char			tmp_label[MAXLAB];
+	struct nlist	*np;
+	struct symtab	*table;
+	u_int			hash;
 
-	/* 1. Does the symbol name meet our criteria? */	
+	/* 1. Does the symbol name meet our criteria? */
 	if (!alpha(*name) && *name != '@')
 	{
 		error(as, "illegal symbol name");
@@ -37,60 +294,51 @@ struct nlist *symbol_add(assembler *as, char *name, int val, int override)
 		return NULL;
 	}
 
-	/* 2. If it's a temporary symbol, generate a unique symbol name based on
-     *    current file index and number of blank lines.
-	 */
-//	if (name[strlen(name) - 1] == '@')
-	if (strchr(name, '@') != NULL)
-	{
-		sprintf(tmp_label, "_tmp%s%04X%04X", name, (int)as->use_depth, (int)as->current_file->num_blank_lines);
-		
-		name = tmp_label;
-	}
-	
-	/* See if the value is already defined. */
+	/* 2. See if the value is already defined. */
 	if ((np = symbol_find(as, name, 0)) != NULL)
 	{
+		precomp_redefine(as, np);
+
 		/* 1. Symbol has been defined already -- is this pass 2? */
 		if (as->pass == 2)
 		{
-			/* 1. It's pass 2 -- determine if the value has changed from pass 1. */			
+			/* 1. It's pass 2 -- determine if the value has changed from pass 1. */
 			if (np->def == val || override == 1)
 			{
-				/* 1. Is the existing variable is overridable? */				
+				/* 1. Is the existing variable is overridable? */
 				if (np->overridable == 1)
 				{
-					/* 1.  Yes, so we'll override it with new passed value. */					
+					/* 1.  Yes, so we'll override it with new passed value. */
 					np->def = val;
 				}
-				
+
 				return np;
 			}
 			else
 			{
-				/* 1. The value is different and we can't override -- it's a phasing error. */				
+				/* 1. The value is different and we can't override -- it's a phasing error. */
 				error(as, "phasing error");
 
 				return NULL;
 			}
 		}
 
-		/* If we're here, it's pass 1 -- is the existing symbol overridable? */		
+		/* If we're here, it's pass 1 -- is the existing symbol overridable? */
 		if (np->overridable == 1)
 		{
-			/* 1. Yes it is. */			
+			/* 1. Yes it is. */
 			np->def = val;
-			
+
 			return np;
 		}
 		else
 		{
-			/* 2. No, it's not overridable. */			
+			/* 2. No, it's not overridable. */
 			if (override == 0)
 			{
 				error(as, "symbol redefined");
 			}
-			
+
 			return NULL;
 		}
 	}
@@ -98,21 +346,22 @@ struct nlist *symbol_add(assembler *as, char *name, int val, int override)
 	/* 3. It's not an existing symbol, so we'll add it to the bucket. */
 	if (as->o_debug)
 	{
-		 printf("Installing %s as $%x\n", name, val);
+		 fprintf(as->out, "Installing %s as $%x\n", name, val);
 	}
 
-	/* 4. Allocate memory for a symbol entry. */	
-	np = (struct nlist *)malloc(sizeof(struct nlist));
-	if (np == NULL)
+	/* 4. Make room for it in its table. */
+	table = symbol_table(as, name);
+
+	if (table_grow(table, table == &as->bucket ? TABLE_MIN : SCOPE_MIN) != 0)
 	{
 		error(as, "symbol table full");
 
 		return NULL;
 	}
-	
-	/* 5. Allocate memory for the symbol name. */
-	np->name = (char *)malloc(strlen(name) + 1);
-	if (np->name == NULL)
+
+	/* 5. Allocate memory for a symbol entry. */
+	np = (struct nlist *)malloc(sizeof(struct nlist));
+	if (np == NULL)
 	{
 		error(as, "symbol table full");
 
@@ -120,19 +369,22 @@ struct nlist *symbol_add(assembler *as, char *name, int val, int override)
 	}
 
 	/* 6. Set up the symbol entry with the appropriate information. */
-	strcpy(np->name, name);
+	hash = symbol_hash(name);
+	np->name = name_intern(as, name, hash, 1);
+	np->hash = hash;
 	np->def = val;
-	np->Lnext = NULL;  
-	np->Rnext = NULL;
 	np->overridable = override;
+	np->serial = ++as->symbol_serial;
 
 	/* 7. Allocate a link. */
 	lp = (struct link *)malloc(sizeof(struct link));
 	if (lp == NULL)
 	{
+		free(np);
+
 		return NULL;
 	}
-	
+
 	np->L_list = lp;
 
 	if (as->current_file != NULL)
@@ -141,303 +393,620 @@ struct nlist *symbol_add(assembler *as, char *name, int val, int override)
 	}
 	else
 	{
-		/* 1. Symbol was defined on the command line. */		
+		/* 1. Symbol was defined on the command line. */
 		lp->L_num = 0;
 	}
-	
+
 	lp->next = NULL;
-	p = as->bucket;
-	backp = NULL;
 
-	/* 8. Insert the symbol into the table in alphabetical order. */
-	while (p != NULL) 
+	/* 8. Enter the symbol in the table. */
+	*table_slot(table, np->name, hash) = np;
+	table->count++;
+	as->stats.inserts++;
+
+	/* 9. We're done, and we were successful. */
+	return np;
+}
+
+
+/*!
+	@function symbol_find
+	@discussion Finds a symbol in the symbol bucket
+	@param as The assembler state structure
+	@param name Name of the symbol to search for
+	@param ignoreUndefined Ignore the symbol if it is not found
+	@result pointer to symbol if found, else NULL
+ */
+struct nlist *symbol_find(assembler *as, char *name, int ignoreUndefined)
+{
+	struct symtab	*table = symbol_table(as, name);
+	struct nlist	**slot;
+	u_int			hash, probe;
+
+	as->stats.lookups++;
+
+	/* 1. A name that was never interned cannot be in any table. */
+	if (table->slot != NULL)
 	{
-		backp = p;
-		
-#ifdef CASE_SENSITIVE
-		i = strcmp(name, p->name);
-#else
-		i = strcasecmp(name, p->name);
-#endif
-		if (i < 0)
-		{
-			p = p->Lnext;
-		}
-		else
+		hash = symbol_hash(name);
+		name = name_intern(as, name, hash, 0);
+
+		if (name != NULL)
 		{
-			p = p->Rnext;
+			slot = table_slot(table, name, hash);
+
+			/* 1. Count the slots looked at, for --stats. */
+			probe = (((u_int)(slot - table->slot) - hash) & (table->size - 1)) + 1;
+			as->stats.probes += probe;
+			if (probe > as->stats.longest_probe)
+			{
+				as->stats.longest_probe = probe;
+			}
+
+			if (*slot != NULL)
+			{
+				return *slot;
+			}
 		}
 	}
-	if (backp == NULL)
+
+	if (as->pass == 2 && ignoreUndefined == 0)
 	{
-		as->bucket = np;
+		error(as, "symbol undefined on pass 2");
 	}
-#ifdef CASE_SENSITIVE
-	else if (strcmp(name, backp->name) < 0)
-#else
-	else if (strcasecmp(name, backp->name) < 0)
-#endif
+
+	return NULL;
+}
+
+
+/*!
+	@function symbol_scope_open
+	@discussion Starts a new scope for temporary symbols.  A scope is opened
+	@discussion for each file and again after each blank line.  On pass 2 the
+	@discussion scope starts with the symbols pass 1 found in it, so that
+	@discussion forward references resolve.  Scopes in a file used under ifp1
+	@discussion or ifp2 are not numbered, since the other pass never opens them.
+	@param as The assembler state structure
+ */
+void symbol_scope_open(assembler *as)
+{
+	struct tmpscope	*scope;
+
+	scope = (struct tmpscope *)calloc(1, sizeof(struct tmpscope));
+	if (scope == NULL)
 	{
-		backp->Lnext = np;
+		fatal("Out of memory");
 	}
-	else
+
+	scope->ordinal = as->pass_only_depth > 0 ? SCOPE_UNSAVED : as->scope_ordinal++;
+	scope->prev = as->scope;
+
+	if (as->pass == 2 && scope->ordinal < as->scope_count)
 	{
-		backp->Rnext = np;
+		scope->labels = as->scope_labels[scope->ordinal];
+		memset(&as->scope_labels[scope->ordinal], 0, sizeof(struct symtab));
 	}
 
-	/* 9. We're done, and we were successful. */	
-	return np;  
+	as->scope = scope;
 }
 
 
 /*!
-	@function symbol_find
-	@discussion Finds a symbol in the symbol bucket
+	@function symbol_scope_close
+	@discussion Ends the current temporary symbol scope.  Pass 1 keeps its
+	@discussion symbols for pass 2; pass 2 drops them.
 	@param as The assembler state structure
-	@param name Name of the symbol to search for
-	@param ignoreUndefined Ignore the symbol if it is not found
-	@result pointer to symbol if found, else NULL
  */
-struct nlist *symbol_find(assembler *as, char *name, int ignoreUndefined)
+void symbol_scope_close(assembler *as)
 {
-	struct nlist *np;
-	int     i;
-	char			tmp_label[MAXLAB];
-	
-	/* 1. If it's a temporary symbol that hasn't had the _tmp tag prepended,
-	 *    then generate a unique symbol name based on the current use depth
-	 *    and number of blank lines.
-	 */	
-	if (strchr(name, '@') != NULL && strncmp(name, "_tmp", 4) != 0)
+	struct tmpscope	*scope = as->scope;
+
+	if (scope == NULL)
 	{
-		sprintf(tmp_label, "_tmp%s%04X%04X", name, (int)as->use_depth, (int)as->current_file->num_blank_lines);
-		
-		name = tmp_label;
+		return;
 	}
-	
-	np = as->bucket;
 
-	while (np != NULL)
+	as->scope = scope->prev;
+
+	if (as->pass == 1 && scope->labels.count > 0 && scope->ordinal != SCOPE_UNSAVED)
 	{
-#ifdef CASE_SENSITIVE
-		i = strcmp(name, np->name);
-#else
-		i = strcasecmp(name, np->name);
-#endif
-		if (i == 0)
+		if (scope->ordinal >= as->scope_count)
 		{
-			return np;
-		}
-		else if (i < 0)
-		{
-			np = np->Lnext;
-		}
-		else
-		{
-			np = np->Rnext;
+			struct symtab	*saved;
+			u_int			count = as->scope_count == 0 ? TABLE_MIN : as->scope_count;
+
+			while (count <= scope->ordinal)
+			{
+				count *= 2;
+			}
+
+			saved = (struct symtab *)realloc(as->scope_labels, count * sizeof(struct symtab));
+			if (saved == NULL)
+			{
+				fatal("Out of memory");
+			}
+
+			memset(&saved[as->scope_count], 0, (count - as->scope_count) * sizeof(struct symtab));
+			as->scope_labels = saved;
+			as->scope_count = count;
 		}
+
+		as->scope_labels[scope->ordinal] = scope->labels;
+	}
+	else
+	{
+		table_free(&scope->labels);
 	}
 
-	if (as->pass == 2 && ignoreUndefined == 0)
+	free(scope);
+}
+
+
+/*!
+	@function symbol_free
+	@discussion Frees all symbols and symbol names
+	@param as The assembler state structure
+ */
+void symbol_free(assembler *as)
+{
+	struct tmpscope	*scope;
+	char			*block;
+	u_int			i;
+
+	while ((scope = as->scope) != NULL)
 	{
-		error(as, "symbol undefined on pass 2");
+		as->scope = scope->prev;
+		table_free(&scope->labels);
+		free(scope);
 	}
-	
-	return NULL;
+
+	for (i = 0; i < as->scope_count; i++)
+	{
+		table_free(&as->scope_labels[i]);
+	}
+
+	free(as->scope_labels);
+	as->scope_labels = NULL;
+	as->scope_count = 0;
+
+	table_free(&as->bucket);
+
+	while ((block = as->names.block) != NULL)
+	{
+		as->names.block = *(char **)block;
+		free(block);
+	}
+
+	free(as->names.slot);
+	memset(&as->names, 0, sizeof(struct namepool));
 }
 
 
 #define NMNE (sizeof(table) / sizeof(struct h6309_opcode))
 #define NPSE (sizeof(pseudo) / sizeof(struct pseudo_opcode))
 
+#define MNE_BUCKET_LOAD	4		/* mnemonics per displacement bucket */
+#define MNE_MAX_TRIES	65536	/* displacements tried before the table grows */
+
+/*
+ * The machine and pseudo mnemonics are found through a perfect hash: a
+ * mnemonic's bucket gives a displacement that puts it in a slot of its own,
+ * so a lookup is one hash and one compare.  Names are hashed in lower case,
+ * which folds the case of the source.  The table is built once and shared,
+ * unchanged, by every assembly in the process.
+ */
+struct mne_entry
+{
+	char		*name;		/* NULL if the slot is empty */
+	mnemonic	m;
+};
+
+static struct mne_entry	*mne_slot;		/* one entry per slot */
+static u_int			*mne_displace;	/* displacement for each bucket */
+static u_int			mne_slots;		/* slots, a power of 2 */
+static u_int			mne_buckets;	/* buckets, a power of 2 */
+static int				mne_shift;		/* leaves a slot number of a 32 bit hash */
+static pthread_once_t	mne_once = PTHREAD_ONCE_INIT;
+
+#define MNE_SLOT(h, d)	((u_int)(((h) ^ (d)) * 2654435761u) >> mne_shift)
+
+
 /*!
-	@function mne_look
-	@discussion Looks up a mnemonic
-	@param as The assembler state structure
-	@param str A pointer to the text of the mnemonic
-	@param m A pointer to the mnemonic structure
+	@function mne_hash
+	@discussion Hashes a mnemonic (FNV-1a), ignoring case
+	@param name The name to hash
+	@result The hash value
  */
-int mne_look(assembler *as, char *str, mnemonic *m)
+static u_int mne_hash(char *name)
 {
-	struct h6309_opcode		*low, *high, *mid;
-	struct pseudo_opcode	*plow, *phigh, *pmid;
-	int						cond;
-	
-	/* Assume opcode is unknown. */	
-	m->type = OPCODE_UNKNOWN;
+	u_int	h = 2166136261u;
 
-	/* Search machine mnemonics first. */
-	low =  &table[0];
-	high = &table[NMNE - 1];
-	while (low <= high)
+	while (*name != EOS)
 	{
-		mid = low + (high - low) / 2;
-		if ((cond = strcasecmp(str, mid->mnemonic)) < 0)
+		h ^= (u_char)tolower((u_char)*name);
+		h *= 16777619u;
+		name++;
+	}
+
+	return h;
+}
+
+
+/*!
+	@function mne_place
+	@discussion Finds a displacement that puts every mnemonic of a bucket in a free slot
+	@param entry The mnemonics
+	@param hash The hash of each mnemonic
+	@param member Indexes of the mnemonics in the bucket
+	@param count Number of mnemonics in the bucket
+	@param bucket The bucket
+	@result 1 if the bucket was placed, 0 if the table needs to grow
+ */
+static int mne_place(struct mne_entry *entry, u_int *hash, int *member, int count, u_int bucket)
+{
+	u_int	d;
+	int		i, j;
+
+	for (d = 0; d < MNE_MAX_TRIES; d++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			struct mne_entry	*e = &mne_slot[MNE_SLOT(hash[member[i]], d)];
+
+			if (e->name != NULL)
+			{
+				break;
+			}
+
+			*e = entry[member[i]];
+		}
+
+		if (i == count)
 		{
-			high = mid - 1;
+			mne_displace[bucket] = d;
+
+			return 1;
 		}
-		else if (cond > 0)
+
+		/* Take back the mnemonics placed with this displacement. */
+		for (j = 0; j < i; j++)
 		{
-			low = mid + 1;
+			mne_slot[MNE_SLOT(hash[member[j]], d)].name = NULL;
+		}
+	}
+
+	return 0;
+}
+
+
+/*!
+	@function mne_build
+	@discussion Builds the perfect hash of the machine and pseudo mnemonics
+ */
+static void mne_build(void)
+{
+	struct mne_entry	*entry;
+	u_int				*hash, bucket;
+	int					*bucket_of, *bucket_size, *member;
+	int					count = 0, i, j, size, max_size, placed;
+
+	entry = (struct mne_entry *)malloc((NMNE + NPSE) * sizeof(struct mne_entry));
+	hash = (u_int *)malloc((NMNE + NPSE) * sizeof(u_int));
+	bucket_of = (int *)malloc((NMNE + NPSE) * sizeof(int));
+	member = (int *)malloc((NMNE + NPSE) * sizeof(int));
+	if (entry == NULL || hash == NULL || bucket_of == NULL || member == NULL)
+	{
+		fatal("Out of memory");
+	}
+
+	/* 1. Collect the mnemonics, machine mnemonics first. */
+	for (i = 0; i < (int)(NMNE + NPSE); i++)
+	{
+		struct mne_entry	*e = &entry[count];
+
+		if (i < (int)NMNE)
+		{
+			e->name = table[i].mnemonic;
+			e->m.type = OPCODE_H6309;
+			e->m.opcode.h6309 = &table[i];
 		}
 		else
 		{
-			if (as->o_cpuclass < mid->cpuclass)
+			e->name = pseudo[i - NMNE].pseudo;
+			e->m.type = OPCODE_PSEUDO;
+			e->m.opcode.pseudo = &pseudo[i - NMNE];
+		}
+
+		hash[count] = mne_hash(e->name);
+
+		for (j = 0; j < count; j++)
+		{
+			if (hash[j] == hash[count] && strcasecmp(entry[j].name, e->name) == 0)
 			{
-				return 1;
+				break;
 			}
+		}
 
-			m->type = OPCODE_H6309;
-			m->opcode.h6309 = mid;
-			
-			return 0;
+		if (j == count)
+		{
+			count++;
 		}
 	}
 
-	/* Check for pseudo ops. */
-	plow =  &pseudo[0];
-	phigh = &pseudo[NPSE - 1];
-	
-	while (plow <= phigh)
+	/* 2. Start with twice as many slots as mnemonics, and grow until
+	 *    every bucket finds a displacement.
+	 */
+	mne_slots = 2;
+	mne_shift = 31;
+	while (mne_slots < (u_int)count * 2)
+	{
+		mne_slots <<= 1;
+		mne_shift--;
+	}
+
+	mne_buckets = 1;
+	while (mne_buckets * MNE_BUCKET_LOAD < (u_int)count)
 	{
-		pmid = plow + (phigh - plow) / 2;
+		mne_buckets <<= 1;
+	}
+
+	do
+	{
+		free(mne_slot);
+		free(mne_displace);
 
-		if ((cond = strcasecmp(str, pmid->pseudo)) < 0)
+		mne_slot = (struct mne_entry *)calloc(mne_slots, sizeof(struct mne_entry));
+		mne_displace = (u_int *)calloc(mne_buckets, sizeof(u_int));
+		bucket_size = (int *)calloc(mne_buckets, sizeof(int));
+		if (mne_slot == NULL || mne_displace == NULL || bucket_size == NULL)
 		{
-			phigh = pmid - 1;
+			fatal("Out of memory");
 		}
-		else if (cond > 0)
+
+		max_size = 0;
+		for (i = 0; i < count; i++)
 		{
-			plow = pmid + 1;
+			bucket_of[i] = hash[i] & (mne_buckets - 1);
+			if (++bucket_size[bucket_of[i]] > max_size)
+			{
+				max_size = bucket_size[bucket_of[i]];
+			}
 		}
-		else
+
+		/* 3. Place the fullest buckets first, while there is the most room. */
+		placed = 1;
+		for (size = max_size; size > 0 && placed; size--)
 		{
-			m->type = OPCODE_PSEUDO;
-			m->opcode.pseudo = pmid;			
-			
-			return 0;
+			for (bucket = 0; bucket < mne_buckets && placed; bucket++)
+			{
+				if (bucket_size[bucket] != size)
+				{
+					continue;
+				}
+
+				for (i = 0, j = 0; i < count; i++)
+				{
+					if ((u_int)bucket_of[i] == bucket)
+					{
+						member[j++] = i;
+					}
+				}
+
+				placed = mne_place(entry, hash, member, size, bucket);
+			}
+		}
+
+		free(bucket_size);
+
+		if (!placed)
+		{
+			mne_slots <<= 1;
+			mne_shift--;
 		}
+	} while (!placed);
+
+	free(member);
+	free(bucket_of);
+	free(hash);
+	free(entry);
+}
+
+
+/*!
+	@function mne_look
+	@discussion Looks up a mnemonic
+	@param as The assembler state structure
+	@param str A pointer to the text of the mnemonic
+	@param m A pointer to the mnemonic structure
+ */
+int mne_look(assembler *as, char *str, mnemonic *m)
+{
+	struct mne_entry	*e;
+	u_int				h;
+
+	/* Assume opcode is unknown. */	
+	m->type = OPCODE_UNKNOWN;
+
+	pthread_once(&mne_once, mne_build);
+
+	h = mne_hash(str);
+	e = &mne_slot[MNE_SLOT(h, mne_displace[h & (mne_buckets - 1)])];
+
+	if (e->name == NULL || strcasecmp(str, e->name) != 0)
+	{
+		return 1;
+	}
+
+	/* Machine mnemonics the CPU doesn't have are unknown. */
+	if (e->m.type == OPCODE_H6309 && as->o_cpuclass < e->m.opcode.h6309->cpuclass)
+	{
+		return 1;
 	}
 
-	return 1;
+	*m = e->m;
+
+	return 0;
+}
+
+
+/*!
+	@function symbol_compare
+	@discussion qsort comparison of two symbols by name
+ */
+static int symbol_compare(const void *a, const void *b)
+{
+	return SYMCMP((*(struct nlist **)a)->name, (*(struct nlist **)b)->name);
 }
 
 
-static void symbol_dump_bucket_r(struct nlist *ptr, int type);
-static unsigned int	counter;
+/*!
+	@function symbol_sort
+	@discussion Lists the symbols in a table in alphabetical order
+	@param table The symbol table
+	@param count Set to the number of symbols
+	@result array of symbols the caller frees, or NULL if there are none
+ */
+static struct nlist **symbol_sort(struct symtab *table, u_int *count)
+{
+	struct nlist	**list;
+	u_int			i, n = 0;
+
+	*count = 0;
+
+	if (table->count == 0)
+	{
+		return NULL;
+	}
+
+	list = (struct nlist **)malloc(table->count * sizeof(struct nlist *));
+	if (list == NULL)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < table->size; i++)
+	{
+		if (table->slot[i] != NULL)
+		{
+			list[n++] = table->slot[i];
+		}
+	}
+
+	qsort(list, n, sizeof(struct nlist *), symbol_compare);
+
+	*count = n;
+
+	return list;
+}
+
 
 /*!
 	@function symbol_bucket_dump
 	@discussion Prints the symbol table in alphabetical order
-	@param ptr Pointer to the symbol bucket tree
+	@param as The assembler state structure
+	@param table The symbol table
    @param type Type of output (1 = columnar, 2 = assembly listing)
  */
-void symbol_dump_bucket(struct nlist *ptr, int type)
+void symbol_dump_bucket(assembler *as, struct symtab *table, int type)
 {
+	struct nlist	**list, *ptr;
+	u_int			i, count, counter;
+
    if (type == 1)
    {
-      printf("\f");
+      fprintf(as->out, "\f");
    }
    else
    {
-      printf("* ");
+      fprintf(as->out, "* ");
    }
 
-   /* 1. Reset the counter. */	
+   /* 1. Reset the counter. */
    counter = 0;
 
-   /* 2. Print the symbol table heading. */	
-   printf("Symbol table:\n");
-	
-	/* 3. Do the dump. */	
-	symbol_dump_bucket_r(ptr, type);
-   
-   printf("\n");
-}
+   /* 2. Print the symbol table heading. */
+   fprintf(as->out, "Symbol table:\n");
 
-static void symbol_dump_bucket_r(struct nlist *ptr, int type)
-{
-	if (ptr != NULL)
+	/* 3. Do the dump. */
+	list = symbol_sort(table, &count);
+
+	for (i = 0; i < count; i++)
 	{
-		symbol_dump_bucket_r(ptr->Lnext, type);
-		
+		ptr = list[i];
+
       if (type == 1)
       {
-         printf("%-10s $%04X", ptr->name, (int)ptr->def);
-         
+         fprintf(as->out, "%-10s $%04X", ptr->name, (int)ptr->def);
+
          counter++;
-         
+
          if (counter >= 4)
          {
-            printf("\n");
-            
+            fprintf(as->out, "\n");
+
             counter = 0;
          }
          else
          {
-            printf("     ");
+            fprintf(as->out, "     ");
          }
       }
       else
       {
-         printf("%-10s EQU  $%04X\n", ptr->name, (int)ptr->def);
+         fprintf(as->out, "%-10s EQU  $%04X\n", ptr->name, (int)ptr->def);
       }
-		
-		symbol_dump_bucket_r(ptr->Rnext, type);
 	}
-		
-	return;
+
+	free(list);
+
+   fprintf(as->out, "\n");
 }
 
 
 /*!
 	@function symbol_cross_reference
 	@discussion Prints the cross reference table
-	@param ptr Pointer to the symbol table
+	@param as The assembler state structure
+	@param table The symbol table
  */
-static void symbol_cross_reference_r(struct nlist *ptr);
-
-void symbol_cross_reference(struct nlist *ptr)
+void symbol_cross_reference(assembler *as, struct symtab *table)
 {
-	/* 1. Print the heading. */	
-	printf("Cross-Reference table:\n");
-	
-	/* 2. Do the cross reference. */	
-	symbol_cross_reference_r(ptr);
-}
+	struct nlist	**list, *ptr;
+	struct link		*tp;
+	u_int			n, count;
+	int				i;
 
+	/* 1. Print the heading. */
+	fprintf(as->out, "Cross-Reference table:\n");
+
+	/* 2. Do the cross reference. */
+	list = symbol_sort(table, &count);
+
+	for (n = 0; n < count; n++)
+	{
+		ptr = list[n];
+		i = 1;
+
+		fprintf(as->out, "%-10s ($%04X) referenced from lines ", ptr->name, (int)ptr->def);
 
-static void symbol_cross_reference_r(struct nlist *ptr)
-{
-	struct link *tp;
-	int i = 1;
-		
-	if (ptr != NULL)
-	{
-		symbol_cross_reference_r(ptr->Lnext);
-		
-		printf("%-10s ($%04X) referenced from lines ", ptr->name, (int)ptr->def);
-		
 		tp = ptr->L_list;
-		
+
 		while (tp != NULL)
 		{
 			if (i++ > 10)
 			{
 				i = 1;
-				
-				printf("\n                      ");
+
+				fprintf(as->out, "\n                      ");
 			}
-			
-			printf("%05d ", (int)tp->L_num);
-			
+
+			fprintf(as->out, "%05d ", (int)tp->L_num);
+
 			tp = tp->next;
 		}
-		
-		printf("\n");
-		
-		symbol_cross_reference_r(ptr->Rnext);
+
+		fprintf(as->out, "\n");
 	}
-		
-	return;
+
+	free(list);
 }
@@ -64,6 +64,8 @@ void fatal(char *str)
  */
 void error(assembler *as, char *str)
 {
+	precomp_veto(as);
+
 	if (as->ignore_errors == 1)
 	{
 		return;
@@ -74,7 +76,7 @@ void error(assembler *as, char *str)
 		print_header(as);
 	}
 	as->current_line++;
-	printf("\n***** Error: %s\n", str);
+	fprintf(as->out, "\n***** Error: %s\n", str);
 	print_line(as, 1, 'E', as->old_program_counter);
 	as->num_errors++;
 
@@ -186,7 +188,7 @@ void emit(assembler *as, int byte)
 	/* 1. Show debug output if flagged. */
 	if (as->o_debug)
 	{
-		printf("Emit       %04X[%02X]\n", (unsigned int)as->program_counter, byte);
+		fprintf(as->out, "Emit       %04X[%02X]\n", (unsigned int)as->program_counter, byte);
 	}	
 	
 	/* 2. If this is pass 1... */
@@ -208,7 +210,11 @@ void emit(assembler *as, int byte)
 			}
 		}
 
-		as->psect[as->current_psect].size++;
+		/* Only Disk BASIC mode opens a segment before counting. */
+		if (as->current_psect >= 0)
+		{
+			as->psect[as->current_psect].size++;
+		}
 	}
 	else
 	{
@@ -232,7 +238,7 @@ void emit(assembler *as, int byte)
 
 		if (as->E_total > E_LIMIT + MAXBUF)
 		{
-			printf("Overflow in E_bytes array\n");
+			fprintf(as->out, "Overflow in E_bytes array\n");
 		}
 	}
 
@@ -268,7 +274,7 @@ void decb_header_emit(assembler *as, unsigned int start, unsigned int size)
 
 		if (as->E_total > E_LIMIT + MAXBUF)
 		{
-			printf("Overflow in E_bytes array\n");
+			fprintf(as->out, "Overflow in E_bytes array\n");
 		}
 		
 		f_record(as);
@@ -302,7 +308,7 @@ void decb_trailer_emit(assembler *as, unsigned int exec)
 
 		if (as->E_total > E_LIMIT + MAXBUF)
 		{
-			printf("Overflow in E_bytes array\n");
+			fprintf(as->out, "Overflow in E_bytes array\n");
 		}
 		
 		f_record(as);
@@ -481,6 +487,25 @@ void finish_outfile(assembler *as)
 	}
 
 	_coco_close(as->fd_object);
+	as->fd_object = NULL;
+
+	return;
+}
+
+
+/*!
+	@function local_time
+	@discussion Converts a time to local time in a buffer of the caller's
+	@param t The time to convert
+	@param tm Set to the local time
+ */
+void local_time(time_t t, struct tm *tm)
+{
+#ifdef _WIN32
+	localtime_s(tm, &t);
+#else
+	localtime_r(&t, tm);
+#endif
 
 	return;
 }
@@ -38,6 +38,7 @@ struct cmdtbl
 static struct cmdtbl table[] =
 {
     {os9attr,	"attr"},
+    {os9build,	"build"},
     {os9cmp,	"cmp"},
     {os9copy,	"copy"},
     {os9dcheck,	"dcheck"},
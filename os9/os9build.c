@@ -0,0 +1,1020 @@
+/********************************************************************
+ * os9build.c - Build an RBF disk image from a manifest
+ *
+ * The manifest lists what would otherwise take a format, many makdir
+ * and copy commands, attr and gen.  The image is formatted, then every
+ * directory and file is laid out in memory, each one in a single run of
+ * clusters, and the image is written back with one write.
+ *
+ * $Id$
+ ********************************************************************/
+#include <util.h>
+#include <string.h>
+#include <time.h>
+#include <cocotypes.h>
+#include <cococonv.h>
+#include <cocopath.h>
+#include <os9path.h>
+#include <nativepath.h>
+#include <toolshed.h>
+
+#define	MAX_TOKENS	64
+#define	TRACK_SIZE	(256 * 18)		/* kernel track, as os9 gen writes it */
+#define	ROOT_ATTR	(FAP_DIR | FAP_READ | FAP_WRITE | FAP_EXEC | FAP_PREAD | FAP_PWRITE | FAP_PEXEC)
+
+/* A directory or file to be put on the image */
+typedef struct build_node
+{
+	char				name[D_NAMELEN + 1];
+	int					isdir;
+	int					attr;
+	int					attrSet, attrReset;		/* from attr lines */
+	char				*source;				/* file to copy */
+	int					translate;				/* copy -l */
+	struct build_node	*parent;
+	struct build_node	*child, *last;			/* entries in manifest order */
+	struct build_node	*next;
+	int					count;					/* entries besides . and .. */
+	u_int				fd_lsn;
+	u_char				*data;
+	u_int				size;
+	time_t				date;
+} build_node;
+
+/* The image while it is being built */
+typedef struct
+{
+	u_char		*image;
+	u_int		imageBytes;			/* size of the image file after format */
+	u_int		bps;
+	u_int		totalSectors;
+	u_int		clusterSize;
+	u_int		totalClusters;
+	u_char		*bitmap;
+	u_int		nextCluster;		/* where the search for free clusters starts */
+	u_int		endLSN;				/* one past the highest sector in use */
+	time_t		now;
+	int			fixedDate;			/* SOURCE_DATE_EPOCH gave the time */
+	int			dirs, files;
+} build_image;
+
+static int do_build(char **argv, char *manifest, char *disk, int quiet);
+static int ParseManifest(char *manifest, char *disk, build_node *root, char ***format, int *formatCount, char **bootfile, char **trackfile);
+static int Tokenize(char *line, char **tokens);
+static build_node *FindEntry(build_node *dir, char *name);
+static build_node *AddEntry(build_node *dir, char *name, int isdir);
+static build_node *WalkPath(build_node *root, char *pathlist, int makeDirs, int wantDir, char **error);
+static int ParseAttr(char *option, int *setMask, int *resetMask);
+static error_code LoadImage(char *disk, build_image *b);
+static error_code Allocate(build_image *b, u_int sectors, u_int *lsn);
+static error_code LoadSource(build_image *b, build_node *n);
+static error_code LayoutDirectory(build_image *b, build_node *dir);
+static void WriteFD(build_image *b, build_node *n, u_int dataLSN, u_int dataSectors);
+static void WriteDirectory(build_image *b, build_node *dir, u_int *segLSN, u_int *segSectors, int segCount);
+static void FreeNodes(build_node *n);
+
+/* Help message */
+static char const * const helpMessage[] =
+{
+	"Syntax: build {[<opts>]} <manifest> <disk> {[<opts>]}\n",
+	"Usage:  Format a disk image and fill it from a manifest in one pass.\n",
+	"Options:\n",
+	"     -q    quiet; do not report a summary\n",
+	"Manifest lines:\n",
+	"     format <format options>          geometry, as for os9 format\n",
+	"     makdir <dir>                     make a directory\n",
+	"     copy {-l} <file> <pathlist>      copy a file (-l translates EOLs)\n",
+	"     attr <pathlist> <attr options>   set attributes, as for os9 attr\n",
+	"     gen {-t=<trackfile>} {<bootfile>} link a bootfile, as for os9 gen\n",
+	NULL
+};
+
+
+int os9build(int argc, char **argv)
+{
+	error_code	ec = 0;
+	char *p = NULL;
+	int i;
+	int quiet = 0;
+	char *manifest = NULL, *disk = NULL;
+
+	/* if no arguments, show help and return */
+	if (argv[1] == NULL)
+	{
+		show_help(helpMessage);
+		return(0);
+	}
+
+	/* walk command line for options */
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			for (p = &argv[i][1]; *p != '\0'; p++)
+			{
+				switch(*p)
+				{
+					case 'q':
+						quiet = 1;
+						break;
+
+					case 'h':
+					case '?':
+						show_help(helpMessage);
+						return(0);
+
+					default:
+						fprintf(stderr, "%s: unknown option '%c'\n", argv[0], *p);
+						return(0);
+				}
+			}
+		}
+		else if (manifest == NULL)
+		{
+			manifest = argv[i];
+		}
+		else if (disk == NULL)
+		{
+			disk = argv[i];
+		}
+	}
+
+	if (manifest == NULL || disk == NULL)
+	{
+		show_help(helpMessage);
+		return(0);
+	}
+
+	ec = do_build(argv, manifest, disk, quiet);
+
+	return(ec);
+}
+
+
+static int do_build(char **argv, char *manifest, char *disk, int quiet)
+{
+	error_code	ec = 0;
+	build_node	root;
+	build_image	b;
+	char		**format = NULL;
+	int			formatCount = 0;
+	char		*bootfile = NULL, *trackfile = NULL;
+	char		*env;
+	lsn0_sect	*lsn0;
+	native_path_id	path;
+	u_int		size;
+
+	memset(&root, 0, sizeof(root));
+	memset(&b, 0, sizeof(b));
+	root.isdir = 1;
+	root.parent = &root;
+
+	/* 1. Read the whole manifest before touching the image */
+	if (ParseManifest(manifest, disk, &root, &format, &formatCount, &bootfile, &trackfile) != 0)
+	{
+		ec = 1;
+		goto out;
+	}
+
+	/* 2. Format the image as os9 format would */
+	format[formatCount] = disk;
+	format[formatCount + 1] = NULL;
+	os9format(formatCount + 1, format);
+
+	ec = LoadImage(disk, &b);
+	if (ec != 0)
+	{
+		fprintf(stderr, "%s: error %d reading '%s'\n", argv[0], ec, disk);
+		goto out;
+	}
+	lsn0 = (lsn0_sect *)b.image;
+
+	/* dates come from SOURCE_DATE_EPOCH for reproducible images */
+	b.now = time(NULL);
+	env = getenv("SOURCE_DATE_EPOCH");
+	if (env != NULL && *env != '\0')
+	{
+		b.now = (time_t)strtol(env, NULL, 10);
+		b.fixedDate = 1;
+		UnixToOS9Time(b.now, (char *)lsn0->dd_dat);
+	}
+
+	/* 3. Put the kernel track where os9 gen would and keep files off it */
+	if (trackfile != NULL)
+	{
+		coco_path_id	tpath;
+		u_int			startlsn, sectors, first, last;
+
+		if (int1(lsn0->pd_typ) == 0x80)
+		{
+			startlsn = 612;
+		}
+		else
+		{
+			startlsn = 34 * int2(lsn0->pd_sct) * int1(lsn0->pd_sid);
+		}
+
+		if (startlsn * 256 + TRACK_SIZE > b.totalSectors * b.bps)
+		{
+			fprintf(stderr, "%s: start LSN puts boottrack outside of OS-9 volume boundary\n", argv[0]);
+			ec = 1;
+			goto out;
+		}
+
+		ec = _coco_open(&tpath, trackfile, FAM_READ);
+		if (ec != 0)
+		{
+			fprintf(stderr, "%s: error %d opening '%s'\n", argv[0], ec, trackfile);
+			goto out;
+		}
+		size = TRACK_SIZE;
+		_coco_read(tpath, b.image + startlsn * 256, &size);
+		_coco_close(tpath);
+
+		sectors = (size + b.bps - 1) / b.bps;
+		first = startlsn / b.clusterSize;
+		last = (startlsn + (sectors > 0 ? sectors : 1) - 1) / b.clusterSize;
+		_os9_allbit(b.bitmap, first, last - first + 1);
+		if ((last + 1) * b.clusterSize > b.endLSN)
+		{
+			b.endLSN = (last + 1) * b.clusterSize;
+		}
+	}
+
+	/* 4. Lay out every directory and file */
+	ec = LayoutDirectory(&b, &root);
+	if (ec != 0)
+	{
+		if (ec == EOS_DF)
+		{
+			fprintf(stderr, "%s: '%s' is too small for the manifest\n", argv[0], disk);
+		}
+		goto out;
+	}
+
+	/* 5. Link the bootfile to LSN0 */
+	if (bootfile != NULL)
+	{
+		build_node *boot = FindEntry(&root, "OS9Boot");
+		fd_stats *fd = (fd_stats *)(b.image + boot->fd_lsn * b.bps);
+
+		_int3(int3(fd->fd_seg[0].lsn), lsn0->dd_bt);
+		_int2(boot->size, lsn0->dd_bsz);
+	}
+
+	/* 6. Write the image in one go; a short image stays short */
+	size = b.endLSN * b.bps;
+	if (size < b.imageBytes)
+	{
+		size = b.imageBytes;
+	}
+
+	ec = _native_open(&path, disk, FAM_READ | FAM_WRITE);
+	if (ec == 0)
+	{
+		_native_write(path, b.image, &size);
+		_native_close(path);
+	}
+	if (ec != 0)
+	{
+		fprintf(stderr, "%s: error %d writing '%s'\n", argv[0], ec, disk);
+		goto out;
+	}
+
+	if (!quiet)
+	{
+		printf("Built %s: %d directories, %d files, image ends at sector %u of %u\n",
+			disk, b.dirs, b.files, b.endLSN, b.totalSectors);
+	}
+
+out:
+	FreeNodes(root.child);
+	if (format != NULL)
+	{
+		while (formatCount > 2)
+		{
+			free(format[--formatCount]);
+		}
+		free(format);
+	}
+	free(trackfile);
+	free(bootfile);
+	free(b.image);
+
+	return(ec);
+}
+
+
+/* Read the manifest into a tree of nodes under root. The format options
+ * are returned as an argument vector with room left for the disk name.
+ */
+static int ParseManifest(char *manifest, char *disk, build_node *root, char ***format, int *formatCount, char **bootfile, char **trackfile)
+{
+	FILE	*fp;
+	char	line[1024];
+	char	*tokens[MAX_TOKENS];
+	char	*error = NULL;
+	int		lineNumber = 0, count, i;
+	build_node	*n;
+
+	*format = (char **)calloc(MAX_TOKENS + 3, sizeof(char *));
+	if (*format == NULL)
+	{
+		return(1);
+	}
+	(*format)[0] = "format";
+	(*format)[1] = "-q";
+	*formatCount = 2;
+
+	fp = fopen(manifest, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "build: cannot open '%s'\n", manifest);
+		return(1);
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineNumber++;
+
+		count = Tokenize(line, tokens);
+		if (count == 0 || tokens[0][0] == '*' || tokens[0][0] == '#')
+		{
+			continue;
+		}
+
+		error = NULL;
+
+		if (strcmp(tokens[0], "format") == 0)
+		{
+			/* the strings are kept for os9 format */
+			for (i = 1; i < count && *formatCount < MAX_TOKENS; i++)
+			{
+				(*format)[(*formatCount)++] = strdup(tokens[i]);
+			}
+		}
+		else if (strcmp(tokens[0], "makdir") == 0 && count == 2)
+		{
+			WalkPath(root, tokens[1], 1, 1, &error);
+		}
+		else if (strcmp(tokens[0], "copy") == 0 && (count == 3 || (count == 4 && strcmp(tokens[1], "-l") == 0)))
+		{
+			n = WalkPath(root, tokens[count - 1], 0, 0, &error);
+			if (n != NULL)
+			{
+				n->source = strdup(tokens[count - 2]);
+				n->translate = count == 4;
+			}
+		}
+		else if (strcmp(tokens[0], "attr") == 0 && count >= 3)
+		{
+			n = WalkPath(root, tokens[1], 0, -1, &error);
+			for (i = 2; i < count && n != NULL && error == NULL; i++)
+			{
+				if (ParseAttr(tokens[i], &n->attrSet, &n->attrReset) != 0)
+				{
+					error = "unknown attribute option";
+				}
+			}
+		}
+		else if (strcmp(tokens[0], "gen") == 0 && count >= 2)
+		{
+			for (i = 1; i < count && error == NULL; i++)
+			{
+				if (strncmp(tokens[i], "-t=", 3) == 0)
+				{
+					*trackfile = strdup(tokens[i] + 3);
+				}
+				else if (*bootfile == NULL)
+				{
+					*bootfile = strdup(tokens[i]);
+					n = WalkPath(root, "OS9Boot", 0, 0, &error);
+					if (n != NULL)
+					{
+						n->source = *bootfile;
+						n->attrSet = FAP_READ | FAP_WRITE;
+						n->attrReset = ~n->attrSet;
+					}
+				}
+				else
+				{
+					error = "more than one bootfile";
+				}
+			}
+		}
+		else
+		{
+			error = "unknown or malformed line";
+		}
+
+		if (error != NULL)
+		{
+			fprintf(stderr, "build: %s, line %d: %s\n", manifest, lineNumber, error);
+			fclose(fp);
+			return(1);
+		}
+	}
+
+	fclose(fp);
+
+	return(0);
+}
+
+
+/* Split a line at white space; double quotes keep spaces in a token
+ * and are dropped, as a shell would, so -n"My Disk" works.
+ */
+static int Tokenize(char *line, char **tokens)
+{
+	char	*p = line, *o;
+	int		count = 0, quoted;
+
+	while (count < MAX_TOKENS)
+	{
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		{
+			p++;
+		}
+		if (*p == '\0')
+		{
+			break;
+		}
+
+		tokens[count++] = o = p;
+		quoted = 0;
+
+		while (*p != '\0' && *p != '\r' && *p != '\n' && (quoted || (*p != ' ' && *p != '\t')))
+		{
+			if (*p == '"')
+			{
+				quoted = !quoted;
+				p++;
+			}
+			else
+			{
+				*o++ = *p++;
+			}
+		}
+
+		if (*p != '\0')
+		{
+			p++;
+		}
+		*o = '\0';
+	}
+
+	return(count);
+}
+
+
+/* OS-9 names don't distinguish case */
+static build_node *FindEntry(build_node *dir, char *name)
+{
+	build_node *n;
+
+	for (n = dir->child; n != NULL; n = n->next)
+	{
+		if (strcasecmp(n->name, name) == 0)
+		{
+			return(n);
+		}
+	}
+
+	return(NULL);
+}
+
+
+static build_node *AddEntry(build_node *dir, char *name, int isdir)
+{
+	build_node *n;
+
+	n = (build_node *)calloc(1, sizeof(build_node));
+	if (n == NULL)
+	{
+		return(NULL);
+	}
+
+	strcpy(n->name, name);
+	n->isdir = isdir;
+	n->parent = dir;
+
+	if (dir->last == NULL)
+	{
+		dir->child = n;
+	}
+	else
+	{
+		dir->last->next = n;
+	}
+	dir->last = n;
+	dir->count++;
+
+	return(n);
+}
+
+
+/* Find the node for a pathlist.  makdir makes every missing directory;
+ * copy makes the file in a directory that must already be there.
+ * wantDir is 1 for a directory, 0 for a file and -1 for either.
+ */
+static build_node *WalkPath(build_node *root, char *pathlist, int makeDirs, int wantDir, char **error)
+{
+	char		name[1024], *p, *q;
+	build_node	*dir = root, *n = root;
+
+	strncpy(name, pathlist, sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+
+	for (p = name; *p != '\0'; p = q)
+	{
+		while (*p == '/')
+		{
+			p++;
+		}
+		if (*p == '\0')
+		{
+			break;
+		}
+
+		q = p + strcspn(p, "/");
+		if (*q != '\0')
+		{
+			*q++ = '\0';
+		}
+
+		if (strlen(p) > D_NAMELEN || strcmp(p, ".") == 0 || strcmp(p, "..") == 0)
+		{
+			*error = "bad name";
+			return(NULL);
+		}
+
+		if (dir->isdir == 0)
+		{
+			*error = "not a directory";
+			return(NULL);
+		}
+
+		n = FindEntry(dir, p);
+		if (n == NULL)
+		{
+			if (makeDirs == 1 || (wantDir == 0 && *q == '\0'))
+			{
+				n = AddEntry(dir, p, makeDirs);
+				if (n == NULL)
+				{
+					*error = "out of memory";
+					return(NULL);
+				}
+			}
+			else
+			{
+				*error = "no such directory or file";
+				return(NULL);
+			}
+		}
+		else if (wantDir == 0 && *q == '\0')
+		{
+			*error = "already copied";
+			return(NULL);
+		}
+
+		dir = n;
+	}
+
+	if (n == root && wantDir != -1)
+	{
+		*error = "bad pathlist";
+		return(NULL);
+	}
+
+	if (wantDir != -1 && n->isdir != wantDir)
+	{
+		*error = wantDir == 1 ? "not a directory" : "is a directory";
+		return(NULL);
+	}
+
+	return(n);
+}
+
+
+/* An os9 attr option: -e -w -r -s, -p[ewr], -n[ewrs] or -np[ewr] */
+static int ParseAttr(char *option, int *setMask, int *resetMask)
+{
+	int		*mask = setMask;
+	int		public = 0;
+	char	*p = option;
+
+	if (*p++ != '-')
+	{
+		return(1);
+	}
+
+	if (*p == 'n')
+	{
+		mask = resetMask;
+		p++;
+	}
+
+	if (*p == 'p')
+	{
+		public = 1;
+		p++;
+	}
+
+	switch (*p)
+	{
+		case 'e':
+			*mask |= public ? FAP_PEXEC : FAP_EXEC;
+			break;
+
+		case 'w':
+			*mask |= public ? FAP_PWRITE : FAP_WRITE;
+			break;
+
+		case 'r':
+			*mask |= public ? FAP_PREAD : FAP_READ;
+			break;
+
+		case 's':
+			if (public)
+			{
+				return(1);
+			}
+			*mask |= FAP_SINGLE;
+			break;
+
+		default:
+			return(1);
+	}
+
+	return(*(p + 1) != '\0');
+}
+
+
+/* Read the freshly formatted image, grown to its full size, into memory */
+static error_code LoadImage(char *disk, build_image *b)
+{
+	error_code		ec;
+	native_path_id	path;
+	lsn0_sect		lsn0;
+	u_int			size;
+
+	ec = _native_open(&path, disk, FAM_READ);
+	if (ec != 0)
+	{
+		return(ec);
+	}
+
+	size = sizeof(lsn0);
+	ec = _native_read(path, &lsn0, &size);
+	if (ec != 0 || size != sizeof(lsn0))
+	{
+		_native_close(path);
+		return(ec != 0 ? ec : EOS_EOF);
+	}
+
+	b->bps = int1(lsn0.dd_lsnsize) == 0 ? 256 : int1(lsn0.dd_lsnsize) * 256;
+	b->totalSectors = int3(lsn0.dd_tot);
+	b->clusterSize = int2(lsn0.dd_bit);
+	b->totalClusters = b->totalSectors / b->clusterSize;
+
+	b->image = (u_char *)calloc(b->totalSectors, b->bps);
+	if (b->image == NULL)
+	{
+		_native_close(path);
+		return(EOS_OM);
+	}
+
+	_native_seek(path, 0, SEEK_SET);
+	_native_gs_size(path, &b->imageBytes);
+	if (b->imageBytes > b->totalSectors * b->bps)
+	{
+		b->imageBytes = b->totalSectors * b->bps;
+	}
+	size = b->imageBytes;
+	_native_read(path, b->image, &size);
+	_native_close(path);
+
+	b->bitmap = b->image + b->bps;
+
+	/* the format's own sectors end where the root directory does */
+	{
+		fd_stats	*fd = (fd_stats *)(b->image + int3(lsn0.dd_dir) * b->bps);
+
+		b->endLSN = int3(fd->fd_seg[0].lsn) + int2(fd->fd_seg[0].num);
+	}
+
+	return(0);
+}
+
+
+/* Claim the first run of free clusters that holds this many sectors */
+static error_code Allocate(build_image *b, u_int sectors, u_int *lsn)
+{
+	u_int	clusters = (sectors + b->clusterSize - 1) / b->clusterSize;
+	u_int	start, run = 0, c;
+
+	for (c = b->nextCluster, start = c; c < b->totalClusters; c++)
+	{
+		if (_os9_ckbit(b->bitmap, c) != 0)
+		{
+			run = 0;
+			start = c + 1;
+			continue;
+		}
+
+		if (++run == clusters)
+		{
+			_os9_allbit(b->bitmap, start, clusters);
+
+			*lsn = start * b->clusterSize;
+			if ((start + clusters) * b->clusterSize > b->endLSN)
+			{
+				b->endLSN = (start + clusters) * b->clusterSize;
+			}
+			if (start == b->nextCluster)
+			{
+				b->nextCluster = start + clusters;
+			}
+
+			return(0);
+		}
+	}
+
+	return(EOS_DF);
+}
+
+
+/* Read a file to copy, as os9 copy would, with its attributes and date */
+static error_code LoadSource(build_image *b, build_node *n)
+{
+	error_code		ec;
+	coco_path_id	path;
+	coco_file_stat	fdesc;
+	u_int			size, capacity = 0;
+	char			*newBuffer;
+	u_int			newSize;
+
+	ec = _coco_open(&path, n->source, FAM_READ);
+	if (ec != 0)
+	{
+		fprintf(stderr, "build: error %d opening '%s'\n", ec, n->source);
+		return(ec);
+	}
+
+	_coco_gs_size(path, &capacity);
+	n->data = (u_char *)malloc(capacity + 1);
+	if (n->data == NULL)
+	{
+		_coco_close(path);
+		return(EOS_OM);
+	}
+
+	size = capacity;
+	ec = _coco_read(path, n->data, &size);
+	if (ec == EOS_EOF || capacity == 0)
+	{
+		ec = 0;
+		size = 0;
+	}
+	n->size = size;
+
+	_coco_gs_fd(path, &fdesc);
+	n->attr = fdesc.attributes & ~FAP_DIR;
+	n->date = b->fixedDate ? b->now : fdesc.last_modified_time;
+
+	if (n->translate == 1 && path->type == NATIVE)
+	{
+		NativeToCoCo((char *)n->data, n->size, &newBuffer, &newSize);
+		free(n->data);
+		n->data = (u_char *)newBuffer;
+		n->size = newSize;
+	}
+
+	_coco_close(path);
+
+	if (ec != 0)
+	{
+		fprintf(stderr, "build: error %d reading '%s'\n", ec, n->source);
+	}
+
+	return(ec);
+}
+
+
+/* Give each entry of a directory its sectors, then fill in the directory.
+ * A new directory or file gets its FD sector and its data in one run.
+ */
+static error_code LayoutDirectory(build_image *b, build_node *dir)
+{
+	error_code	ec = 0;
+	build_node	*n;
+	u_int		sectors, lsn;
+	u_int		segLSN[2], segSectors[2];
+	int			segCount = 1;
+	u_int		dirBytes = (dir->count + 2) * sizeof(os9_dir_entry);
+
+	if (dir == dir->parent)
+	{
+		/* The root keeps the sectors format gave it, plus a run for any
+		 * entries that don't fit.
+		 */
+		lsn0_sect	*lsn0 = (lsn0_sect *)b->image;
+		fd_stats	*fd;
+
+		dir->fd_lsn = int3(lsn0->dd_dir);
+		fd = (fd_stats *)(b->image + dir->fd_lsn * b->bps);
+		segLSN[0] = int3(fd->fd_seg[0].lsn);
+		segSectors[0] = int2(fd->fd_seg[0].num);
+
+		if (dirBytes > segSectors[0] * b->bps)
+		{
+			sectors = (dirBytes - segSectors[0] * b->bps + b->bps - 1) / b->bps;
+			ec = Allocate(b, sectors, &lsn);
+			if (ec != 0)
+			{
+				return(ec);
+			}
+			segLSN[1] = lsn;
+			segSectors[1] = NextHighestMultiple(sectors, b->clusterSize);
+			segCount = 2;
+		}
+
+		dir->attr = ROOT_ATTR;
+		dir->date = b->now;
+		WriteFD(b, dir, 0, 0);
+		fd->fd_att = (dir->attr | dir->attrSet) & ~dir->attrReset;
+	}
+	else
+	{
+		segLSN[0] = dir->fd_lsn + 1;
+		segSectors[0] = NextHighestMultiple(1 + (dirBytes + b->bps - 1) / b->bps, b->clusterSize) - 1;
+	}
+
+	for (n = dir->child; n != NULL; n = n->next)
+	{
+		if (n->isdir == 1)
+		{
+			sectors = 1 + (((n->count + 2) * sizeof(os9_dir_entry)) + b->bps - 1) / b->bps;
+			n->attr = ROOT_ATTR;
+			n->date = b->now;
+			b->dirs++;
+		}
+		else
+		{
+			ec = LoadSource(b, n);
+			if (ec != 0)
+			{
+				return(ec);
+			}
+			sectors = 1 + (n->size + b->bps - 1) / b->bps;
+			b->files++;
+		}
+
+		ec = Allocate(b, sectors, &n->fd_lsn);
+		if (ec != 0)
+		{
+			return(ec);
+		}
+
+		if (n->isdir == 1)
+		{
+			ec = LayoutDirectory(b, n);
+			if (ec != 0)
+			{
+				return(ec);
+			}
+		}
+		else
+		{
+			sectors = NextHighestMultiple(sectors, b->clusterSize) - 1;
+			memcpy(b->image + (n->fd_lsn + 1) * b->bps, n->data, n->size);
+			WriteFD(b, n, n->size > 0 ? n->fd_lsn + 1 : 0, n->size > 0 ? sectors : 0);
+			free(n->data);
+			n->data = NULL;
+		}
+	}
+
+	WriteDirectory(b, dir, segLSN, segSectors, segCount);
+
+	return(0);
+}
+
+
+/* Fill in a new FD sector; data is one contiguous run */
+static void WriteFD(build_image *b, build_node *n, u_int dataLSN, u_int dataSectors)
+{
+	fd_stats	*fd = (fd_stats *)(b->image + n->fd_lsn * b->bps);
+	char		date[5];
+	int			i = 0;
+
+	if (n == n->parent)
+	{
+		/* the root's FD is there already; only its date is set here */
+		if (b->fixedDate)
+		{
+			UnixToOS9Time(b->now, date);
+			memcpy(fd->fd_dat, date, 5);
+			memcpy(fd->fd_creat, date, 3);
+		}
+		return;
+	}
+
+	memset(fd, 0, b->bps);
+	fd->fd_att = (n->attr | n->attrSet | (n->isdir ? FAP_DIR : 0)) & ~(n->attrReset & ~FAP_DIR);
+	_int2(0, fd->fd_own);
+	UnixToOS9Time(n->date, date);
+	memcpy(fd->fd_dat, date, 5);
+	memcpy(fd->fd_creat, date, 3);
+	fd->fd_lnk = 1;
+	_int4(n->isdir ? (n->count + 2) * sizeof(os9_dir_entry) : n->size, fd->fd_siz);
+
+	/* a segment counts at most 65535 sectors */
+	while (dataSectors > 0 && i < NUM_SEGS)
+	{
+		u_int num = dataSectors > 0xFFFF ? 0xFFFF : dataSectors;
+
+		_int3(dataLSN, fd->fd_seg[i].lsn);
+		_int2(num, fd->fd_seg[i].num);
+		dataLSN += num;
+		dataSectors -= num;
+		i++;
+	}
+}
+
+
+/* Write a directory's entries into its segments */
+static void WriteDirectory(build_image *b, build_node *dir, u_int *segLSN, u_int *segSectors, int segCount)
+{
+	fd_stats		*fd = (fd_stats *)(b->image + dir->fd_lsn * b->bps);
+	os9_dir_entry	entry;
+	build_node		*n;
+	u_char			name[D_NAMELEN + 1];
+	u_int			offset = 0;
+	int				i, seg = 0;
+
+	if (dir != dir->parent)
+	{
+		WriteFD(b, dir, segLSN[0], segSectors[0]);
+	}
+	else
+	{
+		for (i = 0; i < segCount; i++)
+		{
+			_int3(segLSN[i], fd->fd_seg[i].lsn);
+			_int2(segSectors[i], fd->fd_seg[i].num);
+		}
+		_int4((dir->count + 2) * sizeof(os9_dir_entry), fd->fd_siz);
+	}
+
+	for (i = -2, n = dir->child; i < dir->count; i++)
+	{
+		memset(&entry, 0, sizeof(entry));
+
+		if (i == -2)
+		{
+			strcpy((char *)name, "..");
+			_int3(dir->parent->fd_lsn, entry.lsn);
+		}
+		else if (i == -1)
+		{
+			strcpy((char *)name, ".");
+			_int3(dir->fd_lsn, entry.lsn);
+		}
+		else
+		{
+			strcpy((char *)name, n->name);
+			_int3(n->fd_lsn, entry.lsn);
+			n = n->next;
+		}
+		CStringToOS9String(name);
+		memcpy(entry.name, name, strlen((char *)name));
+
+		if (offset == segSectors[seg] * b->bps)
+		{
+			seg++;
+			offset = 0;
+		}
+		memcpy(b->image + segLSN[seg] * b->bps + offset, &entry, sizeof(entry));
+		offset += sizeof(entry);
+	}
+}
+
+
+static void FreeNodes(build_node *n)
+{
+	build_node *next;
+
+	while (n != NULL)
+	{
+		next = n->next;
+		FreeNodes(n->child);
+		if (n->source != NULL && strcmp(n->name, "OS9Boot") != 0)
+		{
+			free(n->source);
+		}
+		free(n->data);
+		free(n);
+		n = next;
+	}
+}
@@ -4,19 +4,59 @@
  * $Id$
  ********************************************************************/
 #include <util.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "cocopath.h"
 #include "cocotypes.h"
 
 
-#define BUFFSIZ	256
+#define BUFFSIZ	65536
+
+/* One pathlist found while walking an image for -i */
+typedef struct
+{
+    char *name;             /* pathlist relative to the root */
+    int isdir;
+} cmp_entry;
+
+typedef struct
+{
+    cmp_entry *entries;
+    int count;
+    int size;
+} cmp_list;
+
+/* A pair of files compared by the -i worker pool */
+typedef struct
+{
+    char *name;
+    int different;          /* 1 if contents or lengths differ */
+    u_int offset;           /* first differing byte */
+    error_code ec;
+} cmp_job;
 
 static int do_cmp(char **argv, char *file1, char *file2);
+static int do_cmp_images(char **argv, char *image1, char *image2);
+static void root_of(char *image, char *root);
+static error_code fill_buffer(coco_path_id path, u_char *buffer, u_int *size);
+static size_t first_difference(u_char *buffer1, u_char *buffer2, size_t num_bytes);
 static int compare(u_char *buffer1, u_char *buffer2, size_t num_bytes, size_t total_bytes);
+static error_code compare_files(char *file1, char *file2, u_char *buffer1, u_char *buffer2, u_int *offset, int *differ);
+static error_code walk_image(char *root, char *dir, cmp_list *list);
+static void free_list(cmp_list *list);
+static void *cmp_worker(void *arg);
 
 static void show_header(void);
 
 static int different;
+static int quiet;
+static int threads = 1;
+
+static cmp_job *jobs;
+static char *root1, *root2;
+static int jobCount, jobNext;
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Help message */
 static char const * const helpMessage[] =
@@ -24,6 +64,9 @@ static char const * const helpMessage[] =
     "Syntax: cmp {[<opts>]} <file1> <file2> {[<...>]} {[<opts>]}\n",
     "Usage:  Compare the contents of two files.\n",
     "Options:\n",
+    "     -q    stop at the first difference and exit with status 1\n",
+    "     -i    compare two disk images file by file\n",
+    "     -j<n> compare files in images with <n> threads\n",
     NULL
 };
 
@@ -33,6 +76,7 @@ int os9cmp(int argc, char **argv)
     error_code	ec = 0;
     char *p = NULL;
     int i;
+    int images = 0;
     char *file1 = NULL, *file2 = NULL;
 
 
@@ -43,6 +87,9 @@ int os9cmp(int argc, char **argv)
         return(0);
     }
 
+    quiet = 0;
+    threads = 1;
+
     /* walk command line for options */
     for (i = 1; i < argc; i++)
     {
@@ -52,11 +99,31 @@ int os9cmp(int argc, char **argv)
             {
                 switch(*p)
                 {
+                    case 'q':
+                        quiet = 1;
+                        break;
+
+                    case 'i':
+                        images = 1;
+                        break;
+
+                    case 'j':
+                        threads = atoi(p + 1);
+                        if (threads < 1)
+                        {
+                            threads = 1;
+                        }
+                        while (*(p + 1) != '\0')
+                        {
+                            p++;
+                        }
+                        break;
+
                     case '?':
                     case 'h':
                         show_help(helpMessage);
                         return(0);
-	
+
                     default:
                         fprintf(stderr, "%s: unknown option '%c'\n", argv[0], *p);
                         return(0);
@@ -81,25 +148,40 @@ int os9cmp(int argc, char **argv)
             else
             {
                 file2 = argv[i];
-                do_cmp(argv, file1, file2);
+                if (images == 1)
+                {
+                    ec |= do_cmp_images(argv, file1, file2);
+                }
+                else
+                {
+                    ec |= do_cmp(argv, file1, file2);
+                }
                 file1 = NULL;
+
+                if (quiet == 1 && ec != 0)
+                {
+                    break;
+                }
             }
         }
     }
 
-    return(ec);
+    /* only -q reports differences in the exit status */
+    return(quiet == 1 ? ec : 0);
 }
 
 
+/* Returns 1 if the files differ, for -q */
+
 static int do_cmp(char **argv, char *file1, char *file2)
 {
     error_code	ec = 0;
-    u_char buffer1[BUFFSIZ];
-    u_char buffer2[BUFFSIZ];
+    u_char *buffer1, *buffer2;
     coco_path_id path1, path2;
-    u_int num_bytes1, num_bytes2;
+    u_int num_bytes1, num_bytes2, num_bytes;
     error_code ec1, ec2;
-    int accum1 = 0, accum2 = 0;
+    size_t accum1 = 0, accum2 = 0;
+    size_t i;
     int diffCount = 0;
 
     /* open a path to the first file */
@@ -108,7 +190,7 @@ static int do_cmp(char **argv, char *file1, char *file2)
     if (ec != 0)
     {
         fprintf(stderr, "%s: cannot open file\n", argv[0]);
-        return(ec);
+        return(1);
     }
 
     /* open a path to the second file */
@@ -116,10 +198,26 @@ static int do_cmp(char **argv, char *file1, char *file2)
     if (ec != 0)
     {
         fprintf(stderr, "%s: cannot open file\n", argv[0]);
-        return(ec);
+        _coco_close(path1);
+        return(1);
     }
 
-    printf("Differences\n");
+    buffer1 = (u_char *)malloc(BUFFSIZ);
+    buffer2 = (u_char *)malloc(BUFFSIZ);
+    if (buffer1 == NULL || buffer2 == NULL)
+    {
+        fprintf(stderr, "%s: cannot allocate buffers\n", argv[0]);
+        free(buffer1);
+        free(buffer2);
+        _coco_close(path2);
+        _coco_close(path1);
+        return(1);
+    }
+
+    if (quiet == 0)
+    {
+        printf("Differences\n");
+    }
     different = 0;
 
     do
@@ -127,67 +225,615 @@ static int do_cmp(char **argv, char *file1, char *file2)
         num_bytes1 = BUFFSIZ;
         num_bytes2 = BUFFSIZ;
 
-        ec1 = _coco_read(path1, buffer1, &num_bytes1);
-        ec2 = _coco_read(path2, buffer2, &num_bytes2);
+        ec1 = fill_buffer(path1, buffer1, &num_bytes1);
+        ec2 = fill_buffer(path2, buffer2, &num_bytes2);
+
+        num_bytes = (num_bytes1 > num_bytes2) ? num_bytes2 : num_bytes1;
+
+        if (quiet == 1)
+        {
+            i = first_difference(buffer1, buffer2, num_bytes);
+            if (i < num_bytes)
+            {
+                printf("%s %s differ: byte %08X\n", file1, file2, (u_int)(accum1 + i));
+                different = 1;
+                break;
+            }
+        }
+        else
+        {
+            diffCount += compare(buffer1, buffer2, num_bytes, accum1);
+        }
 
-        diffCount += compare(buffer1, buffer2, (num_bytes1 > num_bytes2) ? num_bytes2 : num_bytes1, accum1);
-        
         accum1 += num_bytes1;
         accum2 += num_bytes2;
     }
-    while (ec1 == 0 && ec2 == 0);
+    while (ec1 == 0 && ec2 == 0 && num_bytes1 == BUFFSIZ && num_bytes2 == BUFFSIZ);
 
-    if (different == 0)
+    if (quiet == 1)
     {
-        printf("None\n");
+        if (different == 0 && accum1 != accum2)
+        {
+            printf("%s %s differ: EOF on %s\n", file1, file2, (accum1 > accum2) ? file2 : file1);
+            different = 1;
+        }
     }
+    else
+    {
+        if (different == 0)
+        {
+            printf("None\n");
+        }
+
+        printf("Bytes compared:   %08X\n", (u_int)((accum1 > accum2) ? accum2 : accum1));
+        printf("Bytes different:  %08X\n", diffCount);
+
+        if (accum1 > accum2)
+        {
+            printf("%s is longer\n", file1);
+        }
+        else if (accum2 > accum1)
+        {
+            printf("%s is longer\n", file2);
+        }
+    }
+
+    free(buffer2);
+    free(buffer1);
+
+    _coco_close(path2);
+    _coco_close(path1);
+
+    return(different);
+}
+
+
+/* Compare every file in two disk images (or native directories) by
+ * pathlist.  Returns 1 if the images differ, for -q.
+ */
+
+static int do_cmp_images(char **argv, char *image1, char *image2)
+{
+    error_code	ec = 0;
+    cmp_list list1, list2;
+    char *name1, *name2;
+    int i = 0, j = 0, k, c;
+    int fileCount = 0, diffCount = 0;
+    int workers;
+    pthread_t *tids;
+
+    memset(&list1, 0, sizeof(list1));
+    memset(&list2, 0, sizeof(list2));
+
+    /* an image name alone means its root directory */
+    name1 = (char *)malloc(strlen(image1) + 2);
+    name2 = (char *)malloc(strlen(image2) + 2);
+    if (name1 == NULL || name2 == NULL)
+    {
+        fprintf(stderr, "%s: cannot allocate memory\n", argv[0]);
+        free(name1);
+        free(name2);
+        return(1);
+    }
+    root_of(image1, name1);
+    root_of(image2, name2);
+
+    ec = walk_image(name1, "", &list1);
+    if (ec == 0)
+    {
+        ec = walk_image(name2, "", &list2);
+    }
+    if (ec != 0)
+    {
+        fprintf(stderr, "%s: error %d reading directories\n", argv[0], ec);
+        free_list(&list1);
+        free_list(&list2);
+        free(name1);
+        free(name2);
+        return(1);
+    }
+
+    /* Pair up the sorted lists; files in both go to the workers */
+    jobs = (cmp_job *)calloc(list1.count + 1, sizeof(cmp_job));
+    if (jobs == NULL)
+    {
+        fprintf(stderr, "%s: cannot allocate memory\n", argv[0]);
+        free_list(&list1);
+        free_list(&list2);
+        free(name1);
+        free(name2);
+        return(1);
+    }
+    jobCount = 0;
+
+    if (quiet == 0)
+    {
+        printf("Differences\n");
+    }
+    different = 0;
+
+    while (i < list1.count || j < list2.count)
+    {
+        if (i == list1.count)
+        {
+            c = 1;
+        }
+        else if (j == list2.count)
+        {
+            c = -1;
+        }
+        else
+        {
+            c = strcmp(list1.entries[i].name, list2.entries[j].name);
+        }
 
-    printf("Bytes compared:   %08X\n", (accum1 > accum2) ? accum2 : accum1);
-    printf("Bytes different:  %08X\n", diffCount);
+        if (c < 0)
+        {
+            if (quiet == 1)
+            {
+                printf("%s %s differ: %s only in %s\n", image1, image2, list1.entries[i].name, image1);
+            }
+            else
+            {
+                printf("Only in #1:  %s\n", list1.entries[i].name);
+            }
+            different = 1;
+            i++;
+        }
+        else if (c > 0)
+        {
+            if (quiet == 1)
+            {
+                printf("%s %s differ: %s only in %s\n", image1, image2, list2.entries[j].name, image2);
+            }
+            else
+            {
+                printf("Only in #2:  %s\n", list2.entries[j].name);
+            }
+            different = 1;
+            j++;
+        }
+        else
+        {
+            if (list1.entries[i].isdir != list2.entries[j].isdir)
+            {
+                if (quiet == 1)
+                {
+                    printf("%s %s differ: %s not same type\n", image1, image2, list1.entries[i].name);
+                }
+                else
+                {
+                    printf("Not same type:  %s\n", list1.entries[i].name);
+                }
+                different = 1;
+            }
+            else if (list1.entries[i].isdir == 0)
+            {
+                jobs[jobCount++].name = list1.entries[i].name;
+            }
+            i++;
+            j++;
+        }
 
-    if (accum1 > accum2)
+        if (quiet == 1 && different == 1)
+        {
+            break;
+        }
+    }
+
+    /* Compare the contents of the files found in both */
+    if (quiet == 0 || different == 0)
     {
-        printf("%s is longer\n", file1);
+        root1 = name1;
+        root2 = name2;
+        jobNext = 0;
+
+        /* no more workers than files, leaving -j as given for the next pair */
+        workers = threads;
+        if (workers > jobCount)
+        {
+            workers = jobCount > 0 ? jobCount : 1;
+        }
+
+        if (workers < 2)
+        {
+            cmp_worker(NULL);
+        }
+        else
+        {
+            tids = (pthread_t *)calloc(workers, sizeof(pthread_t));
+            if (tids == NULL)
+            {
+                cmp_worker(NULL);
+            }
+            else
+            {
+                for (k = 0; k < workers; k++)
+                {
+                    pthread_create(&tids[k], NULL, cmp_worker, NULL);
+                }
+                for (k = 0; k < workers; k++)
+                {
+                    pthread_join(tids[k], NULL);
+                }
+                free(tids);
+            }
+        }
+
+        /* report in pathlist order whatever order the workers finished in */
+        for (k = 0; k < jobCount; k++)
+        {
+            fileCount++;
+
+            if (jobs[k].ec != 0)
+            {
+                fprintf(stderr, "%s: error %d comparing %s\n", argv[0], jobs[k].ec, jobs[k].name);
+                different = 1;
+                diffCount++;
+            }
+            else if (jobs[k].different == 1)
+            {
+                if (quiet == 1)
+                {
+                    printf("%s %s differ: %s byte %08X\n", image1, image2, jobs[k].name, jobs[k].offset);
+                    different = 1;
+                    break;
+                }
+                printf("Differ:      %s (byte %08X)\n", jobs[k].name, jobs[k].offset);
+                different = 1;
+                diffCount++;
+            }
+        }
     }
-    else if (accum2 > accum1)
+
+    if (quiet == 0)
     {
-        printf("%s is longer\n", file2);
+        if (different == 0)
+        {
+            printf("None\n");
+        }
+
+        printf("Files compared:   %08X\n", fileCount);
+        printf("Files different:  %08X\n", diffCount);
     }
 
-    ec = _coco_close(path2);
-    ec = _coco_close(path1);
+    free_list(&list1);
+    free_list(&list2);
+    free(jobs);
+    free(name1);
+    free(name2);
+
+    return(different);
+}
+
+
+/* Turn an image name or directory into a prefix for pathlists under it:
+ * a bare image name gets a ',' and a directory gets a '/'
+ */
+
+static void root_of(char *image, char *root)
+{
+    coco_path_id path;
+    size_t len;
+
+    strcpy(root, image);
+
+    if (strchr(root, ',') == NULL)
+    {
+        if (_coco_open(&path, root, FAM_DIR | FAM_READ) == 0)
+        {
+            _coco_close(path);
+        }
+        else
+        {
+            strcat(root, ",");
+        }
+    }
+
+    len = strlen(root);
+    if (len > 0 && root[len - 1] != ',' && root[len - 1] != '/')
+    {
+        strcat(root, "/");
+    }
+}
+
+
+/* Read until the buffer is full or the file ends */
+
+static error_code fill_buffer(coco_path_id path, u_char *buffer, u_int *size)
+{
+    error_code ec = 0;
+    u_int accum = 0, num_bytes;
+
+    while (accum < *size)
+    {
+        num_bytes = *size - accum;
+
+        ec = _coco_read(path, buffer + accum, &num_bytes);
+        if (ec != 0 || num_bytes == 0)
+        {
+            break;
+        }
+
+        accum += num_bytes;
+    }
+
+    *size = accum;
 
     return(ec);
 }
 
 
+/* Offset of the first byte that differs, or num_bytes if none does.
+ * Whole words are compared until one differs.
+ */
+
+static size_t first_difference(u_char *buffer1, u_char *buffer2, size_t num_bytes)
+{
+    size_t i = 0;
+    unsigned long w1, w2;
+
+    while (i + sizeof(w1) <= num_bytes)
+    {
+        memcpy(&w1, buffer1 + i, sizeof(w1));
+        memcpy(&w2, buffer2 + i, sizeof(w2));
+        if (w1 != w2)
+        {
+            break;
+        }
+        i += sizeof(w1);
+    }
+
+    while (i < num_bytes && buffer1[i] == buffer2[i])
+    {
+        i++;
+    }
+
+    return(i);
+}
+
+
 static int compare(u_char *buffer1, u_char *buffer2, size_t num_bytes, size_t total_bytes)
 {
-    u_int i;
+    size_t i = 0;
     int dc = 0;
 
-    for (i = 0; i < num_bytes; i++)
+    for (;;)
     {
-        if (buffer1[i] != buffer2[i])
+        i += first_difference(buffer1 + i, buffer2 + i, num_bytes - i);
+        if (i >= num_bytes)
         {
-            if (different == 0)
-            {
-                different = 1;
-                show_header();
-            }
+            break;
+        }
+
+        if (different == 0)
+        {
+            different = 1;
+            show_header();
+        }
 #ifdef __APPLE__
-			printf("%08lx  %02x %02x\n", total_bytes + i, buffer1[i], buffer2[i]);
+		printf("%08lx  %02x %02x\n", total_bytes + i, buffer1[i], buffer2[i]);
 #else
-			printf("%08x  %02x %02x\n", total_bytes + i, buffer1[i], buffer2[i]);
+		printf("%08x  %02x %02x\n", (u_int)(total_bytes + i), buffer1[i], buffer2[i]);
 #endif
-			dc++;
-        }
+		dc++;
+        i++;
     }
 
     return(dc);
 }
 
 
+/* Compare two whole files, stopping at the first difference */
+
+static error_code compare_files(char *file1, char *file2, u_char *buffer1, u_char *buffer2, u_int *offset, int *differ)
+{
+    error_code ec;
+    coco_path_id path1, path2;
+    u_int num_bytes1, num_bytes2, num_bytes;
+    u_int accum = 0;
+    size_t i;
+
+    *differ = 0;
+    *offset = 0;
+
+    ec = _coco_open(&path1, file1, FAM_READ);
+    if (ec != 0)
+    {
+        return(ec);
+    }
+
+    ec = _coco_open(&path2, file2, FAM_READ);
+    if (ec != 0)
+    {
+        _coco_close(path1);
+        return(ec);
+    }
+
+    do
+    {
+        num_bytes1 = BUFFSIZ;
+        num_bytes2 = BUFFSIZ;
+
+        ec = fill_buffer(path1, buffer1, &num_bytes1);
+        if (ec == 0 || ec == EOS_EOF)
+        {
+            ec = fill_buffer(path2, buffer2, &num_bytes2);
+        }
+        if (ec != 0 && ec != EOS_EOF)
+        {
+            break;
+        }
+        ec = 0;
+
+        num_bytes = (num_bytes1 > num_bytes2) ? num_bytes2 : num_bytes1;
+
+        i = first_difference(buffer1, buffer2, num_bytes);
+        if (i < num_bytes || num_bytes1 != num_bytes2)
+        {
+            *differ = 1;
+            *offset = accum + i;
+            break;
+        }
+
+        accum += num_bytes;
+    }
+    while (num_bytes == BUFFSIZ);
+
+    _coco_close(path2);
+    _coco_close(path1);
+
+    return(ec);
+}
+
+
+/* Add every pathlist under dir (relative to root) to list, sorted */
+
+static int compare_entries(const void *a, const void *b)
+{
+    return(strcmp(((cmp_entry *)a)->name, ((cmp_entry *)b)->name));
+}
+
+static error_code walk_image(char *root, char *dir, cmp_list *list)
+{
+    error_code ec;
+    coco_path_id path, filePath;
+    coco_dir_entry dirent;
+    char pathlist[1024];
+    u_char name[256];
+    int first = list->count, last, k;
+
+    snprintf(pathlist, sizeof(pathlist), "%s%s", root, dir);
+    ec = _coco_open(&path, pathlist, FAM_DIR | FAM_READ);
+    if (ec != 0)
+    {
+        return(ec);
+    }
+
+    while (_coco_readdir(path, &dirent) == 0)
+    {
+        _coco_ncpy_name(&dirent, name, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+
+        if (name[0] == '\0' || name[0] == 255 ||
+            strcmp((char *)name, ".") == 0 || strcmp((char *)name, "..") == 0)
+        {
+            continue;
+        }
+
+        if (list->count == list->size)
+        {
+            cmp_entry *entries;
+
+            entries = (cmp_entry *)realloc(list->entries, (list->size == 0 ? 256 : list->size * 2) * sizeof(cmp_entry));
+            if (entries == NULL)
+            {
+                _coco_close(path);
+                return(EOS_OM);
+            }
+            list->entries = entries;
+            list->size = list->size == 0 ? 256 : list->size * 2;
+        }
+
+        snprintf(pathlist, sizeof(pathlist), "%s%s%s", dir, dir[0] == '\0' ? "" : "/", name);
+        list->entries[list->count].name = strdup(pathlist);
+        list->entries[list->count].isdir = 0;
+
+        /* as in dsave, whatever opens as a directory is one */
+        snprintf(pathlist, sizeof(pathlist), "%s%s", root, list->entries[list->count].name);
+        if (_coco_open(&filePath, pathlist, FAM_DIR | FAM_READ) == 0)
+        {
+            list->entries[list->count].isdir = 1;
+            _coco_close(filePath);
+        }
+
+        list->count++;
+    }
+
+    _coco_close(path);
+
+    /* descend once this directory is closed, to keep few paths open */
+    last = list->count;
+    for (k = first; k < last; k++)
+    {
+        if (list->entries[k].isdir == 1)
+        {
+            ec = walk_image(root, list->entries[k].name, list);
+            if (ec != 0)
+            {
+                return(ec);
+            }
+        }
+    }
+
+    if (dir[0] == '\0')
+    {
+        qsort(list->entries, list->count, sizeof(cmp_entry), compare_entries);
+    }
+
+    return(0);
+}
+
+
+/* Free the pathlists in a list and the list itself */
+
+static void free_list(cmp_list *list)
+{
+    int k;
+
+    if (list->entries != NULL)
+    {
+        for (k = 0; k < list->count; k++)
+        {
+            free(list->entries[k].name);
+        }
+        free(list->entries);
+    }
+    list->entries = NULL;
+    list->count = list->size = 0;
+}
+
+
+/* Take files off the job list until it is empty */
+
+static void *cmp_worker(void *arg)
+{
+    u_char *buffer1, *buffer2;
+    char file1[1024], file2[1024];
+    cmp_job *job;
+
+    buffer1 = (u_char *)malloc(BUFFSIZ);
+    buffer2 = (u_char *)malloc(BUFFSIZ);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&jobLock);
+        job = jobNext < jobCount ? &jobs[jobNext++] : NULL;
+        pthread_mutex_unlock(&jobLock);
+
+        if (job == NULL)
+        {
+            break;
+        }
+
+        if (buffer1 == NULL || buffer2 == NULL)
+        {
+            job->ec = EOS_OM;
+            continue;
+        }
+
+        snprintf(file1, sizeof(file1), "%s%s", root1, job->name);
+        snprintf(file2, sizeof(file2), "%s%s", root2, job->name);
+        job->ec = compare_files(file1, file2, buffer1, buffer2, &job->offset, &job->different);
+    }
+
+    free(buffer1);
+    free(buffer2);
+
+    return(NULL);
+}
+
+
 static void show_header(void)
 {
     printf("byte      #1 #2\n");
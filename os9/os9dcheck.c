@@ -8,15 +8,18 @@
 #include <cocopath.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
-static char *strcatdup( char *orig, char *cat1, char *cat2 );
-static error_code ParseFDSegList(fd_stats *fd, u_int dd_tot, char *path, unsigned char *secondaryBitmap );
-static error_code BuildSecondaryAllocationMap( os9_path_id os9_path, int dir_lsn, char *path, unsigned char *secondaryBitmap );
+static error_code LoadImage( os9_path_id os9_path );
+static u_char *ImageSector( u_int lsn );
+static u_int AddPathNode( u_int parent, char *name );
+static char *PathOfNode( u_int node );
+static error_code BuildSecondaryAllocationMap( os9_path_id os9_path, int dir_lsn, u_int node, unsigned char *secondaryBitmap );
+static int ParallelAllocationMap( os9_path_id os9_path, int dir_lsn, u_int node, unsigned char *secondaryBitmap, int bitmapBytes, int threads );
+static void InitSecondaryBitmap( os9_path_id os9_path, unsigned char *secondaryBitmap, int bitmapBytes );
 static error_code CompareAllocationMap( unsigned char *primaryAlloMap, unsigned char *secondaryBitmap, int dd_map, int cluster_size );
-static void PathlistsForQuestionableClusters();
-static void FreeQuestionableMemory();
 static void AddQuestionableCluster( int cluster );
-static void AddPathToBit( int lsn, char *path );
+static void AddPathToBit( u_int lsn, u_int node );
 static int do_dcheck(char **argv, char *p);
 static void PathlistsForQuestionableClusters(void);
 static void FreeQuestionableMemory(void);
@@ -34,6 +37,7 @@ static char const * const helpMessage[] =
 	"     -b    suppress listing of unused clusters (clusters allocated\n",
 	"            but not in file structure)\n"
 	"     -p    print pathlists of questionable clusters\n",	
+	"     -j<n> walk the directory tree with <n> threads\n",
 	NULL
 };
 
@@ -45,6 +49,7 @@ int	gFolderCount,
 	gBadFD; 		/* Incremented when a file descriptor has an out of range file segment  */
 
 int	sOption, bOption, pOption;	/* Flags for command line options */
+int	jOption;					/* Number of threads walking the tree */
 
 typedef struct qCluster_t
 {
@@ -52,15 +57,101 @@ typedef struct qCluster_t
 	int					lsn;
 } qCluster_t;
 
-typedef struct qBitPath_t
+/* A directory entry seen during the walk.  Pathnames are only put back
+   together from these when something has to be reported. */
+typedef struct pathNode_t
 {
-	struct qBitPath_t	*next;
-	int					lsn;
-	char				*path;	
-} qBitPath_t;
+	u_int				parent;		/* index of the parent directory's node, 0 at the root */
+	u_int				name;		/* offset of the name in gNames */
+} pathNode_t;
+
+/* A sector claimed by more than one file; the first claim lives in gOwner */
+typedef struct extraOwner_t
+{
+	u_int				lsn;
+	u_int				node;
+} extraOwner_t;
+
+/* Something the walk has to report. A serial walk prints it as soon as it is
+   found; a parallel walk records it with the directory it was found in. */
+typedef struct dcheckEvent_t
+{
+	int					type;
+	u_int				node;
+	u_int				a, b, c;
+} dcheckEvent_t;
+
+enum
+{
+	EV_BADSEG,			/* directory segment longer than the disk */
+	EV_BADDIRLSN,		/* directory sector past the end of the disk */
+	EV_BADENTRYLSN,		/* directory entry pointing past the end of the disk */
+	EV_BADFDSEG,		/* file segment past the end of the disk */
+	EV_BADDIRFD,		/* directory not walked because of a bad segment */
+	EV_OWNER,			/* the sectors of a segment belong to node (with -p) */
+	EV_SUBTREE			/* the report of another task goes here */
+};
+
+/* A directory handed to a walker in a parallel walk, with its report */
+typedef struct dcheckTask_t
+{
+	u_int				dir_lsn;
+	u_int				node;
+	dcheckEvent_t		*events;
+	u_int				eventCount, eventSize;
+} dcheckTask_t;
+
+/* A directory being walked, and where to resume in it */
+typedef struct dirFrame_t
+{
+	fd_stats			*fd;		/* directory file descriptor, in gImage */
+	u_int				node;
+	u_int				fd_siz;
+	u_int				count;		/* bytes of the directory file walked so far */
+	u_int				seg, sector, entry;
+} dirFrame_t;
+
+/* One walker. A serial walk has one working on the secondary bitmap; each
+   thread of a parallel walk has its own bitmap and works on one task at a time. */
+typedef struct dcheckWalker_t
+{
+	unsigned char		*bitmap;
+	u_int				dd_tot;
+	dcheckTask_t		*task;		/* task being walked, NULL in a serial walk */
+	int					folders, files;
+	int					unsure;		/* found something only a serial walk reports in order */
+} dcheckWalker_t;
+
+static void Report( dcheckWalker_t *w, int type, u_int node, u_int a, u_int b, u_int c );
+static void PrintEvent( dcheckEvent_t *ev );
+static error_code ParseFDSegList( dcheckWalker_t *w, fd_stats *fd, u_int dd_tot, u_int node );
+static void AddTask( dcheckWalker_t *w, u_int dir_lsn, u_int node );
 
 static qCluster_t	*qCluster;		/* This is an array of clusters that are reported unusual */
-static qBitPath_t	*gBitPaths;		/* Every allocated bit has its path (sometimes more that one) */
+
+static u_char		*gImage;		/* The whole image, read once */
+static u_int		gImageSectors;	/* Number of whole sectors in gImage */
+static u_int		gBps;
+
+static pathNode_t	*gNodes;		/* Node 0 is unused so that 0 can mean no owner */
+static u_int		gNodeCount, gNodeSize;
+static char			*gNames;
+static u_int		gNamesUsed, gNamesSize;
+
+static u_int		*gOwner;		/* Node of the first file holding each LSN (only with -p) */
+static u_int		gOwnerCount;
+static extraOwner_t	*gExtraOwners;
+static u_int		gExtraCount, gExtraSize;
+
+static pthread_mutex_t	gNodeLock = PTHREAD_MUTEX_INITIALIZER;	/* protects the path nodes */
+static pthread_mutex_t	gQueueLock = PTHREAD_MUTEX_INITIALIZER;	/* protects everything below */
+static pthread_cond_t	gQueueCond = PTHREAD_COND_INITIALIZER;
+static dcheckTask_t	**gTasks;		/* Tasks in the order they were queued */
+static u_int		gTaskCount, gTaskSize;
+static u_int		gTaskNext;		/* Next task for an idle walker */
+static int			gTasksActive;
+static int			gAbandon;		/* Give up the parallel walk */
+static unsigned char	*gDirSeen;	/* Directory FDs already queued */
 
 int os9dcheck(int argc, char *argv[])
 {
@@ -69,6 +160,7 @@ int os9dcheck(int argc, char *argv[])
 	int i;
 	
 	sOption = bOption = pOption = 0;
+	jOption = 1;
 	
 	/* walk command line for options */
 	for (i = 1; i < argc; i++)
@@ -88,6 +180,17 @@ int os9dcheck(int argc, char *argv[])
 					case 'p':
 						pOption = 1;
 						break;
+					case 'j':
+						jOption = atoi(p + 1);
+						if (jOption < 1)
+						{
+							jOption = 1;
+						}
+						while (*(p + 1) >= '0' && *(p + 1) <= '9')
+						{
+							p++;
+						}
+						break;
 					case '?':
 					case 'h':
 						show_help(helpMessage);
@@ -139,9 +242,9 @@ static int do_dcheck(char **argv, char *p)
 	os9_path_id		os9_path;
 	int		cluster_size;
 	unsigned char  *secondaryBitmap;
-	char		*newName;
+	int			bitmapBytes;
+	u_int		root;
 	char os9pathlist[256];
-	double		size;
 	
 	if( strchr(p, ',') != 0 )
 	{
@@ -197,7 +300,8 @@ static int do_dcheck(char **argv, char *p)
    This allows us to track wether a partial cluster is (incorrectly) allocated.
    It also makes it easier to determine if sectors are allocated multiple times.
 */
-	secondaryBitmap = (unsigned char *)malloc( (int3(os9_path->lsn0->dd_tot)+1) / 8 );
+	bitmapBytes = int3(os9_path->lsn0->dd_tot) / 8 + 1;
+	secondaryBitmap = (unsigned char *)malloc( bitmapBytes );
 
 	if( secondaryBitmap == NULL )
 	{
@@ -205,24 +309,41 @@ static int do_dcheck(char **argv, char *p)
 		return -1;
 	}
 
-	memset(secondaryBitmap, 0, (int3(os9_path->lsn0->dd_tot) + 1) / 8);
-
-	/* Allocate LSN0 in secondary bitmap */
-	_os9_allbit(secondaryBitmap, 0, 1);
-	
-	/* Allocate primary bitmap sectors in secondary bitmap */
-	
-	size = (double)os9_path->bitmap_bytes / (double)os9_path->bps;
-	
-	_os9_allbit(secondaryBitmap, 1, ceil(size) );
+	InitSecondaryBitmap( os9_path, secondaryBitmap, bitmapBytes );
 
 	/* Setup questionable cluster array */
 	qCluster = NULL;
-	gBitPaths = NULL;
 	
+	/* Read the whole image in one go, the walk below only looks at memory */
+	if( LoadImage( os9_path ) != 0 )
+	{
+		printf("Failed to allocate memory for the disk image.\n");
+		free(secondaryBitmap);
+		_os9_close(os9_path);
+		return -1;
+	}
+
+	/* Ownership of each sector is only needed to report pathlists */
+	if( pOption == 1 )
+	{
+		gOwnerCount = int3(os9_path->lsn0->dd_tot) + 1;
+		gOwner = (u_int *)calloc( gOwnerCount, sizeof(u_int) );
+		if( gOwner == NULL )
+		{
+			printf("Out of memory, terminating (004).\n");
+			exit(-1);
+		}
+	}
+
 	printf("Building secondary allocation map...\n");
-	newName = strcatdup( p, ",.", "" );
-	BuildSecondaryAllocationMap( os9_path, int3(os9_path->lsn0->dd_dir), newName, secondaryBitmap );
+	strcpy( os9pathlist, p );
+	strcat( os9pathlist, ",." );
+	root = AddPathNode( 0, os9pathlist );
+	if( jOption < 2 || ParallelAllocationMap( os9_path, int3(os9_path->lsn0->dd_dir), root, secondaryBitmap, bitmapBytes, jOption ) != 0 )
+	{
+		InitSecondaryBitmap( os9_path, secondaryBitmap, bitmapBytes );
+		BuildSecondaryAllocationMap( os9_path, int3(os9_path->lsn0->dd_dir), root, secondaryBitmap );
+	}
 	
 	printf("Comparing primary and secondary allocation maps...\n" );
 	CompareAllocationMap( os9_path->bitmap, secondaryBitmap, int3(os9_path->lsn0->dd_tot), cluster_size );
@@ -260,6 +381,19 @@ static int do_dcheck(char **argv, char *p)
 	}
 
 	_os9_close(os9_path);
+
+	free(gImage);
+	free(gNodes);
+	free(gNames);
+	free(gOwner);
+	free(gExtraOwners);
+	gImage = NULL;
+	gNodes = NULL;
+	gNames = NULL;
+	gOwner = NULL;
+	gExtraOwners = NULL;
+	gNodeCount = gNodeSize = gNamesUsed = gNamesSize = 0;
+	gOwnerCount = gExtraCount = gExtraSize = 0;
 	
 	if (gFolderCount == 1)
 	{
@@ -276,222 +410,511 @@ static int do_dcheck(char **argv, char *p)
 }
 
 
-/* This function will drill down into a directory file and fillout a secondary allocation bitmap.
-   It is recursive, so whenever a directory is encoundered it will call itself. It will also compare
-   the map it creates with the map suppilied that represents the map on disk. */
-   
-static error_code BuildSecondaryAllocationMap( os9_path_id os9_path, int dir_lsn, char *path, unsigned char *secondaryBitmap )
+static void InitSecondaryBitmap( os9_path_id os9_path, unsigned char *secondaryBitmap, int bitmapBytes )
 {
-	error_code 	ec = 0;
-	fd_stats	*dir_fd, *file_fd;
-	u_int		dd_tot,
-				fd_siz,
-				count,
-				i, j, k;
-	os9_dir_entry	*dEnt;  /* Each entry is 32 bytes long */
-	Fd_seg		theSeg;
-	char		*newPath;
-	int			bps = os9_path->bps;
+	double		size;
+
+	memset(secondaryBitmap, 0, bitmapBytes);
+
+	/* Allocate LSN0 in secondary bitmap */
+	_os9_allbit(secondaryBitmap, 0, 1);
+	
+	/* Allocate primary bitmap sectors in secondary bitmap */
+	
+	size = (double)os9_path->bitmap_bytes / (double)os9_path->bps;
+	
+	_os9_allbit(secondaryBitmap, 1, ceil(size) );
+}
+
+/* Read the image into memory once. Sectors past the end of a short image are
+   left out of gImageSectors, so asking for one is treated like a short read. */
+
+static error_code LoadImage( os9_path_id os9_path )
+{
+	size_t	bytes;
+
+	gBps = os9_path->bps;
+	bytes = (size_t)(int3(os9_path->lsn0->dd_tot) + 1) * gBps;
+
+	gImage = (u_char *)malloc( bytes );
+	if( gImage == NULL )
+	{
+		return EOS_MF;
+	}
+
+	fseek( os9_path->fd, 0, SEEK_SET );
+	gImageSectors = fread( gImage, 1, bytes, os9_path->fd ) / gBps;
+
+	return 0;
+}
+
+static u_char *ImageSector( u_int lsn )
+{
+	if( lsn >= gImageSectors )
+	{
+		return NULL;
+	}
+
+	return gImage + (size_t)lsn * gBps;
+}
+
+/* Path nodes hold one name each and point at their parent directory, so a
+   pathlist costs one small record no matter how deep the tree goes. */
+
+static u_int AddPathNode( u_int parent, char *name )
+{
+	u_int	len = strlen( name ) + 1;
+	u_int	node;
+
+	pthread_mutex_lock( &gNodeLock );
+
+	if( gNodeCount == 0 )
+	{
+		gNodeCount = 1;
+	}
+
+	if( gNodeCount >= gNodeSize )
+	{
+		gNodeSize = gNodeSize == 0 ? 1024 : gNodeSize * 2;
+		gNodes = (pathNode_t *)realloc( gNodes, gNodeSize * sizeof(pathNode_t) );
+		if( gNodes == NULL )
+		{
+			printf("Out of memory, terminating (005).\n");
+			exit(-1);
+		}
+	}
+
+	while( gNamesUsed + len > gNamesSize )
+	{
+		gNamesSize = gNamesSize == 0 ? 16384 : gNamesSize * 2;
+		gNames = (char *)realloc( gNames, gNamesSize );
+		if( gNames == NULL )
+		{
+			printf("Out of memory, terminating (006).\n");
+			exit(-1);
+		}
+	}
+
+	memcpy( gNames + gNamesUsed, name, len );
+	gNodes[gNodeCount].parent = parent;
+	gNodes[gNodeCount].name = gNamesUsed;
+	gNamesUsed += len;
+	node = gNodeCount++;
+
+	pthread_mutex_unlock( &gNodeLock );
+
+	return node;
+}
+
+/* Put the pathlist of a node back together. The caller frees the result. */
+
+static char *PathOfNode( u_int node )
+{
+	u_int	n, len = 1;
+	char	*result, *p;
+
+	for( n = node; n != 0; n = gNodes[n].parent )
+	{
+		len += strlen( gNames + gNodes[n].name );
+		if( gNodes[n].parent != 0 )
+		{
+			len++;
+		}
+	}
+
+	result = (char *)malloc( len );
+	if( result == NULL )
+	{
+		printf("Out of memory, terminating (007).\n");
+		exit(-1);
+	}
+
+	p = result + len - 1;
+	*p = '\0';
+
+	for( n = node; n != 0; n = gNodes[n].parent )
+	{
+		u_int	l = strlen( gNames + gNodes[n].name );
+
+		p -= l;
+		memcpy( p, gNames + gNodes[n].name, l );
+
+		if( gNodes[n].parent != 0 )
+		{
+			*--p = '/';
+		}
+	}
+
+	return result;
+}
+
+/* Report a problem the walk found. A serial walk prints it right away; a parallel
+   walk records it in its task so it can be printed later in serial order. */
+
+static void Report( dcheckWalker_t *w, int type, u_int node, u_int a, u_int b, u_int c )
+{
+	dcheckTask_t	*t = w->task;
+	dcheckEvent_t	ev;
+
+	ev.type = type;
+	ev.node = node;
+	ev.a = a;
+	ev.b = b;
+	ev.c = c;
+
+	if( t == NULL )
+	{
+		PrintEvent( &ev );
+		return;
+	}
+
+	if( t->eventCount == t->eventSize )
+	{
+		t->eventSize = t->eventSize == 0 ? 16 : t->eventSize * 2;
+		t->events = (dcheckEvent_t *)realloc( t->events, t->eventSize * sizeof(dcheckEvent_t) );
+		if( t->events == NULL )
+		{
+			printf("Out of memory, terminating (008).\n");
+			exit(-1);
+		}
+	}
+
+	t->events[t->eventCount++] = ev;
+}
+
+static void PrintEvent( dcheckEvent_t *ev )
+{
+	char	*path = PathOfNode( ev->node );
+	u_int	i;
+
+	switch( ev->type )
+	{
+		case EV_BADSEG:
+			printf("File: %s contains a bad segment (%d > %d)\n", path, ev->a, ev->b );
+			gBadFD++;
+			break;
+
+		case EV_BADDIRLSN:
+			printf("File: %s, contains bad LSN (%d > %d)\n", path, ev->a, ev->b);
+			gBadFD++;
+			break;
+
+		case EV_BADENTRYLSN:
+			printf("File: %s, contains bad LSN\n", path);
+			break;
+
+		case EV_BADFDSEG:
+			printf("*** Bad FD segment ($%6.6X-$%6.6X) for file: %s (Segement index: %d)\n", ev->a, ev->b, path, ev->c );
+			gBadFD++;
+			break;
+
+		case EV_BADDIRFD:
+			printf("File descriptor for directory %s is bad. Will not open directory file.\n", path);
+			break;
+
+		case EV_OWNER:
+			for( i = 0; i < ev->b; i++ )
+			{
+				AddPathToBit( ev->a + i, ev->node );
+			}
+			break;
+	}
+
+	free( path );
+}
+
+/* A sector the walk could not read. The serial walk gives up on the disk; a
+   parallel walker stops and leaves the serial walk to report it. */
+
+static void SectorWrongSize( dcheckWalker_t *w, int where, u_int lsn )
+{
+	if( w->task != NULL )
+	{
+		w->unsure = 1;
+		return;
+	}
+
+	printf("Sector wrong size, terminating (%3.3d).\n", where );
+	printf("LSN: %d\n", lsn );
+	exit(-1);
+}
+
+/* Mark a directory as visited and check its file descriptor. Returns 1 with the
+   frame filled in if the directory's contents should be walked. */
+
+static int EnterDirectory( dcheckWalker_t *w, u_int dir_lsn, u_int node, u_int dd_tot, dirFrame_t *frame )
+{
+	fd_stats	*dir_fd;
+	char		*path;
 
 	/* Check if this directory has already been drilled into */
 
-	if ( _os9_ckbit( secondaryBitmap, dir_lsn ) != 0)
+	if ( _os9_ckbit( w->bitmap, dir_lsn ) != 0)
 	{
+		if( w->task != NULL )
+		{
+			w->unsure = 1;
+			return 0;
+		}
+
 		/* Whoops, it is already allocated! */
+		path = PathOfNode( node );
 		printf("Directory %s has a circular reference. Skipping\n", path);
+		free( path );
 		AddQuestionableCluster(dir_lsn);
-		return(0);
+		return 0;
 	}
-	
+
 	/* Allocate directory file descriptor LSN in secondary allocation map */
-	
-	_os9_allbit(secondaryBitmap, dir_lsn, 1);
-	gFolderCount++;
-	
-	dd_tot = int3(os9_path->lsn0->dd_tot);
-	
-	dir_fd = (fd_stats *)malloc( bps );
+
+	_os9_allbit(w->bitmap, dir_lsn, 1);
+	w->folders++;
+
+	dir_fd = (fd_stats *)ImageSector( dir_lsn );
 	if( dir_fd == NULL )
 	{
-		printf("Out of memory, terminating (001).\n");
-		exit(-1);
-	}
-	
-	if (read_lsn(os9_path, dir_lsn, dir_fd ) != bps)
-	{
-		printf("Sector wrong size, terminating (001).\n" );
-		printf("LSN: %d\n", dir_lsn );
-		exit(-1);
+		SectorWrongSize( w, 1, dir_lsn );
+		return 0;
 	}
 
 	/* Parse segment list of directory, report any problems */
-	ec = ParseFDSegList( dir_fd, dd_tot, path, secondaryBitmap );
-	
-	if (ec != 0)
+	if( ParseFDSegList( w, dir_fd, dd_tot, node ) != 0 )
 	{
-		printf("File descriptor for directory %s is bad. Will not open directory file.\n", path);
-		ec = 0;
+		Report( w, EV_BADDIRFD, node, 0, 0, 0 );
+		return 0;
 	}
-	else
+
+	frame->fd = dir_fd;
+	frame->node = node;
+	frame->fd_siz = int4(dir_fd->fd_siz);
+	frame->count = 0;
+	frame->seg = frame->sector = frame->entry = 0;
+
+	return 1;
+}
+
+/* Step to the next live entry of a directory. Returns 1 with the entry's name
+   (as a C string) and LSN, or 0 once the directory file is used up. */
+
+static int NextDirEntry( dcheckWalker_t *w, dirFrame_t *f, u_int dd_tot, char *name, u_int *lsn )
+{
+	u_int			perSector = gBps / sizeof(os9_dir_entry);
+	os9_dir_entry	*dEnt;
+	Fd_seg			theSeg;
+
+	for( ; f->seg < NUM_SEGS && int3(f->fd->fd_seg[f->seg].lsn) != 0; f->seg++, f->sector = 0 )
 	{
-		/* Now open directory file and parse contents */
-		fd_siz = int4(dir_fd->fd_siz);
-		count = 0;
-		i = 0;
-		
-		while (int3(dir_fd->fd_seg[i].lsn) != 0)
+		theSeg = &(f->fd->fd_seg[f->seg]);
+
+		if (f->count > f->fd_siz)
 		{
-			theSeg = &(dir_fd->fd_seg[i]);
-			
-			if (i > NUM_SEGS)
-			{
+			break;
+		}
+
+		if (int2(theSeg->num) > dd_tot)
+		{
+			Report( w, EV_BADSEG, f->node, int2(theSeg->num), dd_tot, 0 );
+			break;
+		}
+
+		for( ; f->sector < int2(theSeg->num); f->sector++, f->entry = 0 )
+		{
+			if (f->count > f->fd_siz)
 				break;
-			}
-				
-			if (count > fd_siz)
+
+			if (int3(theSeg->lsn) + f->sector > dd_tot)
 			{
+				Report( w, EV_BADDIRLSN, f->node, int3(theSeg->lsn) + f->sector, dd_tot, 0 );
+				f->count += 256;
 				break;
 			}
-			
-			if (int2(theSeg->num) > dd_tot)
+
+			dEnt = (os9_dir_entry *)ImageSector( int3(theSeg->lsn) + f->sector );
+			if( dEnt == NULL )
 			{
-				printf("File: %s contains a bad segment (%d > %d)\n", path, int2(theSeg->num), dd_tot );
-				gBadFD++;
-				break;
+				SectorWrongSize( w, 2, int3(theSeg->lsn) + f->sector );
+				f->seg = NUM_SEGS;
+				return 0;
 			}
-			
-			for (j = 0; j < int2(theSeg->num); j++ )
+
+			while( f->entry < perSector )
 			{
-				if (count > fd_siz)
-					break;
-				
-				if (int3(theSeg->lsn) + j > dd_tot)
+				os9_dir_entry	*e = &dEnt[f->entry++];
+
+				f->count += sizeof(os9_dir_entry);
+				if (f->count > f->fd_siz)
 				{
-					printf("File: %s, contains bad LSN (%d > %d)\n", path, int3(theSeg->lsn)+j, dd_tot);
-					count += 256;
-					gBadFD++;
 					break;
 				}
-				
-				dEnt = (os9_dir_entry *)malloc( bps );
-				if( dEnt == NULL )
+
+				if (e->name[0] == 0)
 				{
-					printf("Out of memory, terminating (002).\n");
-					exit(-1);
+					continue;
 				}
-				
-				if( read_lsn( os9_path, int3(theSeg->lsn)+j, dEnt ) != bps )
+
+				memcpy( name, e->name, D_NAMELEN );
+				name[D_NAMELEN] = '\0';
+				OS9StringToCString( (u_char *)name );
+
+				if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
 				{
-					int	temp = int3(theSeg->lsn)+j;
-					
-					printf("Sector wrong size, terminating (002).\nLSN: %d\n", temp );
-					exit(-1);
+					continue;
 				}
 
-				for (k = 0; k < (bps / sizeof(os9_dir_entry)); k++)
+				*lsn = int3(e->lsn);
+				return 1;
+			}
+		}
+	}
+
+	f->seg = NUM_SEGS;
+
+	return 0;
+}
+
+
+/* This function will drill down into a directory file and fillout a secondary allocation bitmap.
+   Directories are kept on a stack of frames instead of being walked recursively, so entries are
+   visited in the same depth-first order, and every sector comes out of the image buffer.
+   A parallel walker hands each subdirectory off as a new task instead of descending into it. */
+
+static error_code WalkDirectory( dcheckWalker_t *w, u_int dir_lsn, u_int node, u_int dd_tot )
+{
+	error_code 	ec = 0;
+	dirFrame_t	*stack;
+	u_int		depth = 0, stackSize = 16;
+	fd_stats	*file_fd;
+	char		name[D_NAMELEN + 1];
+	u_int		lsn, newNode;
+
+	stack = (dirFrame_t *)malloc( stackSize * sizeof(dirFrame_t) );
+	if( stack == NULL )
+	{
+		printf("Out of memory, terminating (001).\n");
+		exit(-1);
+	}
+
+	depth = EnterDirectory( w, dir_lsn, node, dd_tot, &stack[0] );
+
+	while( depth > 0 && w->unsure == 0 )
+	{
+		if( NextDirEntry( w, &stack[depth - 1], dd_tot, name, &lsn ) == 0 )
+		{
+			depth--;
+			continue;
+		}
+
+		newNode = AddPathNode( stack[depth - 1].node, name );
+
+		if (lsn > dd_tot)
+		{
+			Report( w, EV_BADENTRYLSN, newNode, 0, 0, 0 );
+			continue;
+		}
+
+		file_fd = (fd_stats *)ImageSector( lsn );
+		if( file_fd == NULL )
+		{
+			SectorWrongSize( w, 3, lsn );
+			break;
+		}
+
+		/* If actually a directory? */
+		if ((file_fd->fd_att & FAP_DIR) == 0)
+		{
+			/* No, file is a file */
+			if( w->task != NULL && _os9_ckbit( w->bitmap, lsn ) != 0 )
+			{
+				w->unsure = 1;
+				break;
+			}
+			_os9_allbit(w->bitmap, lsn, 1);
+
+			w->files++;
+			ParseFDSegList(w, file_fd, dd_tot, newNode);
+		}
+		else if( w->task != NULL )
+		{
+			/* Yes, let another walker do the directory */
+			AddTask( w, lsn, newNode );
+		}
+		else
+		{
+			/* Yes, go do directory */
+			if( depth == stackSize )
+			{
+				stackSize *= 2;
+				stack = (dirFrame_t *)realloc( stack, stackSize * sizeof(dirFrame_t) );
+				if( stack == NULL )
 				{
-					count += sizeof(os9_dir_entry);
-					if (count > fd_siz)
-					{
-						break;
-					}
-
-					if (dEnt[k].name[0] == 0)
-					{
-						continue;
-					}
-
-					OS9StringToCString(dEnt[k].name);
-					
-					if (strcmp((char *)dEnt[k].name, ".") == 0)
-					{
-						continue;
-					}
-					if (strcmp((char *)dEnt[k].name, "..") == 0)
-					{
-						continue;
-					}
-
-					newPath = strcatdup(path, "/", (char *)dEnt[k].name);
-					
-					if (int3(dEnt[k].lsn) > dd_tot)
-					{
-						printf("File: %s, contains bad LSN\n", newPath);
-						free(newPath);
-						continue;
-					}
-
-					file_fd = (fd_stats *)malloc( bps );
-					if( file_fd == NULL )
-					{
-						printf("Out of memory, terminating (003).\n");
-						exit(-1);
-					}
-					
-					if( read_lsn(os9_path, int3(dEnt[k].lsn), file_fd ) != bps )
-					{
-						printf("Sector wrong size, terminating (003).\n" );
-						printf("LSN: %d\n", int3(dEnt[k].lsn) );
-						exit(-1);
-					}
-
-					/* If actually a directory? */
-					if ((file_fd->fd_att & FAP_DIR) == 0)
-					{
-						/* No, file is a file */
-						_os9_allbit(secondaryBitmap, int3(dEnt[k].lsn), 1);
-
-						gFileCount++;
-						ParseFDSegList(file_fd, dd_tot, newPath, secondaryBitmap);
-					}
-					else
-					{
-						/* Yes, go do directory */
-						ec = BuildSecondaryAllocationMap(os9_path, int3(dEnt[k].lsn), newPath, secondaryBitmap);
-						if (ec != 0)
-						{
-							return(ec);
-						}
-					}
-					
-					free(file_fd);
-					free(newPath);
+					printf("Out of memory, terminating (001).\n");
+					exit(-1);
 				}
-				
-				free(dEnt);
 			}
-			
-			i++;
+
+			depth += EnterDirectory( w, lsn, newNode, dd_tot, &stack[depth] );
 		}
 	}
-	
-	free(dir_fd);
-	
+
+	free(stack);
+
 	return(ec);
 }
 
-static error_code ParseFDSegList( fd_stats *fd, u_int dd_tot, char *path, unsigned char *secondaryBitmap )
+static error_code BuildSecondaryAllocationMap( os9_path_id os9_path, int dir_lsn, u_int node, unsigned char *secondaryBitmap )
+{
+	dcheckWalker_t	w;
+
+	memset( &w, 0, sizeof(w) );
+	w.bitmap = secondaryBitmap;
+
+	WalkDirectory( &w, dir_lsn, node, int3(os9_path->lsn0->dd_tot) );
+
+	gFolderCount += w.folders;
+	gFileCount += w.files;
+
+	return 0;
+}
+
+static error_code ParseFDSegList( dcheckWalker_t *w, fd_stats *fd, u_int dd_tot, u_int node )
 {
 	error_code	ec = 0;
 	u_int  		i = 0, j, once;
 	Fd_seg		theSeg;
 	u_int 		num, curLSN;
 
-	while( int3(fd->fd_seg[i].lsn) != 0 )
+	while( i < NUM_SEGS && int3(fd->fd_seg[i].lsn) != 0 )
 	{
-		if( i > NUM_SEGS )
-		{
-			i++;
-			break;
-		}
-
 		theSeg = &(fd->fd_seg[i]);
 		num = int2(theSeg->num);
 
 		if( (int3(theSeg->lsn) + num) > dd_tot )
 		{
-			printf("*** Bad FD segment ($%6.6X-$%6.6X) for file: %s (Segement index: %d)\n", int3(theSeg->lsn), int3(theSeg->lsn)+num, path, i );
-			gBadFD++;
+			Report( w, EV_BADFDSEG, node, int3(theSeg->lsn), int3(theSeg->lsn)+num, i );
+			i++;
+			continue;
+		}
+
+		/* A parallel walker only notes who owns the segment; the claims are
+		   checked against each other when the walkers' bitmaps are merged */
+		if( w->task != NULL )
+		{
+			if( gOwner != NULL )
+			{
+				Report( w, EV_OWNER, node, int3(theSeg->lsn), num, 0 );
+			}
+
+			for(j = 0; j < num; j++)
+			{
+				curLSN = int3(theSeg->lsn)+j;
+
+				if ( _os9_ckbit( w->bitmap, curLSN ) != 0 )
+				{
+					w->unsure = 1;
+				}
+				_os9_allbit( w->bitmap, curLSN, 1);
+			}
+
 			i++;
 			continue;
 		}
@@ -500,14 +923,13 @@ static error_code ParseFDSegList( fd_stats *fd, u_int dd_tot, char *path, unsign
 		{
 			once = 0;
 			curLSN = int3(theSeg->lsn)+j;
-			
+
 			/* check for segment elements out of bounds */
 			if( curLSN > dd_tot )
 			{
 				if( once == 0 )
 				{
-					printf("*** Bad FD segment ($%6.6X-$%6.6X) for file: %s (Segement index: %d)\n", int3(theSeg->lsn), int3(theSeg->lsn)+num, path, i );
-					gBadFD++;
+					Report( w, EV_BADFDSEG, node, int3(theSeg->lsn), int3(theSeg->lsn)+num, i );
 					once = 1;
 					ec = 1;
 				}
@@ -515,10 +937,10 @@ static error_code ParseFDSegList( fd_stats *fd, u_int dd_tot, char *path, unsign
 			else
 			{
 				/* Record path to this bit */
-				AddPathToBit( curLSN, path );
+				AddPathToBit( curLSN, node );
 
 				/* Check if bit is already allocated */
-				if ( _os9_ckbit( secondaryBitmap, curLSN ) != 0 )
+				if ( _os9_ckbit( w->bitmap, curLSN ) != 0 )
 				{
 					/* Whoops, it is already allocated! */
 					printf("Sector $%6.6X was previously allocated\n", curLSN );
@@ -528,34 +950,263 @@ static error_code ParseFDSegList( fd_stats *fd, u_int dd_tot, char *path, unsign
 				else
 				{
 					/* Allocate bit and move on */
-					_os9_allbit( secondaryBitmap, curLSN, 1);
+					_os9_allbit( w->bitmap, curLSN, 1);
 				}
 			}
 		}
-		
+
 		i++;
 	}
-	
+
 	return ec;
 }
 
+/* Queue a directory for the parallel walk and note where its report goes */
+
+static void AddTask( dcheckWalker_t *w, u_int dir_lsn, u_int node )
+{
+	dcheckTask_t	*t;
+
+	t = (dcheckTask_t *)calloc( 1, sizeof(dcheckTask_t) );
+	if( t == NULL )
+	{
+		printf("Out of memory, terminating (009).\n");
+		exit(-1);
+	}
+	t->dir_lsn = dir_lsn;
+	t->node = node;
+
+	pthread_mutex_lock( &gQueueLock );
+
+	/* A directory reached twice is a circular reference or a cross link,
+	   which only the serial walk reports properly */
+	if( _os9_ckbit( gDirSeen, dir_lsn ) != 0 )
+	{
+		gAbandon = 1;
+	}
+	_os9_allbit( gDirSeen, dir_lsn, 1 );
+
+	if( gTaskCount == gTaskSize )
+	{
+		gTaskSize = gTaskSize == 0 ? 256 : gTaskSize * 2;
+		gTasks = (dcheckTask_t **)realloc( gTasks, gTaskSize * sizeof(dcheckTask_t *) );
+		if( gTasks == NULL )
+		{
+			printf("Out of memory, terminating (009).\n");
+			exit(-1);
+		}
+	}
+
+	if( w != NULL )
+	{
+		Report( w, EV_SUBTREE, 0, gTaskCount, 0, 0 );
+	}
+	gTasks[gTaskCount++] = t;
+
+	pthread_cond_signal( &gQueueCond );
+	pthread_mutex_unlock( &gQueueLock );
+}
+
+/* Worker thread: take the oldest waiting directory, walk it, repeat until
+   every queued directory has been walked */
+
+static void *WalkWorker( void *arg )
+{
+	dcheckWalker_t	*w = (dcheckWalker_t *)arg;
+
+	pthread_mutex_lock( &gQueueLock );
+	for( ;; )
+	{
+		while( gTaskNext == gTaskCount && gTasksActive > 0 && gAbandon == 0 )
+		{
+			pthread_cond_wait( &gQueueCond, &gQueueLock );
+		}
+
+		if( gTaskNext == gTaskCount || gAbandon != 0 )
+		{
+			break;
+		}
+
+		w->task = gTasks[gTaskNext++];
+		gTasksActive++;
+		pthread_mutex_unlock( &gQueueLock );
+
+		WalkDirectory( w, w->task->dir_lsn, w->task->node, w->dd_tot );
+
+		pthread_mutex_lock( &gQueueLock );
+		gTasksActive--;
+		if( w->unsure != 0 )
+		{
+			gAbandon = 1;
+		}
+		if( gTasksActive == 0 || gAbandon != 0 )
+		{
+			pthread_cond_broadcast( &gQueueCond );
+		}
+	}
+	pthread_cond_broadcast( &gQueueCond );
+	pthread_mutex_unlock( &gQueueLock );
+
+	return NULL;
+}
+
+/* Walk the tree with several threads. Each walker fills its own bitmap; the
+   bitmaps are OR-merged into the secondary bitmap, and the recorded reports
+   are printed in the order a serial walk would have printed them.
+   Returns 1 if the walk found something only the serial walk can report in
+   order (a sector or directory claimed twice, or an unreadable sector); the
+   caller then starts over with a serial walk. */
+
+static int ParallelAllocationMap( os9_path_id os9_path, int dir_lsn, u_int node, unsigned char *secondaryBitmap, int bitmapBytes, int threads )
+{
+	dcheckWalker_t	*walkers;
+	pthread_t		*tids;
+	u_int			*stack = NULL, depth = 0, stackSize = 0;
+	u_int			*next;
+	int				i, b, unsure = 0;
+
+	walkers = (dcheckWalker_t *)calloc( threads, sizeof(dcheckWalker_t) );
+	tids = (pthread_t *)calloc( threads, sizeof(pthread_t) );
+	gDirSeen = (unsigned char *)calloc( bitmapBytes, 1 );
+	if( walkers == NULL || tids == NULL || gDirSeen == NULL )
+	{
+		printf("Out of memory, terminating (009).\n");
+		exit(-1);
+	}
+
+	gTaskCount = gTaskNext = 0;
+	gTasksActive = 0;
+	gAbandon = 0;
+	AddTask( NULL, dir_lsn, node );
+
+	for( i = 0; i < threads; i++ )
+	{
+		walkers[i].bitmap = (unsigned char *)calloc( bitmapBytes, 1 );
+		if( walkers[i].bitmap == NULL )
+		{
+			printf("Out of memory, terminating (009).\n");
+			exit(-1);
+		}
+		walkers[i].dd_tot = int3(os9_path->lsn0->dd_tot);
+		pthread_create( &tids[i], NULL, WalkWorker, &walkers[i] );
+	}
+
+	for( i = 0; i < threads; i++ )
+	{
+		pthread_join( tids[i], NULL );
+	}
+
+	unsure = gAbandon;
+
+	/* OR the walkers' bitmaps together; a bit set by two of them is a sector
+	   claimed twice */
+	for( i = 0; i < threads && unsure == 0; i++ )
+	{
+		for( b = 0; b < bitmapBytes; b++ )
+		{
+			if( (secondaryBitmap[b] & walkers[i].bitmap[b]) != 0 )
+			{
+				unsure = 1;
+				break;
+			}
+			secondaryBitmap[b] |= walkers[i].bitmap[b];
+		}
+	}
+
+	/* Print the recorded reports, descending into each subtree where the
+	   serial walk would have */
+	if( unsure == 0 )
+	{
+		next = (u_int *)calloc( gTaskCount, sizeof(u_int) );
+		stackSize = 16;
+		stack = (u_int *)malloc( stackSize * sizeof(u_int) );
+		if( next == NULL || stack == NULL )
+		{
+			printf("Out of memory, terminating (009).\n");
+			exit(-1);
+		}
+		stack[depth++] = 0;
+
+		while( depth > 0 )
+		{
+			u_int			t = stack[depth - 1];
+			dcheckEvent_t	*ev;
+
+			if( next[t] == gTasks[t]->eventCount )
+			{
+				depth--;
+				continue;
+			}
+
+			ev = &gTasks[t]->events[next[t]++];
+
+			if( ev->type != EV_SUBTREE )
+			{
+				PrintEvent( ev );
+				continue;
+			}
+
+			if( depth == stackSize )
+			{
+				stackSize *= 2;
+				stack = (u_int *)realloc( stack, stackSize * sizeof(u_int) );
+				if( stack == NULL )
+				{
+					printf("Out of memory, terminating (009).\n");
+					exit(-1);
+				}
+			}
+			stack[depth++] = ev->a;
+		}
+
+		free( next );
+		free( stack );
+
+		for( i = 0; i < threads; i++ )
+		{
+			gFolderCount += walkers[i].folders;
+			gFileCount += walkers[i].files;
+		}
+	}
+
+	for( i = 0; i < (int)gTaskCount; i++ )
+	{
+		free( gTasks[i]->events );
+		free( gTasks[i] );
+	}
+	free( gTasks );
+	gTasks = NULL;
+	gTaskCount = gTaskSize = 0;
+
+	for( i = 0; i < threads; i++ )
+	{
+		free( walkers[i].bitmap );
+	}
+	free( walkers );
+	free( tids );
+	free( gDirSeen );
+	gDirSeen = NULL;
+
+	return unsure;
+}
+
 static error_code CompareAllocationMap( unsigned char *primaryAlloMap, unsigned char *secondaryBitmap, int dd_map, int cluster_size )
 {
 	error_code ec = 0;
 	int i, j, LSN;
-	
+
 	for(i=0; i< (dd_map / cluster_size); i++ )
 	{
 		int p, s;
-		
+
 		p = _os9_ckbit( primaryAlloMap, i );
-		
+
 		for( j=0; j<cluster_size; j++ )
 		{
 			LSN = i*cluster_size+j;
-			
+
 			s = _os9_ckbit( secondaryBitmap, LSN );
-			
+
 			if( p != s )
 			{
 				if( p == 0 )
@@ -564,12 +1215,12 @@ static error_code CompareAllocationMap( unsigned char *primaryAlloMap, unsigned
 					AddQuestionableCluster( i );
 					gFnotA++;
 				}
-				
+
 				if( s == 0 )
 				{
 					if( bOption == 0 )
 						printf("Logical sector %d ($%6.6X) of cluster %d ($%6.6X) in allocation map but not in file structure\n", LSN, LSN, i, i );
-						
+
 					gAnotF++;
 				}
 			}
@@ -579,103 +1230,92 @@ static error_code CompareAllocationMap( unsigned char *primaryAlloMap, unsigned
 	return(ec);
 }
 
+/* Print every file holding a questionable cluster, most recent claim first */
+
 static void PathlistsForQuestionableClusters(void)
 {
 	qCluster_t	*tmp;
-	qBitPath_t	*bitpath, *tmpBP;
-	
+	u_int		i, lsn;
+	char		*path;
+
 	while( qCluster != NULL )
 	{
-		bitpath = gBitPaths;
-		
-		while( bitpath != NULL )
+		lsn = qCluster->lsn;
+
+		for( i = gExtraCount; i > 0; i-- )
+		{
+			if( gExtraOwners[i - 1].lsn == lsn )
+			{
+				path = PathOfNode( gExtraOwners[i - 1].node );
+				printf("Cluster $%6.6X in path: %s\n", lsn, path );
+				free( path );
+			}
+		}
+
+		if( gOwner != NULL && lsn < gOwnerCount && gOwner[lsn] != 0 )
 		{
-			if( qCluster->lsn == bitpath->lsn )
-				printf("Cluster $%6.6X in path: %s\n", qCluster->lsn, bitpath->path );
-			
-			bitpath = bitpath->next;
+			path = PathOfNode( gOwner[lsn] );
+			printf("Cluster $%6.6X in path: %s\n", lsn, path );
+			free( path );
 		}
 
 		tmp = qCluster->next;
 		free( qCluster );
 		qCluster = tmp;
 	}
-	
-	bitpath = gBitPaths;
-		
-	while( bitpath != NULL )
-	{
-		free( bitpath->path );
-		tmpBP = bitpath->next;
-		free( bitpath );
-		bitpath = tmpBP;
-	}
 }
 
 static void FreeQuestionableMemory(void)
 {
 	qCluster_t	*tmp;
-	qBitPath_t	*tmpBP;
-	
+
 	while( qCluster != NULL )
 	{
 		tmp = qCluster->next;
 		free( qCluster );
 		qCluster = tmp;
 	}
-
-	while( gBitPaths != NULL )
-	{
-		free( gBitPaths->path );
-		tmpBP = gBitPaths->next;
-		free( gBitPaths );
-		gBitPaths = tmpBP;
-	}
-}
-
-static char *strcatdup( char *orig, char *cat1, char *cat2 )
-{
-	char	*result;
-	
-	if( cat2 == NULL )
-		result = (char *)malloc( strlen(orig) + strlen(cat1) + 1 );
-	else
-		result = (char *)malloc( strlen(orig) + strlen(cat1) + strlen(cat2) + 1 );
-		
-	if( result != NULL )
-	{
-		strcpy( result, orig );
-		strcat( result, cat1 );
-		if( cat2 != NULL )
-			strcat( result, cat2 );
-	}
-	
-	return result;
 }
 
 static void AddQuestionableCluster( int cluster )
 {
 	qCluster_t *curCluster;
-	
+
 	curCluster = (qCluster_t *)malloc( sizeof(qCluster_t) );
 	if( curCluster == NULL )
 		return;
-	
+
 	curCluster->lsn = cluster;
 	curCluster->next = qCluster;
 	qCluster = curCluster;
 }
 
-static void AddPathToBit( int lsn, char *path )
+/* The first file to claim a sector goes in the index; later claims, which only
+   happen on a damaged disk, go on the short extra list. */
+
+static void AddPathToBit( u_int lsn, u_int node )
 {
-	qBitPath_t	*bitPath;
-	
-	bitPath = (qBitPath_t *)malloc( sizeof (qBitPath_t) );
-	if( bitPath == NULL )
+	if( gOwner == NULL )
 		return;
-	
-	bitPath->lsn = lsn;
-	bitPath->path = (char *)strdup( path );
-	bitPath->next = gBitPaths;
-	gBitPaths = bitPath;
+
+	if( gOwner[lsn] == 0 )
+	{
+		gOwner[lsn] = node;
+		return;
+	}
+
+	if( gExtraCount == gExtraSize )
+	{
+		extraOwner_t	*t;
+
+		gExtraSize = gExtraSize == 0 ? 64 : gExtraSize * 2;
+		t = (extraOwner_t *)realloc( gExtraOwners, gExtraSize * sizeof(extraOwner_t) );
+		if( t == NULL )
+			return;
+		gExtraOwners = t;
+	}
+
+	gExtraOwners[gExtraCount].lsn = lsn;
+	gExtraOwners[gExtraCount].node = node;
+	gExtraCount++;
 }
@@ -7,15 +7,70 @@
 #include <string.h>
 #include <cocotypes.h>
 #include <cocopath.h>
+#include <toolshed.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <math.h>
+#include <pthread.h>
 
 /* globals */
 u_int buffer_size = 32768;
 
+static int sync_target = 0;		/* only copy files that differ, remove the rest */
+static int sync_contents = 0;	/* also compare contents when syncing */
+static int readers = 1;			/* threads reading ahead for the -e pipeline */
+
+/* With -e and -j, each command is queued as an operation instead of being
+ * run.  Reader threads load and translate the files to be copied ahead of
+ * time, and the main thread commits the operations to the target in the
+ * order they were printed, so it is the only one writing to the target.
+ */
+#define	DSAVE_SHELL		0		/* run command with system() */
+#define	DSAVE_MAKDIR	1
+#define	DSAVE_COPY		2
+
+#define	DSAVE_PENDING	0
+#define	DSAVE_READING	1
+#define	DSAVE_READY		2
+
+typedef struct
+{
+	int				type;
+	char			*command;
+	char			*source;
+	char			*target;
+	int				rewrite;
+	int				translate;		/* 1 native to CoCo, 2 CoCo to native, 3 drop */
+
+	/* filled in by a reader */
+	int				state;
+	error_code		ec;				/* opening the source */
+	error_code		readec;			/* reading it, reported once written */
+	_path_type		sourceType;
+	coco_file_stat	fdesc;
+	char			**blocks;		/* data as the copy writes it, block by block */
+	u_int			*sizes;
+	int				count;
+} dsave_op;
+
+static dsave_op			*ops;
+static int				opCount, opSize;
+static int				opNextRead, opCommitted;
+static pthread_mutex_t	opLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	opCond = PTHREAD_COND_INITIALIZER;
+
 error_code do_dsave(char *pgmname, char *source, char *target, int execute, int buffsize, int rewrite, int eoltranslate);
+static error_code SyncDeletions(char *pgmname, char *source, char *target, char *dst_path_seperator, int execute);
+static int FileNeedsCopy(char *source, char *target, int eoltranslate);
+static error_code HashFile(char *pathlist, int translate, unsigned long long *hash);
+static int IsDirectory(char *pathlist, int *isdir);
+static error_code RunCommand(int type, char *command, char *source, char *target, int rewrite, int eoltranslate);
+static error_code CommitOperations(void);
+static void *ReadAhead(void *arg);
+static void ReadOperation(dsave_op *op);
+static error_code WriteOperation(dsave_op *op);
+static void FreeOperations(void);
 static char *ShellEscapePath(char *source, char *src_path_seperator, u_char *direntry_name_buffer);
 static char *EscapePart( char *dest, char *src );
 
@@ -29,6 +84,10 @@ static char const * const helpMessage[] =
 	"     -e         actually execute commands\n",
     "     -l         perform end of line translation on copy\n",
 	"     -r         force rewrite on copy\n",
+	"     -s         sync: copy only files that are new or changed and\n",
+	"                remove files the source no longer has\n",
+	"     -c         with -s, also compare file contents\n",
+	"     -j<n>      with -e, read files ahead with <n> threads\n",
 	NULL
 };
 
@@ -84,6 +143,26 @@ int os9dsave(int argc, char *argv[])
 						execute = 1;
 						break;
 
+					case 's':
+						sync_target = 1;
+						break;
+
+					case 'c':
+						sync_contents = 1;
+						break;
+
+					case 'j':
+						readers = atoi(p + 1);
+						if (readers < 1)
+						{
+							readers = 1;
+						}
+						while (*(p + 1) != '\0')
+						{
+							p++;
+						}
+						break;
+
 					case 'h':
 					case '?':
 						show_help(helpMessage);
@@ -136,6 +215,11 @@ int os9dsave(int argc, char *argv[])
 
 	/* do dsave */
 	ec = do_dsave("os9", source, target, execute, buffer_size, rewrite, eoltranslate);
+	if (ec == 0 && opCount > 0)
+	{
+		ec = CommitOperations();
+	}
+	FreeOperations();
 	if (ec != 0)
 	{
 		fprintf(stderr, "%s: error %d encountered during dsave\n", argv[0], ec);
@@ -170,6 +254,20 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 		dst_path_seperator = "/";
 	else
 		dst_path_seperator = "";
+
+	/* Clear out of the way whatever the source no longer has before
+	 * copying, so a name that changed case or type is copied afresh.
+	 */
+	if (sync_target == 1)
+	{
+		ec = SyncDeletions(pgmname, source, target, dst_path_seperator, execute);
+		if (ec != 0)
+		{
+			_coco_close(sourcePath);
+
+			return(ec);
+		}
+	}
 	
 	while (_coco_readdir(sourcePath, &dirent) == 0)
 	{
@@ -204,6 +302,7 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 			if (isdir == 1)
 			{
 				char newTarget[512];
+				int exists;
 
 				/* We've encountered a directory */
 				newTarget[0] = '\0';
@@ -226,12 +325,19 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 					sprintf(newTarget, "%s%s%s", target, dst_path_seperator, direntry_name_buffer);
 				}
 
-				/* 3. make directory on target */
+				/* 3. make directory on target, unless syncing into one that is there */
 				snprintf(command, sizeof(command), "os9 makdir '%s'", newTarget);
-				puts(command);
-				if (execute) 
+				if (sync_target == 1 && IsDirectory(newTarget, &exists) == 0 && exists == 1)
+				{
+					command[0] = '\0';
+				}
+				else
 				{
-					ec = system(command);
+					puts(command);
+				}
+				if (execute && command[0] != '\0')
+				{
+					ec = RunCommand(DSAVE_MAKDIR, command, NULL, newTarget, 0, 0);
 					if (ec != 0)
 					{
 						_coco_close(sourcePath);
@@ -249,24 +355,36 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 			else
 			{
 				/* We've encountered a file -- just copy */
-				char ropt[4], bopt[32], *escaped_source, *escaped_dest;
+				char ropt[8], bopt[32], *escaped_source, *escaped_dest;
 
 				ropt[0] = 0;
 				bopt[0] = 0;
 
+				if (sync_target == 1)
+				{
+					char targetPathList[1024];
+
+					snprintf(targetPathList, sizeof(targetPathList), "%s%s%s", target, dst_path_seperator, direntry_name_buffer);
+					if (FileNeedsCopy(sourcePathList, targetPathList, eoltranslate) == 0)
+					{
+						continue;
+					}
+				}
+
 				if ( strcmp(pgmname, "os9") == 0 && buffer_size > 0)
 				{
 					sprintf(bopt, "-b=%d", buffer_size);
 				}
 
-				if (rewrite > 0)
+				/* when syncing, a changed file is there already */
+				if (rewrite > 0 || sync_target == 1)
 				{
 					strcat(ropt, "-r");
 				}
 				
 				if (eoltranslate > 0)
 				{
-					strcat(ropt, "-l");
+					strcat(ropt, ropt[0] == 0 ? "-l" : " -l");
 				}
 				
 				escaped_source = ShellEscapePath(source, src_path_seperator, direntry_name_buffer);
@@ -276,7 +394,11 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 				puts(command);
 				if (execute)
 				{
-					ec = system(command);
+					char targetPathList[1024];
+
+					snprintf(targetPathList, sizeof(targetPathList), "%s%s%s", target, dst_path_seperator, direntry_name_buffer);
+					ec = RunCommand(strcmp(pgmname, "os9") == 0 ? DSAVE_COPY : DSAVE_SHELL, command,
+						sourcePathList, targetPathList, rewrite > 0 || sync_target == 1, eoltranslate);
 					if (ec != 0)
 					{
 						_coco_close(sourcePath);
@@ -303,6 +425,594 @@ error_code do_dsave(char *pgmname, char *source, char *target, int execute, int
 	return(ec);
 }
 
+/* Remove from the target directory whatever is not in the source directory,
+ * or is a file in one and a directory in the other.
+ */
+static error_code SyncDeletions(char *pgmname, char *source, char *target, char *dst_path_seperator, int execute)
+{
+	error_code	ec = 0;
+	coco_path_id	targetPath;
+	coco_dir_entry	dirent;
+	char		command[1024];
+	char		pathlist[1024];
+	u_char		**names = NULL;
+	int		count = 0, size = 0, i;
+
+	/* 1. A target directory that isn't there yet has nothing to remove */
+	if (_coco_open(&targetPath, target, FAM_DIR | FAM_READ) != 0)
+	{
+		return(0);
+	}
+
+	/* 2. Gather the names first; the directory changes as they go */
+	while (_coco_readdir(targetPath, &dirent) == 0)
+	{
+		u_char direntry_name_buffer[255];
+		_coco_ncpy_name( &dirent, direntry_name_buffer, 255 );
+
+		if ( (direntry_name_buffer[0] == '\0') || (direntry_name_buffer[0] == 255) ||
+			(strncmp((const char *) direntry_name_buffer, ".", 2) == 0) ||
+			(strncmp((const char *) direntry_name_buffer, "..", 3) == 0) )
+		{
+			continue;
+		}
+
+		if (count == size)
+		{
+			size = size == 0 ? 64 : size * 2;
+			names = (u_char **)realloc(names, size * sizeof(u_char *));
+			if (names == NULL)
+			{
+				_coco_close(targetPath);
+
+				return(EOS_OM);
+			}
+		}
+		names[count++] = (u_char *)strdup((char *)direntry_name_buffer);
+	}
+
+	_coco_close(targetPath);
+
+	/* 3. Remove each one the source doesn't have in the same form */
+	for (i = 0; i < count; i++)
+	{
+		int sourceIsDir, targetIsDir = 0;
+		char *escaped_dest;
+
+		snprintf(pathlist, sizeof(pathlist), "%s%s%s", target, dst_path_seperator, names[i]);
+		IsDirectory(pathlist, &targetIsDir);
+
+		snprintf(pathlist, sizeof(pathlist), "%s/%s", source, names[i]);
+		if (IsDirectory(pathlist, &sourceIsDir) == 0 && sourceIsDir == targetIsDir)
+		{
+			continue;
+		}
+
+		escaped_dest = ShellEscapePath(target, dst_path_seperator, names[i]);
+		if (escaped_dest == NULL)
+		{
+			ec = EOS_OM;
+			break;
+		}
+
+		if (targetIsDir == 1)
+		{
+			snprintf(command, sizeof(command), "%s deldir -q '%s'", pgmname, escaped_dest);
+		}
+		else
+		{
+			snprintf(command, sizeof(command), "%s del '%s'", pgmname, escaped_dest);
+		}
+		free(escaped_dest);
+
+		puts(command);
+		if (execute)
+		{
+			ec = RunCommand(DSAVE_SHELL, command, NULL, NULL, 0, 0);
+			if (ec != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		free(names[i]);
+	}
+	free(names);
+
+	return(ec);
+}
+
+/* Decide whether a file must be copied to bring the target up to date:
+ * it is missing, its size differs, it is older than the source, or (with -c)
+ * its contents differ.  Sizes can't be compared when translating line
+ * endings, and Disk BASIC files carry no dates.
+ */
+static int FileNeedsCopy(char *source, char *target, int eoltranslate)
+{
+	coco_file_stat	sourceStat, targetStat;
+	u_int		sourceSize, targetSize;
+	_path_type	sourceType, targetType;
+	int		translate = 0;
+
+	if (_coco_gs_fd_pathlist(target, &targetStat) != 0 ||
+		_coco_gs_fd_pathlist(source, &sourceStat) != 0 ||
+		_coco_gs_size_pathlist(target, &targetSize) != 0 ||
+		_coco_gs_size_pathlist(source, &sourceSize) != 0)
+	{
+		return(1);
+	}
+
+	_coco_identify_image(source, &sourceType);
+	_coco_identify_image(target, &targetType);
+
+	if (eoltranslate == 1 && (sourceType == NATIVE) != (targetType == NATIVE))
+	{
+		translate = sourceType == NATIVE ? 1 : 2;
+	}
+
+	if (translate == 0 && sourceSize != targetSize)
+	{
+		return(1);
+	}
+
+	/* OS-9 keeps the time to the minute; a native copy is stamped when closed */
+	if (sourceType != DECB && targetType != DECB &&
+		targetStat.last_modified_time / 60 < sourceStat.last_modified_time / 60)
+	{
+		return(1);
+	}
+
+	if (sync_contents == 1)
+	{
+		unsigned long long	sourceHash, targetHash;
+
+		if (HashFile(source, translate, &sourceHash) != 0 ||
+			HashFile(target, 0, &targetHash) != 0 ||
+			sourceHash != targetHash)
+		{
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+/* FNV-1a hash of a file's contents, after the end of line translation the
+ * copy would apply (1 native to CoCo, 2 CoCo to native).  The file is read
+ * in the same blocks as the copy so the translation comes out the same.
+ */
+static error_code HashFile(char *pathlist, int translate, unsigned long long *hash)
+{
+	error_code	ec;
+	coco_path_id	path;
+	char		*buffer, *newBuffer;
+	u_char		*p;
+	u_int		size, newSize, i;
+
+	*hash = 14695981039346656037ULL;
+
+	ec = _coco_open(&path, pathlist, FAM_READ);
+	if (ec != 0)
+	{
+		return(ec);
+	}
+
+	buffer = (char *)malloc(buffer_size);
+	if (buffer == NULL)
+	{
+		_coco_close(path);
+
+		return(EOS_OM);
+	}
+
+	while (_coco_gs_eof(path) == 0)
+	{
+		size = buffer_size;
+		ec = _coco_read(path, buffer, &size);
+		if (ec != 0)
+		{
+			break;
+		}
+
+		newBuffer = NULL;
+		if (translate == 1)
+		{
+			NativeToCoCo(buffer, size, &newBuffer, &newSize);
+			p = (u_char *)newBuffer;
+		}
+		else if (translate == 2)
+		{
+			CoCoToNative(buffer, size, &newBuffer, &newSize);
+			p = (u_char *)newBuffer;
+		}
+		else
+		{
+			p = (u_char *)buffer;
+			newSize = size;
+		}
+
+		for (i = 0; i < newSize; i++)
+		{
+			*hash = (*hash ^ p[i]) * 1099511628211ULL;
+		}
+
+		free(newBuffer);
+	}
+
+	free(buffer);
+	_coco_close(path);
+
+	return(ec == EOS_EOF ? 0 : ec);
+}
+
+/* Find out whether a pathlist is a directory; fails if it isn't there */
+static int IsDirectory(char *pathlist, int *isdir)
+{
+	coco_path_id	path;
+
+	if (_coco_open(&path, pathlist, FAM_DIR | FAM_READ) == 0)
+	{
+		*isdir = 1;
+	}
+	else if (_coco_open(&path, pathlist, FAM_READ) == 0)
+	{
+		*isdir = 0;
+	}
+	else
+	{
+		return(1);
+	}
+
+	_coco_close(path);
+
+	return(0);
+}
+
+/* Run a command now, or queue it when reading ahead with -j */
+static error_code RunCommand(int type, char *command, char *source, char *target, int rewrite, int eoltranslate)
+{
+	dsave_op	*op;
+	_path_type	sourceType, targetType;
+
+	if (readers < 2)
+	{
+		return(system(command));
+	}
+
+	if (opCount == opSize)
+	{
+		opSize = opSize == 0 ? 256 : opSize * 2;
+		ops = (dsave_op *)realloc(ops, opSize * sizeof(dsave_op));
+		if (ops == NULL)
+		{
+			return(EOS_OM);
+		}
+	}
+
+	op = &ops[opCount];
+	memset(op, 0, sizeof(dsave_op));
+	op->type = type;
+	op->command = strdup(command);
+	op->source = source != NULL ? strdup(source) : NULL;
+	op->target = target != NULL ? strdup(target) : NULL;
+	op->rewrite = rewrite;
+
+	/* translate the way TSCopyFile does, which writes nothing at all when
+	 * asked to translate between two files of the same kind
+	 */
+	if (type == DSAVE_COPY && eoltranslate == 1)
+	{
+		_coco_identify_image(source, &sourceType);
+		_coco_identify_image(target, &targetType);
+		if (sourceType == NATIVE && targetType != NATIVE)
+		{
+			op->translate = 1;
+		}
+		else if (sourceType != NATIVE && targetType == NATIVE)
+		{
+			op->translate = 2;
+		}
+		else
+		{
+			op->translate = 3;
+		}
+	}
+
+	opCount++;
+
+	return(0);
+}
+
+/* Start the readers and commit the queued operations in order */
+static error_code CommitOperations(void)
+{
+	error_code	ec = 0;
+	pthread_t	*tids;
+	int			i, started = 0;
+
+	opNextRead = 0;
+	opCommitted = 0;
+
+	tids = (pthread_t *)calloc(readers, sizeof(pthread_t));
+	if (tids == NULL)
+	{
+		return(EOS_OM);
+	}
+
+	for (i = 0; i < readers; i++)
+	{
+		if (pthread_create(&tids[i], NULL, ReadAhead, NULL) == 0)
+		{
+			started++;
+		}
+	}
+
+	for (i = 0; i < opCount; i++)
+	{
+		dsave_op	*op = &ops[i];
+
+		if (op->type == DSAVE_COPY)
+		{
+			pthread_mutex_lock(&opLock);
+			if (started == 0 && op->state == DSAVE_PENDING)
+			{
+				op->state = DSAVE_READING;
+				pthread_mutex_unlock(&opLock);
+				ReadOperation(op);
+				pthread_mutex_lock(&opLock);
+				op->state = DSAVE_READY;
+			}
+			while (op->state != DSAVE_READY)
+			{
+				pthread_cond_wait(&opCond, &opLock);
+			}
+			pthread_mutex_unlock(&opLock);
+
+			ec = WriteOperation(op);
+		}
+		else if (op->type == DSAVE_MAKDIR)
+		{
+			ec = TSMakeDirectory(op->target);
+			if (ec != 0)
+			{
+				fprintf(stderr, "makdir: error %d creating '%s'\n", ec, op->target);
+			}
+		}
+		else
+		{
+			ec = system(op->command);
+		}
+
+		pthread_mutex_lock(&opLock);
+		opCommitted = i + 1;
+		if (ec != 0)
+		{
+			/* tell the readers to stop */
+			opNextRead = opCount;
+		}
+		pthread_cond_broadcast(&opCond);
+		pthread_mutex_unlock(&opLock);
+
+		if (ec != 0)
+		{
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	free(tids);
+
+	return(ec);
+}
+
+/* Reader thread: load the next file to be copied, staying no more than a
+ * few operations per reader ahead of the commits to bound memory use
+ */
+static void *ReadAhead(void *arg)
+{
+	dsave_op	*op;
+
+	pthread_mutex_lock(&opLock);
+	for (;;)
+	{
+		while (opNextRead < opCount && ops[opNextRead].type != DSAVE_COPY)
+		{
+			opNextRead++;
+		}
+
+		if (opNextRead >= opCount)
+		{
+			break;
+		}
+
+		if (opNextRead >= opCommitted + 4 * readers)
+		{
+			pthread_cond_wait(&opCond, &opLock);
+			continue;
+		}
+
+		op = &ops[opNextRead++];
+		op->state = DSAVE_READING;
+		pthread_mutex_unlock(&opLock);
+
+		ReadOperation(op);
+
+		pthread_mutex_lock(&opLock);
+		op->state = DSAVE_READY;
+		pthread_cond_broadcast(&opCond);
+	}
+	pthread_mutex_unlock(&opLock);
+
+	return(NULL);
+}
+
+/* Read a source file into memory in the blocks TSCopyFile would write */
+static void ReadOperation(dsave_op *op)
+{
+	coco_path_id	path;
+	char		*buffer, *newBuffer;
+	u_int		size, newSize;
+
+	op->ec = _coco_open(&path, op->source, FAM_READ);
+	if (op->ec != 0)
+	{
+		return;
+	}
+
+	op->sourceType = path->type;
+
+	buffer = (char *)malloc(buffer_size);
+	if (buffer == NULL)
+	{
+		op->ec = EOS_OM;
+		_coco_close(path);
+		return;
+	}
+
+	while (_coco_gs_eof(path) == 0)
+	{
+		size = buffer_size;
+		op->readec = _coco_read(path, buffer, &size);
+		if (op->readec != 0)
+		{
+			break;
+		}
+
+		switch (op->translate)
+		{
+			case 1:
+				NativeToCoCo(buffer, size, &newBuffer, &newSize);
+				break;
+
+			case 2:
+				CoCoToNative(buffer, size, &newBuffer, &newSize);
+				break;
+
+			case 3:
+				continue;
+
+			default:
+				newBuffer = (char *)malloc(size > 0 ? size : 1);
+				if (newBuffer != NULL)
+				{
+					memcpy(newBuffer, buffer, size);
+				}
+				newSize = size;
+				break;
+		}
+
+		op->blocks = (char **)realloc(op->blocks, (op->count + 1) * sizeof(char *));
+		op->sizes = (u_int *)realloc(op->sizes, (op->count + 1) * sizeof(u_int));
+		if (newBuffer == NULL || op->blocks == NULL || op->sizes == NULL)
+		{
+			free(newBuffer);
+			op->ec = EOS_OM;
+			break;
+		}
+		op->blocks[op->count] = newBuffer;
+		op->sizes[op->count] = newSize;
+		op->count++;
+	}
+
+	_coco_gs_fd(path, &op->fdesc);
+
+	free(buffer);
+	_coco_close(path);
+}
+
+/* Write a loaded file to the target as "os9 copy" would; like copy, a
+ * failure is reported and the dsave goes on
+ */
+static error_code WriteOperation(dsave_op *op)
+{
+	error_code	ec = op->ec;
+	coco_path_id	destpath;
+	coco_file_stat	fstat;
+	int		mode = FAM_NOCREATE | FAM_WRITE;
+	int		i;
+
+	if (ec == 0)
+	{
+		if (op->rewrite == 1)
+		{
+			mode &= ~FAM_NOCREATE;
+		}
+
+		fstat.perms = FAP_PREAD | FAP_READ | FAP_WRITE;
+		ec = _coco_create(&destpath, op->target, mode, &fstat);
+	}
+
+	if (ec == 0)
+	{
+		for (i = 0; i < op->count && ec == 0; i++)
+		{
+			ec = _coco_write(destpath, op->blocks[i], &op->sizes[i]);
+		}
+
+		if (op->sourceType == NATIVE)
+		{
+			op->fdesc.user_id = 0;
+			op->fdesc.group_id = 0;
+		}
+
+		_coco_ss_fd(destpath, &op->fdesc);
+		_coco_close(destpath);
+
+		if (ec == 0)
+		{
+			ec = op->readec;
+		}
+	}
+
+	if (ec != 0)
+	{
+		char errorstr[TS_MAXSTR];
+
+		TSReportError(ec, errorstr);
+		fprintf(stderr, "copy: error %d on file '%s': %s\n", ec, op->source, errorstr);
+	}
+
+	for (i = 0; i < op->count; i++)
+	{
+		free(op->blocks[i]);
+	}
+	free(op->blocks);
+	free(op->sizes);
+	op->blocks = NULL;
+	op->sizes = NULL;
+	op->count = 0;
+
+	return(0);
+}
+
+static void FreeOperations(void)
+{
+	int		i, j;
+
+	for (i = 0; i < opCount; i++)
+	{
+		for (j = 0; j < ops[i].count; j++)
+		{
+			free(ops[i].blocks[j]);
+		}
+		free(ops[i].blocks);
+		free(ops[i].sizes);
+		free(ops[i].command);
+		free(ops[i].source);
+		free(ops[i].target);
+	}
+	free(ops);
+
+	ops = NULL;
+	opCount = opSize = 0;
+}
+
 static char *ShellEscapePath(char *source, char *src_path_seperator, u_char *direntry_name_buffer)
 {
 	char *buffer = malloc((strlen(source)+strlen(src_path_seperator)+strlen((const char *)direntry_name_buffer) * 4 ) + 1 );
@@ -8,17 +8,12 @@
 #include "cocopath.h"
 #include "cocotypes.h"
 #include "cococonv.h"
+#include "dump.h"
 
 
-#define BUFFSIZ	256
+#define BUFFSIZ	32768
 
-static u_int dumpchunk;
-
-static void dump(u_char *buffer, size_t num_bytes, int format);
-static void dump_line(u_char *buffer, int count, int format);
 static int do_dump(char **argv, char *file, int format);
-static void dump_header(int format);
-static char *binary(char s);
 
 /* Help message */
 static char const * const helpMessage[] =
@@ -47,11 +42,10 @@ int os9dump(int argc, char **argv)
     char *p = NULL;
     int i;
 
-    assemblerFormat = 0;
+    assemblerFormat = DUMP_HEX;
     displayASCII = 1;
     displayHeader = 1;
     displayLabel = 1;
-    dumpchunk = 16;
 
     if (argv[1] == NULL)
     {
@@ -69,13 +63,11 @@ int os9dump(int argc, char **argv)
                 switch(*p)
                 {
                     case 'a':
-                        assemblerFormat = 1;
-                        dumpchunk = 8;
+                        assemblerFormat = DUMP_FCB;
                         break;
 
                     case 'b':
-                        assemblerFormat = 2;
-                        dumpchunk = 1;
+                        assemblerFormat = DUMP_BINARY;
                         break;
 
                     case 'c':
@@ -127,17 +119,14 @@ int os9dump(int argc, char **argv)
 }
 
 
-static int byte_count;
-
 static int do_dump(char **argv, char *file, int format)
 {
     error_code	ec = 0;
-    u_char buffer[BUFFSIZ];
+    u_char *buffer;
+    dump_context *d;
     coco_path_id path;
 
 
-    byte_count = 0;
-
     /* 1. Open a path to the file. */
 	
     ec = _coco_open(&path, file, FAM_READ);
@@ -153,6 +142,23 @@ static int do_dump(char **argv, char *file, int format)
         }
     }
 
+    buffer = (u_char *)malloc(BUFFSIZ);
+    d = (dump_context *)malloc(sizeof(dump_context));
+
+    if (buffer == NULL || d == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        free(buffer);
+        free(d);
+        _coco_close(path);
+        return(1);
+    }
+
+    dump_init(d, stdout, format);
+    d->displayASCII = displayASCII;
+    d->displayHeader = displayHeader;
+    d->displayLabel = displayLabel;
+
     while (1)
     {
         u_int num_bytes = BUFFSIZ;
@@ -162,232 +168,16 @@ static int do_dump(char **argv, char *file, int format)
         {
             break;
         }
-        dump(buffer, num_bytes, format);
+        dump_bytes(d, buffer, num_bytes);
     }
 
-    printf("\n");
+    dump_finish(d);
+
+    free(d);
+    free(buffer);
 
     ec = _coco_close(path);
 
 
     return ec;
 }
-
-
-static void dump(u_char *buffer, size_t num_bytes, int format)
-{
-    u_int i;
-
-    for (i = 0; i < num_bytes; i += dumpchunk)
-    {
-        if (byte_count % BUFFSIZ == 0)
-        {
-            dump_header(format);
-        }
-
-        /* print line header */
-        if (format == 0)
-        {
-            if (displayLabel == 1)
-            {
-                printf("\n%08x  ", byte_count);
-            }
-            else
-            {
-                printf("\n");
-            }
-        }
-        else
-        {
-            if (displayLabel == 1)
-            {
-                printf("\nL%04X    fcb   ", byte_count);
-            }
-            else
-            {
-                printf("\n         fcb   ");
-            }
-        }
-        if (num_bytes - i > dumpchunk)
-        {
-            dump_line(&buffer[i], dumpchunk, format);
-            byte_count += dumpchunk;
-        }
-        else
-        {
-            dump_line(&buffer[i], num_bytes - i, format);
-            byte_count += num_bytes - i;
-        }
-    }
-
-    return;
-}
-
-
-static void dump_line(u_char *buffer, int count, int format)
-{
-    int i;
-    int carry = 0;
-
-    if (count % 2 != 0)
-    {
-        count--;
-        carry = 1;
-    }
-	
-    for (i = 0; i < count; i += 2)
-    {
-        switch (format)
-        {
-            case 0:
-                printf("%02x%02x ", buffer[i], buffer[i + 1]);
-                break;
-
-            case 1:
-                if (i == count - 2 && carry == 0)
-                {
-                    printf("$%02X,$%02X", buffer[i], buffer[i + 1]);
-                }
-                else
-                {
-                    printf("$%02X,$%02X,", buffer[i], buffer[i + 1]);
-                }
-                break;
-                
-            case 2:
-                if (i == count - 2 && carry == 0)
-                {
-                    printf("%%%s,%%%s", binary(buffer[i]), binary(buffer[i + 1]));
-                }
-                else
-                {
-                    printf("%%%s,%%%s,", binary(buffer[i]), binary(buffer[i + 1]));
-                }
-                break;
-        }
-    }
-
-    if (carry == 1)
-    {
-        switch (format)
-        {
-            case 0:
-                printf("%02x", buffer[i]);
-                break;
-
-            case 1:
-                printf("$%02X", buffer[i]);
-                break;
-
-            case 2:
-                printf("%%%s", binary(buffer[i]));
-                break;
-        }
-        count++;
-    }
-
-    if (displayASCII == 1)
-    {
-        /* make spaces available if last line is not full */
-        i = (dumpchunk - count);
-
-        if (format == 1)
-        {
-            printf("   ");
-        }
-
-        if (i % 2 != 0)
-        {
-            switch (format)
-            {
-                case 1:
-                    printf("     ");
-                    break;
-                    
-                default:
-                    printf("   ");
-                    break;
-            }
-        }
-    
-        i /= 2;
-    
-        while (i--)
-        {
-            if (format == 1)
-            {
-                printf("        ");
-            }
-            else
-            {
-                printf("     ");
-            }
-        }
-
-        /* print character dump on right side */
-        for (i = 0; i < count; i++)
-        {
-            if (buffer[i] >= 32 && buffer[i] < 127)
-            {
-                printf("%c", buffer[i]);
-            }
-            else if (buffer[i] >= 128+32 && buffer[i] <= 128+'z')
-            {
-                printf("%c", buffer[i]-128);
-            }
-            else
-            {
-                printf(".");
-            }
-        }
-    }
-
-    return;
-}
-
-
-static void dump_header(int format)
-{
-    if (format == 0 && displayHeader == 1)
-    {
-        printf("\n\n  Addr     0 1  2 3  4 5  6 7  8 9  A B  C D  E F");
-        if (displayASCII == 1)
-        {
-            printf(" 0 2 4 6 8 A C E");
-        }
-        printf("\n");
-        
-        printf("--------  ---- ---- ---- ---- ---- ---- ---- ----");
-        if (displayASCII == 1)
-        {
-            printf(" ----------------");
-        }
-    }
-
-    return;
-}
-
-
-static char *binary(char s)
-{
-    static char buffer[9] = {'0', '0', '0', '0', '0', '0', '0', '0', '\0'};
-    int i;
-    
-    
-    for (i = 0; i < 8; i++)
-    {
-        int x = s & (1 << (7 - i));
-        
-        if (x != 0)
-        {
-            buffer[i] = '1';
-        }
-        else
-        {
-            buffer[i] = '0';
-        }
-    }
-    
-
-    return(buffer);
-}
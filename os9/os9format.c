@@ -5,6 +5,7 @@
  ********************************************************************/
 #include <util.h>
 #include <string.h>
+#include <limits.h>
 
 #include "cocotypes.h"
 #include "cocosys.h"
@@ -16,8 +17,9 @@
 #define BUFFSIZ	256
 
 #define DragonBootSize	16	/* Size of Dragon boot area in sectors */
+#define EMPTY_BATCH_BYTES	(1024 * 1024)	/* empty sectors written at a time */
 
-static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks, int sectorsPerTrack, int heads, int sectorSize, int clusterSize, char *diskName, int sectorAllocationSize, int tpi, int density, int formatEntire, int isDragon, int isHDD);
+static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks, int sectorsPerTrack, int heads, int sectorSize, int clusterSize, char *diskName, int sectorAllocationSize, int tpi, int density, int formatEntire, int isDragon, int isHDD, int sparse, int inMemory);
 
 /* Help message */
 static char const * const helpMessage[] =
@@ -29,7 +31,10 @@ static char const * const helpMessage[] =
 	"     -cX  = cluster size\n",
 	"     -e   = format entire disk (make full sized image)\n",
 	"     -k   = make OS-9/68K LSN0\n",
+	"     -m   = with -e, build the image in memory and write it at once\n",
 	"     -nX  = disk name\n",
+	"     -p   = with -e, make a sparse image (host file system supplies\n",
+	"            the empty sectors)\n",
 	"     -q   = quiet; do not report format summary\n",
 	" Floppy Options:\n",
 	"     -4   = 48 tpi (default)\n",
@@ -68,6 +73,8 @@ int os9format(int argc, char **argv)
 	int formatEntire = 0;	/* format entire disk image */
 	int isDragon = 0;		/* format disk as Dragon, with reserved boot sectors at begining */
 	int isHDD = 0; /* Is this image for a hard drive */
+	int sparse = 0;		/* leave the empty sectors to the host file system */
+	int inMemory = 0;	/* build the entire image in memory */
 	
 	/* if no arguments, show help and return */
 	if (argv[1] == NULL)
@@ -111,6 +118,14 @@ int os9format(int argc, char **argv)
 						os968k = 1;
 						break;
 
+					case 'm':
+						inMemory = 1;
+						break;
+
+					case 'p':
+						sparse = 1;
+						break;
+
 					case 'q':
 						quiet = 1;
 						break;
@@ -256,7 +271,7 @@ int os9format(int argc, char **argv)
 		}
 		else
 		{
-			do_format(argv, argv[i], os968k, quiet, tracks, sectorsPerTrack, heads, bytesPerSector, clusterSize, diskName, sectorAllocationSize, tpi, density, formatEntire, isDragon, isHDD);
+			do_format(argv, argv[i], os968k, quiet, tracks, sectorsPerTrack, heads, bytesPerSector, clusterSize, diskName, sectorAllocationSize, tpi, density, formatEntire, isDragon, isHDD, sparse, inMemory);
 		}
 	}
 
@@ -265,7 +280,7 @@ int os9format(int argc, char **argv)
 
 
 
-static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks, int sectorsPerTrack, int heads, int sectorSize, int clusterSize, char *diskName, int sectorAllocationSize, int tpi, int density, int formatEntire, int isDragon, int isHDD)
+static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks, int sectorsPerTrack, int heads, int sectorSize, int clusterSize, char *diskName, int sectorAllocationSize, int tpi, int density, int formatEntire, int isDragon, int isHDD, int sparse, int inMemory)
 {
 	error_code	ec = 0;
 	native_path_id path;
@@ -275,6 +290,8 @@ static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks
 	unsigned int sectorsToAlloc = 0;
 	unsigned int bitmapSectors, bitmapBytes;
 	unsigned int rootSects;
+	u_char *image, *p;
+	u_int imageBytes;
 
 	/* 1. Open a path to the virtual disk. */
 
@@ -445,38 +462,60 @@ static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks
 	/* put bytes per sector */
 	_int1(sectorSize / 256, s0.dd_lsnsize);
 
-	/***** Write LSN0 *****/
+	/* Work out what LSN0, the bitmap, any Dragon boot area and the root
+	 * directory take up; these are built in memory and written together.
+	 */
+	sectorsToAlloc++;	/* LSN0 */
+	sectorsToAlloc += bitmapSectors;	/* Bitmap sectors */
+
+	if(isDragon)
 	{
-		u_int size = sizeof(s0);
-		u_int size2 = sectorSize - size;
+		sectorsToAlloc += DragonBootSize;			/* Dragon boot area */
+	}
 
-		/* write LSN0 structure */
-		_native_write(path, &s0, &size);
+	rootSects = 1;				/* Root FD Sector */
+	rootSects += sectorAllocationSize;	/* Root dirent sectors */
 
-		/* fill in rest of sector with zeros */
-		while (size2--)
-		{
-			u_int size = 1;
-			char nil = '\0';
+	sectorsToAlloc += rootSects;	/* Total sectors so far -- will be a multiple of cluster size */
 
-			_native_write(path, &nil, &size);
-		}
+	/* Round up sectors to allocate to next highest multiple
+	 * of cluster size.
+	 * This gives the root directory the fullest possible
+	 * number of sectors remaining in the cluster.
+	 */
+	{
+		unsigned int sectorsToAllocOld = sectorsToAlloc;
+
+		sectorsToAlloc = NextHighestMultiple(sectorsToAlloc, clusterSize);
+		rootSects += sectorsToAlloc - sectorsToAllocOld;
 	}
 
-	/***** Write Bitmap Sector(s) *****/
+	sectorsLeft = sectorsLeft > sectorsToAlloc ? sectorsLeft - sectorsToAlloc : 0;
+
+	/* With -m the whole disk is built here and written in one go */
+	imageBytes = sectorsToAlloc * sectorSize;
+	if (formatEntire == 1 && inMemory == 1)
 	{
-		u_char *bitmap;
-		u_int size;
+		imageBytes += sectorsLeft * sectorSize;
+	}
 
-		size = bitmapSectors * sectorSize;
-		bitmap = (u_char *)malloc(size);
-		if (bitmap == NULL)
-		{
-			return(1);
-		}
+	image = (u_char *)calloc(imageBytes, 1);
+	if (image == NULL)
+	{
+		_native_close(path);
 
-		/* Clear out bitmap sectors (assume all space available) */
-		memset(bitmap, 0, size);
+		return(1);
+	}
+	p = image;
+
+	/***** Build LSN0 *****/
+	memcpy(p, &s0, sizeof(s0));
+	p += sectorSize;
+
+	/***** Build Bitmap Sector(s) *****/
+	{
+		u_char *bitmap = p;
+		u_int size = bitmapSectors * sectorSize;
 
 		/* Allocate bits after s0.dd_dot sectors to end of bitmap */
 		{
@@ -486,87 +525,23 @@ static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks
 		}
 
 		/* Allocate LSN0, Bitmap Sectors, Root FD and Root Dir */
-		{
-			int clusters;
-
-			sectorsToAlloc++;	/* LSN0 */
-			sectorsToAlloc += bitmapSectors;	/* Bitmap sectors */
-
-			if(isDragon)
-			{
-				sectorsToAlloc += DragonBootSize;			/* Dragon boot area */
-			}
-
-			rootSects = 1;				/* Root FD Sector */
-			rootSects += sectorAllocationSize;	/* Root dirent sectors */
-
-			sectorsToAlloc += rootSects;	/* Total sectors so far -- will be a multiple of cluster size */
-
-			/* Round up sectors to allocate to next highest multiple
-			 * of cluster size.
-			 * This gives the root directory the fullest possible
-			 * number of sectors remaining in the cluster.
-			 */
-			{
-				unsigned int sectorsToAllocOld = sectorsToAlloc;
-
-				sectorsToAlloc = NextHighestMultiple(sectorsToAlloc, clusterSize);
-				rootSects += sectorsToAlloc - sectorsToAllocOld;
-			}
+		_os9_allbit(bitmap, 0, sectorsToAlloc / clusterSize);
 
-			clusters = sectorsToAlloc / clusterSize;
-			_os9_allbit(bitmap, 0, clusters);
-
-			sectorsLeft -= sectorsToAlloc;
-		}
-
-		_native_write(path, bitmap, &size);
-
-		free(bitmap);
+		p += size;
 	}
 
-	/* If this is a Dragon disk, write out Dragon boot area */
+	/* If this is a Dragon disk, fill in the Dragon boot area */
 	if(isDragon)
 	{
-		char	*DragonBoot;
-		u_int		BootSize;
-
-		BootSize=DragonBootSize*sectorSize;
-
-		DragonBoot=(char *)calloc(BootSize,1);
-		memset(DragonBoot,0x55,BootSize);	
-		_native_write(path,DragonBoot,&BootSize);
-	
-		free(DragonBoot);
+		memset(p, 0x55, DragonBootSize * sectorSize);
+		p += DragonBootSize * sectorSize;
 	}
 
-	/* Write Root Directory FD and Root Sectors */
+	/* Build Root Directory FD and Root Sectors */
 	{
-		char *allocedSectors;
-		unsigned int totalSectors;
-		u_int totalBytes;
-
-		if(isDragon)
-		{
-			totalSectors = sectorsToAlloc - 1 - bitmapSectors - DragonBootSize;
-		}
-		else
-		{
-			totalSectors = sectorsToAlloc - 1 - bitmapSectors;
-		}
-		totalBytes = totalSectors * sectorSize;
-		allocedSectors = (char *)malloc(totalBytes);
-
-		if (allocedSectors == NULL)
-		{
-			return(1);
-		}
-
-		memset(allocedSectors, 0, totalBytes);
-
 		/* Build FD sector */
 		{
-			Fd_stats statSector = (Fd_stats)allocedSectors;
+			Fd_stats statSector = (Fd_stats)p;
 
 			char lastModifiedDate[5], createDate[5];
 
@@ -586,7 +561,7 @@ static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks
 
 		/* Build directory sector */
 		{
-			os9_dir_entry *d = (os9_dir_entry *)&allocedSectors[sectorSize];
+			os9_dir_entry *d = (os9_dir_entry *)&p[sectorSize];
 
 			/* Create '..' */
 			strcpy((char *)d->name, "..");
@@ -600,32 +575,42 @@ static int do_format(char **argv, char *vdisk, int os968k, int quiet, int tracks
 			CStringToOS9String(d->name);
 			_int3(int3(s0.dd_dir), d->lsn);
 		}
+	}
 
+	/***** Write LSN0, Bitmap and Root Directory (and with -m the rest) *****/
+	_native_write(path, image, &imageBytes);
 
-		_native_write(path, allocedSectors, &totalBytes);
-
-		free(allocedSectors);
-	}
+	free(image);
 
 	/* Write Rest of disk as empty sectors */
-	if (formatEntire == 1)
+	if (formatEntire == 1 && inMemory == 0 && sectorsLeft > 0)
 	{
-		char *oneEmptySector;
-
-		oneEmptySector = (char *)malloc(sectorSize);
-
-		if (oneEmptySector != NULL)
+		if (sparse == 1 && totalBytes <= INT_MAX)
 		{
-			memset(oneEmptySector, 0, sectorSize);
+			/* Let the host file system supply the zeros */
+			fflush(path->fd);
+			_native_ss_size(path, totalBytes);
+		}
+		else
+		{
+			char *emptySectors;
+			unsigned int batch = EMPTY_BATCH_BYTES / sectorSize;
 
-			while (sectorsLeft--)
+			emptySectors = (char *)calloc(batch, sectorSize);
+
+			if (emptySectors != NULL)
 			{
-				u_int size = sectorSize;
+				while (sectorsLeft > 0)
+				{
+					u_int count = sectorsLeft < batch ? sectorsLeft : batch;
+					u_int size = count * sectorSize;
 
-				_native_write(path, oneEmptySector, &size);
-			}
+					_native_write(path, emptySectors, &size);
+					sectorsLeft -= count;
+				}
 
-			free(oneEmptySector);
+				free(emptySectors);
+			}
 		}
 	}
 
@@ -4,9 +4,12 @@
  * $Id$
  ********************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "cocotypes.h"
+#include "cococonv.h"
 #include "cocopath.h"
 #include "os9module.h"
 #include "util.h"
@@ -24,9 +27,59 @@ static char const * const langs[16] = {
 	"???", "???", "???", "???", "???"
 };
 
+/* One module found while building an index */
+typedef struct
+{
+    char name[80];
+    u_int edition;
+    u_int tyla;             /* type and language; two bytes for OS-9/68K */
+    u_int attrev;
+    u_int crc;
+    int goodCRC;
+    u_int size;
+    u_int offset;           /* where the module starts in its file */
+} ident_module;
+
+/* A file to ident and the modules found in it */
+typedef struct
+{
+    char *path;
+    time_t date;            /* FD date and size decide if the index is current */
+    u_int size;
+    ident_module *modules;
+    int count;
+    error_code ec;
+} ident_file;
+
+typedef struct
+{
+    ident_file *files;
+    int count;
+    int size;
+} ident_list;
+
+static int do_index(char **argv, int argc);
+static error_code walk_tree(char *pathlist, ident_list *list);
+static ident_file *add_file(ident_list *list, char *path);
+static ident_module *add_module(ident_file *file);
+static void scan_modules(ident_file *file, u_char *data, u_int size);
+static void load_index(char *indexName, ident_list *list);
+static error_code save_index(char *indexName, ident_list *list);
+static int compare_files(const void *a, const void *b);
+static void *ident_worker(void *arg);
+static void free_list(ident_list *list);
+
 static int shortFlag = 0;
 static u_char *buffer;
 
+static int recurse = 0;
+static int threads = 1;
+static char *indexName = NULL;
+
+static ident_list fileList, cacheList;
+static int fileNext;
+static pthread_mutex_t fileLock = PTHREAD_MUTEX_INITIALIZER;
+
 
 
 
@@ -37,6 +90,10 @@ static char const * const helpMessage[] =
 	"Usage:  Display OS-9 module information.\n",
 	"Options:\n",
 	"     -s    short output\n",
+	"     -r    ident everything in directories and disk images\n",
+	"     -j<n> read files with <n> threads\n",
+	"     -x=<file>  keep a module index in <file>; files with the same\n",
+	"           date and size as in the index are not read again\n",
 	NULL
 };
 
@@ -342,6 +399,33 @@ int os9ident(int argc, char **argv)
                     case 's':
                         shortFlag = 1;
                         break;
+
+                    case 'r':
+                        recurse = 1;
+                        break;
+
+                    case 'j':
+                        threads = atoi(p + 1);
+                        if (threads < 1)
+                        {
+                            threads = 1;
+                        }
+                        while (*(p + 1) != '\0')
+                        {
+                            p++;
+                        }
+                        break;
+
+                    case 'x':
+                        if (*(p + 1) == '=')
+                        {
+                            indexName = p + 2;
+                        }
+                        while (*(p + 1) != '\0')
+                        {
+                            p++;
+                        }
+                        break;
 	
                     case '?':
                     case 'h':
@@ -357,6 +441,18 @@ int os9ident(int argc, char **argv)
     }
 
 
+    /* the index mode reports modules one per line, with their pathlists */
+
+    if (recurse == 1 || threads > 1 || indexName != NULL)
+    {
+        ec = do_index(argv, argc);
+
+        free(buffer);
+
+        return(ec);
+    }
+
+
     /* walk command line for pathnames */
 
     for (i = 1; i < argc; i++)
@@ -384,3 +480,516 @@ int os9ident(int argc, char **argv)
 
     return(ec);
 }
+
+
+
+/* Ident many files or whole trees, reading unchanged files from the index */
+
+static int do_index(char **argv, int argc)
+{
+    error_code ec = 0;
+    int i, k;
+    pthread_t *tids;
+    ident_file *file;
+    ident_module *mod;
+
+    memset(&fileList, 0, sizeof(fileList));
+    memset(&cacheList, 0, sizeof(cacheList));
+
+    for (i = 1; i < argc && ec == 0; i++)
+    {
+        if (argv[i][0] == '-')
+        {
+            continue;
+        }
+
+        if (recurse == 1)
+        {
+            /* host directories list in no particular order */
+            k = fileList.count;
+            ec = walk_tree(argv[i], &fileList);
+            qsort(fileList.files + k, fileList.count - k, sizeof(ident_file), compare_files);
+        }
+        else if (add_file(&fileList, argv[i]) == NULL)
+        {
+            ec = EOS_OM;
+        }
+    }
+
+    if (ec != 0)
+    {
+        fprintf(stderr, "%s: error %d reading directories\n", argv[0], ec);
+        free_list(&fileList);
+        return(ec);
+    }
+
+    if (indexName != NULL)
+    {
+        load_index(indexName, &cacheList);
+    }
+
+    fileNext = 0;
+
+    if (threads > fileList.count)
+    {
+        threads = fileList.count > 0 ? fileList.count : 1;
+    }
+
+    if (threads < 2)
+    {
+        ident_worker(NULL);
+    }
+    else
+    {
+        tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+        if (tids == NULL)
+        {
+            ident_worker(NULL);
+        }
+        else
+        {
+            for (k = 0; k < threads; k++)
+            {
+                pthread_create(&tids[k], NULL, ident_worker, NULL);
+            }
+            for (k = 0; k < threads; k++)
+            {
+                pthread_join(tids[k], NULL);
+            }
+            free(tids);
+        }
+    }
+
+    /* report in list order whatever order the workers finished in */
+    for (i = 0; i < fileList.count; i++)
+    {
+        file = &fileList.files[i];
+
+        if (file->ec != 0)
+        {
+            fprintf(stderr, "%s: error %d opening file %s\n", argv[0], file->ec, file->path);
+            continue;
+        }
+
+        for (k = 0; k < file->count; k++)
+        {
+            mod = &file->modules[k];
+            printf("  %3d $%02X $%06X %c %-16s %s\n", mod->edition, mod->tyla, mod->crc,
+                mod->goodCRC ? '.' : '?', mod->name, file->path);
+        }
+    }
+
+    if (indexName != NULL)
+    {
+        ec = save_index(indexName, &fileList);
+        if (ec != 0)
+        {
+            fprintf(stderr, "%s: error %d writing index %s\n", argv[0], ec, indexName);
+        }
+    }
+
+    free_list(&fileList);
+    free_list(&cacheList);
+
+    return(ec);
+}
+
+
+/* Add a file, or every file under a directory or RBF disk image */
+
+static error_code walk_tree(char *pathlist, ident_list *list)
+{
+    error_code ec = 0;
+    coco_path_id path;
+    coco_dir_entry dirent;
+    _path_type type;
+    char child[1024];
+    u_char name[256];
+    size_t len = strlen(pathlist);
+
+    if (_coco_open(&path, pathlist, FAM_DIR | FAM_READ) != 0)
+    {
+        /* a host file holding a disk image is walked from its root */
+        snprintf(child, sizeof(child), "%s,", pathlist);
+        if (strchr(pathlist, ',') == NULL &&
+            _coco_identify_image(child, &type) == 0 && type == OS9)
+        {
+            return(walk_tree(child, list));
+        }
+
+        return(add_file(list, pathlist) == NULL ? EOS_OM : 0);
+    }
+
+    while (ec == 0 && _coco_readdir(path, &dirent) == 0)
+    {
+        _coco_ncpy_name(&dirent, name, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+
+        if (name[0] == '\0' || name[0] == 255 ||
+            strcmp((char *)name, ".") == 0 || strcmp((char *)name, "..") == 0)
+        {
+            continue;
+        }
+
+        snprintf(child, sizeof(child), "%s%s%s", pathlist,
+            (len > 0 && (pathlist[len - 1] == ',' || pathlist[len - 1] == '/')) ? "" : "/", name);
+        ec = walk_tree(child, list);
+    }
+
+    _coco_close(path);
+
+    return(ec);
+}
+
+
+static ident_file *add_file(ident_list *list, char *path)
+{
+    ident_file *file;
+
+    if (list->count == list->size)
+    {
+        file = (ident_file *)realloc(list->files, (list->size == 0 ? 256 : list->size * 2) * sizeof(ident_file));
+        if (file == NULL)
+        {
+            return(NULL);
+        }
+        list->files = file;
+        list->size = list->size == 0 ? 256 : list->size * 2;
+    }
+
+    file = &list->files[list->count];
+    memset(file, 0, sizeof(ident_file));
+    file->path = strdup(path);
+    if (file->path == NULL)
+    {
+        return(NULL);
+    }
+    list->count++;
+
+    return(file);
+}
+
+
+static ident_module *add_module(ident_file *file)
+{
+    ident_module *mod;
+
+    mod = (ident_module *)realloc(file->modules, (file->count + 1) * sizeof(ident_module));
+    if (mod == NULL)
+    {
+        return(NULL);
+    }
+    file->modules = mod;
+
+    mod = &file->modules[file->count++];
+    memset(mod, 0, sizeof(ident_module));
+
+    return(mod);
+}
+
+
+/* Copy a module name, which ends with its top bit set; returns its length */
+
+static u_int module_name(char *name, u_char *string, u_int max)
+{
+    u_int i = 0;
+
+    while (i < max && i < 79)
+    {
+        name[i] = string[i] & 0x7f;
+        if (string[i++] >= 0x7f)
+        {
+            break;
+        }
+    }
+    name[i] = '\0';
+
+    return(i);
+}
+
+
+/* Find the modules in a file held in memory, stopping where do_ident would */
+
+static void scan_modules(ident_file *file, u_char *data, u_int size)
+{
+    u_int offset = 0, modsize, nameoff, len;
+    u_char *buf;
+    ident_module *mod;
+
+    while (offset + 2 <= size)
+    {
+        buf = data + offset;
+
+        if (buf[0] == OS9_ID0 && buf[1] == OS9_ID1)
+        {
+            OS9_MODULE_t *os9mod = (OS9_MODULE_t *)buf;
+
+            if (offset + OS9_HEADER_SIZE > size || _os9_header(os9mod) != 0xFF)
+            {
+                break;
+            }
+
+            modsize = INT(os9mod->size);
+            nameoff = INT(os9mod->name);
+            if (modsize < OS9_HEADER_SIZE + 3 || modsize > size - offset || nameoff >= modsize)
+            {
+                break;
+            }
+
+            if ((mod = add_module(file)) == NULL)
+            {
+                break;
+            }
+            len = module_name(mod->name, &buf[nameoff], modsize - nameoff);
+            mod->edition = nameoff + len < modsize ? buf[nameoff + len] : 0;
+            mod->tyla = os9mod->tyla;
+            mod->attrev = os9mod->atrv;
+            mod->goodCRC = _os9_crc(os9mod);
+        }
+        else if (buf[0] == OSK_ID0 && buf[1] == OSK_ID1)
+        {
+            OSK_MODULE_t *oskmod = (OSK_MODULE_t *)buf;
+
+            if (offset + OSK_HEADER_SIZE > size || _osk_header(oskmod) != 0xFFFF)
+            {
+                break;
+            }
+
+            modsize = int4(oskmod->size);
+            nameoff = int4(oskmod->name);
+            if (modsize < OSK_HEADER_SIZE + 3 || modsize > size - offset || nameoff >= modsize)
+            {
+                break;
+            }
+
+            if ((mod = add_module(file)) == NULL)
+            {
+                break;
+            }
+            module_name(mod->name, &buf[nameoff], modsize - nameoff);
+            mod->edition = int2(oskmod->edit);
+            mod->tyla = (oskmod->type << 8) | oskmod->lang;
+            mod->attrev = (oskmod->attr << 8) | oskmod->revs;
+            mod->goodCRC = _osk_crc(oskmod);
+        }
+        else
+        {
+            break;
+        }
+
+        mod->size = modsize;
+        mod->offset = offset;
+        mod->crc = (buf[modsize - 3] << 16) | (buf[modsize - 2] << 8) | buf[modsize - 1];
+
+        offset += modsize;
+    }
+}
+
+
+static int compare_files(const void *a, const void *b)
+{
+    return(strcmp(((ident_file *)a)->path, ((ident_file *)b)->path));
+}
+
+
+/* Read an index written by an earlier run; a missing index is empty.
+ *
+ *   F <date> <size> <pathlist>
+ *   M <edition> <ty/la> <at/rv> <crc> <good> <size> <offset> <name>
+ */
+
+static void load_index(char *indexName, ident_list *list)
+{
+    FILE *fp;
+    char line[1200];
+    ident_file *file = NULL;
+    ident_module *mod;
+    long date;
+    u_int size;
+    int n;
+
+    fp = fopen(indexName, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        n = 0;
+
+        if (line[0] == 'F')
+        {
+            file = NULL;
+            if (sscanf(line, "F\t%ld\t%u\t%n", &date, &size, &n) == 2 && n > 0)
+            {
+                file = add_file(list, line + n);
+                if (file != NULL)
+                {
+                    file->date = (time_t)date;
+                    file->size = size;
+                }
+            }
+        }
+        else if (line[0] == 'M' && file != NULL && (mod = add_module(file)) != NULL)
+        {
+            if (sscanf(line, "M\t%u\t%x\t%x\t%x\t%d\t%u\t%u\t%n", &mod->edition, &mod->tyla, &mod->attrev,
+                &mod->crc, &mod->goodCRC, &mod->size, &mod->offset, &n) != 7 || n == 0)
+            {
+                file->count--;
+                continue;
+            }
+            strncpy(mod->name, line + n, sizeof(mod->name) - 1);
+        }
+    }
+
+    fclose(fp);
+
+    qsort(list->files, list->count, sizeof(ident_file), compare_files);
+}
+
+
+static error_code save_index(char *indexName, ident_list *list)
+{
+    FILE *fp;
+    ident_file *file;
+    ident_module *mod;
+    int i, k;
+
+    fp = fopen(indexName, "w");
+    if (fp == NULL)
+    {
+        return(UnixToCoCoError(errno));
+    }
+
+    fprintf(fp, "* os9 ident index\n");
+
+    for (i = 0; i < list->count; i++)
+    {
+        file = &list->files[i];
+        if (file->ec != 0)
+        {
+            continue;
+        }
+
+        fprintf(fp, "F\t%ld\t%u\t%s\n", (long)file->date, file->size, file->path);
+
+        for (k = 0; k < file->count; k++)
+        {
+            mod = &file->modules[k];
+            fprintf(fp, "M\t%u\t%X\t%X\t%06X\t%d\t%u\t%u\t%s\n", mod->edition, mod->tyla, mod->attrev,
+                mod->crc, mod->goodCRC, mod->size, mod->offset, mod->name);
+        }
+    }
+
+    if (fclose(fp) != 0)
+    {
+        return(UnixToCoCoError(errno));
+    }
+
+    return(0);
+}
+
+
+/* Take files off the list until it is empty */
+
+static void *ident_worker(void *arg)
+{
+    coco_path_id path;
+    coco_file_stat fdesc;
+    ident_file *file, key, *cached;
+    u_char *data;
+    u_int size, total, count;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&fileLock);
+        file = fileNext < fileList.count ? &fileList.files[fileNext++] : NULL;
+        pthread_mutex_unlock(&fileLock);
+
+        if (file == NULL)
+        {
+            break;
+        }
+
+        file->ec = _coco_open(&path, file->path, FAM_READ);
+        if (file->ec != 0)
+        {
+            continue;
+        }
+
+        _coco_gs_fd(path, &fdesc);
+        file->date = fdesc.last_modified_time;
+        _coco_gs_size(path, &file->size);
+
+        /* an unchanged file has the modules the index gave it last time */
+        key.path = file->path;
+        cached = cacheList.count == 0 ? NULL :
+            (ident_file *)bsearch(&key, cacheList.files, cacheList.count, sizeof(ident_file), compare_files);
+
+        if (cached != NULL && cached->date == file->date && cached->size == file->size)
+        {
+            file->modules = (ident_module *)malloc((cached->count > 0 ? cached->count : 1) * sizeof(ident_module));
+            if (file->modules == NULL)
+            {
+                file->ec = EOS_OM;
+            }
+            else
+            {
+                memcpy(file->modules, cached->modules, cached->count * sizeof(ident_module));
+                file->count = cached->count;
+            }
+            _coco_close(path);
+            continue;
+        }
+
+        /* only a file that starts like a module is read in full */
+        data = (u_char *)malloc(file->size > 2 ? file->size : 2);
+        if (data == NULL)
+        {
+            file->ec = EOS_OM;
+            _coco_close(path);
+            continue;
+        }
+
+        total = 0;
+        size = 2;
+        if (_coco_read(path, data, &size) == 0 && size == 2 &&
+            ((data[0] == OS9_ID0 && data[1] == OS9_ID1) || (data[0] == OSK_ID0 && data[1] == OSK_ID1)))
+        {
+            total = 2;
+            while (total < file->size)
+            {
+                count = file->size - total;
+                if (_coco_read(path, data + total, &count) != 0 || count == 0)
+                {
+                    break;
+                }
+                total += count;
+            }
+        }
+
+        scan_modules(file, data, total);
+
+        free(data);
+        _coco_close(path);
+    }
+
+    return(NULL);
+}
+
+
+static void free_list(ident_list *list)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++)
+    {
+        free(list->files[i].path);
+        free(list->files[i].modules);
+    }
+
+    free(list->files);
+    memset(list, 0, sizeof(ident_list));
+}
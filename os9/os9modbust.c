@@ -10,7 +10,7 @@
 #include <cococonv.h>
 
 
-static int do_modbust(char **argv, char *filename);
+static int do_modbust(char **argv, char *filename, char *destination);
 
 /* Help message */
 static char const * const helpMessage[] =
@@ -18,9 +18,20 @@ static char const * const helpMessage[] =
 	"Syntax: modbust {[<opts>]} {<file> [<...>]} {[<opts>]}\n",
 	"Usage:  Bust a single merged file of OS-9 modules into separate files.\n",
 	"Options:\n",
+	"     -d<path>   write the modules to <path> (a native directory or\n",
+	"                a directory in a disk image, e.g. -dos9.dsk,CMDS)\n",
 	NULL
 };
 
+/* A module found in the merged file */
+typedef struct
+{
+	u_int	offset;
+	u_int	size;
+	int		crc_ok;
+	char	name[256];
+} modbust_module;
+
 
 
 int os9modbust(int argc, char **argv)
@@ -28,6 +39,7 @@ int os9modbust(int argc, char **argv)
 	error_code	ec = 0;
 	int i;
 	char *p = NULL;
+	char *destination = NULL;
 
 
 	if (argv[1] == NULL)
@@ -48,6 +60,11 @@ int os9modbust(int argc, char **argv)
 			{
 				switch(*p)
 				{
+					case 'd':
+						destination = p + 1;
+						while (*(p + 1) != '\0') p++;
+						break;
+
 					case '?':
 					case 'h':
 						show_help(helpMessage);
@@ -77,7 +94,7 @@ int os9modbust(int argc, char **argv)
 			p = argv[i];
 		}
 
-		ec = do_modbust(argv, p);
+		ec = do_modbust(argv, p, destination);
 
 		if (ec != 0)
 		{
@@ -93,89 +110,213 @@ int os9modbust(int argc, char **argv)
 
 
 
-static int do_modbust(char **argv, char *filename)
+/*
+ * find_modules - scans a buffer for OS-9 modules
+ *
+ * Notes: the whole file is in memory, so sync bytes are found with memchr.
+ * A sync only counts as a module if the header parity checks out and the
+ * module fits in the buffer; the CRC is checked in the same pass.  The scan
+ * carries on after the end of each module found.
+ */
+static int find_modules(u_char *buffer, u_int length, modbust_module **modules)
+{
+	u_int offset = 0;
+	int count = 0, room = 0;
+
+	*modules = NULL;
+
+	while (offset + OS9_HEADER_SIZE <= length)
+	{
+		u_char *p = memchr(buffer + offset, OS9_ID0, length - offset - 1);
+		OS9_MODULE_t *mod;
+		u_int size, nameoffset, namelen;
+
+		if (p == NULL)
+		{
+			break;
+		}
+
+		offset = p - buffer;
+		mod = (OS9_MODULE_t *)p;
+
+		if (offset + OS9_HEADER_SIZE > length || p[1] != OS9_ID1 || _os9_header(mod) != 0xFF)
+		{
+			offset++;
+			continue;
+		}
+
+		size = int2(mod->size);
+		nameoffset = int2(mod->name);
+
+		if (size < OS9_HEADER_SIZE || offset + size > length || nameoffset >= size)
+		{
+			offset++;
+			continue;
+		}
+
+		if (count == room)
+		{
+			modbust_module *m;
+
+			room = room == 0 ? 32 : room * 2;
+			m = realloc(*modules, room * sizeof(modbust_module));
+
+			if (m == NULL)
+			{
+				free(*modules);
+				*modules = NULL;
+
+				return -1;
+			}
+
+			*modules = m;
+		}
+
+		namelen = OS9Strlen(p + nameoffset);
+
+		if (namelen > size - nameoffset)
+		{
+			namelen = size - nameoffset;
+		}
+		if (namelen > sizeof((*modules)[count].name) - 1)
+		{
+			namelen = sizeof((*modules)[count].name) - 1;
+		}
+
+		memcpy((*modules)[count].name, p + nameoffset, namelen);
+		(*modules)[count].name[namelen] = '\0';
+		OS9StringToCString((u_char *)(*modules)[count].name);
+		(*modules)[count].offset = offset;
+		(*modules)[count].size = size;
+		(*modules)[count].crc_ok = _os9_crc(mod);
+		count++;
+
+		offset += size;
+	}
+
+	return count;
+}
+
+
+
+static int do_modbust(char **argv, char *filename, char *destination)
 {
 	error_code	ec = 0;
-	char buffer[256];
-	os9_path_id path;
-	u_char *module;
+	coco_path_id path;
+	u_char *buffer;
+	u_int size;
+	modbust_module *modules;
+	int i, count;
+
+
+	/* 1. Read the whole file in one go. */
+
+	ec = _coco_open(&path, filename, FAM_READ);
 
+	if (ec != 0)
+	{
+		return ec;
+	}
 
-	ec = _os9_open(&path, filename, FAM_READ);
+	ec = _coco_gs_size(path, &size);
 
 	if (ec != 0)
 	{
+		_coco_close(path);
+
 		return ec;
 	}
-    
-	while (_os9_gs_eof(path) == 0)
+
+	buffer = (u_char *)malloc(size + 1);
+
+	if (buffer == NULL)
 	{
-		u_int size = 1;
+		printf("Memory allocation error\n");
+		_coco_close(path);
 
-		ec = _os9_read(path, buffer, &size);
-		if (ec != 0)
+		return 1;
+	}
+
+	ec = _coco_read(path, buffer, &size);
+
+	_coco_close(path);
+
+	if (ec != 0)
+	{
+		fprintf(stderr, "%s: error reading file %s\n", argv[0], filename);
+		free(buffer);
+
+		return ec;
+	}
+
+
+	/* 2. Find every module. */
+
+	count = find_modules(buffer, size, &modules);
+
+	if (count < 0)
+	{
+		printf("Memory allocation error\n");
+		free(buffer);
+
+		return 1;
+	}
+
+
+	/* 3. Write them all out. */
+
+	for (i = 0; i < count; i++)
+	{
+		coco_path_id path2;
+		coco_file_stat fstat;
+		char name[1024];
+		u_int wsize = modules[i].size;
+
+		if (destination != NULL && *destination != '\0')
 		{
-			fprintf(stderr, "%s: error reading file %s\n", argv[0], filename);
+			char last = destination[strlen(destination) - 1];
 
-			return ec;
+			snprintf(name, sizeof(name), "%s%s%s", destination, (last == ',' || last == '/') ? "" : "/", modules[i].name);
 		}
-     
-		if (buffer[0] == '\x87')
+		else
 		{
-			coco_file_stat fstat;
-			size = 1;
-			
-			ec = _os9_read(path, buffer, &size);
+			snprintf(name, sizeof(name), "%s", modules[i].name);
+		}
 
-			if (buffer[0] == '\xCD')
-			{
-				coco_path_id path2;
-				char name[256];
-				int nameoffset;
+		printf("Busting module %s...\n", modules[i].name);
 
-				/* We have an OS-9 module - get size */
-				size = 2;
+		if (modules[i].crc_ok == 0)
+		{
+			fprintf(stderr, "%s: warning: module %s has a bad CRC\n", argv[0], modules[i].name);
+		}
 
-				ec = _os9_read(path, buffer, &size);
-				size = int2((u_char *)buffer);
-				module = (u_char *)malloc(size);
+		fstat.perms = FAP_READ | FAP_WRITE;
+		ec = _coco_create(&path2, name, FAM_WRITE, &fstat);
 
-				if (module == NULL)
-				{
-					printf("Memory allocation error\n");
-					return(1);
-				}
+		if (ec != 0)
+		{
+			printf("Error creating file %s\n", name);
+			free(modules);
+			free(buffer);
 
-				module[0] = 0x87;
-				module[1] = 0xCD;
-				module[2] = buffer[0];
-				module[3] = buffer[1];
-				size -= 4;
-				ec = _os9_read(path, &module[4], &size);
-				nameoffset = int2(&module[4]);
-				memcpy(name, &module[nameoffset], OS9Strlen(&module[nameoffset]));
-				OS9StringToCString((u_char *)name);
-				printf("Busting module %s...\n", name);
-				
-				fstat.perms = FAP_READ | FAP_WRITE;
-				ec = _coco_create(&path2, name, FAM_WRITE, &fstat);
-
-				if (ec != 0)
-				{
-					printf("Error creating file %s\n", name);
-					return(1);
-				}
+			return 1;
+		}
 
-				size += 4;
-				_coco_write(path2, module, &size);
-				_coco_close(path2);
+		ec = _coco_write(path2, buffer + modules[i].offset, &wsize);
+		_coco_close(path2);
 
-				free(module);
-			}
+		if (ec != 0)
+		{
+			fprintf(stderr, "%s: error writing file %s\n", argv[0], name);
+			free(modules);
+			free(buffer);
+
+			return ec;
 		}
 	}
 
-	_os9_close(path);
+	free(modules);
+	free(buffer);
 
 
 	return 0;